@@ -54,28 +54,16 @@ int main() {
 
     printf("✅ 연결 성공!\n\n");
 
-    // 서버로부터 환영 메시지 수신
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_read = read(sock, buffer, BUFFER_SIZE);
-    if (bytes_read > 0) {
-        printf("%s", buffer);
-    }
-
-    // 대기 상태 메시지 확인 (창구가 모두 사용 중인 경우)
-    if (strstr(buffer, "대기") != NULL || strstr(buffer, "기다려") != NULL) {
-        // 추가 메시지 대기
-        memset(buffer, 0, BUFFER_SIZE);
-        bytes_read = read(sock, buffer, BUFFER_SIZE);
-        if (bytes_read > 0) {
-            printf("%s", buffer);
-        }
-    }
+    // 환영 메시지와 대기 안내도 아래 루프에서 함께 처리한다
+    // (서버는 한 턴의 응답을 모아서 보내므로 환영 메시지와 첫 프롬프트가
+    //  한 번의 read로 도착할 수 있다)
+    int bytes_read;
 
     // 대화형 통신 시작 (업무 처리 루프)
     while (1) {
         // 서버 응답 수신
         memset(buffer, 0, BUFFER_SIZE);
-        bytes_read = read(sock, buffer, BUFFER_SIZE);
+        bytes_read = read(sock, buffer, BUFFER_SIZE - 1);
         
         if (bytes_read <= 0) {
             printf("\n⚠️  서버와의 연결이 종료되었습니다.\n");
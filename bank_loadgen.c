@@ -0,0 +1,703 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+#define PORT 8080
+#define BINARY_PORT 8081
+#define MAX_CLIENTS 25          // 서버의 기본 고객 수 (pi200~pi224, --clients)
+#define BUFFER_SIZE 16384       // 대화형 응답 누적 버퍼
+#define BIN_HEADER_SIZE 12
+#define BIN_NAME_SIZE 50
+#define BIN_ID_SIZE 16
+#define MAX_TRANSFER_LEGS 4095  // 이체 한 건의 받는 사람 수 상한 (서버 TRANSFER_MAX_LEGS - 1)
+#define MAX_TEXT_LEGS 64        // 대화형 이체의 받는 사람 수 상한 (한 줄에 한 명)
+
+// 부하 생성기
+// 고객마다 다른 출발지 주소(127.10.16.200부터 차례로)로 접속해 서버가 IP로 고객을 구분하게 한다.
+// 세션이 끝날 때마다 다음 고객으로 넘어가므로 --clients가 스레드 수보다 많으면 고객 전체를 돈다.
+// 리눅스는 127.0.0.0/8 전체가 루프백이라 별도 설정 없이 bind 할 수 있다.
+
+// 작업 종류
+typedef enum {
+    OP_OPEN,                    // 통장 개설
+    OP_DEPOSIT_SELF,            // 내 통장에 입금
+    OP_DEPOSIT_OTHER,           // 다른 고객 통장에 입금
+    OP_WITHDRAW,                // 출금
+    OP_WITHDRAW_BAD_PW,         // 틀린 비밀번호로 출금
+    OP_BALANCE,                 // 잔액 조회
+    OP_TRANSFER,                // 내 통장에서 여러 고객에게 묶음 이체
+    OP_COUNT
+} OpType;
+
+// 작업 결과
+typedef enum {
+    RESULT_OK,                  // 성공
+    RESULT_REJECTED,            // 업무 규칙상 거절 (잔고 부족, 통장 없음, 틀린 비밀번호 등)
+    RESULT_ERROR                // 프로토콜 오류, 연결 끊김
+} OpResult;
+
+// 작업별 통계 (스레드마다 하나씩, 끝나고 합친다)
+typedef struct {
+    uint32_t* latency_us;       // 지연 시간 표본
+    long count;
+    long cap;
+    long results[3];            // OpResult별 건수
+} OpStats;
+
+// 부하 스레드
+typedef struct {
+    int thread_id;
+    pthread_t thread;
+    int client_idx;             // 담당 고객 (0 = pi200)
+    unsigned int seed;
+    int sock;
+    char buf[BUFFER_SIZE];      // 대화형 응답 누적
+    size_t buf_len;
+    uint32_t request_id;
+    long sessions;
+    OpStats stats[OP_COUNT];
+} LoadThread;
+
+// 바이너리 프로토콜 op / 상태 (bank_server.c와 같다)
+enum { BIN_OP_OPEN = 1, BIN_OP_DEPOSIT = 2, BIN_OP_WITHDRAW = 3, BIN_OP_BALANCE = 4, BIN_OP_TRANSFER = 5 };
+enum { BANK_OK = 0 };
+
+// 대화형 프롬프트 종류
+typedef enum {
+    PROMPT_CLOSED,              // 연결 종료
+    PROMPT_MENU,                // 업무 선택 ("입력: ")
+    PROMPT_ASK_MORE,            // 추가 업무 질문 (한 업무의 끝)
+    PROMPT_INPUT                // 업무 진행 중 입력 요청
+} PromptKind;
+
+// 전역 설정
+const char* server_host = "127.0.0.1";
+const char* src_prefix = "127.10.16";   // 출발지 주소 앞부분 (빈 문자열이면 bind 안 함)
+bool use_binary = true;                 // --proto binary(기본) / text
+int port = 0;                           // 0이면 프로토콜별 기본 포트
+int thread_count = 8;
+int client_count = MAX_CLIENTS;         // 서버를 --clients N으로 띄웠다면 같은 값
+int duration_sec = 10;
+int ops_per_session = 20;               // 세션 하나에서 처리할 작업 수
+int mix[OP_COUNT] = { 5, 40, 20, 30, 5, 0, 0 };    // 작업 비율
+int transfer_legs = 10;                 // 이체 한 건의 받는 사람 수
+int mix_total;
+volatile bool running = true;
+const char* op_names[OP_COUNT] = {
+    "open", "deposit-self", "deposit-other", "withdraw", "withdraw-badpw", "balance", "transfer"
+};
+
+// 함수 선언
+void parse_options(int argc, char* argv[]);
+void parse_mix(const char* spec);
+double now_sec();
+void stats_add(OpStats* st, double seconds, OpResult result);
+int compare_u32(const void* a, const void* b);
+void print_report(LoadThread* threads, double elapsed);
+int connect_server(LoadThread* t);
+void* load_thread_func(void* arg);
+OpType pick_op(LoadThread* t);
+bool send_all(int sock, const void* data, size_t len);
+bool recv_all(int sock, void* data, size_t len);
+bool bin_call(LoadThread* t, uint8_t op, const void* body, uint32_t body_len,
+              uint8_t* status, unsigned char* resp, uint32_t resp_cap, uint32_t* resp_len);
+OpResult bin_run_op(LoadThread* t, OpType op, int* account_count);
+bool bin_session(LoadThread* t);
+PromptKind text_wait_prompt(LoadThread* t);
+OpResult text_run_op(LoadThread* t, OpType op, int* account_count);
+bool text_session(LoadThread* t);
+
+int main(int argc, char* argv[]) {
+    parse_options(argc, argv);
+
+    LoadThread* threads = calloc(thread_count, sizeof(LoadThread));
+    if (threads == NULL) {
+        perror("calloc failed");
+        return 1;
+    }
+
+    printf("🚀 부하 시작: %s:%d (%s), 스레드 %d개, %d초\n",
+        server_host, port, use_binary ? "binary" : "text", thread_count, duration_sec);
+    printf("   작업 비율:");
+    for (int op = 0; op < OP_COUNT; op++) printf(" %s=%d", op_names[op], mix[op]);
+    printf("\n");
+
+    double started = now_sec();
+    for (int i = 0; i < thread_count; i++) {
+        threads[i].thread_id = i;
+        threads[i].client_idx = i % client_count;
+        threads[i].seed = 0x9E3779B9u * (i + 1);
+        threads[i].sock = -1;
+        pthread_create(&threads[i].thread, NULL, load_thread_func, &threads[i]);
+    }
+
+    sleep(duration_sec);
+    running = false;
+
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    double elapsed = now_sec() - started;
+
+    print_report(threads, elapsed);
+
+    for (int i = 0; i < thread_count; i++) {
+        for (int op = 0; op < OP_COUNT; op++) free(threads[i].stats[op].latency_us);
+    }
+    free(threads);
+    return 0;
+}
+
+// 명령행 옵션 처리
+void parse_options(int argc, char* argv[]) {
+    static struct option long_options[] = {
+        {"host",     required_argument, 0, 'H'},
+        {"port",     required_argument, 0, 'p'},
+        {"proto",    required_argument, 0, 'P'},
+        {"threads",  required_argument, 0, 't'},
+        {"seconds",  required_argument, 0, 's'},
+        {"ops-per-session", required_argument, 0, 'o'},
+        {"mix",      required_argument, 0, 'x'},
+        {"src-prefix", required_argument, 0, 'S'},
+        {"clients",  required_argument, 0, 'c'},
+        {"transfer-legs", required_argument, 0, 'l'},
+        {"help",     no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "H:p:P:t:s:o:x:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'H':
+                server_host = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'P':
+                if (strcmp(optarg, "binary") == 0) {
+                    use_binary = true;
+                } else if (strcmp(optarg, "text") == 0) {
+                    use_binary = false;
+                } else {
+                    fprintf(stderr, "❌ 알 수 없는 프로토콜: %s (binary/text)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 't':
+                thread_count = atoi(optarg);
+                break;
+            case 's':
+                duration_sec = atoi(optarg);
+                break;
+            case 'o':
+                ops_per_session = atoi(optarg);
+                break;
+            case 'x':
+                parse_mix(optarg);
+                break;
+            case 'S':
+                src_prefix = optarg;
+                break;
+            case 'c':
+                client_count = atoi(optarg);
+                break;
+            case 'l':
+                transfer_legs = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("사용법: %s [옵션]\n"
+                       "  -H, --host IP        서버 주소 (기본: 127.0.0.1)\n"
+                       "  -p, --port P         서버 포트 (기본: binary 8081, text 8080)\n"
+                       "  -P, --proto P        binary(기본) 또는 text (대화형 세션 흉내)\n"
+                       "  -t, --threads N      동시 세션 수 (기본: 8)\n"
+                       "  -s, --seconds S      측정 시간 (기본: 10)\n"
+                       "  -o, --ops-per-session N  세션 하나에서 처리할 작업 수 (기본: 20)\n"
+                       "  -x, --mix SPEC       작업 비율 (기본: open=5,deposit-self=40,deposit-other=20,\n"
+                       "                       withdraw=30,withdraw-badpw=5,balance=0,transfer=0)\n"
+                       "      --src-prefix P   출발지 주소 앞 3자리 (기본: 127.10.16, 빈 값이면 bind 안 함)\n"
+                       "      --clients N      서버의 기본 고객 수 (pi200부터, 기본: 25)\n"
+                       "      --transfer-legs N  transfer 작업 한 건의 받는 사람 수 (기본: 10, 대화형은 최대 64)\n"
+                       "  -h, --help           도움말\n", argv[0]);
+                exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    if (port == 0) port = use_binary ? BINARY_PORT : PORT;
+    if (thread_count < 1) thread_count = 1;
+    if (duration_sec < 1) duration_sec = 1;
+    if (ops_per_session < 1) ops_per_session = 1;
+    if (client_count < 1) client_count = 1;
+    if (transfer_legs < 1) transfer_legs = 1;
+    if (transfer_legs > MAX_TRANSFER_LEGS) transfer_legs = MAX_TRANSFER_LEGS;
+
+    mix_total = 0;
+    for (int op = 0; op < OP_COUNT; op++) mix_total += mix[op];
+    if (mix_total <= 0) {
+        fprintf(stderr, "❌ 작업 비율의 합이 0입니다.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// "open=5,deposit-self=40,..." 형식 (적지 않은 작업은 0)
+void parse_mix(const char* spec) {
+    char* copy = strdup(spec);
+    char* save = NULL;
+
+    memset(mix, 0, sizeof(mix));
+    for (char* tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char* eq = strchr(tok, '=');
+        int op;
+        if (eq == NULL) {
+            fprintf(stderr, "❌ 잘못된 작업 비율: %s\n", tok);
+            exit(EXIT_FAILURE);
+        }
+        *eq = 0;
+        for (op = 0; op < OP_COUNT; op++) {
+            if (strcmp(tok, op_names[op]) == 0) break;
+        }
+        if (op == OP_COUNT) {
+            fprintf(stderr, "❌ 알 수 없는 작업: %s\n", tok);
+            exit(EXIT_FAILURE);
+        }
+        mix[op] = atoi(eq + 1);
+    }
+    free(copy);
+}
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 표본 하나 기록
+void stats_add(OpStats* st, double seconds, OpResult result) {
+    if (st->count == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 1024;
+        st->latency_us = realloc(st->latency_us, st->cap * sizeof(uint32_t));
+    }
+    double us = seconds * 1e6;
+    st->latency_us[st->count++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    st->results[result]++;
+}
+
+int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// 결과 출력 (작업별 처리량과 p50/p99/p999 지연)
+void print_report(LoadThread* threads, double elapsed) {
+    long total_ops = 0, total_sessions = 0;
+
+    printf("\n📊 ========== 결과 (%.1f초) ==========\n", elapsed);
+    printf("%-15s %9s %9s %8s %8s %6s %9s %9s %9s %9s\n",
+        "op", "count", "ops/s", "ok", "rejected", "error", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        OpStats all = {0};
+        for (int i = 0; i < thread_count; i++) {
+            OpStats* st = &threads[i].stats[op];
+            all.count += st->count;
+            for (int r = 0; r < 3; r++) all.results[r] += st->results[r];
+        }
+        if (all.count == 0) continue;
+
+        all.latency_us = malloc(all.count * sizeof(uint32_t));
+        long n = 0;
+        for (int i = 0; i < thread_count; i++) {
+            OpStats* st = &threads[i].stats[op];
+            memcpy(all.latency_us + n, st->latency_us, st->count * sizeof(uint32_t));
+            n += st->count;
+        }
+        qsort(all.latency_us, all.count, sizeof(uint32_t), compare_u32);
+
+        printf("%-15s %9ld %9.0f %8ld %8ld %6ld %9u %9u %9u %9u\n",
+            op_names[op], all.count, all.count / elapsed,
+            all.results[RESULT_OK], all.results[RESULT_REJECTED], all.results[RESULT_ERROR],
+            all.latency_us[(long)(all.count * 0.50)],
+            all.latency_us[(long)(all.count * 0.99)],
+            all.latency_us[(long)(all.count * 0.999)],
+            all.latency_us[all.count - 1]);
+        total_ops += all.count;
+        free(all.latency_us);
+    }
+
+    for (int i = 0; i < thread_count; i++) total_sessions += threads[i].sessions;
+    printf("-------------------------------------\n");
+    printf("전체: %ld건, %.0f ops/s, 세션 %ld개\n", total_ops, total_ops / elapsed, total_sessions);
+}
+
+// 서버 접속 (고객별 출발지 주소로 bind)
+int connect_server(LoadThread* t) {
+    struct sockaddr_in addr;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    if (src_prefix[0] != 0) {
+        char src_ip[INET_ADDRSTRLEN];
+        struct sockaddr_in src;
+        memset(&src, 0, sizeof(src));
+        src.sin_family = AF_INET;
+        // 고객 i = 앞부분.200 + i (4번째 자리를 넘으면 3번째 자리로 올린다)
+        snprintf(src_ip, sizeof(src_ip), "%s.200", src_prefix);
+        inet_pton(AF_INET, src_ip, &src.sin_addr);
+        src.sin_addr.s_addr = htonl(ntohl(src.sin_addr.s_addr) + t->client_idx);
+        if (bind(sock, (struct sockaddr*)&src, sizeof(src)) < 0) {
+            perror("bind failed");
+            close(sock);
+            return -1;
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, server_host, &addr.sin_addr);
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+// 부하 스레드: 시간이 다 될 때까지 세션을 열고 닫기를 반복한다
+void* load_thread_func(void* arg) {
+    LoadThread* t = (LoadThread*)arg;
+
+    while (running) {
+        t->sock = connect_server(t);
+        if (t->sock < 0) {
+            usleep(10000);
+            continue;
+        }
+        t->buf_len = 0;
+
+        bool ok = use_binary ? bin_session(t) : text_session(t);
+        close(t->sock);
+        t->sock = -1;
+        if (ok) t->sessions++;
+        t->client_idx = (t->client_idx + thread_count) % client_count;
+    }
+
+    return NULL;
+}
+
+// 작업 비율에 따라 다음 작업 선택
+OpType pick_op(LoadThread* t) {
+    int r = rand_r(&t->seed) % mix_total;
+    for (int op = 0; op < OP_COUNT; op++) {
+        if (r < mix[op]) return op;
+        r -= mix[op];
+    }
+    return OP_DEPOSIT_SELF;
+}
+
+bool send_all(int sock, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool recv_all(int sock, void* data, size_t len) {
+    char* p = data;
+    while (len > 0) {
+        ssize_t n = recv(sock, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// ========== 바이너리 프로토콜 ==========
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// 요청 하나 보내고 응답 받기
+bool bin_call(LoadThread* t, uint8_t op, const void* body, uint32_t body_len,
+              uint8_t* status, unsigned char* resp, uint32_t resp_cap, uint32_t* resp_len) {
+    unsigned char frame[BIN_HEADER_SIZE + 128];
+    uint32_t request_id = ++t->request_id;
+
+    put_u32(frame, BIN_HEADER_SIZE - 4 + body_len);
+    frame[4] = op;
+    frame[5] = 0;
+    frame[6] = frame[7] = 0;
+    put_u32(frame + 8, request_id);
+    if (body_len <= sizeof(frame) - BIN_HEADER_SIZE) {
+        memcpy(frame + BIN_HEADER_SIZE, body, body_len);
+        if (!send_all(t->sock, frame, BIN_HEADER_SIZE + body_len)) return false;
+    } else {
+        // 큰 본문(묶음 이체)은 복사하지 않고 이어서 보낸다
+        if (!send_all(t->sock, frame, BIN_HEADER_SIZE)) return false;
+        if (!send_all(t->sock, body, body_len)) return false;
+    }
+
+    unsigned char header[BIN_HEADER_SIZE];
+    if (!recv_all(t->sock, header, BIN_HEADER_SIZE)) return false;
+    uint32_t len = get_u32(header);
+    if (len < BIN_HEADER_SIZE - 4 || get_u32(header + 8) != request_id || header[4] != op) {
+        return false;
+    }
+    *resp_len = len - (BIN_HEADER_SIZE - 4);
+    if (*resp_len > resp_cap) return false;
+    if (!recv_all(t->sock, resp, *resp_len)) return false;
+    *status = header[5];
+    return true;
+}
+
+// 작업 하나 실행
+OpResult bin_run_op(LoadThread* t, OpType op, int* account_count) {
+    unsigned char body[128], resp[512];
+    uint32_t resp_len;
+    uint8_t status;
+    int password = (200 + t->client_idx) & 0xFF;     // 비밀번호 = IP 마지막 숫자
+
+    memset(body, 0, sizeof(body));
+    switch (op) {
+        case OP_OPEN:
+            snprintf((char*)body, BIN_NAME_SIZE, "LOAD-%d", t->thread_id);
+            if (!bin_call(t, BIN_OP_OPEN, body, BIN_NAME_SIZE, &status, resp, sizeof(resp), &resp_len)) {
+                return RESULT_ERROR;
+            }
+            if (status == BANK_OK) (*account_count)++;
+            break;
+        case OP_DEPOSIT_SELF:
+        case OP_DEPOSIT_OTHER: {
+            int target = t->client_idx;
+            if (op == OP_DEPOSIT_OTHER) target = rand_r(&t->seed) % client_count;
+            snprintf((char*)body, BIN_ID_SIZE, "pi%d", 200 + target);
+            put_u32(body + BIN_ID_SIZE, 1);
+            put_u32(body + BIN_ID_SIZE + 4, 1000 + rand_r(&t->seed) % 9000);
+            if (!bin_call(t, BIN_OP_DEPOSIT, body, BIN_ID_SIZE + 8, &status, resp, sizeof(resp), &resp_len)) {
+                return RESULT_ERROR;
+            }
+            break;
+        }
+        case OP_WITHDRAW:
+        case OP_WITHDRAW_BAD_PW:
+            put_u32(body, 1);
+            put_u32(body + 4, op == OP_WITHDRAW ? password : password + 1000);
+            put_u32(body + 8, 100 + rand_r(&t->seed) % 900);
+            if (!bin_call(t, BIN_OP_WITHDRAW, body, 12, &status, resp, sizeof(resp), &resp_len)) {
+                return RESULT_ERROR;
+            }
+            if (op == OP_WITHDRAW_BAD_PW) {
+                // 틀린 비밀번호가 통과되면 서버 오류다
+                return status == BANK_OK ? RESULT_ERROR : RESULT_REJECTED;
+            }
+            break;
+        case OP_BALANCE:
+            if (!bin_call(t, BIN_OP_BALANCE, NULL, 0, &status, resp, sizeof(resp), &resp_len)) {
+                return RESULT_ERROR;
+            }
+            break;
+        case OP_TRANSFER: {
+            // 0번 항목: 내 1번 통장에서 총액 출금, 나머지: 임의 고객 1번 통장에 입금
+            uint32_t leg_size = BIN_ID_SIZE + 8;
+            uint32_t len = 8 + (transfer_legs + 1) * leg_size;
+            unsigned char* req = calloc(1, len);
+            if (req == NULL) return RESULT_ERROR;
+            put_u32(req, password);
+            put_u32(req + 4, transfer_legs + 1);
+            int total = 0;
+            for (int i = 1; i <= transfer_legs; i++) {
+                unsigned char* leg = req + 8 + i * leg_size;
+                int amount = 1 + rand_r(&t->seed) % 100;
+                snprintf((char*)leg, BIN_ID_SIZE, "pi%d", 200 + rand_r(&t->seed) % client_count);
+                put_u32(leg + BIN_ID_SIZE, 1);
+                put_u32(leg + BIN_ID_SIZE + 4, amount);
+                total += amount;
+            }
+            snprintf((char*)req + 8, BIN_ID_SIZE, "pi%d", 200 + t->client_idx);
+            put_u32(req + 8 + BIN_ID_SIZE, 1);
+            put_u32(req + 8 + BIN_ID_SIZE + 4, (uint32_t)-total);
+            bool ok = bin_call(t, BIN_OP_TRANSFER, req, len, &status, resp, sizeof(resp), &resp_len);
+            free(req);
+            if (!ok) return RESULT_ERROR;
+            break;
+        }
+        default:
+            return RESULT_ERROR;
+    }
+
+    return status == BANK_OK ? RESULT_OK : RESULT_REJECTED;
+}
+
+// 바이너리 세션: 통장이 없으면 먼저 하나 만든 뒤 작업을 돌린다
+bool bin_session(LoadThread* t) {
+    unsigned char resp[512];
+    uint32_t resp_len;
+    uint8_t status;
+    int account_count;
+
+    if (!bin_call(t, BIN_OP_BALANCE, NULL, 0, &status, resp, sizeof(resp), &resp_len) || resp_len < 4) {
+        return false;
+    }
+    account_count = get_u32(resp);
+
+    for (int i = 0; i < ops_per_session && running; i++) {
+        OpType op = (account_count == 0) ? OP_OPEN : pick_op(t);
+        double start = now_sec();
+        OpResult result = bin_run_op(t, op, &account_count);
+        stats_add(&t->stats[op], now_sec() - start, result);
+        if (result == RESULT_ERROR) return false;
+    }
+    return true;
+}
+
+// ========== 대화형 프로토콜 ==========
+
+// 다음 프롬프트까지 읽기 (응답은 t->buf에 쌓인다)
+PromptKind text_wait_prompt(LoadThread* t) {
+    while (1) {
+        t->buf[t->buf_len] = 0;
+        if (strstr(t->buf, "예/아니오") != NULL) return PROMPT_ASK_MORE;
+        if (strstr(t->buf, "입력: ") != NULL) return PROMPT_MENU;
+        if (strstr(t->buf, "입력하세요") != NULL || strstr(t->buf, "선택하세요") != NULL) {
+            return PROMPT_INPUT;
+        }
+        if (strstr(t->buf, "연결을 종료") != NULL || strstr(t->buf, "감사합니다") != NULL) {
+            return PROMPT_CLOSED;
+        }
+
+        // 버퍼가 차면 앞부분을 버린다 (프롬프트는 항상 응답 끝에 온다)
+        if (t->buf_len >= BUFFER_SIZE - 1) {
+            memmove(t->buf, t->buf + BUFFER_SIZE / 2, t->buf_len - BUFFER_SIZE / 2);
+            t->buf_len -= BUFFER_SIZE / 2;
+        }
+        ssize_t n = recv(t->sock, t->buf + t->buf_len, BUFFER_SIZE - 1 - t->buf_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return PROMPT_CLOSED;
+        t->buf_len += n;
+    }
+}
+
+// 작업 하나를 대화로 진행 (추가 업무 질문이 나오면 한 작업이 끝난 것이다)
+OpResult text_run_op(LoadThread* t, OpType op, int* account_count) {
+    char inputs[4 + MAX_TEXT_LEGS][64];
+    int input_count = 0;
+    int password = (200 + t->client_idx) & 0xFF;     // 비밀번호 = IP 마지막 숫자
+
+    switch (op) {
+        case OP_OPEN:
+            snprintf(inputs[input_count++], 64, "통장 개설\n");
+            snprintf(inputs[input_count++], 64, "LOAD-%d\n", t->thread_id);
+            break;
+        case OP_DEPOSIT_SELF:
+        case OP_DEPOSIT_OTHER: {
+            int target = t->client_idx;
+            if (op == OP_DEPOSIT_OTHER) target = rand_r(&t->seed) % client_count;
+            snprintf(inputs[input_count++], 64, "입금\n");
+            snprintf(inputs[input_count++], 64, "pi%d\n", 200 + target);
+            snprintf(inputs[input_count++], 64, "1\n");
+            snprintf(inputs[input_count++], 64, "%d\n", 1000 + rand_r(&t->seed) % 9000);
+            break;
+        }
+        case OP_WITHDRAW:
+        case OP_WITHDRAW_BAD_PW:
+            snprintf(inputs[input_count++], 64, "출금\n");
+            snprintf(inputs[input_count++], 64, "1\n");
+            snprintf(inputs[input_count++], 64, "%d\n", op == OP_WITHDRAW ? password : password + 1000);
+            snprintf(inputs[input_count++], 64, "%d\n", 100 + rand_r(&t->seed) % 900);
+            break;
+        case OP_BALANCE:
+            snprintf(inputs[input_count++], 64, "잔액 조회\n");
+            break;
+        case OP_TRANSFER: {
+            int legs = transfer_legs < MAX_TEXT_LEGS ? transfer_legs : MAX_TEXT_LEGS;
+            snprintf(inputs[input_count++], 64, "이체\n");
+            snprintf(inputs[input_count++], 64, "1\n");
+            snprintf(inputs[input_count++], 64, "%d\n", password);
+            for (int i = 0; i < legs; i++) {
+                snprintf(inputs[input_count++], 64, "pi%d 1 %d\n",
+                    200 + rand_r(&t->seed) % client_count, 1 + rand_r(&t->seed) % 100);
+            }
+            snprintf(inputs[input_count++], 64, "끝\n");
+            break;
+        }
+        default:
+            return RESULT_ERROR;
+    }
+
+    // 중간에 거절되면 남은 입력을 보내지 않고 바로 추가 업무 질문이 온다
+    PromptKind prompt = PROMPT_INPUT;
+    for (int i = 0; i < input_count && prompt == PROMPT_INPUT; i++) {
+        if (!send_all(t->sock, inputs[i], strlen(inputs[i]))) return RESULT_ERROR;
+        t->buf_len = 0;
+        prompt = text_wait_prompt(t);
+    }
+    if (prompt != PROMPT_ASK_MORE) return RESULT_ERROR;
+
+    // 마지막 단계의 응답으로 결과 판정
+    if (op == OP_BALANCE) {
+        if (strstr(t->buf, "보유한 통장이 없습니다") != NULL) *account_count = 0;
+        return strstr(t->buf, "보유 통장 목록") != NULL ? RESULT_OK : RESULT_ERROR;
+    }
+    if (strstr(t->buf, "✅") != NULL) {
+        if (op == OP_WITHDRAW_BAD_PW) return RESULT_ERROR;     // 틀린 비밀번호가 통과됨
+        if (op == OP_OPEN) (*account_count)++;
+        return RESULT_OK;
+    }
+    return strstr(t->buf, "❌") != NULL ? RESULT_REJECTED : RESULT_ERROR;
+}
+
+// 대화형 세션: 환영 메시지 → 잔액 조회 → 작업 반복 → "아니오"로 종료
+bool text_session(LoadThread* t) {
+    int account_count = 1;
+
+    if (text_wait_prompt(t) != PROMPT_MENU) return false;
+
+    // 바이너리 세션처럼 잔액 조회로 통장이 있는지 먼저 본다
+    if (text_run_op(t, OP_BALANCE, &account_count) != RESULT_OK) return false;
+    if (!send_all(t->sock, "예\n", strlen("예\n"))) return false;
+    t->buf_len = 0;
+    if (text_wait_prompt(t) != PROMPT_MENU) return false;
+
+    for (int i = 0; i < ops_per_session && running; i++) {
+        OpType op = (account_count == 0) ? OP_OPEN : pick_op(t);
+        if (op == OP_OPEN && account_count == 0) account_count = 1;
+
+        double start = now_sec();
+        OpResult result = text_run_op(t, op, &account_count);
+        stats_add(&t->stats[op], now_sec() - start, result);
+        if (result == RESULT_ERROR) return false;
+
+        const char* next = (i + 1 < ops_per_session && running) ? "예\n" : "아니오\n";
+        if (!send_all(t->sock, next, strlen(next))) return false;
+        t->buf_len = 0;
+        PromptKind prompt = text_wait_prompt(t);
+        if (prompt != PROMPT_MENU) return prompt == PROMPT_CLOSED;
+    }
+    return true;
+}
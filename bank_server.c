@@ -1,697 +1,10917 @@
+#define _GNU_SOURCE             // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <arpa/inet.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/io_uring.h>
 
-#define PORT 8080
-#define MAX_WORKERS 5           // 창구(워커 스레드) 개수
-#define MAX_CLIENTS 25          // 총 클라이언트 수 (pi200~pi224)
-#define MAX_ACCOUNTS 5          // 클라이언트당 최대 통장 개수
+#define PORT 8080               // 대화형 포트 (기본값, --port)
+#define BINARY_PORT 8081        // 바이너리 프로토콜 포트 (기본값)
+#define MAX_WORKERS 1024        // 창구(워커 스레드) 최대 개수 (--max-workers 상한)
+#define DEFAULT_MIN_WORKERS 5   // 항상 열어 두는 창구 수 (기본값)
+#define WORKER_IDLE_SEC 30      // 이 시간 동안 손님이 없으면 최소 수를 넘는 창구는 닫는다
+#define MAX_CLIENTS 25          // 기동 시 만드는 기본 고객 수 (pi200~pi224, --clients)
+#define MAX_ACCOUNTS 5          // 클라이언트당 기본 최대 통장 개수 (--max-accounts)
+#define MAX_ACCOUNTS_LIMIT 16   // --max-accounts 상한 (응답 버퍼 크기 기준)
+#define CLIENT_CHUNK 4096       // 고객 디렉터리 할당 단위 (고객 수)
+#define MAX_CLIENT_CHUNKS 4096  // 최대 고객 수 = CLIENT_CHUNK * MAX_CLIENT_CHUNKS
+#define CLIENT_ID_SIZE 16       // 고객 ID 최대 길이 (NUL 포함)
 #define BUFFER_SIZE 1024
-#define MAX_QUEUE 20            // 대기 큐 크기
+#define TEXT_MAX_LINE 4096      // 대화형 입력 한 줄 최대 길이 (줄바꿈 없이 넘으면 연결 종료)
+#define MAX_QUEUE 20            // 대기 큐 크기 (등급마다)
+#define QUEUE_MAX_WEIGHT 16     // 대기 등급 가중치 상한 (--queue-weights)
+#define CLIENT_WINDOWS 2        // 한 고객이 동시에 쓰는 창구가 이만큼이면 다음 연결은 후순위 (--client-windows)
+#define LISTEN_BACKLOG 1024     // 수신 소켓 listen 대기열 기본 길이 (--backlog, 커널 somaxconn까지)
+#define MAX_OUT_IOV 64          // sendmsg 한 번에 넘기는 출력 조각 수
+#define MAX_EVENTS 64           // epoll_wait 한 번에 처리할 이벤트 수
+#define URING_ENTRIES 1024      // io_uring 제출 큐 크기 (리액터마다)
+#define URING_BUF_SLOTS 1024    // 리액터마다 커널에 등록해 두는 읽기 버퍼 수 (BUFFER_SIZE씩)
+#define IDLE_TIMEOUT_SEC 120    // 입력 없이 기다리는 최대 시간 (기본값, --idle-timeout)
+#define SESSION_TIMEOUT_SEC 1800    // 세션 하나의 최대 상담 시간 (기본값, --session-timeout)
+#define TIMER_WHEEL_SLOTS 256   // 리액터 타이머 휠 칸 수 (1칸 = 1초, 넘는 기한은 바퀴를 더 돈다)
+#define CACHE_LINE 64
+#define ADMIN_PORT 8090         // 관리 소켓 포트 (127.0.0.1 전용, 기본값)
+#define LOG_RING_SIZE (256 * 1024)  // 스레드별 로그 링 크기 (2의 거듭제곱)
+#define LOG_MAX_RECORD 1024     // 로그 레코드 최대 크기
+#define LOG_MAX_STRING 512      // 로그 인자 문자열 최대 길이
+#define LOG_FLUSH_INTERVAL_US 1000  // 링이 비었을 때 로그 스레드가 쉬는 시간
+#define CLASSIFIER_MAX_STATES 4096   // 키워드 분류기 상태 수 상한 (uint16_t 전이표)
+#define INTENT_MAX_GROUPS 4     // 의도 하나가 요구할 수 있는 키워드 조건 수
+#define HIST_BUCKETS 24         // 히스토그램 칸 수 (1us ~ 8.4s, 2배 간격) + 초과 칸
+#define DATA_DIR "bank_data"    // WAL 등 데이터 파일 디렉터리 (기본값)
+#define WAL_MAX_RECORD (64 * 1024)  // WAL 레코드 본문 최대 길이 (이체 묶음 포함)
+#define TRANSFER_MAX_LEGS 4096  // 이체 한 건의 최대 항목 수
+#define WAL_SEGMENT_SIZE (16 * 1024 * 1024) // WAL 세그먼트 교체 크기
+#define SNAPSHOT_MAGIC "BANKSNAP"
+#define SNAPSHOT_VERSION 4
+#define REPL_MAGIC "BANKREPL"
+#define REPL_VERSION 1
+#define REPL_MAX_FOLLOWERS 8    // 주 서버 하나에 붙을 수 있는 대기 서버 수
+#define REPL_HEARTBEAT_MS 500   // 보낼 레코드가 없을 때 하트비트 주기
+#define REPL_BUF_SIZE (256 * 1024)  // 복제 송수신 버퍼 (레코드 묶음 최대 크기)
+#define MAX_SHARDS 32           // 지점 수 상한 (참여 지점을 비트로 기록한다)
+#define SHARD_LOCK_TIMEOUT_MS 200   // 2PC 준비 단계의 고객 lock 대기 한도 (넘으면 거절해 지점 간 교착을 푼다)
+#define SHARD_STATUS_SEC 2      // 준비한 뒤 조정 지점 소식이 없으면 이 주기로 결과를 묻는다
+#define SHARD_CALL_THREADS 8    // 리액터 세션의 지점 간 호출을 맡는 스레드 수 (느린 지점 하나에 다 묶이지 않게)
+#define ROUTER_BUF_SIZE 16384   // 라우터의 방향별 전달 버퍼
+#define LEDGER_CHUNK_ENTRIES 32 // 원장 묶음 하나의 항목 수 (디스크로 내리는 단위)
+#define LEDGER_PAGE 10          // 대화형 거래 내역 한 쪽의 항목 수
+#define LEDGER_MAX_PAGE 256     // 바이너리 STATEMENT 응답 하나의 최대 항목 수
+#define HOT_STRIPES 16          // 인기 통장 입금 누적기 조각 수 (스레드마다 하나씩 돌아가며 쓴다)
+#define HOT_PENDING 64          // 조각 하나에 쌓아 두는 입금 건수 (차면 잔고에 반영)
+#define EOD_CHUNK 4096          // 일 마감 스레드가 한 번에 가져가는 고객 수
+#define EOD_INTEREST_PPM 55     // 일 마감 이자 기본값 (잔고의 백만분율, 하루 0.0055% = 연 2% 정도)
+#define EOD_FEE_WAIVE 100000    // 잔고가 이만큼 이상이면 계좌 유지 수수료 면제 (기본값)
+
+// 인기 통장에 쌓아 둔 입금 한 건 (반영할 때 원장 항목이 된다)
+typedef struct {
+    uint64_t lsn;               // 입금을 담은 WAL 레코드
+    uint32_t time;
+    uint32_t from_no;           // 입금한 고객
+    int32_t amount;
+} HotDeposit;
+
+// 입금 누적기 조각 (조각마다 lock을 따로 두어 입금끼리 고객 lock을 다투지 않는다)
+typedef struct {
+    pthread_mutex_t lock;
+    int count;
+    HotDeposit pending[HOT_PENDING];
+} __attribute__((aligned(CACHE_LINE))) HotStripe;
+
+// 인기 통장 입금 누적기
+typedef struct HotAccount {
+    HotStripe stripes[HOT_STRIPES];
+    atomic_llong pending;       // 아직 잔고에 반영하지 않은 입금 합 + reserved (한도 확인용)
+    atomic_llong reserved;      // 이체/지점 간 거래가 잔고에 더하기 전에 잡아 둔 금액 (조회에서는 뺀다)
+} HotAccount;
 
 // 통장 정보 구조체
 typedef struct {
     char bank_name[50];         // 은행명
-    int balance;                // 잔고
+    int balance;                // 잔고 (인기 통장은 누적기에 쌓인 입금을 빼고)
     bool is_active;             // 활성화 여부
+    struct Ledger* ledger;      // 거래 원장 (첫 거래 때 만든다, 고객 lock으로 보호)
+    HotAccount* _Atomic hot;    // 인기 통장 입금 누적기 (NULL이면 일반 통장)
 } Account;
 
-// 클라이언트 정보 구조체
+// 원장 항목 (통장별 거래 한 건, 파일에도 이 배치 그대로 적는다)
+typedef struct {
+    uint64_t lsn;               // 거래를 담은 WAL 레코드 (WAL 없이 운영하면 0)
+    uint32_t time;              // 거래 시각 (유닉스 초, WAL 레코드 헤더의 시각)
+    uint32_t type;              // WalType (입금, 출금, 이체, 지점 간 거래)
+    int32_t amount;             // 들어오면 양수, 나가면 음수
+    int32_t balance;            // 거래 후 잔고
+    char counterparty[CLIENT_ID_SIZE];  // 상대 고객 ID (현금 출금, 여러 명, 다른 지점이면 빈 문자열)
+} LedgerEntry;
+
+// 원장 파일(ledger.dat)의 묶음. 통장마다 순번 k * LEDGER_CHUNK_ENTRIES부터 채운 묶음을 이어 쓴다.
+// 다 찬 묶음은 그때 바로, 덜 찬 마지막 묶음은 스냅샷 때 적는다 (같은 first_seq면 뒤에 적은 것이 더 길다).
+typedef struct {
+    uint32_t crc;               // client_no부터 묶음 끝까지의 CRC32
+    uint32_t client_no;
+    uint32_t account_num;
+    uint32_t count;             // 채운 항목 수
+    uint64_t first_seq;         // 첫 항목의 통장 내 순번
+    LedgerEntry entries[LEDGER_CHUNK_ENTRIES];
+} LedgerChunk;
+
+// 통장별 원장 (메모리에는 덜 찬 마지막 묶음과 지난 묶음의 파일 위치만 둔다)
+typedef struct Ledger {
+    uint64_t count;             // 전체 항목 수 (다음 항목의 순번)
+    uint64_t last_lsn;          // 마지막 항목의 LSN (복구 때 이미 적힌 레코드를 건너뛴다)
+    uint64_t* chunk_offsets;    // 파일로 내린 묶음 k의 위치
+    uint32_t chunk_cap;
+    uint32_t tail_cap;
+    uint32_t tail_saved;        // 마지막 묶음 중 스냅샷이 파일에 적어 둔 항목 수
+    LedgerEntry* tail;          // 아직 다 차지 않은 마지막 묶음 (count % LEDGER_CHUNK_ENTRIES건)
+} Ledger;
+
+// 원장 파일
+typedef struct {
+    int fd;                     // data_dir/ledger.dat (-1이면 원장을 남기지 않는다)
+    _Atomic uint64_t end;       // 다음 묶음을 쓸 위치 (fetch_add로 자리를 잡고 pwrite)
+    atomic_ulong entries;       // 적은 항목 수
+    atomic_ulong chunks[2];     // 파일로 내린 묶음 수 (다 찬 것, 스냅샷이 적은 덜 찬 것)
+    atomic_long memory;         // 원장이 쥔 메모리 (마지막 묶음 + 묶음 위치 표)
+} LedgerFile;
+
+// 거래 내역 구간 지정 방식 (바이너리 STATEMENT의 mode)
+typedef enum {
+    LEDGER_BY_SEQ,              // 순번 [from, to)
+    LEDGER_BY_TIME,             // 거래 시각 [from, to) (유닉스 초)
+    LEDGER_LAST                 // 마지막 limit건
+} LedgerRange;
+
+// 거래 내역 한 쪽의 위치
+typedef struct {
+    uint64_t total;             // 통장의 전체 항목 수
+    uint64_t first;             // 돌려준 첫 항목의 순번
+    uint64_t end;               // 요청 구간의 끝 순번 (다음 쪽은 first + count부터)
+    int count;                  // 돌려준 항목 수
+} LedgerPage;
+
+// 이체 항목 하나 (amount가 음수면 출금, 양수면 입금)
 typedef struct {
-    char client_id[10];         // pi200 ~ pi224
-    int ip_last_digit;          // IP 마지막 숫자 (200~224) = 비밀번호
-    Account accounts[MAX_ACCOUNTS]; // 통장 배열
+    struct ClientInfo* client;  // 다른 지점 고객이면 NULL
+    int account_num;
+    int amount;
+    int shard;                  // client가 NULL일 때 고객이 있는 지점
+    char client_id[CLIENT_ID_SIZE]; // client가 NULL일 때 고객 ID
+} TransferLeg;
+
+// 클라이언트 정보 구조체
+// 잔고와 통장 목록은 고객별 lock으로 보호한다. 여러 고객을 함께 잠글 때는
+// 반드시 client_no 오름차순으로 잠근다 (lock_clients() 참고).
+// 바꾸는 쪽은 lock 안에서 seq도 올리고, 조회만 하는 쪽은 lock 없이 seq로 확인하며 읽는다.
+typedef struct ClientInfo {
+    char client_id[CLIENT_ID_SIZE]; // pi200 ~ pi224, 또는 등록한 ID
+    uint32_t ip;                // 등록된 IPv4 주소 (호스트 바이트 순서)
+    int ip_last_digit;          // IP 마지막 숫자 = 비밀번호
+    int client_no;              // 디렉터리 내 번호 (잠금 순서 기준)
+    Account* accounts;          // 통장 배열 (max_accounts개)
     int account_count;          // 현재 통장 개수
-} ClientInfo;
+    uint64_t last_lsn;          // 이 고객을 마지막으로 바꾼 WAL 레코드
+    atomic_uint seq;            // seqlock 순번 (홀수 = 바꾸는 중)
+    atomic_int windows;         // 이 고객을 상담 중인 창구 수 (thread 모드)
+    atomic_int last_tasks;      // 직전 대화형 상담에서 처리한 업무 수 + 1 (0 = 기록 없음)
+    atomic_int hot_accounts;    // 인기 통장 수 (있으면 lock을 잡을 때 쌓인 입금을 반영한다)
+    uint32_t epoch;             // 잔고에 반영한 마지막 일 마감 회차 (고객 lock, 조회는 seq로 확인)
+    pthread_mutex_t lock;       // 고객별 mutex
+} __attribute__((aligned(CACHE_LINE))) ClientInfo;
+
+// 고객 디렉터리
+// 고객은 CLIENT_CHUNK명 단위 블록에 들어가 한 번 등록되면 주소가 바뀌지 않는다
+// (세션이 ClientInfo*를 쥐고 있으므로). ID와 IP는 각각 개방 주소 해시 표로 찾는다.
+// 등록은 쓰기 lock, 해시 조회는 읽기 lock. client_no로 찾을 때는 lock이 필요 없다.
+typedef struct {
+    ClientInfo* chunks[MAX_CLIENT_CHUNKS];
+    Account* account_chunks[MAX_CLIENT_CHUNKS];  // 블록별 통장 (calloc, 쓰기 전엔 메모리를 거의 안 쓴다)
+    atomic_int count;           // 등록된 고객 수 (client_no < count만 유효)
+    uint32_t* by_id;            // ID 해시 표 (client_no + 1, 0 = 빈 칸)
+    uint32_t* by_ip;            // IP 해시 표
+    uint32_t table_mask;        // 해시 표 크기 - 1 (2의 거듭제곱)
+    pthread_rwlock_t lock;
+} ClientDirectory;
+
+// 은행 업무 처리 결과
+typedef enum {
+    BANK_OK = 0,
+    BANK_ERR_ACCOUNT_LIMIT,     // 통장 개수 초과
+    BANK_ERR_NO_ACCOUNT,        // 잘못된 통장 번호
+    BANK_ERR_AMOUNT,            // 잘못된 금액 (0 이하 또는 잔고 범위 초과)
+    BANK_ERR_INSUFFICIENT,      // 잔고 부족
+    BANK_ERR_NO_CLIENT,         // 존재하지 않는 고객 ID
+    BANK_ERR_PASSWORD,          // 비밀번호 불일치
+    BANK_ERR_BAD_REQUEST,       // 형식이 잘못된 요청
+    BANK_ERR_CLIENT_EXISTS,     // 이미 등록된 고객 ID 또는 IP (고객 등록)
+    BANK_ERR_CLIENT_LIMIT,      // 고객 디렉터리가 가득 참 (고객 등록)
+    BANK_ERR_UNBALANCED,        // 이체 항목의 출금 합과 입금 합이 다름
+    BANK_ERR_BUSY,              // 다른 지점 거래와 겹쳐 준비하지 못함 (다시 시도)
+    BANK_ERR_UNAVAILABLE,       // 고객이 있는 지점에 연결할 수 없음
+    BANK_STATUS_COUNT
+} BankStatus;
+
+// 세션 프로토콜
+typedef enum {
+    PROTO_TEXT,                 // 한국어 대화형 (text_port)
+    PROTO_BINARY                // 길이 접두 바이너리 (binary_port)
+} SessionProto;
+
+// 대기 등급 (등급마다 큐를 따로 두고 가중치대로 번갈아 꺼낸다)
+typedef enum {
+    QUEUE_EXPRESS,              // 빠른 창구: 바이너리, 직전 상담이 업무 하나 이하였던 고객
+    QUEUE_NORMAL,               // 일반 상담
+    QUEUE_BULK,                 // 이미 창구를 client_windows개 이상 쓰고 있는 고객
+    QUEUE_CLASSES
+} QueueClass;
+
+// 수락된 연결 (대기 큐에 들어가는 단위)
+typedef struct {
+    int client_fd;
+    SessionProto proto;
+    QueueClass qclass;          // 대기 등급 (큐에 넣을 때 정한다)
+    ClientInfo* client;         // 수락할 때 IP로 확인한 고객 (인증은 여기서 한 번만)
+    uint64_t accepted_ns;       // 접속 수락 시각 (now_ns)
+    uint64_t enqueued_ns;       // 대기 큐에 들어간 시각
+} Connection;
+
+// 대기 큐 슬롯
+typedef struct {
+    atomic_size_t sequence;     // 슬롯 차례 번호
+    Connection conn;
+} QueueSlot;
+
+// 등급별 큐 (lock-free 다중 생산자/다중 소비자 원형 큐)
+// 슬롯마다 차례 번호를 두어 생산자/소비자가 위치만 CAS로 차지한다.
+// 가득 차면 enqueue()가 false를 돌려주고, 호출자가 고객에게 알린다.
+typedef struct {
+    QueueSlot slots[MAX_QUEUE];
+    _Alignas(CACHE_LINE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE) atomic_size_t dequeue_pos;
+} QueueRing;
 
 // 대기 큐 구조체
+// 창구가 빌 때마다 schedule[turn]의 등급부터 꺼내 본다 (가중치 4,2,1이면 7번 중 4번은 빠른 창구).
+// 차례인 등급이 비었으면 다음 차례로 넘어가므로 창구가 놀지 않는다.
 typedef struct {
-    int queue[MAX_QUEUE];       // 대기 중인 client_fd들
-    int front;
-    int rear;
-    int count;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
+    QueueRing rings[QUEUE_CLASSES];
+    int weights[QUEUE_CLASSES];
+    int schedule[QUEUE_CLASSES * QUEUE_MAX_WEIGHT];  // 가중치를 고르게 섞은 등급 순서
+    int schedule_len;
+    _Alignas(CACHE_LINE) atomic_size_t turn;    // 꺼낸 횟수 (schedule 위치)
 } WaitingQueue;
 
+// 워커 슬롯 상태
+typedef enum {
+    WORKER_FREE,                // 비어 있음 (창구 닫힘)
+    WORKER_RUNNING              // 스레드가 돌고 있음
+} WorkerState;
+
 // 워커 스레드 정보
 typedef struct {
     int worker_id;              // 창구 번호
     pthread_t thread;
-    bool is_busy;               // 업무 중 여부
+    atomic_int state;           // WorkerState (슬롯 재사용 판단)
+    atomic_int wake;            // futex 깨우기 신호 (1 = 깨움)
     int client_fd;              // 현재 상담 중인 클라이언트
-} WorkerThread;
+    int cpu;                    // 고정된 CPU (-1이면 고정 안 함)
+    struct timespec opened;     // 창구를 연 시각
+    _Atomic uint64_t busy_ns;   // 상담에 쓴 누적 시간
+    atomic_long sessions;       // 처리한 세션 수
+} __attribute__((aligned(CACHE_LINE))) WorkerThread;
+
+// 세션 상태 (대화 단계)
+typedef enum {
+    STATE_MENU,                 // 업무 선택 대기
+    STATE_OPEN_NAME,            // 통장 개설: 은행명 대기
+    STATE_DEPOSIT_TARGET,       // 입금: 대상 ID 대기
+    STATE_DEPOSIT_ACCOUNT,      // 입금: 통장 번호 대기
+    STATE_DEPOSIT_AMOUNT,       // 입금: 금액 대기
+    STATE_WITHDRAW_ACCOUNT,     // 출금: 통장 번호 대기
+    STATE_WITHDRAW_PASSWORD,    // 출금: 비밀번호 대기
+    STATE_WITHDRAW_AMOUNT,      // 출금: 금액 대기
+    STATE_TRANSFER_ACCOUNT,     // 이체: 출금할 통장 번호 대기
+    STATE_TRANSFER_PASSWORD,    // 이체: 비밀번호 대기
+    STATE_TRANSFER_LEGS,        // 이체: 받는 사람 줄 단위 입력 ("끝"까지)
+    STATE_STATEMENT_ACCOUNT,    // 거래 내역: 통장 번호 대기
+    STATE_STATEMENT_MORE,       // 거래 내역: 이전 쪽을 더 볼지 대기
+    STATE_ASK_MORE,             // 추가 업무 여부 대기
+    STATE_CLOSED                // 업무 종료
+} SessionState;
+
+// 출력 조각: 고정 안내문은 복사하지 않고 가리키기만 하고, 동적 응답은 out 버퍼 위치로 가리킨다
+// (out은 realloc으로 옮겨질 수 있어 포인터 대신 오프셋을 둔다)
+typedef struct {
+    const char* data;           // NULL이면 out 버퍼의 offset부터
+    size_t offset;
+    size_t len;
+} OutFrag;
+
+// io_uring 요청 종류 (user_data 하위 3비트, 나머지는 세션 포인터 또는 수신 소켓 번호)
+typedef enum {
+    URING_IO_NONE = 0,
+    URING_IO_READ,              // 세션 읽기 (등록 버퍼 또는 rbuf)
+    URING_IO_SEND,              // 세션 응답 (sendmsg)
+    URING_IO_ACCEPT,            // 수신 소켓 수락
+    URING_IO_WAKE,              // WAL 커밋 완료 eventfd 읽기
+    URING_IO_CANCEL             // 요청 취소 (결과는 버린다)
+} UringOp;
+
+#define URING_OP_MASK 7ull
+
+// 세션 (연결별 대화 상태)
+// 대화 흐름은 입력 한 번마다 session_on_input()으로 한 단계씩 진행되며,
+// 응답은 출력 버퍼에 쌓였다가 session_flush()로 전송된다.
+// 스레드 모드와 epoll 모드가 같은 상태 머신을 공유한다.
+// 입력은 in 버퍼에 모아 대화형은 줄 단위로, 바이너리는 프레임 단위로 잘라 도착 순서대로 처리하므로
+// read 경계와 상관없이 여러 건을 한 번에 보내도(파이프라이닝) 된다.
+typedef struct Session {
+    int client_fd;
+    SessionProto proto;
+    int window_id;              // 담당 창구 번호 (워커 또는 리액터)
+    ClientInfo* client;
+    SessionState state;
+    ClientInfo* target;         // 입금 대상 고객 (다른 지점 고객이면 NULL)
+    int target_shard;           // 다른 지점 입금 대상: 지점 번호, ID, 통장 수
+    char target_id[CLIENT_ID_SIZE];
+    int target_accounts;
+    int account_num;            // 선택한 통장 번호 (0부터)
+    uint64_t statement_next;    // 거래 내역: 다음에 보여 줄 쪽의 끝 순번 (이보다 앞 항목이 남았다)
+    int tasks;                  // 이번 상담에서 끝낸 업무 수 (대기 등급 판단용)
+    TransferLeg* legs;          // 이체: 입력받은 항목 (legs[0]은 본인 통장 출금)
+    int leg_count;
+    int leg_cap;
+    char* out;                  // 출력 버퍼 (동적으로 만든 응답 바이트)
+    size_t out_len;
+    size_t out_cap;
+    OutFrag* frags;             // 보낼 조각 목록 (한 번의 sendmsg로 모아 보낸다)
+    int frag_count;
+    int frag_cap;
+    int frag_head;              // 아직 다 못 보낸 첫 조각
+    size_t frag_done;           // frag_head 조각에서 이미 보낸 바이트
+    char* in;                   // 입력 버퍼 (줄/프레임 조립용, 처리 못 한 조각이 남는다)
+    size_t in_len;
+    size_t in_cap;
+    bool want_write;            // epoll에 EPOLLOUT 등록 여부
+    uint64_t commit_lsn;        // 응답 전에 디스크에 내려가야 할 WAL LSN
+    struct Session* durable_prev;   // 리액터의 커밋 대기 목록
+    struct Session* durable_next;
+    bool durable_waiting;
+    uint64_t opened_ns;         // 상담 시작 시각 (전체 기한 기준)
+    uint64_t active_ns;         // 마지막 입력 시각 (유휴 기한 기준)
+    uint64_t timer_tick;        // 타이머 휠에 걸어 둔 기한 (초 단위 tick)
+    struct Session* timer_prev; // 리액터 타이머 휠 칸 목록 (새 세션 인계 목록으로도 쓴다)
+    struct Session* timer_next;
+    bool timer_armed;
+    UringOp io_op;              // uring 모드: 커널에 걸어 둔 요청 (세션당 한 번에 하나)
+    bool io_cancel;             // uring 모드: 걸어 둔 요청의 취소를 보냈다
+    bool io_closing;            // uring 모드: 걸어 둔 요청이 끝나면 닫는다
+    bool out_busy;              // uring 모드: 커널이 out 버퍼를 보내는 중 (늘리거나 옮기면 안 된다)
+    int read_slot;              // uring 모드: 등록 버퍼 번호 (-1이면 rbuf로 읽는다)
+    char* rbuf;                 // uring 모드: 등록 버퍼가 모자랄 때 쓰는 읽기 버퍼
+    struct msghdr send_msg;     // uring 모드: 보내는 중인 sendmsg 인자 (완료될 때까지 살아 있어야 한다)
+    struct iovec* send_iov;
+    struct Reactor* reactor;    // epoll/uring 모드: 담당 리액터 (스레드 모드는 NULL)
+    struct ShardCall* shard_call;   // 답을 기다리는 지점 간 호출 (그동안 입력은 쌓기만 한다)
+} Session;
+
+// ========== 바이너리 프로토콜 ==========
+// 자동화 클라이언트용. 모든 정수는 네트워크 바이트 순서이며 프레임 공통 헤더는 다음과 같다.
+//   u32 length      뒤따르는 바이트 수 (op부터 본문 끝까지)
+//   u8  op          BIN_OP_*
+//   u8  status      요청: 0, 응답: BankStatus
+//   u16 reserved
+//   u32 request_id  응답에 그대로 돌려준다
+// 요청 본문:
+//   OPEN      char bank_name[50]
+//   DEPOSIT   char target_id[16], u32 account_no(1부터), i32 amount
+//   WITHDRAW  u32 account_no(1부터), u32 password, i32 amount
+//   BALANCE   (없음)
+//   TRANSFER  u32 password, u32 count, count x { char client_id[16], u32 account_no(1부터), i32 amount }
+//             amount가 음수인 항목은 본인 통장 출금이며, 전체 합은 0이어야 한다 (전부 반영 또는 전부 거절).
+//   STATEMENT u32 account_no(1부터), u32 mode, u64 from, u64 to, u32 limit
+//             mode 0: 순번 [from, to), 1: 시각(유닉스 초) [from, to), 2: 마지막 limit건 (from, to 무시)
+//             구간 앞에서부터 최대 limit건(LEDGER_MAX_PAGE까지)을 돌려준다. 다음 쪽은 mode 0으로
+//             from = first + count, to = end를, 이전 쪽은 from = first - limit, to = first를 보낸다.
+// 응답 본문 (status가 BANK_OK일 때만, TRANSFER는 실패해도 본문이 있다):
+//   OPEN      u32 account_no
+//   DEPOSIT   i32 balance
+//   WITHDRAW  i32 balance
+//   BALANCE   u32 count, count x { char bank_name[50], u16 reserved, i32 balance }
+//   TRANSFER  성공: u32 count, 실패: u32 문제가 된 항목 번호 (1부터, 항목과 무관하면 0)
+//   STATEMENT u64 total, u64 first, u64 end, u32 count,
+//             count x { u32 time, u32 type(WalType), i32 amount, i32 balance, char counterparty[16] }
+//             total은 통장의 전체 항목 수, [first, end)는 요청 구간을 순번으로 바꾼 것이다.
+// 응답을 기다리지 않고 요청을 연달아 보내도 되며(파이프라이닝), 응답은 요청 순서대로 온다.
+#define BIN_HEADER_SIZE 12
+#define BIN_MAX_FRAME (128 * 1024)  // length 필드 최댓값 (TRANSFER_MAX_LEGS건 이체가 들어간다)
+#define BIN_NAME_SIZE 50
+#define BIN_ID_SIZE 16
+
+typedef enum {
+    BIN_OP_OPEN = 1,
+    BIN_OP_DEPOSIT = 2,
+    BIN_OP_WITHDRAW = 3,
+    BIN_OP_BALANCE = 4,
+    BIN_OP_TRANSFER = 5,
+    BIN_OP_STATEMENT = 6
+} BinOp;
+
+// 수신 소켓 묶음 (대화형 + 바이너리)
+// 수락 스레드(epoll 모드는 리액터)마다 SO_REUSEPORT로 같은 포트에 따로 열어
+// 커널이 새 연결을 나눠 주게 한다. 수락 경로에 공유 자원이 없다.
+typedef struct {
+    int fds[2];                 // [0] 대화형, [1] 바이너리 (binary_port > 0일 때)
+    int count;
+    atomic_ulong accepted;      // 이 묶음으로 받은 연결 수 (인증 실패 포함)
+} ListenerSet;
+
+// 리액터 타이머 휠 (리액터 스레드만 만진다)
+// 세션은 기한이 속한 초의 칸에 걸리고, 입력이 와도 옮기지 않는다. 칸이 돌아왔을 때
+// 실제 기한을 다시 계산해 늘어났으면 새 칸으로 옮기고 지났으면 닫는다.
+typedef struct {
+    Session* slots[TIMER_WHEEL_SLOTS];
+    uint64_t tick;              // 마지막으로 처리한 tick (초)
+} TimerWheel;
+
+// io_uring 링 (liburing 없이 시스템 호출과 mmap으로 직접 다룬다)
+// 제출 큐에 쌓아 둔 요청은 io_uring_enter 한 번으로 한꺼번에 커널에 넘어간다.
+typedef struct {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    unsigned to_submit;         // 쌓아 두고 아직 제출하지 않은 요청 수
+} Uring;
+
+// 리액터의 io_uring 상태 (uring 모드)
+typedef struct {
+    Uring ring;
+    char* bufs;                 // 읽기 버퍼 (URING_BUF_SLOTS x BUFFER_SIZE, 0번 등록 버퍼)
+    bool bufs_registered;       // 등록에 실패하면 같은 메모리를 일반 recv로 쓴다
+    int* free_slots;
+    int free_count;
+    struct sockaddr_in accept_addr[2];  // 수신 소켓별 수락 중인 주소
+    socklen_t accept_len[2];
+    uint64_t wake_count;        // eventfd 읽기 버퍼
+} UringIo;
+
+// 리액터 스레드 정보 (epoll/uring 모드)
+typedef struct Reactor {
+    int reactor_id;             // 창구 번호
+    pthread_t thread;
+    int epoll_fd;
+    int event_fd;               // WAL 커밋 완료 알림
+    Session* durable_waiters;   // WAL 커밋을 기다리며 응답을 보류 중인 세션
+    TimerWheel timers;          // 세션 기한
+    ListenerSet* listen;        // 이 리액터 전용 수신 소켓 (직접 수락한다)
+    UringIo* uring;             // uring 모드 전용 (epoll 모드는 NULL)
+    pthread_mutex_t shard_mutex;    // shard_done
+    struct ShardCall* shard_done;   // 호출 스레드가 답을 채워 돌려준 지점 간 호출 (event_fd로 깨운다)
+    struct timespec opened;     // 시작 시각
+    _Atomic uint64_t busy_ns;   // 이벤트 처리에 쓴 누적 시간
+} Reactor;
+
+// WAL 레코드 종류
+typedef enum {
+    WAL_OPEN = 1,
+    WAL_DEPOSIT = 2,
+    WAL_WITHDRAW = 3,
+    WAL_REGISTER = 4,
+    WAL_TRANSFER = 5,
+    WAL_PREPARE = 6,            // 지점 간 거래: 참여 지점이 준비함 (아직 반영하지 않는다)
+    WAL_XCOMMIT = 7,            // 지점 간 거래: 조정 지점의 커밋 결정 + 이 지점 항목 반영
+    WAL_XAPPLY = 8,             // 지점 간 거래: 참여 지점이 준비한 항목 반영
+    WAL_XABORT = 9,             // 지점 간 거래: 참여 지점이 준비한 거래 철회
+    WAL_XEND = 10,              // 지점 간 거래: 모든 참여 지점이 커밋을 마쳐 결정을 잊어도 된다
+    WAL_EPOCH_DATA = 11,        // 일 마감: 통장별 증감 묶음 (아직 반영하지 않는다)
+    WAL_EPOCH = 12              // 일 마감 확정: 앞의 증감 묶음을 한 회차로 반영한다
+} WalType;
+
+// WAL 레코드 헤더 (파일에는 헤더 + 본문이 연달아 기록된다)
+typedef struct {
+    uint32_t crc;               // len부터 본문 끝까지의 CRC32
+    uint32_t len;               // 본문 길이
+    uint64_t lsn;               // 로그 순번 (1부터 연속)
+    uint32_t type;              // WalType
+    uint32_t time;              // 기록 시각 (유닉스 초, 원장 항목의 거래 시각)
+} WalHeader;
+
+typedef struct {
+    uint32_t client_no;
+    uint32_t account_num;
+    char bank_name[50];
+    char reserved[2];
+} WalOpen;
+
+typedef struct {
+    uint32_t from_no;           // 입금자
+    uint32_t client_no;         // 입금 대상
+    uint32_t account_num;
+    int32_t amount;
+} WalDeposit;
+
+typedef struct {
+    uint32_t client_no;
+    uint32_t account_num;
+    int32_t amount;
+} WalWithdraw;
+
+typedef struct {
+    uint32_t client_no;         // 등록 시 부여된 번호 (복구할 때도 같은 번호여야 한다)
+    uint32_t ip;
+    char client_id[CLIENT_ID_SIZE];
+} WalRegister;
+
+typedef struct {
+    uint32_t client_no;
+    uint32_t account_num;
+    int32_t amount;             // 음수 = 출금
+} WalTransferLeg;
+
+typedef struct {
+    uint32_t leg_count;
+    WalTransferLeg legs[];
+} WalTransfer;
+
+// 지점 간 거래 (PREPARE, XCOMMIT, XAPPLY: 이 지점 고객의 항목만)
+typedef struct {
+    uint64_t txid;
+    uint32_t peer;              // PREPARE/XAPPLY: 조정 지점 번호, XCOMMIT: 참여 지점 비트
+    uint32_t leg_count;
+    WalTransferLeg legs[];
+} WalShardTx;
+
+// 지점 간 거래 끝 (XABORT, XEND)
+typedef struct {
+    uint64_t txid;
+} WalShardEnd;
+
+// 일 마감 증감 묶음 (고객 번호 순서, amount = 이자 - 수수료)
+typedef struct {
+    uint32_t epoch;
+    uint32_t leg_count;
+    WalTransferLeg legs[];
+} WalEpochData;
+
+// 일 마감 확정 (묶음 수와 항목 수가 맞아야 반영한다)
+typedef struct {
+    uint32_t epoch;
+    uint32_t records;           // 앞선 WAL_EPOCH_DATA 레코드 수
+    uint64_t legs;              // 증감 항목 수
+    int64_t interest;           // 이자 합
+    int64_t fees;               // 수수료 합
+} WalEpoch;
+
+// WAL 동기화 정책
+typedef enum {
+    WAL_SYNC_FSYNC,             // 묶음마다 fdatasync 후 응답 (그룹 커밋)
+    WAL_SYNC_INTERVAL,          // 기록 즉시 응답, fdatasync는 주기적으로
+    WAL_SYNC_NONE               // 기록 즉시 응답, 동기화는 OS에 맡김
+} WalSyncPolicy;
+
+// WAL 상태
+// 워커는 고객 lock 안에서 wal_append()로 buf에 레코드를 넣기만 하고,
+// 기록 스레드가 모인 레코드를 한 번의 write/fdatasync로 내려보낸다 (그룹 커밋).
+// mutex 안에서는 LSN과 buf 자리만 잡고, 헤더/CRC/복사는 밖에서 한다. 기록 스레드는 버퍼를 바꾼 뒤
+// 그 버퍼에 자리를 잡은 워커가 모두 채울 때까지(filling[gen] == 0) 기다렸다가 쓴다.
+typedef struct {
+    bool enabled;
+    WalSyncPolicy policy;
+    int fd;                     // 현재 세그먼트
+    uint64_t segment_base;      // 현재 세그먼트의 첫 LSN
+    size_t segment_size;
+    bool sync_requested;        // 정책과 상관없이 다음 묶음에서 fdatasync (스냅샷)
+    bool rotate_requested;      // 다음 묶음 뒤 새 세그먼트로 (대기 서버가 스냅샷을 받았을 때)
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;        // 기록 스레드 깨우기
+    pthread_cond_t flushed;     // durable_lsn 진행 알림
+    char* buf;                  // 워커가 채우는 버퍼
+    size_t buf_len;             // 자리를 잡은 데까지 (채우는 중인 레코드 포함)
+    size_t buf_cap;
+    int buf_gen;                // buf가 filling의 몇 번 칸인지 (버퍼를 바꿀 때마다 뒤집는다)
+    atomic_int filling[2];      // 자리를 잡고 아직 채우지 않은 레코드 수 (버퍼별)
+    char* flush_buf;            // 기록 스레드가 쓰는 버퍼
+    size_t flush_cap;
+    uint64_t next_lsn;          // 다음에 부여할 LSN
+    uint64_t written_lsn;       // write()까지 끝난 LSN
+    _Atomic uint64_t durable_lsn;   // fdatasync까지 끝난 LSN
+    long groups;                // 기록 묶음 수
+    int notify_fds[64];         // 커밋 완료를 알릴 eventfd (리액터)
+    int notify_count;
+    Uring* ring;                // uring 모드: write와 fdatasync를 묶어 한 번에 제출 (없으면 NULL)
+} Wal;
+
+// 복제 메시지 종류
+typedef enum {
+    REPL_MSG_HELLO = 1,         // 대기 → 주: ReplHello, lsn = 받을 다음 LSN
+    REPL_MSG_SNAPSHOT = 2,      // 주 → 대기: bank.snap 파일 그대로, lsn = 스냅샷 시점 (로그가 지워진 구간)
+    REPL_MSG_RECORDS = 3,       // 주 → 대기: WAL 레코드(헤더 + 본문) 묶음, 세그먼트 파일에 있는 그대로
+    REPL_MSG_HEARTBEAT = 4,     // 주 → 대기: 본문 없음
+    REPL_MSG_ERROR = 5          // 주 → 대기: 거절 이유 문자열 (보낸 뒤 끊는다)
+} ReplMsgType;
+
+// 복제 메시지 헤더 (레코드를 파일 그대로 보내므로 바이트 순서가 같은 서버끼리만)
+typedef struct {
+    uint32_t type;              // ReplMsgType
+    uint32_t reserved;
+    uint64_t lsn;               // RECORDS/HEARTBEAT: 주 서버가 커밋한 LSN
+    uint64_t len;               // 뒤따르는 본문 길이
+} ReplMsgHeader;
+
+typedef struct {
+    char magic[8];              // REPL_MAGIC
+    uint32_t version;
+    uint32_t initial_clients;   // 기본 고객 수와 통장 수가 같아야 같은 번호로 반영된다
+    uint32_t max_accounts;
+    uint32_t reserved;
+} ReplHello;
+
+// 주 서버에 붙은 대기 서버 하나
+typedef struct {
+    bool used;
+    int fd;
+    char addr[32];              // 대기 서버 주소:포트
+    _Atomic uint64_t sent_lsn;  // 보낸 마지막 LSN
+} ReplFollower;
+
+// 복제 상태
+// 주 서버는 --repl-port로 대기 서버를 받아 커밋된 레코드를 흘려보내고,
+// 대기 서버(--follow)는 받은 레코드를 영업 중 거래와 같은 방법으로 반영하다가 promote 명령으로 영업을 시작한다.
+typedef struct {
+    int port;                   // --repl-port (0이면 대기 서버를 받지 않는다)
+    const char* bind_addr;      // --repl-bind
+    pthread_mutex_t mutex;      // followers, fd, promoting, promoted
+    ReplFollower followers[REPL_MAX_FOLLOWERS];
+    const char* primary;        // --follow HOST:PORT (NULL이면 대기 서버가 아니다)
+    int fd;                     // 주 서버 연결 (-1 = 끊김)
+    pthread_t thread;
+    pthread_cond_t changed;     // promote 요청/완료 알림
+    bool promoting;             // promote 요청 (복제 스레드가 보고 멈춘다)
+    bool promoted;              // 복제를 멈추고 영업을 시작했다
+    _Atomic uint64_t primary_lsn;   // 주 서버가 마지막으로 알려 준 커밋 LSN
+    _Atomic uint64_t applied_lsn;   // 반영한 마지막 LSN
+    _Atomic uint64_t caught_up_ns;  // 마지막으로 주 서버를 따라잡은 시각 (now_ns)
+    atomic_bool connected;
+    atomic_ulong reconnects;
+    atomic_ulong snapshots;     // 받은 스냅샷 수
+} Replication;
+
+// 지점 간 메시지 (바이너리 프로토콜과 같은 프레임, 지점 간 포트로만 받는다)
+//   OWNER     u32 ip                   → 이 지점 고객이면 OK + char client_id[16]
+//   ACCOUNTS  char client_id[16]       → OK + u32 count, count x char bank_name[50]
+//   PREPARE   u32 txid_hi, u32 txid_lo, u32 coordinator, u32 count,
+//             count x { char client_id[16], u32 account_no(0부터), i32 amount }
+//             → OK (준비됨, 결정이 올 때까지 고객 lock을 쥔다) 또는 실패 + u32 문제가 된 항목 번호
+//   COMMIT    u32 txid_hi, u32 txid_lo → OK + i32 첫 항목 잔고 + char bank_name[50] (이미 끝났으면 본문 없음)
+//   ABORT     u32 txid_hi, u32 txid_lo → OK
+//   STATUS    u32 txid_hi, u32 txid_lo → OK + u32 (1 = 커밋, 0 = 철회)
+// PREPARE 다음의 COMMIT/ABORT는 같은 연결로 보낸다. 다른 연결로 온 COMMIT/ABORT는
+// 거래가 아직 준비 중이면 BANK_ERR_BUSY로 답한다 (준비한 스레드가 직접 결과를 물어 끝낸다).
+typedef enum {
+    PEER_OP_OWNER = 1,
+    PEER_OP_ACCOUNTS = 2,
+    PEER_OP_PREPARE = 3,
+    PEER_OP_COMMIT = 4,
+    PEER_OP_ABORT = 5,
+    PEER_OP_STATUS = 6
+} PeerOp;
+
+// 지점 주소 (--shards 항목 하나)
+typedef struct {
+    char host[64];
+    int port;                   // 대화형 포트 (바이너리 = port + 1, 지점 간 = port + 2)
+    struct sockaddr_in addr;    // port 기준 주소
+} ShardAddr;
+
+// 조정 지점이 기억하는 거래 결정 (참여 지점이 결과를 물으면 답한다)
+typedef struct {
+    uint64_t txid;
+    uint64_t lsn;               // XCOMMIT LSN
+    bool committed;             // 커밋하기로 정했다 (false = 아직 결정 전)
+    uint32_t pending;           // 커밋을 아직 확인받지 못한 참여 지점 비트
+    bool doomed;                // 결정 전에 참여 지점이 결과를 물었다 (철회한다)
+    uint64_t decided_ns;
+} ShardDecision;
+
+// 참여 지점이 준비해 둔 거래 (결정이 올 때까지 준비한 스레드가 고객 lock을 쥐고 있다)
+typedef struct {
+    uint64_t txid;
+    uint64_t lsn;               // PREPARE LSN (이 앞의 세그먼트는 지우지 않는다)
+    int coordinator;
+    bool held;                  // 어느 스레드가 고객 lock을 쥐고 결정을 기다리는 중
+    uint32_t leg_count;
+    WalTransferLeg* legs;
+    bool reserved;              // 인기 통장으로 들어갈 항목의 한도를 잡아 두었다 (끝낼 때 푼다)
+} ShardPrepared;
+
+// 지점 나누기 (--shards)
+// 고객은 ID의 CRC32로 지점을 정한다. 지점마다 자기 고객만 디렉터리에 두고 WAL도 따로 쓰며,
+// 다른 지점 고객에게 가는 입금/이체는 2단계 커밋으로 함께 반영하거나 함께 철회한다.
+typedef struct {
+    int count;                  // 지점 수 (0이면 나누지 않는다)
+    int index;                  // 이 지점 번호 (-1 = 정하지 않음)
+    bool router;                // --router
+    ShardAddr addrs[MAX_SHARDS];
+    pthread_mutex_t mutex;      // decisions, prepared, routes
+    ShardDecision* decisions;   // 조정 지점: 결정 표
+    int decision_count;
+    int decision_cap;
+    ShardPrepared** prepared;   // 참여 지점: 준비한 거래
+    int prepared_count;
+    int prepared_cap;
+    uint64_t txid_base;         // 거래 번호 = 지점 번호(상위 8비트) | 기동 시각(us) + 순번
+    atomic_ulong txid_seq;
+    atomic_int resolving;       // 아직 고객 lock을 잡지 못한 복구 스레드 수 (기동 시 기다린다)
+    uint32_t* route_ips;        // 라우터: 고객 IP → 지점 캐시 (개방 주소, 0 = 빈 칸)
+    uint8_t* route_shards;
+    uint32_t route_mask;
+    int route_count;
+    atomic_ulong committed;     // 조정한 지점 간 거래 (커밋/철회)
+    atomic_ulong aborted;
+    atomic_ulong routed[MAX_SHARDS];    // 라우터: 지점별로 넘긴 연결 수
+} ShardState;
+
+// 라우터 연결 한 쌍 (고객 ↔ 지점), 방향마다 버퍼 하나
+typedef struct RouterPipe {
+    int fds[2];                 // [0] 고객, [1] 지점
+    char* bufs[2];              // bufs[i]: fds[i]에서 읽어 반대쪽으로 보낼 바이트
+    size_t lens[2];
+    size_t offs[2];
+    bool eof[2];
+    struct RouterSide {
+        struct RouterPipe* pipe;
+        int side;
+    } sides[2];                 // epoll data.ptr
+    struct RouterPipe* next_closed;
+} RouterPipe;
+
+// 라우터 스레드의 조회 완료 목록 (조회 스레드가 넣고 eventfd로 깨운다)
+typedef struct RouterThread {
+    int epoll_fd;
+    int event_fd;
+    pthread_mutex_t mutex;
+    struct RouterPending* done;
+} RouterThread;
+
+// 지점을 묻는 중인 고객 연결 (라우터 스레드는 기다리지 않고 답이 오면 이어 붙인다)
+typedef struct RouterPending {
+    int client_fd;
+    int idx;                    // 0 대화형, 1 바이너리
+    struct sockaddr_in addr;
+    int owner;                  // 조회 스레드가 채운다
+    RouterThread* thread;       // 답을 돌려줄 라우터 스레드
+    struct RouterPending* next;
+} RouterPending;
+
+// 조회 스레드가 가져갈 지점 조회 대기열 (먼저 온 순서)
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    RouterPending* head;
+    RouterPending* tail;
+} RouterLookups;
+
+// 리액터 세션의 지점 간 호출 종류
+typedef enum {
+    SHARD_CALL_ACCOUNTS,        // 입금 대화: 다른 지점 고객의 통장 목록
+    SHARD_CALL_DEPOSIT,         // 다른 지점 고객에게 입금
+    SHARD_CALL_TRANSFER         // 다른 지점 고객이 낀 이체
+} ShardCallKind;
+
+// 지점 간 호출 하나 (리액터는 다른 지점을 기다리지 않고 호출 스레드에 맡긴다)
+// 호출 스레드가 결과를 채워 리액터의 eventfd로 돌려주면, 리액터가 답을 쓰고 세션을 이어 간다.
+// 스레드 모드는 창구 스레드가 그 자리에서 부르고 바로 답을 쓴다.
+typedef struct ShardCall {
+    ShardCallKind kind;
+    Session* session;           // 맡긴 세션 (답이 오기 전에 닫히면 리액터가 NULL로 바꾼다)
+    Reactor* reactor;           // 답을 돌려줄 리액터
+    bool binary;                // 바이너리 요청이면 op, request_id로 답한다
+    uint8_t op;
+    uint32_t request_id;
+    ClientInfo* requester;      // 요청한 고객 (이체 출금 항목의 주인)
+    int shard_index;            // 통장 목록/입금: 대상 지점, ID, 통장, 금액
+    char target_id[CLIENT_ID_SIZE];
+    int account_num;
+    int amount;
+    TransferLeg* legs;          // 이체: 항목 (호출이 가진다)
+    int leg_count;
+    BankStatus status;          // 여기부터 결과
+    int failed_leg;
+    int balance;
+    char bank_name[50];
+    char names[MAX_ACCOUNTS_LIMIT][50];
+    int count;
+    uint64_t lsn;               // 호출하면서 추가한 마지막 WAL LSN
+    struct ShardCall* next;
+} ShardCall;
+
+// 호출 스레드가 가져갈 지점 간 호출 대기열 (먼저 온 순서)
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    ShardCall* head;
+    ShardCall* tail;
+} ShardCalls;
+
+// 일 마감 단계
+typedef enum {
+    EOD_IDLE,
+    EOD_CUT,                    // 모든 고객을 잠가 잔고 복사 (이 동안만 거래가 기다린다)
+    EOD_COMPUTE,                // 복사본에 이자/수수료 규칙 적용 (병렬)
+    EOD_COMMIT,                 // 증감을 WAL에 적고 회차를 한 번에 공개
+    EOD_APPLY,                  // 공개한 증감을 고객별 잔고와 원장에 반영 (병렬)
+    EOD_PHASES
+} EodPhase;
+
+// 일 마감 배치 (이자, 수수료)
+// 모든 고객을 잠근 한 시점의 잔고를 복사해 스레드들이 나눠 계산하고, 결과는 회차 번호를
+// 올리는 것으로 한꺼번에 공개한다. 고객의 epoch가 회차보다 작으면 조회는 증감을 더해 보여 주고,
+// 고객 lock을 잡는 쪽(client_lock)이 잔고에 반영한다. 반영 스레드가 남은 고객을 마저 반영한다.
+typedef struct {
+    int interest_ppm;           // 이자 (잔고의 백만분율, --eod-interest)
+    int fee;                    // 계좌 유지 수수료 (--eod-fee, 0이면 없음)
+    int fee_waive;              // 잔고가 이만큼 이상이면 수수료 면제 (--eod-fee-waive)
+    int threads;                // 계산/반영 스레드 수 (--batch-threads, 0이면 CPU 수)
+    int at_minute;              // 매일 이 시각(자정부터 분)에 돈다 (--eod-at, -1이면 관리 명령으로만)
+    atomic_bool running;
+    _Atomic uint32_t epoch;     // 공개한 마지막 회차
+    uint64_t epoch_lsn;         // 그 회차의 WAL_EPOCH LSN (원장 항목의 LSN)
+    uint32_t epoch_time;
+    uint32_t cut_clients;       // deltas가 덮는 고객 수 (뒤에 등록한 고객은 증감 없음)
+    uint32_t cut_epoch;         // balances를 복사한 회차 (고객 lock을 모두 쥐고 바꾸므로 고객 lock으로 읽는다)
+    _Atomic uint32_t closing;   // 마감을 시작한 회차 (공개할 때까지 인기 통장 입금도 고객 lock으로 받는다)
+    int32_t* balances;          // 마감 시점 잔고 (고객 x max_accounts)
+    int32_t* deltas;            // 통장별 증감 (이자 - 수수료)
+    size_t cap;                 // 두 배열의 칸 수
+    atomic_int phase;           // EodPhase
+    atomic_uint next;           // 병렬 단계에서 다음에 가져갈 고객 번호
+    atomic_uint done;           // 이번 단계에서 끝낸 고객 수
+    atomic_llong interest;      // 이번 회차 이자 합
+    atomic_llong fees;          // 이번 회차 수수료 합
+    atomic_ulong accounts;      // 이번 회차에 잔고가 바뀐 통장 수
+    double phase_ms[EOD_PHASES];    // 지난 회차의 단계별 소요 시간
+    atomic_ulong runs;
+    uint32_t replay_epoch;      // 복구/복제: 확정 레코드를 만날 때까지 모아 둔 증감
+    uint32_t replay_records;
+    WalTransferLeg* replay_legs;
+    size_t replay_count;
+    size_t replay_cap;
+} EodBatch;
+
+// 스냅샷 파일 형식 (고정 배치, 파일 전체를 그대로 mmap 해서 읽는다)
+typedef struct {
+    char bank_name[50];
+    uint8_t is_active;
+    uint8_t reserved;
+    int32_t balance;
+} SnapshotAccount;
+
+// 고객 레코드 (뒤에 SnapshotAccount가 max_accounts개 이어진다)
+typedef struct {
+    char client_id[CLIENT_ID_SIZE];
+    uint32_t ip;
+    uint32_t account_count;
+    uint64_t last_lsn;          // 이 고객에 반영된 마지막 WAL 레코드
+    uint32_t epoch;             // 반영된 마지막 일 마감 회차
+    uint32_t reserved;
+    SnapshotAccount accounts[];
+} SnapshotClient;
+
+typedef struct {
+    char magic[8];              // "BANKSNAP"
+    uint32_t version;
+    uint32_t client_count;      // 고객 레코드 수 (client_no 순서)
+    uint32_t max_accounts;      // 고객 레코드당 통장 수
+    uint32_t crc;               // 고객 레코드 전체의 CRC32
+    uint64_t start_lsn;         // 이 LSN까지는 모든 고객에 반영되어 있다
+    uint64_t ledger_end;        // 원장 파일에서 이 스냅샷과 함께 확정된 길이
+    unsigned char clients[];    // SnapshotClient 레코드들
+} SnapshotFile;
+
+// 기동 시간 지표
+typedef struct {
+    double snapshot_ms;         // 스냅샷 불러오기
+    double replay_ms;           // WAL 재실행
+    double total_ms;            // 프로세스 시작 ~ 영업 시작
+    long wal_records;           // 재실행한 레코드 수
+} StartupStats;
+
+// 지연 시간 히스토그램 (칸마다 원자적 카운터, 기록에 잠금 없음)
+typedef struct {
+    atomic_ulong buckets[HIST_BUCKETS + 1];
+    atomic_ulong count;
+    atomic_ulong sum_ns;
+} Histogram;
+
+// 지표를 따로 모으는 업무 종류
+typedef enum {
+    METRIC_OP_OPEN,
+    METRIC_OP_DEPOSIT,
+    METRIC_OP_WITHDRAW,
+    METRIC_OP_BALANCE,
+    METRIC_OP_TRANSFER,
+    METRIC_OP_STATEMENT,
+    METRIC_OP_COUNT
+} MetricOp;
+
+// 서버 지표 (관리 소켓의 metrics 명령으로 내보낸다)
+typedef struct {
+    Histogram op_latency[METRIC_OP_COUNT];  // 업무 처리 시간
+    atomic_ulong op_status[METRIC_OP_COUNT][BANK_STATUS_COUNT];  // 결과별 건수
+    Histogram accept_to_assign; // 접속 수락 ~ 창구 배정
+    Histogram queue_wait[QUEUE_CLASSES];    // 대기 큐에 머문 시간 (등급별)
+    Histogram lock_wait;        // 고객 lock 경합 시 대기 시간
+    atomic_ulong lock_acquired;
+    atomic_ulong lock_contended;
+    atomic_ulong read_retries;  // 잔고 조회가 쓰기와 겹쳐 다시 읽은 횟수
+    atomic_ulong connections_accepted;
+    atomic_ulong auth_failed;
+    atomic_ulong timeouts_idle;     // 입력이 없어 닫은 세션 수
+    atomic_ulong timeouts_session;  // 전체 상담 시간을 넘겨 닫은 세션 수
+    atomic_ulong read_calls;    // 고객 소켓 read 호출 수
+    atomic_ulong write_calls;   // 고객 소켓 sendmsg 호출 수
+    atomic_ulong uring_enters;  // 리액터 io_uring_enter 호출 수 (uring 모드)
+    atomic_ulong hot_deposits;  // 인기 통장 누적기로 받은 입금 수
+    atomic_ulong hot_folds;     // 누적기를 잔고에 반영한 횟수
+    atomic_ulong hot_full_waits;    // 조각이 가득 차 고객 lock을 잡고 반영한 입금 수
+    atomic_ulong hot_eod_fallbacks; // 일 마감 중이라 고객 lock 경로로 보낸 입금 수
+} Metrics;
+
+// 로그 수준
+typedef enum {
+    LOG_LEVEL_DEBUG,            // 대화 단계, 배정 등 세부 진행
+    LOG_LEVEL_INFO,             // 거래, 창구 열고 닫기, 기동
+    LOG_LEVEL_WARN,             // 연결 끊김, 인증 실패, 거절
+    LOG_LEVEL_ERROR
+} LogLevel;
+
+// 로그 레코드 (링 안에서 8바이트 정렬, 뒤에 인자가 이어진다)
+typedef struct {
+    uint32_t size;              // 인자 포함 전체 크기
+    uint8_t level;
+    uint8_t reserved[3];
+    uint64_t ts_ns;             // 기록 시각 (스레드 간 순서 맞추기)
+    const char* fmt;            // 형식 문자열 (리터럴), NULL이면 링 끝 건너뛰기
+} LogRecordHeader;
+
+// 스레드별 로그 링 (기록하는 스레드 하나, 읽는 로그 스레드 하나)
+typedef struct LogRing {
+    char* data;
+    _Alignas(CACHE_LINE) atomic_size_t head;    // 기록 스레드만 올린다
+    _Alignas(CACHE_LINE) atomic_size_t tail;    // 로그 스레드만 올린다
+    atomic_ulong dropped;       // 링이 가득 차 버린 레코드 수
+    atomic_bool abandoned;      // 스레드 종료됨 (비면 로그 스레드가 치운다)
+    struct LogRing* next;
+} LogRing;
+
+// 로거 상태
+typedef struct {
+    LogRing* rings;             // 등록된 링 목록 (registry_mutex)
+    pthread_mutex_t registry_mutex;
+    pthread_mutex_t drain_mutex;    // 로그 스레드와 종료 시 flush가 겹치지 않게
+    pthread_key_t ring_key;     // 스레드 종료 시 링 반납
+    atomic_ulong dropped_retired;   // 치운 링에서 버려졌던 레코드 수
+} Logger;
+
+// 입력 의도 (창구 대화의 자유 입력을 분류한 결과, 앞쪽일수록 우선)
+typedef enum {
+    INTENT_NONE,
+    INTENT_STATEMENT,           // 거래 내역 ("입금 내역"은 입금이 아니라 내역 조회)
+    INTENT_OPEN,                // 통장 개설
+    INTENT_DEPOSIT,             // 입금
+    INTENT_WITHDRAW,            // 출금
+    INTENT_TRANSFER,            // 이체
+    INTENT_BALANCE,             // 잔액 조회
+    INTENT_NO,                  // 추가 업무 없음 (종료)
+    INTENT_COUNT
+} Intent;
+_Static_assert(INTENT_COUNT * INTENT_MAX_GROUPS <= 64, "의도 조건 비트는 uint64_t 하나에 들어가야 한다");
+
+// 분류 키워드 (group이 다른 키워드가 모두 나와야 의도가 성립한다)
+typedef struct {
+    const char* keyword;
+    Intent intent;
+    int group;
+} IntentKeyword;
+
+// 키워드 분류기 (Aho-Corasick 자동자를 256바이트 전이표로 펼친 DFA)
+typedef struct {
+    uint16_t (*next)[256];      // 상태별 바이트 전이 (0번이 시작 상태)
+    uint64_t* out;              // 상태에 도달하면 켜지는 (의도, 조건) 비트
+    int state_count;
+    int state_cap;
+    int groups[INTENT_COUNT];   // 의도별 조건 수 (0이면 키워드 없음)
+    bool built;                 // 실패 전이까지 채웠으면 true (이후 키워드 추가 불가)
+} Classifier;
+
+// 관리 명령
+typedef struct {
+    const char* name;
+    void (*handler)(FILE* out, const char* args);
+    const char* help;
+} AdminCommand;
+
+// 서버 실행 모드
+typedef enum {
+    MODE_THREAD,                // 창구(워커)당 한 세션 (블로킹)
+    MODE_EPOLL,                 // 리액터당 다수 세션 (논블로킹)
+    MODE_URING                  // 리액터당 다수 세션 (io_uring, 지원하지 않는 커널이면 epoll)
+} ServerMode;
 
 // 전역 변수
-ClientInfo client_db[MAX_CLIENTS];      // 클라이언트 DB
-pthread_mutex_t db_mutex;               // DB 접근 mutex
-WaitingQueue waiting_queue;             // 대기 큐
-WorkerThread workers[MAX_WORKERS];      // 워커 스레드 풀
-pthread_mutex_t workers_mutex;          // 워커 관리 mutex
+ClientDirectory directory;              // 고객 디렉터리 (고객별 lock 포함)
+int initial_clients = MAX_CLIENTS;      // 기동 시 만드는 기본 고객 수 (--clients)
+int max_accounts = MAX_ACCOUNTS;        // 고객당 최대 통장 수 (--max-accounts)
+WaitingQueue waiting_queue = { .weights = { 4, 2, 1 } };   // 대기 큐 (--queue-weights)
+int client_windows = CLIENT_WINDOWS;    // 고객 한 명이 앞 등급으로 쓸 수 있는 창구 수 (0이면 제한 없음)
+WorkerThread* workers;                  // 워커 슬롯 (max_workers개)
+pthread_mutex_t spawn_mutex = PTHREAD_MUTEX_INITIALIZER;    // 창구 추가 (수락 스레드끼리)
+atomic_uint_fast64_t idle_workers[MAX_WORKERS / 64];   // 쉬고 있는 창구 비트맵 (bit i = 창구 i+1)
+_Static_assert(MAX_WORKERS % 64 == 0, "idle_workers 비트맵은 64비트 단위다");
+int min_workers = DEFAULT_MIN_WORKERS;  // 최소 창구 수
+int max_workers = 0;                    // 최대 창구 수 (0이면 CPU 수로 정한다)
+atomic_int live_workers;                // 현재 열린 창구 수
+int worker_idle_sec = WORKER_IDLE_SEC;  // 최소 수를 넘는 창구를 닫기까지의 유휴 시간
+bool pin_cpus = false;                  // 창구/리액터를 CPU에 고정
+int cpu_count = 1;                      // 사용 가능한 CPU 수
+int* cpu_list = NULL;                   // 사용 가능한 CPU 번호 (sched_getaffinity)
+atomic_long queue_rejected;             // 대기 큐가 가득 차 돌려보낸 고객 수
+atomic_ulong queue_served[QUEUE_CLASSES];   // 등급별 창구 배정 수
+atomic_int hot_account_count;           // 인기 통장 수
+const char* hot_accounts_list = NULL;   // 기동 때 인기 통장으로 지정할 목록 (--hot-accounts)
+ServerMode server_mode = MODE_THREAD;   // 실행 모드
+int reactor_count = 0;                  // 리액터 수 (0이면 CPU 수)
+Reactor* reactors = NULL;               // 리액터 배열
+int acceptor_count = 0;                 // thread 모드 수락 스레드 수 (0이면 CPU 수)
+int listen_backlog = LISTEN_BACKLOG;    // listen 대기열 길이 (--backlog)
+ListenerSet* listeners = NULL;          // 수락 스레드(리액터)별 수신 소켓
+int listener_count = 0;
+const char* bench_name = NULL;          // 실행할 벤치마크 (--bench)
+int bench_seconds = 2;                  // 벤치마크 구간별 측정 시간
+const char* self_test_name = NULL;      // 실행할 자체 시험 (--self-test)
+int binary_port = BINARY_PORT;          // 바이너리 프로토콜 포트 (0이면 사용 안 함)
+const char* data_dir = DATA_DIR;        // 데이터 디렉터리
+Wal wal = { .fd = -1 };                 // 선행 기록 로그
+bool wal_disabled = false;              // --no-wal
+int wal_interval_ms = 10;               // interval 정책의 동기화 주기
+uint32_t crc32_table[256];
+__thread uint64_t wal_last_lsn;         // 이 스레드가 마지막으로 추가한 LSN
+int snapshot_interval = 60;             // 스냅샷 주기 (초, 0이면 끔)
+LedgerFile ledger_file = { .fd = -1 };  // 통장별 거래 원장
+pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER; // 스냅샷 찍기/받기
+ShardState shard = { .index = -1, .mutex = PTHREAD_MUTEX_INITIALIZER };    // 지점 나누기
+__thread int peer_fds[MAX_SHARDS];      // 이 스레드의 지점 간 연결 (fd + 1, 0 = 없음)
+int text_port = PORT;                   // 대화형 포트 (--port)
+__thread RouterPipe* router_closed;     // 이 라우터 스레드가 이번 묶음에서 닫은 연결 (묶음 끝에 해제)
+RouterLookups router_lookups = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL };
+ShardCalls shard_calls = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL };
+Replication repl = {                    // 복제 (핫 스탠바이)
+    .bind_addr = "127.0.0.1", .fd = -1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER
+};
+int idle_timeout = IDLE_TIMEOUT_SEC;    // 유휴 기한 (초, 0이면 끔)
+int session_timeout = SESSION_TIMEOUT_SEC;  // 전체 상담 기한 (초, 0이면 끔)
+StartupStats startup_stats;             // 기동 시간 지표
+Metrics metrics;                        // 서버 지표
+Logger logger;                          // 비동기 로거
+int log_level = LOG_LEVEL_INFO;         // 이 수준 이상만 기록 (--log-level)
+__thread LogRing* log_ring;             // 이 스레드의 로그 링
+__thread int hot_stripe = -1;           // 이 스레드가 쓰는 인기 통장 누적기 조각
+atomic_int hot_stripe_next;             // 다음 스레드에 줄 조각 번호
+EodBatch eod = {                        // 일 마감 배치
+    .interest_ppm = EOD_INTEREST_PPM, .fee_waive = EOD_FEE_WAIVE, .at_minute = -1
+};
+int admin_port = ADMIN_PORT;            // 관리 소켓 포트 (0이면 사용 안 함)
+Classifier classifier;                  // 메뉴/추가 업무 입력 분류기
+const char* keywords_path = NULL;       // 추가 키워드 파일 (--keywords)
+const char* intent_names[INTENT_COUNT] = {
+    "none", "statement", "open", "deposit", "withdraw", "transfer", "balance", "no"
+};
+const char* metric_op_names[METRIC_OP_COUNT] = {
+    "open", "deposit", "withdraw", "balance", "transfer", "statement"
+};
+const char* queue_class_names[QUEUE_CLASSES] = {
+    "express", "normal", "bulk"
+};
+const char* eod_phase_names[EOD_PHASES] = {
+    "idle", "cut", "compute", "commit", "apply"
+};
+const char* bank_status_names[BANK_STATUS_COUNT] = {
+    "ok", "account_limit", "no_account", "amount", "insufficient",
+    "no_client", "password", "bad_request", "client_exists", "client_limit",
+    "unbalanced", "busy", "unavailable"
+};
 
 // 함수 선언
 void init_database();
 void init_waiting_queue();
-void enqueue(int client_fd);
-int dequeue();
+QueueClass queue_classify(const Connection* conn);
+bool enqueue(Connection conn);
+bool queue_ring_pop(QueueRing* ring, Connection* conn);
+bool dequeue(Connection* conn);
+int queue_class_depth(QueueClass qclass);
+int queue_depth();
+int futex_wait(atomic_int* addr, int expected, const struct timespec* timeout);
+void futex_wake(atomic_int* addr);
+int wake_idle_worker();
+bool any_idle_worker();
+void init_cpu_list();
+void pin_thread(pthread_t thread, int cpu);
+int worker_pool_spawn();
+bool worker_try_retire(WorkerThread* worker);
+double worker_utilization(WorkerThread* worker);
 ClientInfo* find_client_by_ip(char* ip);
+ClientInfo* find_client_by_addr(uint32_t host);
+ClientInfo* find_client_by_id(const char* client_id);
+ClientInfo* client_at(int client_no);
+int client_count();
+uint32_t client_id_hash(const char* client_id);
+uint32_t client_ip_hash(uint32_t ip);
+void directory_table_insert(uint32_t* table, uint32_t hash, int client_no);
+void directory_grow();
+ClientInfo* directory_lookup_id(const char* client_id);
+ClientInfo* directory_lookup_ip(uint32_t ip);
+ClientInfo* directory_add(const char* client_id, uint32_t ip);
+BankStatus client_register(const char* client_id, uint32_t ip, ClientInfo** client_out);
+void lock_clients(ClientInfo** clients, int count);
+void unlock_clients(ClientInfo** clients, int count);
+void client_write_begin(ClientInfo* client);
+void client_write_end(ClientInfo* client);
+int client_read_accounts(ClientInfo* client, Account* out);
+BankStatus bank_open_account(ClientInfo* client, const char* bank_name, int* idx_out);
+BankStatus bank_deposit(ClientInfo* from, ClientInfo* target, int account_num,
+                        int amount, int* balance_out);
+BankStatus bank_withdraw(ClientInfo* client, int account_num, int amount, int* balance_out);
+BankStatus bank_transfer(ClientInfo* requester, const TransferLeg* legs, int count, int* failed_leg);
+bool transfer_crosses_shards(const TransferLeg* legs, int count);
+BankStatus transfer_apply_legs(const TransferLeg* legs, int count, int* failed_leg);
+void transfer_undo_legs(const TransferLeg* legs, int count);
+BankStatus transfer_reserve_legs(const TransferLeg* legs, int count, int* failed_leg);
+void transfer_release_legs(const TransferLeg* legs, int count);
+void transfer_commit_legs(const TransferLeg* legs, int count);
+bool transfer_leg_target(TransferLeg* leg, const char* client_id);
+void client_sort(ClientInfo** clients, int count);
+void clients_write_begin(ClientInfo** clients, int count);
+void clients_write_end(ClientInfo** clients, int count);
+int client_no_compare(const void* a, const void* b);
+void crc32_init();
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len);
+uint32_t wal_record_crc(const WalHeader* h, const void* body);
+void wal_apply(const WalHeader* h, const void* body);
+void wal_apply_legs(uint64_t lsn, const WalTransferLeg* legs, uint32_t count);
+void wal_segment_path(char* path, size_t size, uint64_t base_lsn);
+int wal_segment_compare(const void* a, const void* b);
+int wal_list_segments(uint64_t** bases_out);
+void wal_open_segment(uint64_t base_lsn);
+void wal_replay(uint64_t start_lsn);
+void wal_open();
+uint64_t wal_append(uint32_t type, const void* body, uint32_t len);
+uint64_t wal_append_at(uint32_t type, const void* body, uint32_t len, uint32_t stamp);
+void wal_append_record(WalHeader* h, const void* body);
+void wal_wait_filled(int gen);
+bool wal_is_durable(uint64_t lsn);
+void wal_wait_durable(uint64_t lsn);
+void wal_sync(uint64_t lsn);
+void wal_add_notify_fd(int fd);
+void* wal_writer_func(void* arg);
+size_t wal_write_uring(size_t len, bool sync, bool* synced);
+double elapsed_ms(const struct timespec* from, const struct timespec* to);
+uint64_t snapshot_load(uint64_t* ledger_end);
+void snapshot_write();
+void snapshot_prune_segments(uint64_t start_lsn);
+void* snapshot_thread_func(void* arg);
+Ledger* ledger_of(Account* account);
+void ledger_reserve_chunks(Ledger* ledger, uint64_t need);
+uint64_t ledger_write_chunk(uint32_t client_no, uint32_t account_num, const Ledger* ledger, uint32_t count);
+void ledger_add(ClientInfo* client, int account_num, Ledger* ledger, const LedgerEntry* entry);
+void ledger_record(const WalHeader* h, const void* body);
+void ledger_record_legs(const WalHeader* h, const WalTransferLeg* legs, uint32_t count,
+                        const char* counterparty);
+void ledger_save_client(ClientInfo* client);
+void ledger_open(uint64_t committed_end);
+void ledger_finish_load(Ledger* ledger, uint64_t client_lsn);
+void ledger_reset();
+BankStatus ledger_read(ClientInfo* client, int account_num, uint64_t from, int max,
+                       LedgerEntry* out, int* count_out, uint64_t* total_out);
+uint64_t ledger_find_time(ClientInfo* client, int account_num, uint64_t time, uint64_t total);
+BankStatus bank_statement(ClientInfo* client, int account_num, LedgerRange range,
+                          uint64_t from, uint64_t to, int limit, LedgerEntry* out, LedgerPage* page);
+HotAccount* hot_account_of(ClientInfo* client, int account_num);
+BankStatus hot_enable(ClientInfo* client, int account_num);
+void hot_enable_list(const char* list);
+int hot_stripe_index();
+bool bank_deposit_hot(ClientInfo* from, ClientInfo* target, int account_num, HotAccount* hot,
+                      int amount, int* balance_out, BankStatus* status_out);
+int hot_deposit_compare(const void* a, const void* b);
+void hot_fold(ClientInfo* client);
+void hot_fold_account(ClientInfo* client, int account_num, HotAccount* hot);
+bool hot_reserve_credit(ClientInfo* client, int account_num, int amount);
+void hot_release_credit(ClientInfo* client, int account_num, int amount);
+int account_balance_read(ClientInfo* client, int account_num);
+int eod_pending(const ClientInfo* client, int account_num);
+int eod_inflight(const ClientInfo* client, int account_num);
+int eod_fee_due(const ClientInfo* client, int account_num);
+void eod_rule(int64_t balance, int64_t* gain, int64_t* fee);
+void eod_fold(ClientInfo* client);
+void eod_apply_client(ClientInfo* client, const int32_t* deltas, uint32_t epoch, uint64_t lsn, uint32_t stamp);
+void eod_replay(const WalHeader* h, const void* body);
+bool eod_start();
+void* eod_thread_func(void* arg);
+void eod_run();
+void eod_cut(uint32_t epoch);
+void* eod_compute_func(void* arg);
+void eod_commit(uint32_t epoch);
+void* eod_apply_func(void* arg);
+void eod_parallel(EodPhase phase, void* (*func)(void*), uint32_t total);
+void eod_schedule_start();
+void* eod_schedule_func(void* arg);
+uint64_t wal_committed_lsn();
+bool repl_send_all(int fd, const void* data, size_t len, int flags);
+bool repl_recv_all(int fd, void* data, size_t len);
+bool repl_send_msg(int fd, uint32_t type, uint64_t lsn, const void* body, size_t len);
+int repl_segment_open(uint64_t lsn, uint64_t* base_out);
+bool repl_send_snapshot(int fd, uint64_t next_lsn, uint64_t* start_out);
+void repl_sender_stream(ReplFollower* f, uint64_t next);
+void* repl_sender_func(void* arg);
+void* repl_listen_func(void* arg);
+void repl_start();
+bool repl_is_standby();
+void repl_apply(const WalHeader* h, const void* body);
+bool repl_install_snapshot(int fd, uint64_t start_lsn, uint64_t len, char* buf);
+void repl_receive(int fd, char* buf);
+int repl_connect();
+void* repl_follower_func(void* arg);
+void repl_follow();
+void shard_parse_list(const char* list);
+int shard_of(const char* client_id);
+bool shard_owns(const char* client_id);
+bool shard_peer_send(int fd, uint8_t op, uint8_t status, const void* body, uint32_t len);
+int shard_peer_recv(int fd, unsigned char* frame, uint32_t cap, uint32_t* len_out);
+int shard_peer_connect(int index);
+void shard_peer_drop(int index);
+BankStatus shard_call(int index, uint8_t op, const void* body, uint32_t len,
+                      unsigned char* reply, uint32_t reply_cap, uint32_t* reply_len);
+uint64_t shard_txid_get(const unsigned char* p);
+void shard_txid_put(unsigned char* p, uint64_t txid);
+ShardDecision* shard_decision_add(uint64_t txid);
+ShardDecision* shard_decision_find(uint64_t txid);
+void shard_decision_remove(uint64_t txid);
+ShardPrepared* shard_prepared_find(uint64_t txid);
+void shard_prepared_add(ShardPrepared* p);
+void shard_prepared_remove(ShardPrepared* p);
+void shard_track(const WalHeader* h, const void* body);
+uint64_t shard_prune_floor(uint64_t start_lsn);
+BankStatus shard_lookup_accounts(int index, const char* client_id, char names[][50], int* count_out);
+BankStatus shard_commit(const TransferLeg* legs, int count, int* failed_leg,
+                        int* balance_out, char* bank_out);
+bool shard_decision_ack(uint64_t txid, int index);
+void shard_resolve_prepared();
+BankStatus bank_deposit_remote(int shard_index, const char* target_id, int account_num,
+                               int amount, int* balance_out, char* bank_out);
+bool lock_clients_timed(ClientInfo** clients, int count, int timeout_ms);
+int shard_prepared_clients(const ShardPrepared* p, ClientInfo** clients);
+bool shard_prepared_reserve(ShardPrepared* p);
+void shard_prepared_release(ShardPrepared* p);
+void shard_prepared_finish(ShardPrepared* p, ClientInfo** clients, int count, bool commit,
+                           int* balance_out, char* bank_out);
+bool shard_wait_decision(int fd, const ShardPrepared* p, int* reply_op);
+bool shard_peer_prepare(int fd, const unsigned char* body, uint32_t body_len);
+bool shard_peer_handle(int fd, const unsigned char* frame, uint32_t len);
+void* shard_peer_conn_func(void* arg);
+void* shard_peer_listen_func(void* arg);
+void* shard_resolver_func(void* arg);
+void* shard_janitor_func(void* arg);
+void shard_start();
+ShardCall* shard_call_new(Session* s, ShardCallKind kind, const TransferLeg* legs, int leg_count);
+void shard_call_free(ShardCall* call);
+void session_shard_call(Session* s, ShardCall* call);
+void shard_call_run(ShardCall* call);
+void shard_call_reply(Session* s, const ShardCall* call);
+void* shard_call_func(void* arg);
+int router_owner_cached(uint32_t ip);
+int router_owner(uint32_t ip);
+void* router_lookup_func(void* arg);
+void router_attach(int epoll_fd, int client_fd, int idx, const struct sockaddr_in* addr, int owner);
+int router_connect(int index, int idx, const struct sockaddr_in* client_addr);
+void router_pipe_close(int epoll_fd, RouterPipe* pipe);
+void router_pipe_update(int epoll_fd, RouterPipe* pipe);
+void router_pipe_event(int epoll_fd, RouterPipe* pipe, int side, uint32_t events);
+void* router_thread_func(void* arg);
+void run_router();
 void* worker_thread_func(void* arg);
-void handle_client(int worker_id, int client_fd, ClientInfo* client);
-void process_account_open(int client_fd, ClientInfo* client);
-void process_deposit(int client_fd, ClientInfo* client);
-void process_withdraw(int client_fd, ClientInfo* client);
-void show_accounts(int client_fd, ClientInfo* client);
-int get_menu_choice(char* message);
-
-int main() {
-    int server_fd, client_fd;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    char client_ip[INET_ADDRSTRLEN];
+void handle_client(int worker_id, Connection conn, ClientInfo* client);
+void parse_options(int argc, char* argv[]);
+int create_listener(int port);
+void listener_probe(int port);
+void listener_set_open(ListenerSet* set);
+int accept_connection(ListenerSet* set, int idx, Connection* conn);
+int accept_admit(ListenerSet* set, int idx, int client_fd, const struct sockaddr_in* addr, Connection* conn);
+int accept_client(ListenerSet* set, Connection* conn);
+void* acceptor_thread_func(void* arg);
+void run_thread_server();
+void run_epoll_server();
+void reactor_accept(Reactor* reactor, int idx);
+Session* reactor_new_session(Reactor* reactor, Connection conn);
+void reactor_arm_timer(Reactor* reactor, Session* s);
+void* reactor_thread_func(void* arg);
+void reactor_close_session(Reactor* reactor, Session* s);
+void reactor_after_input(Reactor* reactor, Session* s);
+void reactor_update_session(Reactor* reactor, Session* s);
+void reactor_wake_durable(Reactor* reactor);
+void reactor_shard_done(Reactor* reactor);
+void timer_arm(TimerWheel* wheel, Session* s, uint64_t deadline_ns);
+void timer_disarm(TimerWheel* wheel, Session* s);
+int timer_advance(Reactor* reactor, uint64_t now);
+int timer_wait_ms(uint64_t now);
+bool uring_supported();
+int uring_init(Uring* ring, unsigned entries, unsigned flags);
+struct io_uring_sqe* uring_get_sqe(Uring* ring);
+int uring_enter(Uring* ring, unsigned wait_nr, int timeout_ms);
+void uring_reactor_init(Reactor* reactor);
+void* uring_reactor_thread_func(void* arg);
+void uring_post_accept(Reactor* reactor, int idx);
+void uring_post_wake(Reactor* reactor);
+void uring_post_cancel(Reactor* reactor, Session* s);
+void uring_update_session(Reactor* reactor, Session* s);
+void uring_on_session(Reactor* reactor, Session* s, UringOp op, int res);
+uint64_t session_deadline(Session* s, bool* idle);
+void session_expire(Session* s, bool idle);
+void session_init(Session* s, Connection conn, int window_id, ClientInfo* client);
+void session_destroy(Session* s);
+void session_send(Session* s, const char* data, size_t len);
+void session_send_static(Session* s, const char* text);
+void session_printf(Session* s, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+bool session_add_frag(Session* s, const char* data, size_t offset, size_t len);
+bool session_out_reserve(Session* s, size_t len);
+int session_out_iov(Session* s, struct iovec* iov);
+void session_out_advance(Session* s, size_t n);
+int session_flush(Session* s);
+void session_start(Session* s);
+void session_on_bytes(Session* s, char* data, size_t len);
+bool session_in_append(Session* s, const char* data, size_t len);
+void session_in_consume(Session* s, size_t pos);
+void text_on_bytes(Session* s, const char* data, size_t len);
+void session_on_input(Session* s, char* input);
+void session_prompt_menu(Session* s);
+void session_end_task(Session* s);
+void process_ask_more(Session* s, char* input);
+void process_account_open(Session* s);
+void process_account_open_name(Session* s, char* input);
+void process_deposit(Session* s);
+void process_deposit_target(Session* s, char* input);
+void process_deposit_target_remote(Session* s, const ShardCall* call);
+void process_deposit_account(Session* s, char* input);
+void process_deposit_amount(Session* s, char* input);
+void process_deposit_amount_remote(Session* s, const ShardCall* call);
+void process_withdraw(Session* s);
+void process_withdraw_account(Session* s, char* input);
+void process_withdraw_password(Session* s, char* input);
+void process_withdraw_amount(Session* s, char* input);
+void show_accounts(Session* s, ClientInfo* client);
+void process_balance(Session* s);
+void process_transfer(Session* s);
+void process_transfer_account(Session* s, char* input);
+void process_transfer_password(Session* s, char* input);
+void process_transfer_leg(Session* s, char* input);
+void process_transfer_result(Session* s, BankStatus status, int failed_leg);
+bool session_add_leg(Session* s, const TransferLeg* leg);
+void process_statement(Session* s);
+void process_statement_account(Session* s, char* input);
+void process_statement_more(Session* s, char* input);
+void statement_show_page(Session* s);
+const char* ledger_type_name(const LedgerEntry* entry);
+int classifier_new_state();
+void classifier_add(const char* keyword, Intent intent, int group);
+void classifier_build();
+void classifier_load(const char* path);
+void classifier_init();
+uint64_t classifier_scan(const char* text);
+Intent classifier_resolve(uint64_t seen, Intent first, Intent last);
+Intent classify_input(const char* text, Intent first, Intent last);
+uint32_t bin_get_u32(const unsigned char* p);
+void bin_put_u32(unsigned char* p, uint32_t v);
+uint64_t bin_get_u64(const unsigned char* p);
+void bin_put_u64(unsigned char* p, uint64_t v);
+void bin_on_bytes(Session* s, const char* data, size_t len);
+void bin_handle_frame(Session* s, const unsigned char* frame, uint32_t len);
+void bin_reply(Session* s, uint8_t op, uint8_t status, uint32_t request_id,
+               const void* body, uint32_t body_len);
+void bin_deposit_remote_result(Session* s, const ShardCall* call);
+void bin_transfer_result(Session* s, uint8_t op, uint32_t request_id, BankStatus status,
+                         uint32_t count, int failed_leg);
+void run_benchmark(const char* name);
+void run_self_test(const char* name);
+uint64_t now_ns();
+void hist_record(Histogram* h, uint64_t ns);
+void metrics_op_done(MetricOp op, BankStatus status, uint64_t start_ns);
+void client_lock(ClientInfo* client);
+double busy_percent(const struct timespec* opened, uint64_t busy_ns);
+void metrics_write_hist(FILE* out, const char* name, const char* labels, Histogram* h);
+void metrics_write(FILE* out);
+void admin_cmd_metrics(FILE* out, const char* args);
+void admin_cmd_help(FILE* out, const char* args);
+void admin_cmd_register(FILE* out, const char* args);
+void admin_cmd_repl(FILE* out, const char* args);
+void admin_cmd_promote(FILE* out, const char* args);
+void admin_cmd_hot(FILE* out, const char* args);
+void admin_cmd_eod(FILE* out, const char* args);
+int admin_create_listener(int port);
+void admin_handle(int fd);
+void* admin_thread_func(void* arg);
+void admin_start();
+char log_parse_spec(const char* fmt, char* len_mod, const char** end);
+LogRing* log_thread_ring();
+void log_ring_release(void* arg);
+void log_write(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_format(FILE* out, const LogRecordHeader* h);
+LogRecordHeader* log_ring_peek(LogRing* ring);
+int log_drain();
+unsigned long log_dropped();
+void* log_thread_func(void* arg);
+void log_flush_at_exit();
+void log_init();
 
-    // 초기화
-    init_database();
-    init_waiting_queue();
-    pthread_mutex_init(&db_mutex, NULL);
-    pthread_mutex_init(&workers_mutex, NULL);
+// 로그 남기기 (수준이 낮으면 인자도 평가하지 않는다)
+#define LOG_AT(level, ...) do { if ((level) >= log_level) log_write((level), __VA_ARGS__); } while (0)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
 
-    // 워커 스레드 풀 생성 (5개 창구 미리 준비)
-    for (int i = 0; i < MAX_WORKERS; i++) {
-        workers[i].worker_id = i + 1;
-        workers[i].is_busy = false;
-        workers[i].client_fd = -1;
-        pthread_create(&workers[i].thread, NULL, worker_thread_func, &workers[i]);
-        printf("✅ 창구 %d번 준비 완료\n", i + 1);
-    }
+// 관리 명령 표
+AdminCommand admin_commands[] = {
+    {"metrics",  admin_cmd_metrics,  "지표 출력 (Prometheus 텍스트 형식, HTTP GET /metrics도 가능)"},
+    {"register", admin_cmd_register, "고객 등록: register <ID> <IPv4> (비밀번호 = IP 마지막 숫자)"},
+    {"repl",     admin_cmd_repl,     "복제 상태 (주 서버: 대기 서버별 보낸 LSN, 대기 서버: 반영 LSN과 지연)"},
+    {"promote",  admin_cmd_promote,  "대기 서버를 주 서버로 전환 (복제를 멈추고 영업 시작)"},
+    {"hot",      admin_cmd_hot,      "인기 통장 지정: hot <ID> <통장번호> (인자 없으면 목록과 쌓인 입금)"},
+    {"eod",      admin_cmd_eod,      "일 마감 (이자/수수료): eod run으로 시작, 인자 없으면 진행 상황과 지난 회차"},
+    {"help",     admin_cmd_help,     "명령 목록"},
+    {NULL, NULL, NULL}
+};
 
-    // 소켓 생성
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1) {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
-    }
+// 기본 분류 키워드 (--keywords 파일로 더할 수 있다, 영문은 대소문자 무시)
+IntentKeyword default_keywords[] = {
+    {"통장", INTENT_OPEN, 0},
+    {"개설", INTENT_OPEN, 1},
+    {"입금", INTENT_DEPOSIT, 0},
+    {"출금", INTENT_WITHDRAW, 0},
+    {"이체", INTENT_TRANSFER, 0},
+    {"송금", INTENT_TRANSFER, 0},
+    {"조회", INTENT_BALANCE, 0},
+    {"잔액", INTENT_BALANCE, 0},
+    {"내역", INTENT_STATEMENT, 0},
+    {"명세", INTENT_STATEMENT, 0},
+    {"아니", INTENT_NO, 0},
+    {"없",   INTENT_NO, 0},
+    {"종료", INTENT_NO, 0},
+    {"끝",   INTENT_NO, 0},
+    {"no",   INTENT_NO, 0},
+    {NULL, INTENT_NONE, 0}
+};
 
-    // SO_REUSEADDR 설정 (재시작 시 즉시 바인딩 가능)
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+int main(int argc, char* argv[]) {
+    struct timespec started, ready;
 
-    // 바인딩
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-    
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        exit(EXIT_FAILURE);
-    }
+    clock_gettime(CLOCK_MONOTONIC, &started);
 
-    // 리슨
-    if (listen(server_fd, 10) < 0) {
-        perror("listen failed");
-        exit(EXIT_FAILURE);
+    parse_options(argc, argv);
+    if (bench_name == NULL && self_test_name == NULL) {
+        log_init();
     }
 
-    printf("\n🏦 ========== 은행 영업 시작 ==========\n");
-    printf("📍 포트: %d\n", PORT);
-    printf("👥 총 창구 수: %d개\n", MAX_WORKERS);
-    printf("=====================================\n\n");
-
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        
-        // 클라이언트 연결 수락
-        client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-        if (client_fd < 0) {
-            perror("accept failed");
-            continue;
-        }
-
-        // 클라이언트 IP 추출
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        printf("\n📞 새 고객 접속: %s\n", client_ip);
-
-        // IP 확인 (10.10.16.200 ~ 10.10.16.224만 허용)
-        ClientInfo* client = find_client_by_ip(client_ip);
-        if (client == NULL) {
-            char* error_msg = "❌ 등록되지 않은 IP입니다. 연결을 종료합니다.\n";
-            send(client_fd, error_msg, strlen(error_msg), 0);
-            close(client_fd);
-            printf("⚠️  등록되지 않은 IP 거부: %s\n", client_ip);
-            continue;
+    // 라우터는 고객 DB 없이 연결만 넘긴다
+    if (shard.router) {
+        if (admin_port > 0) {
+            admin_start();
         }
+        run_router();
+        return 0;
+    }
 
-        printf("✅ 인증 성공: %s\n", client->client_id);
+    // 초기화 (고객이 속한 지점을 CRC32로 정하므로 표를 먼저 만든다)
+    crc32_init();
+    init_database();
+    init_waiting_queue();
+    classifier_init();
 
-        // 비어있는 창구 찾기
-        pthread_mutex_lock(&workers_mutex);
-        int assigned = -1;
-        for (int i = 0; i < MAX_WORKERS; i++) {
-            if (!workers[i].is_busy) {
-                workers[i].is_busy = true;
-                workers[i].client_fd = client_fd;
-                assigned = i;
-                printf("🪟 창구 %d번에 배정되었습니다.\n", i + 1);
-                
-                // 워커 스레드 깨우기 (broadcast로 모든 워커 깨움)
-                pthread_cond_broadcast(&waiting_queue.cond);
-                break;
-            }
-        }
-        pthread_mutex_unlock(&workers_mutex);
+    if (bench_name != NULL) {
+        run_benchmark(bench_name);
+        return 0;
+    }
+    if (self_test_name != NULL) {
+        run_self_test(self_test_name);
+        return 0;
+    }
 
-        // 모든 창구가 사용 중이면 대기 큐에 추가
-        if (assigned == -1) {
-            printf("⏳ 모든 창구가 사용 중입니다. 대기 큐에 추가합니다.\n");
-            char* wait_msg = "⏳ 현재 모든 창구가 사용 중입니다. 잠시만 기다려주세요...\n";
-            send(client_fd, wait_msg, strlen(wait_msg), 0);
-            enqueue(client_fd);
-        }
+    // uring 모드는 커널이 지원할 때만 (아니면 같은 리액터 구조의 epoll 모드로)
+    if (server_mode == MODE_URING && !uring_supported()) {
+        LOG_WARN("⚠️  이 커널은 io_uring을 지원하지 않습니다. epoll 모드로 실행합니다.\n");
+        server_mode = MODE_EPOLL;
     }
 
-    close(server_fd);
-    return 0;
-}
+    // 로그 복구 후 영업 시작 (WAL이 없으면 원장도 빈 채로 시작한다)
+    if (!wal_disabled) {
+        wal_open();
+    } else {
+        ledger_open(0);
+    }
 
-// 데이터베이스 초기화
-void init_database() {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        sprintf(client_db[i].client_id, "pi%d", 200 + i);
-        client_db[i].ip_last_digit = 200 + i;
-        client_db[i].account_count = 0;
-        
-        for (int j = 0; j < MAX_ACCOUNTS; j++) {
-            client_db[i].accounts[j].is_active = false;
-            client_db[i].accounts[j].balance = 0;
-            memset(client_db[i].accounts[j].bank_name, 0, 50);
-        }
+    // 대기 서버는 관리 소켓만 열고 promote 될 때까지 주 서버의 로그를 받는다
+    if (admin_port > 0) {
+        admin_start();
+    }
+    if (repl.primary != NULL) {
+        repl_follow();
     }
-    printf("💾 클라이언트 DB 초기화 완료 (pi200 ~ pi224)\n");
-}
 
-// 대기 큐 초기화
-void init_waiting_queue() {
-    waiting_queue.front = 0;
-    waiting_queue.rear = 0;
-    waiting_queue.count = 0;
-    pthread_mutex_init(&waiting_queue.mutex, NULL);
-    pthread_cond_init(&waiting_queue.cond, NULL);
-}
+    // 인기 통장 지정 (복구가 끝나 통장이 모두 있을 때)
+    if (hot_accounts_list != NULL) {
+        hot_enable_list(hot_accounts_list);
+    }
 
-// 대기 큐에 추가
-void enqueue(int client_fd) {
-    pthread_mutex_lock(&waiting_queue.mutex);
-    if (waiting_queue.count < MAX_QUEUE) {
-        waiting_queue.queue[waiting_queue.rear] = client_fd;
-        waiting_queue.rear = (waiting_queue.rear + 1) % MAX_QUEUE;
-        waiting_queue.count++;
-        printf("🎫 번호표 발급: 대기 인원 %d명\n", waiting_queue.count);
+    // 지점 간 포트를 열고, 재시작 전에 준비한 거래의 고객을 잠근 뒤에 영업을 시작한다
+    if (shard.count > 0) {
+        shard_start();
     }
-    pthread_mutex_unlock(&waiting_queue.mutex);
-}
 
-// 대기 큐에서 꺼내기
-int dequeue() {
-    int client_fd = -1;
-    pthread_mutex_lock(&waiting_queue.mutex);
-    if (waiting_queue.count > 0) {
-        client_fd = waiting_queue.queue[waiting_queue.front];
-        waiting_queue.front = (waiting_queue.front + 1) % MAX_QUEUE;
-        waiting_queue.count--;
-        printf("📢 대기 고객 호출: 남은 대기 인원 %d명\n", waiting_queue.count);
+    if (eod.at_minute >= 0) {
+        eod_schedule_start();
     }
-    pthread_mutex_unlock(&waiting_queue.mutex);
-    return client_fd;
-}
 
-// IP로 클라이언트 찾기
-ClientInfo* find_client_by_ip(char* ip) {
-    // IP 형식: 10.10.16.XXX
-    int last_octet;
-    if (sscanf(ip, "10.10.16.%d", &last_octet) != 1) {
-        // 로컬 테스트를 위해 127.0.0.1도 허용 (pi200으로 매핑)
-        if (strcmp(ip, "127.0.0.1") == 0) {
-            return &client_db[0]; // pi200
-        }
-        return NULL;
+    // 대화형 포트와 바이너리 포트: 수락 스레드(epoll 모드는 리액터)마다 한 벌씩
+    // SO_REUSEPORT는 같은 사용자의 다른 서버와도 포트를 나누므로 먼저 비어 있는지 확인한다
+    listener_probe(text_port);
+    if (binary_port > 0) {
+        listener_probe(binary_port);
     }
-    
-    if (last_octet < 200 || last_octet > 224) {
-        return NULL;
+    listener_count = (server_mode == MODE_THREAD) ? acceptor_count : reactor_count;
+    listeners = calloc(listener_count, sizeof(ListenerSet));
+    if (listeners == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < listener_count; i++) {
+        listener_set_open(&listeners[i]);
     }
-    
-    return &client_db[last_octet - 200];
-}
 
-// 워커 스레드 함수
-void* worker_thread_func(void* arg) {
-    WorkerThread* worker = (WorkerThread*)arg;
-    
-    while (1) {
-        // 업무 대기
-        pthread_mutex_lock(&workers_mutex);
-        while (!worker->is_busy) {
-            pthread_cond_wait(&waiting_queue.cond, &workers_mutex);
-        }
-        int client_fd = worker->client_fd;
-        pthread_mutex_unlock(&workers_mutex);
+    if (repl.port > 0) {
+        repl_start();
+    }
 
-        if (client_fd == -1) continue;
+    clock_gettime(CLOCK_MONOTONIC, &ready);
+    startup_stats.total_ms = elapsed_ms(&started, &ready);
+    LOG_INFO("⏱️  기동 시간: %.1fms (스냅샷 %.1fms, WAL %ld건 %.1fms)\n",
+        startup_stats.total_ms, startup_stats.snapshot_ms,
+        startup_stats.wal_records, startup_stats.replay_ms);
 
-        // 클라이언트 IP로 정보 찾기
-        struct sockaddr_in addr;
-        socklen_t addr_len = sizeof(addr);
-        getpeername(client_fd, (struct sockaddr*)&addr, &addr_len);
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        
-        ClientInfo* client = find_client_by_ip(client_ip);
-        if (client) {
-            handle_client(worker->worker_id, client_fd, client);
-        }
+    if (server_mode != MODE_THREAD) {
+        run_epoll_server();
+    } else {
+        run_thread_server();
+    }
 
-        // 업무 종료
-        close(client_fd);
-        printf("🪟 창구 %d번 업무 종료. 대기 상태로 전환.\n", worker->worker_id);
-        
-        // 다음 대기 고객 확인
-        pthread_mutex_lock(&workers_mutex);
-        int next_client = dequeue();
-        if (next_client != -1) {
-            // 대기 중인 고객이 있으면 바로 처리 (is_busy 상태 유지)
-            worker->client_fd = next_client;
-            worker->is_busy = true;  // 명시적으로 유지
-            printf("📢 창구 %d번: 대기 고객 즉시 배정\n", worker->worker_id);
-            pthread_mutex_unlock(&workers_mutex);
-            // 다음 루프에서 바로 처리됨
-        } else {
-            // 대기 고객이 없으면 대기 모드로 전환
-            worker->is_busy = false;
-            worker->client_fd = -1;
-            pthread_mutex_unlock(&workers_mutex);
+    for (int i = 0; i < listener_count; i++) {
+        for (int j = 0; j < listeners[i].count; j++) {
+            close(listeners[i].fds[j]);
         }
     }
-    
-    return NULL;
+    return 0;
 }
 
-// 클라이언트 처리
-void handle_client(int worker_id, int client_fd, ClientInfo* client) {
-    char buffer[BUFFER_SIZE];
-    char response[BUFFER_SIZE];
-    
-    // 환영 메시지
-    snprintf(response, BUFFER_SIZE, 
-        "\n🏦 ========== 은행 업무 시작 ==========\n"
-        "👤 고객님: %s\n"
-        "🪟 담당 창구: %d번\n"
-        "=====================================\n",
-        client->client_id, worker_id);
-    send(client_fd, response, strlen(response), 0);
-    
-    // 업무 처리 루프
-    while (1) {
-        // 업무 선택 요청
-        char* prompt = "💬 어떤 업무를 도와드릴까요?\n"
-                      "   (통장 개설 / 입금 / 출금 중 원하시는 업무를 말씀해주세요)\n\n"
-                      "입력: ";
-        send(client_fd, prompt, strlen(prompt), 0);
-        
-        // 클라이언트 요청 받기
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-        if (bytes_read <= 0) {
-            printf("⚠️  [창구 %d] %s 연결 종료\n", worker_id, client->client_id);
-            return;
-        }
-        
-        printf("💬 [창구 %d] %s: %s", worker_id, client->client_id, buffer);
-        
-        // 키워드 파싱하여 메뉴 선택
-        int menu = get_menu_choice(buffer);
-        
-        switch (menu) {
-            case 1: // 통장 개설
-                process_account_open(client_fd, client);
+// 명령행 옵션 처리
+void parse_options(int argc, char* argv[]) {
+    static struct option long_options[] = {
+        {"mode",     required_argument, 0, 'm'},
+        {"reactors", required_argument, 0, 'r'},
+        {"workers",  required_argument, 0, 'n'},
+        {"min-workers", required_argument, 0, 'I'},
+        {"max-workers", required_argument, 0, 'X'},
+        {"worker-idle-sec", required_argument, 0, 'T'},
+        {"pin-cpus", no_argument,       0, 'P'},
+        {"binary-port", required_argument, 0, 'p'},
+        {"admin-port", required_argument, 0, 'A'},
+        {"log-level", required_argument, 0, 'L'},
+        {"clients",  required_argument, 0, 'C'},
+        {"max-accounts", required_argument, 0, 'K'},
+        {"keywords", required_argument, 0, 'k'},
+        {"data-dir", required_argument, 0, 'd'},
+        {"wal-sync", required_argument, 0, 'w'},
+        {"wal-interval-ms", required_argument, 0, 'W'},
+        {"no-wal",   no_argument,       0, 'N'},
+        {"snapshot-interval", required_argument, 0, 'S'},
+        {"idle-timeout", required_argument, 0, 'i'},
+        {"session-timeout", required_argument, 0, 'o'},
+        {"acceptors", required_argument, 0, 'a'},
+        {"backlog",  required_argument, 0, 'Q'},
+        {"queue-weights", required_argument, 0, 'q'},
+        {"hot-accounts", required_argument, 0, 'Y'},
+        {"client-windows", required_argument, 0, 'u'},
+        {"eod-interest", required_argument, 0, 'e'},
+        {"eod-fee",  required_argument, 0, 'f'},
+        {"eod-fee-waive", required_argument, 0, 'g'},
+        {"eod-at",   required_argument, 0, 'E'},
+        {"batch-threads", required_argument, 0, 'j'},
+        {"repl-port", required_argument, 0, 'R'},
+        {"repl-bind", required_argument, 0, 'G'},
+        {"follow",   required_argument, 0, 'F'},
+        {"port",     required_argument, 0, 'c'},
+        {"shards",   required_argument, 0, 'H'},
+        {"shard-index", required_argument, 0, 'x'},
+        {"router",   no_argument,       0, 'O'},
+        {"bench",    required_argument, 0, 'b'},
+        {"bench-seconds", required_argument, 0, 'B'},
+        {"self-test", required_argument, 0, 'Z'},
+        {"help",     no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "m:r:n:p:d:w:h", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'm':
+                if (strcmp(optarg, "thread") == 0) {
+                    server_mode = MODE_THREAD;
+                } else if (strcmp(optarg, "epoll") == 0) {
+                    server_mode = MODE_EPOLL;
+                } else if (strcmp(optarg, "uring") == 0) {
+                    server_mode = MODE_URING;
+                } else {
+                    fprintf(stderr, "❌ 알 수 없는 모드: %s (thread/epoll/uring)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
                 break;
-            case 2: // 입금
-                process_deposit(client_fd, client);
+            case 'r':
+                reactor_count = atoi(optarg);
+                if (reactor_count < 1) {
+                    fprintf(stderr, "❌ 리액터 수는 1 이상이어야 합니다.\n");
+                    exit(EXIT_FAILURE);
+                }
                 break;
-            case 3: // 출금
-                process_withdraw(client_fd, client);
+            case 'n':
+                min_workers = max_workers = atoi(optarg);
                 break;
-            default:
-                snprintf(response, BUFFER_SIZE, 
-                    "❌ 요청하신 업무를 찾을 수 없습니다.\n"
-                    "   '통장 개설', '입금', '출금' 중 하나를 말씀해주세요.\n\n");
-                send(client_fd, response, strlen(response), 0);
-                continue; // 다시 업무 선택으로
-        }
-        
-        // 추가 업무 여부 확인
-        char* ask_more = "\n💡 추가로 처리하실 업무가 있으신가요? (예/아니오): ";
-        send(client_fd, ask_more, strlen(ask_more), 0);
-        printf("📤 [창구 %d] 추가 업무 질문 전송\n", worker_id);
-        
-        memset(buffer, 0, BUFFER_SIZE);
-        bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-        if (bytes_read <= 0) {
-            printf("⚠️  [창구 %d] %s 연결 종료\n", worker_id, client->client_id);
-            return;
+            case 'I':
+                min_workers = atoi(optarg);
+                break;
+            case 'X':
+                max_workers = atoi(optarg);
+                break;
+            case 'T':
+                worker_idle_sec = atoi(optarg);
+                if (worker_idle_sec < 1) worker_idle_sec = 1;
+                break;
+            case 'P':
+                pin_cpus = true;
+                break;
+            case 'p':
+                binary_port = atoi(optarg);
+                break;
+            case 'A':
+                admin_port = atoi(optarg);
+                break;
+            case 'C':
+                initial_clients = atoi(optarg);
+                if (initial_clients < 1 || initial_clients > CLIENT_CHUNK * MAX_CLIENT_CHUNKS) {
+                    fprintf(stderr, "❌ 고객 수는 1 ~ %d 사이여야 합니다.\n",
+                            CLIENT_CHUNK * MAX_CLIENT_CHUNKS);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'K':
+                max_accounts = atoi(optarg);
+                if (max_accounts < 1 || max_accounts > MAX_ACCOUNTS_LIMIT) {
+                    fprintf(stderr, "❌ 고객당 통장 수는 1 ~ %d 사이여야 합니다.\n", MAX_ACCOUNTS_LIMIT);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'k':
+                keywords_path = optarg;
+                break;
+            case 'L':
+                if (strcmp(optarg, "debug") == 0) {
+                    log_level = LOG_LEVEL_DEBUG;
+                } else if (strcmp(optarg, "info") == 0) {
+                    log_level = LOG_LEVEL_INFO;
+                } else if (strcmp(optarg, "warn") == 0) {
+                    log_level = LOG_LEVEL_WARN;
+                } else if (strcmp(optarg, "error") == 0) {
+                    log_level = LOG_LEVEL_ERROR;
+                } else {
+                    fprintf(stderr, "❌ 알 수 없는 로그 수준: %s (debug/info/warn/error)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'd':
+                data_dir = optarg;
+                break;
+            case 'w':
+                if (strcmp(optarg, "fsync") == 0) {
+                    wal.policy = WAL_SYNC_FSYNC;
+                } else if (strcmp(optarg, "interval") == 0) {
+                    wal.policy = WAL_SYNC_INTERVAL;
+                } else if (strcmp(optarg, "none") == 0) {
+                    wal.policy = WAL_SYNC_NONE;
+                } else {
+                    fprintf(stderr, "❌ 알 수 없는 WAL 동기화 정책: %s (fsync/interval/none)\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'W':
+                wal_interval_ms = atoi(optarg);
+                if (wal_interval_ms < 1) wal_interval_ms = 1;
+                break;
+            case 'N':
+                wal_disabled = true;
+                break;
+            case 'S':
+                snapshot_interval = atoi(optarg);
+                if (snapshot_interval < 0) snapshot_interval = 0;
+                break;
+            case 'i':
+                idle_timeout = atoi(optarg);
+                if (idle_timeout < 0) idle_timeout = 0;
+                break;
+            case 'o':
+                session_timeout = atoi(optarg);
+                if (session_timeout < 0) session_timeout = 0;
+                break;
+            case 'a':
+                acceptor_count = atoi(optarg);
+                if (acceptor_count < 1) {
+                    fprintf(stderr, "❌ 수락 스레드 수는 1 이상이어야 합니다.\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'Q':
+                listen_backlog = atoi(optarg);
+                if (listen_backlog < 1) {
+                    fprintf(stderr, "❌ listen 대기열 길이는 1 이상이어야 합니다.\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'q': {
+                int* w = waiting_queue.weights;
+                if (sscanf(optarg, "%d,%d,%d", &w[0], &w[1], &w[2]) != 3 ||
+                    w[0] < 1 || w[0] > QUEUE_MAX_WEIGHT || w[1] < 1 || w[1] > QUEUE_MAX_WEIGHT ||
+                    w[2] < 1 || w[2] > QUEUE_MAX_WEIGHT) {
+                    fprintf(stderr, "❌ 대기 등급 가중치는 빠른,일반,후순위 순서로 1 ~ %d 사이 세 값입니다. (예: 4,2,1)\n",
+                            QUEUE_MAX_WEIGHT);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            }
+            case 'Y':
+                hot_accounts_list = optarg;
+                break;
+            case 'u':
+                client_windows = atoi(optarg);
+                if (client_windows < 0) client_windows = 0;
+                break;
+            case 'e':
+                eod.interest_ppm = atoi(optarg);
+                if (eod.interest_ppm < 0 || eod.interest_ppm > 1000000) {
+                    fprintf(stderr, "❌ 일 마감 이자는 0 ~ 1000000 ppm 사이여야 합니다.\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'f':
+                eod.fee = atoi(optarg);
+                if (eod.fee < 0) eod.fee = 0;
+                break;
+            case 'g':
+                eod.fee_waive = atoi(optarg);
+                if (eod.fee_waive < 0) eod.fee_waive = 0;
+                break;
+            case 'E': {
+                int hour, minute;
+                if (sscanf(optarg, "%d:%d", &hour, &minute) != 2 ||
+                    hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+                    fprintf(stderr, "❌ 일 마감 시각은 HH:MM 형식입니다. (예: 23:30)\n");
+                    exit(EXIT_FAILURE);
+                }
+                eod.at_minute = hour * 60 + minute;
+                break;
+            }
+            case 'j':
+                eod.threads = atoi(optarg);
+                if (eod.threads < 0) eod.threads = 0;
+                break;
+            case 'R':
+                repl.port = atoi(optarg);
+                break;
+            case 'G':
+                repl.bind_addr = optarg;
+                break;
+            case 'F':
+                repl.primary = optarg;
+                break;
+            case 'c':
+                text_port = atoi(optarg);
+                break;
+            case 'H':
+                shard_parse_list(optarg);
+                break;
+            case 'x':
+                shard.index = atoi(optarg);
+                break;
+            case 'O':
+                shard.router = true;
+                break;
+            case 'b':
+                bench_name = optarg;
+                break;
+            case 'B':
+                bench_seconds = atoi(optarg);
+                if (bench_seconds < 1) bench_seconds = 1;
+                break;
+            case 'Z':
+                self_test_name = optarg;
+                break;
+            case 'h':
+            default:
+                printf("사용법: %s [옵션]\n"
+                       "  -m, --mode MODE      실행 모드: thread(기본), epoll, uring (io_uring, 없으면 epoll)\n"
+                       "  -r, --reactors N     epoll/uring 모드 리액터 스레드 수 (기본: CPU 수)\n"
+                       "  -n, --workers N      thread 모드 창구 수 고정 (최소 = 최대 = N)\n"
+                       "      --min-workers N  항상 열어 두는 창구 수 (기본: 5)\n"
+                       "      --max-workers N  손님이 밀릴 때 늘릴 수 있는 최대 창구 수 (기본: CPU 수 x 4)\n"
+                       "      --worker-idle-sec N  최소 수를 넘는 창구를 닫기까지의 유휴 시간 (기본: 30)\n"
+                       "      --pin-cpus       창구/리액터 스레드를 CPU에 고정\n"
+                       "  -p, --binary-port P  바이너리 프로토콜 포트 (기본: 8081, 0이면 끔)\n"
+                       "      --admin-port P   관리 소켓 포트 (127.0.0.1, 기본: 8090, 0이면 끔)\n"
+                       "      --log-level L    로그 수준: debug, info(기본), warn, error\n"
+                       "      --clients N      기동 시 만드는 기본 고객 수 (pi200부터, 기본: 25)\n"
+                       "      --max-accounts N 고객당 최대 통장 수 (기본: 5, 최대 16)\n"
+                       "      --keywords FILE  업무 분류 키워드 추가 (줄마다 \"<의도>[.<조건>] <키워드>\")\n"
+                       "  -d, --data-dir DIR   데이터 디렉터리 (기본: bank_data)\n"
+                       "  -w, --wal-sync P     WAL 동기화 정책: fsync(기본), interval, none\n"
+                       "      --wal-interval-ms N  interval 정책의 fdatasync 주기 (기본: 10)\n"
+                       "      --no-wal         WAL 끄기 (재시작하면 모든 계좌가 사라진다)\n"
+                       "      --snapshot-interval N  스냅샷 주기 초 (기본: 60, 0이면 끔)\n"
+                       "      --idle-timeout N 입력 없이 N초가 지나면 세션 종료 (기본: 120, 0이면 끔)\n"
+                       "      --session-timeout N  세션 최대 상담 시간 초 (기본: 1800, 0이면 끔)\n"
+                       "      --acceptors N    thread 모드 수락 스레드 수, 스레드마다 SO_REUSEPORT 소켓 (기본: CPU 수)\n"
+                       "      --backlog N      listen 대기열 길이 (기본: 1024)\n"
+                       "      --queue-weights E,N,B  thread 모드 대기 등급 가중치: 빠른, 일반, 후순위 (기본: 4,2,1)\n"
+                       "      --client-windows N  고객 한 명이 이만큼 창구를 쓰면 다음 연결은 후순위 (기본: 2, 0이면 끔)\n"
+                       "      --hot-accounts LIST  입금이 몰리는 통장 ID:통장번호,... (입금을 스레드별 누적기에 모은다)\n"
+                       "      --eod-interest N 일 마감 이자, 잔고의 백만분율 (기본: 55 = 하루 0.0055%%)\n"
+                       "      --eod-fee N      일 마감 계좌 유지 수수료 (기본: 0, 없음)\n"
+                       "      --eod-fee-waive N  잔고가 이만큼 이상이면 수수료 면제 (기본: 100000)\n"
+                       "      --eod-at HH:MM   매일 이 시각에 일 마감 (기본: 관리 명령 eod run으로만)\n"
+                       "      --batch-threads N  일 마감 계산/반영 스레드 수 (기본: CPU 수)\n"
+                       "      --repl-port P    대기 서버에 WAL을 흘려보낼 복제 포트 (기본: 0, 끔)\n"
+                       "      --repl-bind ADDR 복제 포트 주소 (기본: 127.0.0.1)\n"
+                       "      --follow HOST:PORT  대기 서버로 시작: 주 서버의 WAL을 받아 반영 (영업은 promote 후)\n"
+                       "      --port P         대화형 포트 (기본: 8080)\n"
+                       "      --shards LIST    지점 목록 HOST:PORT,... (PORT 대화형, +1 바이너리, +2 지점 간)\n"
+                       "      --shard-index K  이 서버가 맡을 지점 번호 (0부터, 포트는 목록의 K번째 항목)\n"
+                       "      --router         지점 서버 대신 라우터로 실행: 고객 연결을 그 고객의 지점으로 넘긴다\n"
+                       "      --bench NAME     벤치마크 실행 후 종료 (locks, classify, hot, eod)\n"
+                       "      --bench-seconds S  벤치마크 구간별 측정 시간 (기본: 2)\n"
+                       "      --self-test NAME 자체 시험 실행 후 종료 (ledger)\n"
+                       "  -h, --help           도움말\n", argv[0]);
+                exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
         }
-        
-        printf("📥 [창구 %d] 추가 업무 응답: %s", worker_id, buffer);
-        
-        // "아니오", "아니요", "없어", "없습니다", "종료", "끝" 등으로 종료
-        if (strstr(buffer, "아니") != NULL || 
-            strstr(buffer, "없") != NULL || 
-            strstr(buffer, "종료") != NULL || 
-            strstr(buffer, "끝") != NULL ||
-            strstr(buffer, "no") != NULL ||
-            strstr(buffer, "No") != NULL ||
-            strstr(buffer, "NO") != NULL) {
-            break; // 업무 종료
+    }
+
+    if (wal_disabled && (repl.port > 0 || repl.primary != NULL)) {
+        fprintf(stderr, "❌ 복제는 WAL이 있어야 합니다 (--no-wal과 함께 쓸 수 없습니다).\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // 지점: 포트는 --shards 목록의 자기 항목에서 정한다 (라우터는 --port/--binary-port로 받는다)
+    if (shard.router && shard.count == 0) {
+        fprintf(stderr, "❌ --router는 --shards와 함께 써야 합니다.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (shard.count > 0 && !shard.router) {
+        if (shard.index < 0 || shard.index >= shard.count) {
+            fprintf(stderr, "❌ --shard-index는 0 ~ %d 사이여야 합니다.\n", shard.count - 1);
+            exit(EXIT_FAILURE);
         }
-        
-        // "예", "네", "있어요", "yes" 등으로 계속
-        printf("🔄 [창구 %d] %s 추가 업무 진행\n", worker_id, client->client_id);
+        text_port = shard.addrs[shard.index].port;
+        if (binary_port > 0) binary_port = text_port + 1;
+    } else if (shard.index >= 0 && !shard.router) {
+        fprintf(stderr, "❌ --shard-index는 --shards와 함께 써야 합니다.\n");
+        exit(EXIT_FAILURE);
     }
-    
-    // 종료 메시지
-    char* goodbye = "\n✅ 업무가 완료되었습니다. 감사합니다!\n";
-    send(client_fd, goodbye, strlen(goodbye), 0);
-    
-    printf("✅ [창구 %d] %s 고객 업무 완료\n", worker_id, client->client_id);
-}
 
-// 메뉴 선택 (키워드 기반)
-int get_menu_choice(char* message) {
-    // 1번: "통장" AND "개설" 둘 다 포함
-    if (strstr(message, "통장") != NULL && strstr(message, "개설") != NULL) {
-        return 1;
+    init_cpu_list();
+    if (reactor_count == 0) {
+        reactor_count = cpu_count;
+    }
+    if (acceptor_count == 0) {
+        acceptor_count = cpu_count;
     }
-    // 2번: "입금" 포함
-    if (strstr(message, "입금") != NULL) {
-        return 2;
+
+    // 창구 수: 명시하지 않으면 최대는 CPU 수에 비례 (상담은 대부분 손님 입력을 기다리는 시간이다)
+    if (max_workers == 0) {
+        max_workers = cpu_count * 4;
+        if (max_workers < min_workers) max_workers = min_workers;
     }
-    // 3번: "출금" 포함
-    if (strstr(message, "출금") != NULL) {
-        return 3;
+    if (min_workers < 1 || max_workers > MAX_WORKERS || min_workers > max_workers) {
+        fprintf(stderr, "❌ 창구 수는 1 <= 최소 <= 최대 <= %d 이어야 합니다.\n", MAX_WORKERS);
+        exit(EXIT_FAILURE);
     }
-    return 0; // 알 수 없는 요청
 }
 
-// 통장 개설 처리
-void process_account_open(int client_fd, ClientInfo* client) {
-    char buffer[BUFFER_SIZE];
-    char response[BUFFER_SIZE];
-    
-    pthread_mutex_lock(&db_mutex);
-    
-    // 이미 5개 통장이 있는지 확인
-    if (client->account_count >= MAX_ACCOUNTS) {
-        snprintf(response, BUFFER_SIZE, 
-            "❌ 더 이상 통장을 개설할 수 없습니다.\n"
-            "   (최대 %d개까지만 가능합니다)\n", MAX_ACCOUNTS);
-        send(client_fd, response, strlen(response), 0);
-        pthread_mutex_unlock(&db_mutex);
-        return;
+// 수신 소켓 생성 (같은 포트를 수락 스레드마다 따로 열 수 있게 SO_REUSEPORT)
+int create_listener(int port) {
+    struct sockaddr_in address;
+
+    // 소켓 생성
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd == -1) {
+        perror("socket failed");
+        exit(EXIT_FAILURE);
     }
-    
-    pthread_mutex_unlock(&db_mutex);
-    
-    // 은행명 입력 요청
-    char* prompt = "\n💳 개설할 통장의 은행명을 입력하세요: ";
-    send(client_fd, prompt, strlen(prompt), 0);
-    
-    // 은행명 받기
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read <= 0) {
-        return;
+
+    // SO_REUSEADDR 설정 (재시작 시 즉시 바인딩 가능)
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("SO_REUSEPORT failed");
+        exit(EXIT_FAILURE);
     }
+
+    // 바인딩
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
     
-    // 개행 문자 제거
-    buffer[strcspn(buffer, "\n")] = 0;
-    
-    // DB에 통장 추가
-    pthread_mutex_lock(&db_mutex);
-    
-    int idx = client->account_count;
-    strncpy(client->accounts[idx].bank_name, buffer, 49);
-    client->accounts[idx].balance = 0;
-    client->accounts[idx].is_active = true;
-    client->account_count++;
-    
-    snprintf(response, BUFFER_SIZE, 
-        "\n✅ 통장 개설이 완료되었습니다!\n"
-        "   📌 은행명: %s\n"
-        "   💰 초기 잔고: 0원\n"
-        "   📊 현재 통장 개수: %d/%d\n",
-        client->accounts[idx].bank_name, 
-        client->account_count, 
-        MAX_ACCOUNTS);
-    send(client_fd, response, strlen(response), 0);
-    
-    pthread_mutex_unlock(&db_mutex);
-    
-    printf("💳 [통장 개설] %s - %s 통장 개설 완료\n", 
-        client->client_id, client->accounts[idx].bank_name);
+    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // 리슨
+    if (listen(server_fd, listen_backlog) < 0) {
+        perror("listen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // 여러 포트를 poll/epoll로 기다리므로 accept가 막히지 않게 한다
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL, 0) | O_NONBLOCK);
+    return server_fd;
 }
 
-// 통장 목록 보여주기
-void show_accounts(int client_fd, ClientInfo* client) {
-    char response[BUFFER_SIZE * 2];
-    int offset = 0;
-    
-    pthread_mutex_lock(&db_mutex);
-    
-    offset += sprintf(response + offset, "\n📋 보유 통장 목록:\n");
-    offset += sprintf(response + offset, "=====================================\n");
-    
-    if (client->account_count == 0) {
-        offset += sprintf(response + offset, "   (보유한 통장이 없습니다)\n");
-    } else {
-        for (int i = 0; i < client->account_count; i++) {
-            if (client->accounts[i].is_active) {
-                offset += sprintf(response + offset, 
-                    "   %d. %s - 잔고: %d원\n", 
-                    i + 1, 
-                    client->accounts[i].bank_name, 
-                    client->accounts[i].balance);
-            }
-        }
+// 포트가 비어 있는지 확인 (SO_REUSEPORT 없이 바인딩해 본다)
+// 이미 떠 있는 서버가 있으면 연결을 나눠 갖지 않고 바로 종료한다.
+void listener_probe(int port) {
+    struct sockaddr_in address;
+    int opt = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd == -1) {
+        perror("socket failed");
+        exit(EXIT_FAILURE);
     }
-    offset += sprintf(response + offset, "=====================================\n");
-    
-    pthread_mutex_unlock(&db_mutex);
-    
-    send(client_fd, response, strlen(response), 0);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
 }
 
-// 입금 처리
-void process_deposit(int client_fd, ClientInfo* client) {
-    char buffer[BUFFER_SIZE];
-    char response[BUFFER_SIZE];
-    
-    // 입금 대상 ID 입력 요청
-    char* prompt = "\n💵 입금할 대상의 ID를 입력하세요 (예: pi200): ";
-    send(client_fd, prompt, strlen(prompt), 0);
-    
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read <= 0) return;
-    buffer[strcspn(buffer, "\n")] = 0;
-    
-    // 대상 클라이언트 찾기
-    ClientInfo* target = NULL;
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (strcmp(client_db[i].client_id, buffer) == 0) {
-            target = &client_db[i];
-            break;
+// 수락 스레드 하나가 쓸 수신 소켓 한 벌 (대화형, 바이너리)
+void listener_set_open(ListenerSet* set) {
+    set->count = 0;
+    set->fds[set->count++] = create_listener(text_port);
+    if (binary_port > 0) {
+        set->fds[set->count++] = create_listener(binary_port);
+    }
+    atomic_init(&set->accepted, 0);
+}
+
+// 수신 소켓 하나에서 연결 하나 수락 및 IP 인증
+// 등록되지 않은 IP는 여기서 거절하고 닫는다. 찾은 고객은 conn->client로 넘겨
+// 창구나 리액터가 주소를 다시 조회하지 않게 한다.
+// 반환값: 1 = 수락, 0 = 거절 (다음 연결을 받아도 됨), -1 = 대기 중인 연결 없음 또는 오류
+int accept_connection(ListenerSet* set, int idx, Connection* conn) {
+    struct sockaddr_in client_addr;
+    socklen_t client_len = sizeof(client_addr);
+
+    // 클라이언트 연결 수락
+    int client_fd = accept(set->fds[idx], (struct sockaddr*)&client_addr, &client_len);
+    if (client_fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept failed");
+        return -1;
+    }
+    // 수신 소켓의 O_NONBLOCK은 상속되지 않으므로 블로킹 소켓으로 시작한다
+    return accept_admit(set, idx, client_fd, &client_addr, conn);
+}
+
+// 수락한 연결의 IP 인증 (accept()와 io_uring 수락이 함께 쓴다)
+// 반환값: 1 = 수락, 0 = 거절 (소켓은 닫았다)
+int accept_admit(ListenerSet* set, int idx, int client_fd, const struct sockaddr_in* addr, Connection* conn) {
+    char client_ip[INET_ADDRSTRLEN];
+    uint64_t accepted_ns = now_ns();
+    atomic_fetch_add(&metrics.connections_accepted, 1);
+    atomic_fetch_add_explicit(&set->accepted, 1, memory_order_relaxed);
+    SessionProto proto = (idx == 0) ? PROTO_TEXT : PROTO_BINARY;
+
+    // IP 확인 (고객 디렉터리에 등록된 주소만 허용, 문자열 변환 없이 찾는다)
+    ClientInfo* client = find_client_by_addr(ntohl(addr->sin_addr.s_addr));
+    if (client == NULL) {
+        if (proto == PROTO_TEXT) {
+            char* error_msg = "❌ 등록되지 않은 IP입니다. 연결을 종료합니다.\n";
+            send(client_fd, error_msg, strlen(error_msg), MSG_NOSIGNAL);
         }
+        close(client_fd);
+        atomic_fetch_add(&metrics.auth_failed, 1);
+        inet_ntop(AF_INET, &addr->sin_addr, client_ip, INET_ADDRSTRLEN);
+        LOG_WARN("⚠️  등록되지 않은 IP 거부: %s\n", client_ip);
+        return 0;
     }
-    
-    if (target == NULL) {
-        snprintf(response, BUFFER_SIZE, "❌ 존재하지 않는 ID입니다.\n");
-        send(client_fd, response, strlen(response), 0);
-        return;
+
+    LOG_DEBUG("\n📞 새 고객 접속: %s%s\n", client->client_id, proto == PROTO_BINARY ? " (바이너리)" : "");
+    conn->client_fd = client_fd;
+    conn->proto = proto;
+    conn->client = client;
+    conn->accepted_ns = accepted_ns;
+    conn->enqueued_ns = 0;
+    return 1;
+}
+
+// 수신 소켓 묶음에서 연결이 올 때까지 기다렸다가 하나 수락. 성공 0, 실패 -1
+int accept_client(ListenerSet* set, Connection* conn) {
+    struct pollfd pfds[2];
+
+    for (int i = 0; i < set->count; i++) {
+        pfds[i].fd = set->fds[i];
+        pfds[i].events = POLLIN;
     }
-    
-    // 대상의 통장 목록 보여주기
-    pthread_mutex_lock(&db_mutex);
-    
-    if (target->account_count == 0) {
-        snprintf(response, BUFFER_SIZE, 
-            "❌ %s님은 개설된 통장이 없습니다.\n", target->client_id);
-        send(client_fd, response, strlen(response), 0);
-        pthread_mutex_unlock(&db_mutex);
-        return;
+    if (poll(pfds, set->count, -1) < 0) {
+        if (errno != EINTR) perror("poll failed");
+        return -1;
     }
-    
-    int offset = 0;
-    offset += sprintf(response + offset, "\n📋 %s님의 통장 목록:\n", target->client_id);
-    for (int i = 0; i < target->account_count; i++) {
-        if (target->accounts[i].is_active) {
-            offset += sprintf(response + offset, "   %d. %s\n", 
-                i + 1, target->accounts[i].bank_name);
+
+    for (int i = 0; i < set->count; i++) {
+        if ((pfds[i].revents & POLLIN) && accept_connection(set, i, conn) > 0) {
+            return 0;
         }
     }
-    offset += sprintf(response + offset, "\n입금할 통장 번호를 선택하세요: ");
-    send(client_fd, response, strlen(response), 0);
-    
-    pthread_mutex_unlock(&db_mutex);
-    
-    // 통장 번호 선택
-    memset(buffer, 0, BUFFER_SIZE);
-    bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read <= 0) return;
-    
-    int account_num = atoi(buffer) - 1;
-    if (account_num < 0 || account_num >= target->account_count) {
-        snprintf(response, BUFFER_SIZE, "❌ 잘못된 통장 번호입니다.\n");
-        send(client_fd, response, strlen(response), 0);
-        return;
-    }
-    
-    // 입금액 입력
-    prompt = "\n입금액을 입력하세요: ";
-    send(client_fd, prompt, strlen(prompt), 0);
-    
-    memset(buffer, 0, BUFFER_SIZE);
-    bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read <= 0) return;
-    
-    int amount = atoi(buffer);
-    if (amount <= 0) {
-        snprintf(response, BUFFER_SIZE, "❌ 올바른 금액을 입력하세요.\n");
-        send(client_fd, response, strlen(response), 0);
-        return;
+    return -1;
+}
+
+// 수락 스레드 (thread 모드): 받은 연결을 대기 큐에 넣고 쉬는 창구를 깨운다
+void* acceptor_thread_func(void* arg) {
+    ListenerSet* set = (ListenerSet*)arg;
+
+    while (1) {
+        Connection conn;
+        if (accept_client(set, &conn) < 0) {
+            continue;
+        }
+
+        // 쉬는 창구도 없고 더 열 수도 없으면 대기 안내를 먼저 보낸다
+        // (큐에 넣은 뒤에는 창구가 환영 메시지를 보내기 시작할 수 있다)
+        conn.qclass = queue_classify(&conn);
+        bool all_busy = !any_idle_worker() && atomic_load(&live_workers) >= max_workers;
+        if (all_busy && queue_class_depth(conn.qclass) < MAX_QUEUE) {
+            LOG_DEBUG("⏳ 모든 창구가 사용 중입니다. 대기 큐에 추가합니다.\n");
+            if (conn.proto == PROTO_TEXT) {
+                char* wait_msg = "⏳ 현재 모든 창구가 사용 중입니다. 잠시만 기다려주세요...\n";
+                send(conn.client_fd, wait_msg, strlen(wait_msg), MSG_NOSIGNAL);
+            }
+        }
+
+        // 대기 큐가 가득 차면 조용히 버리지 않고 고객에게 알린 뒤 연결을 닫는다
+        conn.enqueued_ns = now_ns();
+        if (!enqueue(conn)) {
+            long rejected = atomic_fetch_add(&queue_rejected, 1) + 1;
+            if (conn.proto == PROTO_TEXT) {
+                char* full_msg = "❌ 대기 인원이 너무 많습니다. 잠시 후 다시 접속해주세요. 연결을 종료합니다.\n";
+                send(conn.client_fd, full_msg, strlen(full_msg), MSG_NOSIGNAL);
+            }
+            close(conn.client_fd);
+            LOG_WARN("🚫 대기 큐 가득 참: 접속 거절 (누적 %ld명)\n", rejected);
+            continue;
+        }
+
+        // 쉬는 창구 하나만 골라서 깨우고, 없으면 창구를 하나 더 연다
+        if (!all_busy && wake_idle_worker() < 0) {
+            int idx = worker_pool_spawn();
+            if (idx >= 0) {
+                LOG_INFO("🆕 창구 %d번 추가 개설 (열린 창구 %d개, 대기 %d명)\n",
+                    idx + 1, atomic_load(&live_workers), queue_depth());
+            }
+        }
     }
-    
-    // 입금 처리
-    pthread_mutex_lock(&db_mutex);
-    target->accounts[account_num].balance += amount;
-    
-    snprintf(response, BUFFER_SIZE, 
-        "\n✅ 입금이 완료되었습니다!\n"
-        "   📌 입금 대상: %s\n"
-        "   🏦 은행: %s\n"
-        "   💰 입금액: %d원\n"
-        "   📊 입금 후 잔고: %d원\n",
-        target->client_id,
-        target->accounts[account_num].bank_name,
-        amount,
-        target->accounts[account_num].balance);
-    send(client_fd, response, strlen(response), 0);
-    
-    pthread_mutex_unlock(&db_mutex);
-    
-    printf("💵 [입금] %s → %s (%s 통장) %d원\n", 
-        client->client_id, target->client_id, 
-        target->accounts[account_num].bank_name, amount);
+
+    return NULL;
 }
 
-// 출금 처리
-void process_withdraw(int client_fd, ClientInfo* client) {
-    char buffer[BUFFER_SIZE];
-    char response[BUFFER_SIZE];
-    
-    // 본인 통장 확인
-    pthread_mutex_lock(&db_mutex);
-    
-    if (client->account_count == 0) {
-        snprintf(response, BUFFER_SIZE, 
-            "❌ 개설된 통장이 없습니다.\n"
-            "   먼저 통장을 개설해주세요.\n");
-        send(client_fd, response, strlen(response), 0);
-        pthread_mutex_unlock(&db_mutex);
-        return;
+// 스레드 모드: 창구마다 한 고객을 전담
+void run_thread_server() {
+    workers = calloc(max_workers, sizeof(WorkerThread));
+    if (workers == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
     }
-    
-    pthread_mutex_unlock(&db_mutex);
-    
-    // 통장 목록 보여주기
-    show_accounts(client_fd, client);
-    
-    // 통장 선택
-    char* prompt = "\n출금할 통장 번호를 선택하세요: ";
-    send(client_fd, prompt, strlen(prompt), 0);
-    
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read <= 0) return;
-    
-    int account_num = atoi(buffer) - 1;
-    if (account_num < 0 || account_num >= client->account_count) {
-        snprintf(response, BUFFER_SIZE, "❌ 잘못된 통장 번호입니다.\n");
-        send(client_fd, response, strlen(response), 0);
-        return;
+
+    // 최소 창구 수만큼 미리 열어 둔다 (나머지는 손님이 밀리면 연다)
+    for (int i = 0; i < min_workers; i++) {
+        int idx = worker_pool_spawn();
+        if (idx < 0) break;
+        if (workers[idx].cpu >= 0) {
+            LOG_INFO("✅ 창구 %d번 준비 완료 (CPU %d)\n", idx + 1, workers[idx].cpu);
+        } else {
+            LOG_INFO("✅ 창구 %d번 준비 완료\n", idx + 1);
+        }
     }
-    
-    // 비밀번호 확인 (IP 마지막 3자리)
-    prompt = "\n비밀번호를 입력하세요 (ID 뒷 3자리): ";
-    send(client_fd, prompt, strlen(prompt), 0);
-    
-    memset(buffer, 0, BUFFER_SIZE);
-    bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read <= 0) return;
-    
-    int password = atoi(buffer);
-    if (password != client->ip_last_digit) {
-        snprintf(response, BUFFER_SIZE, "❌ 비밀번호가 일치하지 않습니다.\n");
-        send(client_fd, response, strlen(response), 0);
-        printf("⚠️  [출금 실패] %s - 비밀번호 불일치\n", client->client_id);
-        return;
+
+    LOG_INFO("\n🏦 ========== 은행 영업 시작 ==========\n");
+    LOG_INFO("📍 포트: %d\n", text_port);
+    if (binary_port > 0) LOG_INFO("📍 바이너리 포트: %d\n", binary_port);
+    LOG_INFO("👥 창구 수: 최소 %d개, 최대 %d개 (CPU %d개)\n", min_workers, max_workers, cpu_count);
+    LOG_INFO("🚪 수락 스레드: %d개 (listen 대기열 %d)\n", acceptor_count, listen_backlog);
+    LOG_INFO("🎫 대기 등급 가중치: 빠른 %d, 일반 %d, 후순위 %d (고객당 창구 %d개까지 앞 등급)\n",
+        waiting_queue.weights[QUEUE_EXPRESS], waiting_queue.weights[QUEUE_NORMAL],
+        waiting_queue.weights[QUEUE_BULK], client_windows);
+    LOG_INFO("=====================================\n\n");
+
+    // 수락 스레드마다 자기 수신 소켓을 맡는다 (0번은 이 스레드가 직접)
+    for (int i = 1; i < acceptor_count; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, acceptor_thread_func, &listeners[i]);
+        pthread_detach(thread);
     }
-    
-    // 출금액 입력
-    prompt = "\n출금액을 입력하세요: ";
-    send(client_fd, prompt, strlen(prompt), 0);
-    
-    memset(buffer, 0, BUFFER_SIZE);
-    bytes_read = read(client_fd, buffer, BUFFER_SIZE);
-    if (bytes_read <= 0) return;
-    
-    int amount = atoi(buffer);
-    if (amount <= 0) {
-        snprintf(response, BUFFER_SIZE, "❌ 올바른 금액을 입력하세요.\n");
-        send(client_fd, response, strlen(response), 0);
-        return;
+    acceptor_thread_func(&listeners[0]);
+}
+
+// epoll/uring 모드: 소수의 리액터 스레드가 다수 세션을 이벤트 기반으로 처리
+// 리액터마다 자기 수신 소켓에서 직접 수락하므로 세션은 처음부터 끝까지 한 리액터 안에 있다.
+// uring 모드는 세션 상태 머신, 커밋 대기, 타이머 휠을 그대로 쓰고 입출력만 io_uring으로 한다.
+void run_epoll_server() {
+    bool uring = (server_mode == MODE_URING);
+
+    reactors = calloc(reactor_count, sizeof(Reactor));
+    if (reactors == NULL) {
+        perror("calloc failed");
+        exit(EXIT_FAILURE);
     }
+
+    for (int i = 0; i < reactor_count; i++) {
+        reactors[i].reactor_id = i + 1;
+        reactors[i].timers.tick = now_ns() / 1000000000ull;
+        reactors[i].listen = &listeners[i];
+        pthread_mutex_init(&reactors[i].shard_mutex, NULL);
+        // uring 모드의 eventfd는 커널이 읽기를 기다리도록 블로킹으로 만든다
+        reactors[i].event_fd = eventfd(0, (uring ? 0 : EFD_NONBLOCK) | EFD_CLOEXEC);
+        if (reactors[i].event_fd < 0) {
+            perror("eventfd failed");
+            exit(EXIT_FAILURE);
+        }
+        wal_add_notify_fd(reactors[i].event_fd);
+
+        if (uring) {
+            reactors[i].epoll_fd = -1;  // 링은 리액터 스레드가 시작하면서 만든다
+        } else {
+            reactors[i].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (reactors[i].epoll_fd < 0) {
+                perror("epoll_create1 failed");
+                exit(EXIT_FAILURE);
+            }
+
+            // data.ptr == NULL 이벤트는 WAL 커밋 완료 알림이다
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = NULL;
+            epoll_ctl(reactors[i].epoll_fd, EPOLL_CTL_ADD, reactors[i].event_fd, &ev);
+
+            // data.ptr이 수신 소켓 번호 칸을 가리키면 새 연결이다
+            for (int j = 0; j < listeners[i].count; j++) {
+                ev.events = EPOLLIN;
+                ev.data.ptr = &listeners[i].fds[j];
+                epoll_ctl(reactors[i].epoll_fd, EPOLL_CTL_ADD, listeners[i].fds[j], &ev);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &reactors[i].opened);
+        pthread_create(&reactors[i].thread, NULL,
+            uring ? uring_reactor_thread_func : reactor_thread_func, &reactors[i]);
+        if (pin_cpus) {
+            pin_thread(reactors[i].thread, cpu_list[i % cpu_count]);
+            LOG_INFO("✅ 창구 %d번(리액터) 준비 완료 (CPU %d)\n", i + 1, cpu_list[i % cpu_count]);
+        } else {
+            LOG_INFO("✅ 창구 %d번(리액터) 준비 완료\n", i + 1);
+        }
+    }
+
+    LOG_INFO("\n🏦 ========== 은행 영업 시작 ==========\n");
+    LOG_INFO("📍 포트: %d\n", text_port);
+    if (binary_port > 0) LOG_INFO("📍 바이너리 포트: %d\n", binary_port);
+    LOG_INFO("⚡ 실행 모드: %s (리액터 %d개, 리액터마다 수신 소켓, listen 대기열 %d)\n",
+        uring ? "io_uring" : "epoll", reactor_count, listen_backlog);
+    LOG_INFO("=====================================\n\n");
+
+    for (int i = 0; i < reactor_count; i++) {
+        pthread_join(reactors[i].thread, NULL);
+    }
+}
+
+// 리액터의 수신 소켓에서 대기 중인 연결을 받아 세션으로 등록 (한 번에 MAX_EVENTS개까지)
+void reactor_accept(Reactor* reactor, int idx) {
+    for (int n = 0; n < MAX_EVENTS; n++) {
+        Connection conn;
+        int accepted = accept_connection(reactor->listen, idx, &conn);
+        if (accepted < 0) break;
+        if (accepted == 0) continue;
+        int client_fd = conn.client_fd;
+
+        fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL, 0) | O_NONBLOCK);
+        Session* s = reactor_new_session(reactor, conn);
+        if (s == NULL) continue;
+
+        int pending = session_flush(s);
+        if (pending < 0) {
+            session_destroy(s);
+            free(s);
+            close(client_fd);
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (pending ? EPOLLOUT : 0);
+        ev.data.ptr = s;
+        s->want_write = pending;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            session_destroy(s);
+            free(s);
+            close(client_fd);
+            continue;
+        }
+        reactor_arm_timer(reactor, s);
+    }
+}
+
+// 수락한 연결로 세션을 만들고 환영 메시지를 쌓아 둔다 (실패하면 소켓을 닫고 NULL)
+Session* reactor_new_session(Reactor* reactor, Connection conn) {
+    Session* s = malloc(sizeof(Session));
+    if (s == NULL) {
+        close(conn.client_fd);
+        return NULL;
+    }
+    session_init(s, conn, reactor->reactor_id, conn.client);
+    s->read_slot = -1;
+    s->reactor = reactor;
+    LOG_DEBUG("🪟 창구 %d번에 배정되었습니다.\n", reactor->reactor_id);
+    hist_record(&metrics.accept_to_assign, now_ns() - conn.accepted_ns);
+
+    session_start(s);
+    return s;
+}
+
+// 세션의 가까운 기한에 타이머를 건다
+void reactor_arm_timer(Reactor* reactor, Session* s) {
+    bool idle;
+    uint64_t deadline = session_deadline(s, &idle);
+    if (deadline != 0) {
+        timer_arm(&reactor->timers, s, deadline);
+    }
+}
+
+// 리액터 스레드 함수
+void* reactor_thread_func(void* arg) {
+    Reactor* reactor = (Reactor*)arg;
+    struct epoll_event events[MAX_EVENTS];
+    char buffer[BUFFER_SIZE];
+
+    while (1) {
+        int n = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, timer_wait_ms(now_ns()));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            break;
+        }
+        uint64_t busy_start = now_ns();
+        bool wake = false;
+
+        for (int i = 0; i < n; i++) {
+            Session* s = events[i].data.ptr;
+            int* listen_fd = events[i].data.ptr;
+
+            if (listen_fd >= reactor->listen->fds && listen_fd < reactor->listen->fds + reactor->listen->count) {
+                // 이 리액터 몫의 수신 소켓에 새 연결
+                reactor_accept(reactor, listen_fd - reactor->listen->fds);
+                continue;
+            }
+
+            if (s == NULL) {
+                // WAL 기록 스레드의 커밋 완료 알림 (호출 스레드의 지점 간 호출 완료도 같은 eventfd)
+                uint64_t count;
+                if (read(reactor->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    perror("eventfd read failed");
+                }
+                // 보류 응답은 배치 끝에서 보낸다. 여기서 보내다 세션을 닫으면
+                // events 뒤쪽에 남은 같은 세션의 이벤트가 해제된 메모리를 가리킨다.
+                wake = true;
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN) {
+                ssize_t bytes_read = read(s->client_fd, buffer, BUFFER_SIZE);
+                atomic_fetch_add_explicit(&metrics.read_calls, 1, memory_order_relaxed);
+                if (bytes_read == 0 ||
+                    (bytes_read < 0 && errno != EAGAIN && errno != EINTR)) {
+                    LOG_WARN("⚠️  [창구 %d] %s 연결 종료\n", s->window_id, s->client->client_id);
+                    reactor_close_session(reactor, s);
+                    continue;
+                }
+                if (bytes_read > 0 && s->state != STATE_CLOSED) {
+                    session_on_bytes(s, buffer, bytes_read);
+                }
+            } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                reactor_close_session(reactor, s);
+                continue;
+            }
+
+            reactor_after_input(reactor, s);
+        }
+
+        // 지점 간 호출의 답, 커밋이 끝난 응답 전송과 기한이 지난 세션 정리
+        // (이번 이벤트 처리가 끝난 뒤라 events에 남은 포인터가 없다)
+        if (wake) {
+            reactor_shard_done(reactor);
+            reactor_wake_durable(reactor);
+        }
+        timer_advance(reactor, now_ns());
+
+        atomic_fetch_add_explicit(&reactor->busy_ns, now_ns() - busy_start, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+// 입력 처리 후 응답 전송
+// 이번 입력이 만든 WAL 레코드가 아직 디스크에 없으면 응답을 보내지 않고 대기 목록에 건다.
+// 리액터는 그동안 다른 세션을 계속 처리하고, 커밋 완료 알림이 오면 reactor_wake_durable()이 보낸다.
+void reactor_after_input(Reactor* reactor, Session* s) {
+    if (!wal_is_durable(s->commit_lsn)) {
+        if (!s->durable_waiting) {
+            s->durable_waiting = true;
+            s->durable_prev = NULL;
+            s->durable_next = reactor->durable_waiters;
+            if (reactor->durable_waiters) reactor->durable_waiters->durable_prev = s;
+            reactor->durable_waiters = s;
+        }
+        return;
+    }
+
+    reactor_update_session(reactor, s);
+}
+
+// 버퍼에 쌓인 응답을 보내고 쓰기 이벤트 구독을 맞춘다
+void reactor_update_session(Reactor* reactor, Session* s) {
+    if (reactor->uring != NULL) {
+        uring_update_session(reactor, s);
+        return;
+    }
+
+    int pending = session_flush(s);
+    if (pending < 0 || (pending == 0 && s->state == STATE_CLOSED)) {
+        reactor_close_session(reactor, s);
+        return;
+    }
+
+    // 보낼 데이터가 남아 있을 때만 쓰기 이벤트를 구독한다
+    if ((bool)pending != s->want_write) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (pending ? EPOLLOUT : 0);
+        ev.data.ptr = s;
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, s->client_fd, &ev);
+        s->want_write = pending;
+    }
+}
+
+// 커밋이 끝난 세션의 보류된 응답 전송
+void reactor_wake_durable(Reactor* reactor) {
+    Session* s = reactor->durable_waiters;
+    while (s != NULL) {
+        Session* next = s->durable_next;
+        if (wal_is_durable(s->commit_lsn)) {
+            if (s->durable_prev) s->durable_prev->durable_next = s->durable_next;
+            else reactor->durable_waiters = s->durable_next;
+            if (s->durable_next) s->durable_next->durable_prev = s->durable_prev;
+            s->durable_waiting = false;
+            reactor_update_session(reactor, s);
+        }
+        s = next;
+    }
+}
+
+// 호출 스레드가 돌려준 지점 간 호출의 답을 쓰고, 기다리는 동안 쌓인 입력을 이어서 처리한다
+// 닫는 중인 세션의 답은 버린다 (uring 모드는 마지막 안내를 보내는 중일 수 있다).
+void reactor_shard_done(Reactor* reactor) {
+    pthread_mutex_lock(&reactor->shard_mutex);
+    ShardCall* call = reactor->shard_done;
+    reactor->shard_done = NULL;
+    pthread_mutex_unlock(&reactor->shard_mutex);
+
+    while (call != NULL) {
+        ShardCall* next = call->next;
+        Session* s = call->session;
+        if (s != NULL) {
+            s->shard_call = NULL;
+            if (s->state != STATE_CLOSED) {
+                shard_call_reply(s, call);
+                if (call->lsn > s->commit_lsn) s->commit_lsn = call->lsn;
+                session_on_bytes(s, "", 0);
+            }
+            reactor_after_input(reactor, s);
+        }
+        shard_call_free(call);
+        call = next;
+    }
+}
+
+// 리액터 세션 종료
+// uring 모드에서 커널에 걸어 둔 요청이 있으면 취소만 보내고, 그 요청이 끝났을 때 다시 불려 닫는다.
+void reactor_close_session(Reactor* reactor, Session* s) {
+    if (s->io_op != URING_IO_NONE) {
+        s->io_closing = true;
+        uring_post_cancel(reactor, s);
+        return;
+    }
+    if (s->durable_waiting) {
+        if (s->durable_prev) s->durable_prev->durable_next = s->durable_next;
+        else reactor->durable_waiters = s->durable_next;
+        if (s->durable_next) s->durable_next->durable_prev = s->durable_prev;
+    }
+    if (s->shard_call != NULL) {
+        s->shard_call->session = NULL;      // 답이 오면 버린다
+    }
+    timer_disarm(&reactor->timers, s);
+    if (reactor->uring != NULL) {
+        if (s->read_slot >= 0) {
+            reactor->uring->free_slots[reactor->uring->free_count++] = s->read_slot;
+        }
+    } else {
+        epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, s->client_fd, NULL);
+    }
+    close(s->client_fd);
+    LOG_DEBUG("🪟 창구 %d번: %s 세션 종료\n", reactor->reactor_id, s->client->client_id);
+    session_destroy(s);
+    free(s);
+}
+
+// 기한(ns)이 속한 초의 칸에 세션을 건다 (이미 지난 기한은 다음 tick에 처리)
+void timer_arm(TimerWheel* wheel, Session* s, uint64_t deadline_ns) {
+    uint64_t tick = (deadline_ns + 999999999ull) / 1000000000ull;
+    if (tick <= wheel->tick) {
+        tick = wheel->tick + 1;
+    }
+
+    Session** slot = &wheel->slots[tick % TIMER_WHEEL_SLOTS];
+    s->timer_tick = tick;
+    s->timer_prev = NULL;
+    s->timer_next = *slot;
+    if (*slot) (*slot)->timer_prev = s;
+    *slot = s;
+    s->timer_armed = true;
+}
+
+// 타이머 휠에서 세션을 뗀다
+void timer_disarm(TimerWheel* wheel, Session* s) {
+    if (!s->timer_armed) {
+        return;
+    }
+    if (s->timer_prev) s->timer_prev->timer_next = s->timer_next;
+    else wheel->slots[s->timer_tick % TIMER_WHEEL_SLOTS] = s->timer_next;
+    if (s->timer_next) s->timer_next->timer_prev = s->timer_prev;
+    s->timer_prev = s->timer_next = NULL;
+    s->timer_armed = false;
+}
+
+// now까지 지난 tick의 칸을 차례로 처리하고 닫은 세션 수를 돌려준다
+int timer_advance(Reactor* reactor, uint64_t now) {
+    TimerWheel* wheel = &reactor->timers;
+    uint64_t now_tick = now / 1000000000ull;
+    int expired = 0;
+
+    while (wheel->tick < now_tick) {
+        wheel->tick++;
+        Session** slot = &wheel->slots[wheel->tick % TIMER_WHEEL_SLOTS];
+        Session* s = *slot;
+        *slot = NULL;
+
+        while (s != NULL) {
+            Session* next = s->timer_next;
+            bool idle;
+            uint64_t deadline;
+
+            s->timer_armed = false;
+            s->timer_prev = s->timer_next = NULL;
+            if (s->timer_tick > wheel->tick) {
+                // 한 바퀴 이상 남은 기한
+                timer_arm(wheel, s, s->timer_tick * 1000000000ull);
+            } else if ((deadline = session_deadline(s, &idle)) > now) {
+                // 그 사이 입력이 있어 기한이 늘어났다
+                timer_arm(wheel, s, deadline);
+            } else {
+                session_expire(s, idle);
+                if (reactor->uring != NULL) {
+                    reactor_update_session(reactor, s);     // 걸어 둔 읽기를 취소하고 안내를 보낸 뒤 닫는다
+                } else {
+                    session_flush(s);   // 안내는 한 번만 시도하고 기다리지 않는다
+                    reactor_close_session(reactor, s);
+                }
+                expired++;
+            }
+            s = next;
+        }
+    }
+    return expired;
+}
+
+// 다음 tick까지 epoll_wait(io_uring_enter)가 기다릴 시간 (기한을 쓰지 않으면 -1 = 무한정)
+int timer_wait_ms(uint64_t now) {
+    if (idle_timeout == 0 && session_timeout == 0) {
+        return -1;
+    }
+    return 1000 - (int)(now / 1000000ull % 1000);
+}
+
+// ========== io_uring (uring 모드) ==========
+// 리액터는 세션마다 읽기 또는 응답 요청 하나를 커널에 걸어 두고, 한 바퀴 동안 여러 세션이 만든
+// 요청을 제출 큐에 모았다가 io_uring_enter 한 번으로 제출하면서 완료를 기다린다.
+// 읽기는 미리 등록해 둔 버퍼(READ_FIXED)로 받으므로 요청마다 페이지를 고정하지 않는다.
+
+// 이 커널에서 uring 모드를 쓸 수 있는지 (필요한 요청 종류와 기능 확인)
+bool uring_supported() {
+    static const int ops[] = {
+        IORING_OP_ACCEPT, IORING_OP_READ_FIXED, IORING_OP_RECV, IORING_OP_SENDMSG,
+        IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_ASYNC_CANCEL
+    };
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(SYS_io_uring_setup, 4, &params);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, probe_size);
+    bool ok = probe != NULL && (params.features & IORING_FEAT_EXT_ARG) &&
+              syscall(SYS_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); i++) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    close(fd);
+    return ok;
+}
+
+// 링 생성 및 제출/완료 큐 mmap. 성공 0, 실패 -1 (errno)
+// flags를 모르는 커널이면 flags 없이 다시 만든다.
+int uring_init(Uring* ring, unsigned entries, unsigned flags) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(Uring));
+
+    params.flags = flags;
+    ring->fd = syscall(SYS_io_uring_setup, entries, &params);
+    if (ring->fd < 0 && errno == EINVAL && flags != 0) {
+        memset(&params, 0, sizeof(params));
+        ring->fd = syscall(SYS_io_uring_setup, entries, &params);
+    }
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) sq_size = cq_size;
+    }
+    char* sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring->fd, IORING_OFF_SQ_RING);
+    char* cq = sq;
+    if (sq != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring->fd, IORING_OFF_CQ_RING);
+    }
+    void* sqes = MAP_FAILED;
+    if (sq != MAP_FAILED && cq != MAP_FAILED) {
+        sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    }
+    if (sqes == MAP_FAILED) {
+        int err = errno;
+        close(ring->fd);
+        errno = err;
+        return -1;
+    }
+
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->sqes = sqes;
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+// 제출 큐에서 빈 칸 하나 (가득 차 있으면 쌓인 요청을 먼저 제출한다)
+struct io_uring_sqe* uring_get_sqe(Uring* ring) {
+    unsigned tail = *ring->sq_tail;
+    while (tail - atomic_load_explicit((_Atomic unsigned*)ring->sq_head, memory_order_acquire) >= ring->sq_entries) {
+        uring_enter(ring, 0, 0);
+    }
+
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    atomic_store_explicit((_Atomic unsigned*)ring->sq_tail, tail + 1, memory_order_release);
+    ring->to_submit++;
+    return sqe;
+}
+
+// 쌓인 요청 제출 + 완료 wait_nr개 대기 (timeout_ms < 0이면 무한정). 실패하면 -1 (errno)
+int uring_enter(Uring* ring, unsigned wait_nr, int timeout_ms) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    void* argp = NULL;
+    size_t argsz = 0;
+
+    if (wait_nr > 0 && timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+
+    int ret = syscall(SYS_io_uring_enter, ring->fd, ring->to_submit, wait_nr, flags, argp, argsz);
+    if (ret >= 0) {
+        ring->to_submit -= (unsigned)ret < ring->to_submit ? (unsigned)ret : ring->to_submit;
+        return ret;
+    }
+    if (errno == ETIME || errno == EINTR) {
+        return 0;   // 기다리던 시간이 지났거나 신호: 완료 큐만 확인한다
+    }
+    return -1;
+}
+
+// 리액터의 링, 읽기 버퍼, 상시 요청(수락, 커밋 알림) 준비
+// 리액터 스레드가 직접 부른다: 링을 이 스레드만 쓰므로 완료 처리를 enter 안에서 몰아서 하게 한다.
+void uring_reactor_init(Reactor* reactor) {
+    UringIo* io = calloc(1, sizeof(UringIo));
+    if (io == NULL ||
+        uring_init(&io->ring, URING_ENTRIES, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN) < 0) {
+        perror("io_uring_setup failed");
+        exit(EXIT_FAILURE);
+    }
+
+    io->bufs = malloc((size_t)URING_BUF_SLOTS * BUFFER_SIZE);
+    io->free_slots = malloc(URING_BUF_SLOTS * sizeof(int));
+    if (io->bufs == NULL || io->free_slots == NULL) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < URING_BUF_SLOTS; i++) {
+        io->free_slots[io->free_count++] = URING_BUF_SLOTS - 1 - i;
+    }
+
+    // 읽기 버퍼 전체를 0번 등록 버퍼 하나로 등록한다 (memlock 한도에 걸리면 일반 recv로 읽는다)
+    struct iovec iov = { .iov_base = io->bufs, .iov_len = (size_t)URING_BUF_SLOTS * BUFFER_SIZE };
+    io->bufs_registered = syscall(SYS_io_uring_register, io->ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    if (!io->bufs_registered) {
+        LOG_WARN("⚠️  [창구 %d] io_uring 버퍼 등록 실패 (%s), 일반 recv로 읽습니다.\n",
+            reactor->reactor_id, strerror(errno));
+    }
+    reactor->uring = io;
+
+    // 수락은 커널이 기다린다 (O_NONBLOCK 소켓은 io_uring이 기다리지 않고 EAGAIN을 돌려줄 수 있다)
+    for (int i = 0; i < reactor->listen->count; i++) {
+        int fd = reactor->listen->fds[i];
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+        uring_post_accept(reactor, i);
+    }
+    uring_post_wake(reactor);
+}
+
+// 수신 소켓 idx에 수락 요청
+void uring_post_accept(Reactor* reactor, int idx) {
+    UringIo* io = reactor->uring;
+    struct io_uring_sqe* sqe = uring_get_sqe(&io->ring);
+    io->accept_len[idx] = sizeof(io->accept_addr[idx]);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reactor->listen->fds[idx];
+    sqe->addr = (uint64_t)(uintptr_t)&io->accept_addr[idx];
+    sqe->addr2 = (uint64_t)(uintptr_t)&io->accept_len[idx];
+    sqe->user_data = ((uint64_t)idx << 3) | URING_IO_ACCEPT;
+}
+
+// WAL 커밋 완료 eventfd 읽기 요청
+void uring_post_wake(Reactor* reactor) {
+    UringIo* io = reactor->uring;
+    struct io_uring_sqe* sqe = uring_get_sqe(&io->ring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = reactor->event_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&io->wake_count;
+    sqe->len = sizeof(io->wake_count);
+    sqe->user_data = URING_IO_WAKE;
+}
+
+// 세션에 걸어 둔 요청 취소 (한 번만 보낸다, 취소된 요청의 완료가 따로 온다)
+void uring_post_cancel(Reactor* reactor, Session* s) {
+    if (s->io_cancel) {
+        return;
+    }
+    struct io_uring_sqe* sqe = uring_get_sqe(&reactor->uring->ring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)s | s->io_op;
+    sqe->user_data = URING_IO_CANCEL;
+    s->io_cancel = true;
+}
+
+// 세션의 다음 요청: 쌓인 응답이 있으면 보내고, 닫는 중이면 닫고, 아니면 다음 입력을 읽는다
+// 걸어 둔 요청이 있으면 그 완료가 다시 부르므로 여기서는 닫는 세션의 요청만 취소한다.
+void uring_update_session(Reactor* reactor, Session* s) {
+    UringIo* io = reactor->uring;
+
+    if (s->io_op != URING_IO_NONE) {
+        if (s->state == STATE_CLOSED) {
+            if (s->io_op == URING_IO_SEND) s->io_closing = true;
+            uring_post_cancel(reactor, s);
+        }
+        return;
+    }
+    if (s->shard_call != NULL && s->state != STATE_CLOSED) {
+        // 지점 간 호출의 답을 기다리는 동안은 보내지도 읽지도 않는다 (답을 쓸 때 out 버퍼가
+        // 커널에 물려 있으면 안 된다). 답이 오면 reactor_shard_done이 다시 부른다.
+        return;
+    }
+
+    if (s->frag_head < s->frag_count) {
+        if (s->send_iov == NULL) {
+            s->send_iov = malloc(MAX_OUT_IOV * sizeof(struct iovec));
+            if (s->send_iov == NULL) {
+                reactor_close_session(reactor, s);
+                return;
+            }
+        }
+        memset(&s->send_msg, 0, sizeof(s->send_msg));
+        s->send_msg.msg_iov = s->send_iov;
+        s->send_msg.msg_iovlen = session_out_iov(s, s->send_iov);
+
+        struct io_uring_sqe* sqe = uring_get_sqe(&io->ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = s->client_fd;
+        sqe->addr = (uint64_t)(uintptr_t)&s->send_msg;
+        // 닫는 세션의 마지막 안내는 한 번만 시도하고 기다리지 않는다
+        sqe->msg_flags = MSG_NOSIGNAL | (s->state == STATE_CLOSED ? MSG_DONTWAIT : 0);
+        sqe->user_data = (uint64_t)(uintptr_t)s | URING_IO_SEND;
+        s->io_op = URING_IO_SEND;
+        s->out_busy = true;
+        return;
+    }
+
+    if (s->state == STATE_CLOSED) {
+        reactor_close_session(reactor, s);
+        return;
+    }
+
+    if (s->read_slot < 0 && s->rbuf == NULL && io->free_count > 0) {
+        s->read_slot = io->free_slots[--io->free_count];
+    }
+    if (s->read_slot < 0 && s->rbuf == NULL) {
+        s->rbuf = malloc(BUFFER_SIZE);
+        if (s->rbuf == NULL) {
+            reactor_close_session(reactor, s);
+            return;
+        }
+    }
+
+    struct io_uring_sqe* sqe = uring_get_sqe(&io->ring);
+    sqe->fd = s->client_fd;
+    sqe->len = BUFFER_SIZE;
+    if (s->read_slot >= 0) {
+        sqe->addr = (uint64_t)(uintptr_t)(io->bufs + (size_t)s->read_slot * BUFFER_SIZE);
+        if (io->bufs_registered) {
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->buf_index = 0;
+        } else {
+            sqe->opcode = IORING_OP_RECV;
+        }
+    } else {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->addr = (uint64_t)(uintptr_t)s->rbuf;
+    }
+    sqe->user_data = (uint64_t)(uintptr_t)s | URING_IO_READ;
+    s->io_op = URING_IO_READ;
+}
+
+// 세션 요청 완료 처리
+void uring_on_session(Reactor* reactor, Session* s, UringOp op, int res) {
+    s->io_op = URING_IO_NONE;
+    s->io_cancel = false;
+    if (op == URING_IO_SEND) {
+        s->out_busy = false;
+        if (res > 0) session_out_advance(s, res);
+    }
+    if (s->io_closing) {
+        reactor_close_session(reactor, s);
+        return;
+    }
+
+    if (op == URING_IO_READ) {
+        if (res > 0 && s->state != STATE_CLOSED) {
+            char* data = s->read_slot >= 0 ? reactor->uring->bufs + (size_t)s->read_slot * BUFFER_SIZE : s->rbuf;
+            session_on_bytes(s, data, res);
+            reactor_after_input(reactor, s);
+        } else if (res == -ECANCELED || s->state == STATE_CLOSED) {
+            reactor_update_session(reactor, s);     // 기한 초과: 안내를 보내고 닫는다
+        } else {
+            LOG_WARN("⚠️  [창구 %d] %s 연결 종료\n", s->window_id, s->client->client_id);
+            reactor_close_session(reactor, s);
+        }
+        return;
+    }
+
+    if (res < 0) {
+        reactor_close_session(reactor, s);
+        return;
+    }
+    reactor_update_session(reactor, s);
+}
+
+// uring 리액터 스레드 함수
+void* uring_reactor_thread_func(void* arg) {
+    Reactor* reactor = (Reactor*)arg;
+    uring_reactor_init(reactor);
+    UringIo* io = reactor->uring;
+    Uring* ring = &io->ring;
+
+    while (1) {
+        // 지난 바퀴에 모인 요청을 제출하면서 완료를 기다린다 (시스템 호출 한 번)
+        if (uring_enter(ring, 1, timer_wait_ms(now_ns())) < 0) {
+            if (errno == EAGAIN || errno == EBUSY) continue;
+            perror("io_uring_enter failed");
+            break;
+        }
+        atomic_fetch_add_explicit(&metrics.uring_enters, 1, memory_order_relaxed);
+        uint64_t busy_start = now_ns();
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned*)ring->cq_tail, memory_order_acquire);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            UringOp op = (UringOp)(data & URING_OP_MASK);
+
+            if (op == URING_IO_ACCEPT) {
+                int idx = (int)(data >> 3);
+                Connection conn;
+                if (res >= 0 && accept_admit(reactor->listen, idx, res, &io->accept_addr[idx], &conn) > 0) {
+                    Session* s = reactor_new_session(reactor, conn);
+                    if (s != NULL) {
+                        reactor_arm_timer(reactor, s);
+                        reactor_update_session(reactor, s);
+                    }
+                } else if (res < 0 && res != -EAGAIN && res != -EINTR) {
+                    errno = -res;
+                    perror("accept failed");
+                }
+                uring_post_accept(reactor, idx);
+            } else if (op == URING_IO_WAKE) {
+                reactor_shard_done(reactor);
+                reactor_wake_durable(reactor);
+                uring_post_wake(reactor);
+            } else if (op == URING_IO_READ || op == URING_IO_SEND) {
+                uring_on_session(reactor, (Session*)(uintptr_t)(data & ~URING_OP_MASK), op, res);
+            }
+        }
+        atomic_store_explicit((_Atomic unsigned*)ring->cq_head, head, memory_order_release);
+
+        // 기한이 지난 세션 정리
+        timer_advance(reactor, now_ns());
+
+        atomic_fetch_add_explicit(&reactor->busy_ns, now_ns() - busy_start, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+// 데이터베이스 초기화
+// 기본 고객은 pi200부터 차례로, IP는 10.10.16.200부터 차례로 (pi200 = 10.10.16.200) 배정한다.
+void init_database() {
+    char client_id[CLIENT_ID_SIZE];
+    uint32_t base_ip = (10u << 24) | (10u << 16) | (16u << 8) | 200u;
+        
+    pthread_rwlock_init(&directory.lock, NULL);
+    directory.table_mask = 1023;
+    while (directory.table_mask + 1 < (uint32_t)initial_clients * 2) {
+        directory.table_mask = directory.table_mask * 2 + 1;
+    }
+    directory.by_id = calloc(directory.table_mask + 1, sizeof(uint32_t));
+    directory.by_ip = calloc(directory.table_mask + 1, sizeof(uint32_t));
+    if (directory.by_id == NULL || directory.by_ip == NULL) {
+        perror("directory calloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < initial_clients; i++) {
+        snprintf(client_id, sizeof(client_id), "pi%d", 200 + i);
+        if (!shard_owns(client_id)) continue;     // 다른 지점 고객
+        if (directory_add(client_id, base_ip + i) == NULL) {
+            fprintf(stderr, "❌ 기본 고객을 만들 수 없습니다 (--clients %d)\n", initial_clients);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (shard.count > 0) {
+        LOG_INFO("💾 클라이언트 DB 초기화 완료 (pi200 ~ pi%d 중 %d번 지점 고객 %d명, 통장 최대 %d개)\n",
+            200 + initial_clients - 1, shard.index, client_count(), max_accounts);
+        return;
+    }
+    LOG_INFO("💾 클라이언트 DB 초기화 완료 (pi200 ~ pi%d, 통장 최대 %d개)\n",
+        200 + initial_clients - 1, max_accounts);
+}
+
+// 대기 큐 초기화
+void init_waiting_queue() {
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        QueueRing* ring = &waiting_queue.rings[c];
+        for (size_t i = 0; i < MAX_QUEUE; i++) {
+            atomic_init(&ring->slots[i].sequence, i);
+            ring->slots[i].conn.client_fd = -1;
+        }
+        atomic_init(&ring->enqueue_pos, 0);
+        atomic_init(&ring->dequeue_pos, 0);
+        atomic_init(&queue_served[c], 0);
+    }
+
+    // 가중치대로 등급 순서를 만든다 (smooth weighted round-robin: 4,2,1 -> E N E B E N E)
+    int total = 0, current[QUEUE_CLASSES] = { 0 };
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        total += waiting_queue.weights[c];
+    }
+    for (int i = 0; i < total; i++) {
+        int pick = 0;
+        for (int c = 0; c < QUEUE_CLASSES; c++) {
+            current[c] += waiting_queue.weights[c];
+            if (current[c] > current[pick]) pick = c;
+        }
+        current[pick] -= total;
+        waiting_queue.schedule[i] = pick;
+    }
+    waiting_queue.schedule_len = total;
+    atomic_init(&waiting_queue.turn, 0);
+
+    for (int w = 0; w < MAX_WORKERS / 64; w++) {
+        atomic_init(&idle_workers[w], 0);
+    }
+    atomic_init(&queue_rejected, 0);
+}
+
+// 대기 등급 정하기
+// 이미 창구를 여럿 쓰는 고객은 후순위로 보내 한 고객이 창구를 독차지하지 못하게 하고,
+// 바이너리 연결과 직전 상담이 짧았던 고객은 긴 상담 뒤에 줄 서지 않도록 빠른 창구로 보낸다.
+QueueClass queue_classify(const Connection* conn) {
+    ClientInfo* client = conn->client;
+    if (client_windows > 0 && atomic_load(&client->windows) >= client_windows) {
+        return QUEUE_BULK;
+    }
+    int last_tasks = atomic_load(&client->last_tasks);
+    if (conn->proto == PROTO_BINARY || (last_tasks > 0 && last_tasks <= 2)) {
+        return QUEUE_EXPRESS;
+    }
+    return QUEUE_NORMAL;
+}
+
+// 대기 큐에 추가 (그 등급 큐가 가득 차면 false)
+bool enqueue(Connection conn) {
+    QueueRing* ring = &waiting_queue.rings[conn.qclass];
+    size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    while (1) {
+        QueueSlot* slot = &ring->slots[pos % MAX_QUEUE];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            // 빈 슬롯: 위치를 차지하면 기록
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                slot->conn = conn;
+                atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // 한 바퀴 전 항목이 아직 안 빠짐 = 가득 참
+        } else {
+            pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    // 쉬는 창구 비트맵 확인과의 순서를 보장 (wake_idle_worker / worker_thread_func 참고)
+    atomic_thread_fence(memory_order_seq_cst);
+    LOG_DEBUG("🎫 번호표 발급 (%s): 대기 인원 %d명\n", queue_class_names[conn.qclass], queue_depth());
+    return true;
+}
+
+// 등급 큐 하나에서 꺼내기 (비어 있으면 false)
+bool queue_ring_pop(QueueRing* ring, Connection* conn) {
+    size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    while (1) {
+        QueueSlot* slot = &ring->slots[pos % MAX_QUEUE];
+        size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                *conn = slot->conn;
+                // 다음 바퀴의 생산자에게 슬롯을 돌려준다
+                atomic_store_explicit(&slot->sequence, pos + MAX_QUEUE, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // 비어 있음
+        } else {
+            pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// 대기 큐에서 꺼내기 (비어 있으면 false)
+// 차례부터 schedule을 따라가며 손님이 있는 첫 등급에서 꺼내고, 차례를 그 다음으로 옮긴다.
+// 빈 등급의 차례는 건너뛰므로 가중치는 손님이 밀려 있는 등급끼리만 나눈다.
+// (창구 여럿이 같은 차례를 볼 수 있지만 몇 명 단위의 오차라 그대로 둔다)
+bool dequeue(Connection* conn) {
+    size_t turn = atomic_load_explicit(&waiting_queue.turn, memory_order_relaxed);
+    int len = waiting_queue.schedule_len;
+
+    for (int k = 0; k < len; k++) {
+        int c = waiting_queue.schedule[(turn + k) % len];
+        if (queue_ring_pop(&waiting_queue.rings[c], conn)) {
+            atomic_store_explicit(&waiting_queue.turn, turn + k + 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&queue_served[c], 1, memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 등급 하나의 대기 인원 (근사값)
+int queue_class_depth(QueueClass qclass) {
+    QueueRing* ring = &waiting_queue.rings[qclass];
+    size_t tail = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    return (tail > head) ? (int)(tail - head) : 0;
+}
+
+// 현재 대기 인원 (근사값)
+int queue_depth() {
+    int depth = 0;
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        depth += queue_class_depth(c);
+    }
+    return depth;
+}
+
+// futex 대기: *addr가 expected인 동안 잠든다
+// timeout(상대 시간)이 지나면 ETIMEDOUT, 아니면 0을 돌려준다
+int futex_wait(atomic_int* addr, int expected, const struct timespec* timeout) {
+    if (syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+// futex 깨우기: addr에서 잠든 스레드 하나를 깨운다
+void futex_wake(atomic_int* addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// 쉬는 창구 하나를 비트맵에서 꺼내 깨운다 (없으면 -1)
+// 비트를 지운 쪽만 깨우므로 고객 한 명에 창구 하나만 일어난다.
+int wake_idle_worker() {
+    for (int w = 0; w < (max_workers + 63) / 64; w++) {
+        uint_fast64_t mask = atomic_load(&idle_workers[w]);
+        while (mask != 0) {
+            int b = __builtin_ctzll(mask);
+            uint_fast64_t bit = (uint_fast64_t)1 << b;
+            if (atomic_compare_exchange_weak(&idle_workers[w], &mask, mask & ~bit)) {
+                int i = w * 64 + b;
+                atomic_store(&workers[i].wake, 1);
+                futex_wake(&workers[i].wake);
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// 쉬고 있는 창구가 하나라도 있는지
+bool any_idle_worker() {
+    for (int w = 0; w < (max_workers + 63) / 64; w++) {
+        if (atomic_load(&idle_workers[w]) != 0) return true;
+    }
+    return false;
+}
+
+// 이 프로세스가 쓸 수 있는 CPU 목록 (taskset 등으로 제한된 경우 반영)
+void init_cpu_list() {
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        cpu_count = CPU_COUNT(&set);
+        cpu_list = malloc(cpu_count * sizeof(int));
+        for (int cpu = 0, n = 0; n < cpu_count; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpu_list[n++] = cpu;
+        }
+    } else {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_count = (cpus > 0) ? (int)cpus : 1;
+        cpu_list = malloc(cpu_count * sizeof(int));
+        for (int n = 0; n < cpu_count; n++) cpu_list[n] = n;
+    }
+}
+
+// 스레드를 CPU 하나에 고정
+void pin_thread(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (err != 0) {
+        fprintf(stderr, "⚠️  CPU %d 고정 실패: %s\n", cpu, strerror(err));
+    }
+}
+
+// 창구 하나 열기 (빈 슬롯에 워커 스레드 생성)
+// 수락 스레드가 여럿일 수 있으므로 슬롯 탐색은 spawn_mutex로 한 번에 하나만 한다.
+int worker_pool_spawn() {
+    int idx = -1;
+
+    pthread_mutex_lock(&spawn_mutex);
+    if (atomic_load(&live_workers) >= max_workers) {
+        pthread_mutex_unlock(&spawn_mutex);
+        return -1;
+    }
+
+    for (int i = 0; i < max_workers; i++) {
+        WorkerThread* worker = &workers[i];
+        if (atomic_load(&worker->state) != WORKER_FREE) continue;
+
+        worker->worker_id = i + 1;
+        atomic_store(&worker->wake, 0);
+        worker->client_fd = -1;
+        worker->cpu = pin_cpus ? cpu_list[i % cpu_count] : -1;
+        clock_gettime(CLOCK_MONOTONIC, &worker->opened);
+        atomic_store(&worker->busy_ns, 0);
+        atomic_store(&worker->sessions, 0);
+        atomic_store(&worker->state, WORKER_RUNNING);
+        atomic_fetch_add(&live_workers, 1);
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&worker->thread, &attr, worker_thread_func, worker) != 0) {
+            perror("pthread_create failed");
+            atomic_fetch_sub(&live_workers, 1);
+            atomic_store(&worker->state, WORKER_FREE);
+            pthread_attr_destroy(&attr);
+            break;
+        }
+        pthread_attr_destroy(&attr);
+        if (worker->cpu >= 0) {
+            pin_thread(worker->thread, worker->cpu);
+        }
+        idx = i;
+        break;
+    }
+    pthread_mutex_unlock(&spawn_mutex);
+    return idx;
+}
+
+// 오래 쉰 창구 닫기 (최소 창구 수는 남긴다)
+// 비트맵에서 자기 비트를 직접 지워야 닫을 수 있다. 이미 지워져 있으면
+// 생산자가 이 창구를 깨우는 중이므로 닫지 않고 손님을 받는다.
+bool worker_try_retire(WorkerThread* worker) {
+    int i = worker->worker_id - 1;
+    uint_fast64_t bit = (uint_fast64_t)1 << (i % 64);
+
+    int live = atomic_load(&live_workers);
+    do {
+        if (live <= min_workers) return false;
+    } while (!atomic_compare_exchange_weak(&live_workers, &live, live - 1));
+
+    uint_fast64_t prev = atomic_fetch_and(&idle_workers[i / 64], ~bit);
+    if (!(prev & bit)) {
+        atomic_fetch_add(&live_workers, 1);
+        return false;
+    }
+
+    LOG_INFO("🚪 창구 %d번 닫음 (세션 %ld건, 가동률 %.0f%%, 남은 창구 %d개)\n",
+        worker->worker_id, atomic_load(&worker->sessions),
+        worker_utilization(worker), live - 1);
+    atomic_store(&worker->state, WORKER_FREE);
+    return true;
+}
+
+// 창구 가동률 (연 뒤로 상담에 쓴 시간 비율, %)
+double worker_utilization(WorkerThread* worker) {
+    return busy_percent(&worker->opened, atomic_load(&worker->busy_ns));
+}
+
+// IP로 클라이언트 찾기
+ClientInfo* find_client_by_ip(char* ip) {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, ip, &addr) != 1) {
+        return NULL;
+    }
+    return find_client_by_addr(ntohl(addr.s_addr));
+}
+
+// 주소(호스트 바이트 순서)로 클라이언트 찾기 (수락 경로에서 문자열 변환 없이 쓴다)
+ClientInfo* find_client_by_addr(uint32_t host) {
+    // 로컬 테스트를 위해 127.0.0.1도 허용 (pi200으로 매핑, 지점을 나눴으면 pi200이 있는 지점만)
+    if (host == INADDR_LOOPBACK) {
+        host = (10u << 24) | (10u << 16) | (16u << 8) | 200u;
+    }
+    // 부하 테스트용 루프백 주소 127.10.X.X는 10.10.X.X로 본다 (bank_loadgen)
+    if ((host >> 16) == ((127u << 8) | 10u)) {
+        host = (10u << 24) | (host & 0x00FFFFFFu);
+    }
+    
+    pthread_rwlock_rdlock(&directory.lock);
+    ClientInfo* client = directory_lookup_ip(host);
+    pthread_rwlock_unlock(&directory.lock);
+    return client;
+}
+
+// ID로 클라이언트 찾기
+ClientInfo* find_client_by_id(const char* client_id) {
+    pthread_rwlock_rdlock(&directory.lock);
+    ClientInfo* client = directory_lookup_id(client_id);
+    pthread_rwlock_unlock(&directory.lock);
+    return client;
+}
+
+// 번호로 클라이언트 찾기 (lock 없음, 등록된 고객은 옮겨지지 않는다)
+ClientInfo* client_at(int client_no) {
+    if (client_no < 0 || client_no >= atomic_load_explicit(&directory.count, memory_order_acquire)) {
+        return NULL;
+    }
+    return &directory.chunks[client_no / CLIENT_CHUNK][client_no % CLIENT_CHUNK];
+}
+
+// 등록된 고객 수
+int client_count() {
+    return atomic_load_explicit(&directory.count, memory_order_acquire);
+}
+
+// 고객 ID 해시 (FNV-1a)
+uint32_t client_id_hash(const char* client_id) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)client_id; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+// IP 해시 (연속된 주소가 표 전체에 흩어지도록 곱셈 해시)
+uint32_t client_ip_hash(uint32_t ip) {
+    return ip * 2654435761u;
+}
+
+// 해시 표에 번호 넣기 (선형 탐사, 쓰기 lock 필요)
+void directory_table_insert(uint32_t* table, uint32_t hash, int client_no) {
+    uint32_t i = hash & directory.table_mask;
+    while (table[i] != 0) {
+        i = (i + 1) & directory.table_mask;
+    }
+    table[i] = client_no + 1;
+}
+
+// 해시 표 두 배로 키우기 (쓰기 lock 필요)
+void directory_grow() {
+    uint32_t size = (directory.table_mask + 1) * 2;
+    uint32_t* by_id = calloc(size, sizeof(uint32_t));
+    uint32_t* by_ip = calloc(size, sizeof(uint32_t));
+    if (by_id == NULL || by_ip == NULL) {
+        // 표를 못 키우면 그대로 둔다 (채움 비율만 높아진다)
+        free(by_id);
+        free(by_ip);
+        return;
+    }
+
+    free(directory.by_id);
+    free(directory.by_ip);
+    directory.by_id = by_id;
+    directory.by_ip = by_ip;
+    directory.table_mask = size - 1;
+
+    int count = atomic_load_explicit(&directory.count, memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        ClientInfo* client = client_at(i);
+        directory_table_insert(by_id, client_id_hash(client->client_id), i);
+        directory_table_insert(by_ip, client_ip_hash(client->ip), i);
+    }
+}
+
+// ID 해시 표 조회 (디렉터리 lock을 쥔 채 부른다)
+ClientInfo* directory_lookup_id(const char* client_id) {
+    uint32_t hash = client_id_hash(client_id);
+    for (uint32_t i = hash & directory.table_mask; directory.by_id[i] != 0;
+         i = (i + 1) & directory.table_mask) {
+        ClientInfo* client = client_at(directory.by_id[i] - 1);
+        if (strcmp(client->client_id, client_id) == 0) {
+            return client;
+        }
+    }
+    return NULL;
+}
+
+// IP 해시 표 조회 (디렉터리 lock을 쥔 채 부른다)
+ClientInfo* directory_lookup_ip(uint32_t ip) {
+    uint32_t hash = client_ip_hash(ip);
+    for (uint32_t i = hash & directory.table_mask; directory.by_ip[i] != 0;
+         i = (i + 1) & directory.table_mask) {
+        ClientInfo* client = client_at(directory.by_ip[i] - 1);
+        if (client->ip == ip) {
+            return client;
+        }
+    }
+    return NULL;
+}
+
+// 디렉터리에 고객 추가 (쓰기 lock을 쥐었거나 기동 중일 때만, 중복 검사 없음)
+// 디렉터리가 가득 찼거나 메모리가 없으면 NULL.
+ClientInfo* directory_add(const char* client_id, uint32_t ip) {
+    int no = atomic_load_explicit(&directory.count, memory_order_relaxed);
+    int chunk = no / CLIENT_CHUNK;
+
+    if (chunk >= MAX_CLIENT_CHUNKS) return NULL;
+    if (directory.chunks[chunk] == NULL) {
+        ClientInfo* clients = aligned_alloc(CACHE_LINE, sizeof(ClientInfo) * CLIENT_CHUNK);
+        Account* accounts = calloc((size_t)CLIENT_CHUNK * max_accounts, sizeof(Account));
+        if (clients == NULL || accounts == NULL) {
+            free(clients);
+            free(accounts);
+            return NULL;
+        }
+        directory.chunks[chunk] = clients;
+        directory.account_chunks[chunk] = accounts;
+    }
+
+    ClientInfo* client = &directory.chunks[chunk][no % CLIENT_CHUNK];
+    memset(client, 0, sizeof(ClientInfo));
+    strncpy(client->client_id, client_id, CLIENT_ID_SIZE - 1);
+    client->ip = ip;
+    client->ip_last_digit = ip & 0xFF;
+    client->client_no = no;
+    client->accounts = &directory.account_chunks[chunk][(size_t)(no % CLIENT_CHUNK) * max_accounts];
+    pthread_mutex_init(&client->lock, NULL);
+
+    // 해시 표 채움 비율을 1/2 아래로 유지한다
+    if ((uint32_t)(no + 1) * 2 > directory.table_mask + 1) {
+        directory_grow();
+    }
+    directory_table_insert(directory.by_id, client_id_hash(client->client_id), no);
+    directory_table_insert(directory.by_ip, client_ip_hash(ip), no);
+
+    // 고객 내용을 다 채운 뒤 개수를 올려야 client_at()이 반쯤 만든 고객을 보지 않는다
+    atomic_store_explicit(&directory.count, no + 1, memory_order_release);
+    return client;
+}
+
+// 고객 등록 (영업 중, 재시작 없이)
+// 등록도 WAL에 남겨 재시작하면 같은 번호로 되살린다.
+BankStatus client_register(const char* client_id, uint32_t ip, ClientInfo** client_out) {
+    if (client_id[0] == 0 || strlen(client_id) >= CLIENT_ID_SIZE) {
+        return BANK_ERR_BAD_REQUEST;
+    }
+
+    BankStatus status = BANK_OK;
+    ClientInfo* client = NULL;
+
+    pthread_rwlock_wrlock(&directory.lock);
+    if (directory_lookup_id(client_id) != NULL || directory_lookup_ip(ip) != NULL) {
+        status = BANK_ERR_CLIENT_EXISTS;
+    } else if ((client = directory_add(client_id, ip)) == NULL) {
+        status = BANK_ERR_CLIENT_LIMIT;
+    } else {
+        // 디렉터리 lock 안에서 기록해 LSN 순서와 번호 순서가 같게 한다
+        WalRegister rec = { .client_no = client->client_no, .ip = ip };
+        memcpy(rec.client_id, client->client_id, CLIENT_ID_SIZE);
+        client->last_lsn = wal_append(WAL_REGISTER, &rec, sizeof(rec));
+    }
+    pthread_rwlock_unlock(&directory.lock);
+
+    if (client_out != NULL) *client_out = client;
+    return status;
+}
+
+// 여러 고객 잠그기 (client_no 오름차순, 중복은 한 번만)
+// 모든 스레드가 같은 순서로 잠그므로 교차 입금끼리 교착 상태가 생기지 않는다.
+void lock_clients(ClientInfo** clients, int count) {
+    client_sort(clients, count);
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && clients[i] == clients[i - 1]) continue;
+        client_lock(clients[i]);
+    }
+}
+
+// 제한 시간 안에 여러 고객 잠그기 (지점 간 거래 준비용)
+// 다른 지점이 조정하는 거래는 잠금 순서를 맞출 수 없으므로, 기다리다 못 잡으면
+// 잡은 것을 모두 풀고 false를 돌려준다 (요청한 쪽이 거래를 철회해 지점 간 교착을 푼다).
+bool lock_clients_timed(ClientInfo** clients, int count, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    client_sort(clients, count);
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && clients[i] == clients[i - 1]) continue;
+        atomic_fetch_add_explicit(&metrics.lock_acquired, 1, memory_order_relaxed);
+        if (pthread_mutex_timedlock(&clients[i]->lock, &deadline) != 0) {
+            unlock_clients(clients, i);
+            return false;
+        }
+        hot_fold(clients[i]);
+        eod_fold(clients[i]);
+    }
+    return true;
+}
+
+// 잠금 순서로 정렬 (보통은 대상이 적으므로 삽입 정렬, 이체 묶음처럼 많으면 qsort)
+void client_sort(ClientInfo** clients, int count) {
+    if (count > 16) {
+        qsort(clients, count, sizeof(ClientInfo*), client_no_compare);
+        return;
+    }
+    for (int i = 1; i < count; i++) {
+        ClientInfo* c = clients[i];
+        int j = i - 1;
+        while (j >= 0 && clients[j]->client_no > c->client_no) {
+            clients[j + 1] = clients[j];
+            j--;
+        }
+        clients[j + 1] = c;
+    }
+}
+
+int client_no_compare(const void* a, const void* b) {
+    int x = (*(ClientInfo* const*)a)->client_no, y = (*(ClientInfo* const*)b)->client_no;
+    return (x > y) - (x < y);
+}
+
+// lock_clients()로 잠근 고객들 풀기
+void unlock_clients(ClientInfo** clients, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if (i > 0 && clients[i] == clients[i - 1]) continue;
+        pthread_mutex_unlock(&clients[i]->lock);
+    }
+}
+
+// 고객 정보 바꾸기 시작/끝 (고객 lock을 쥔 채 부른다)
+void client_write_begin(ClientInfo* client) {
+    unsigned int seq = atomic_load_explicit(&client->seq, memory_order_relaxed);
+    atomic_store_explicit(&client->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void client_write_end(ClientInfo* client) {
+    atomic_fetch_add_explicit(&client->seq, 1, memory_order_release);
+}
+
+// lock_clients()로 잠근 고객들(정렬, 중복 제외)의 seq를 올려 조회 쪽이 중간 상태를 보지 않게 한다
+void clients_write_begin(ClientInfo** clients, int count) {
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && clients[i] == clients[i - 1]) continue;
+        client_write_begin(clients[i]);
+    }
+}
+
+void clients_write_end(ClientInfo** clients, int count) {
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && clients[i] == clients[i - 1]) continue;
+        client_write_end(clients[i]);
+    }
+}
+
+// 통장 목록을 lock 없이 복사 (잔고 조회용, out은 max_accounts칸)
+// 복사하는 사이에 입출금이 끼어들면 seq가 달라지므로 다시 읽는다. 쓰는 쪽은 기다리지 않는다.
+// 인기 통장의 잔고에는 누적기에 쌓인 입금을, 공개됐지만 아직 반영하지 않은 일 마감 증감도 더해 돌려준다.
+// 반환값: 통장 수
+int client_read_accounts(ClientInfo* client, Account* out) {
+    while (1) {
+        unsigned int seq = atomic_load_explicit(&client->seq, memory_order_acquire);
+        if ((seq & 1) == 0) {
+            int count = client->account_count;
+            if (count > max_accounts) count = max_accounts;   // 찢어진 값이어도 넘치지 않게
+            memcpy(out, client->accounts, sizeof(Account) * count);
+            for (int j = 0; j < count; j++) {
+                if (out[j].hot != NULL) {
+                    out[j].balance += (int)(atomic_load(&out[j].hot->pending) - atomic_load(&out[j].hot->reserved));
+                }
+                out[j].balance += eod_pending(client, j);
+            }
+
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&client->seq, memory_order_relaxed) == seq) {
+                return count;
+            }
+        }
+        atomic_fetch_add_explicit(&metrics.read_retries, 1, memory_order_relaxed);
+        sched_yield();
+    }
+}
+
+// 통장 개설
+BankStatus bank_open_account(ClientInfo* client, const char* bank_name, int* idx_out) {
+    uint64_t start = now_ns();
+    client_lock(client);
+
+    if (client->account_count >= max_accounts) {
+        pthread_mutex_unlock(&client->lock);
+        metrics_op_done(METRIC_OP_OPEN, BANK_ERR_ACCOUNT_LIMIT, start);
+        return BANK_ERR_ACCOUNT_LIMIT;
+    }
+
+    int idx = client->account_count;
+    client_write_begin(client);
+    strncpy(client->accounts[idx].bank_name, bank_name, 49);
+    client->accounts[idx].bank_name[49] = 0;
+    client->accounts[idx].balance = 0;
+    client->accounts[idx].is_active = true;
+    client->account_count++;
+    client_write_end(client);
+
+    WalOpen rec = { .client_no = client->client_no, .account_num = idx };
+    memcpy(rec.bank_name, client->accounts[idx].bank_name, sizeof(rec.bank_name));
+    client->last_lsn = wal_append(WAL_OPEN, &rec, sizeof(rec));
+
+    pthread_mutex_unlock(&client->lock);
+
+    *idx_out = idx;
+    metrics_op_done(METRIC_OP_OPEN, BANK_OK, start);
+    return BANK_OK;
+}
+
+// 입금 (from → target의 account_num 통장)
+// 입금자와 대상을 고정 순서로 함께 잠가 다른 고객 간 입금이 서로 막지 않게 한다.
+BankStatus bank_deposit(ClientInfo* from, ClientInfo* target, int account_num,
+                        int amount, int* balance_out) {
+    uint64_t start = now_ns();
+    if (amount <= 0) {
+        metrics_op_done(METRIC_OP_DEPOSIT, BANK_ERR_AMOUNT, start);
+        return BANK_ERR_AMOUNT;
+    }
+
+    // 인기 통장은 고객 lock 없이 누적기에 쌓는다 (일 마감 중이면 아래 고객 lock 경로로)
+    BankStatus status = BANK_OK;
+    HotAccount* hot = hot_account_of(target, account_num);
+    if (hot != NULL && bank_deposit_hot(from, target, account_num, hot, amount, balance_out, &status)) {
+        metrics_op_done(METRIC_OP_DEPOSIT, status, start);
+        return status;
+    }
+
+    ClientInfo* locked[2] = { from, target };
+    lock_clients(locked, 2);
+
+    if (account_num < 0 || account_num >= target->account_count) {
+        status = BANK_ERR_NO_ACCOUNT;
+    } else if (!hot_reserve_credit(target, account_num, amount)) {
+        status = BANK_ERR_AMOUNT;
+    } else {
+        client_write_begin(target);
+        target->accounts[account_num].balance += amount;
+        client_write_end(target);
+        hot_release_credit(target, account_num, amount);
+        *balance_out = target->accounts[account_num].balance;
+
+        WalDeposit rec = { from->client_no, target->client_no, account_num, amount };
+        target->last_lsn = wal_append(WAL_DEPOSIT, &rec, sizeof(rec));
+    }
+
+    unlock_clients(locked, 2);
+    metrics_op_done(METRIC_OP_DEPOSIT, status, start);
+    return status;
+}
+
+// 출금 (잔고 부족 시 balance_out에 현재 잔고를 돌려준다)
+BankStatus bank_withdraw(ClientInfo* client, int account_num, int amount, int* balance_out) {
+    uint64_t start = now_ns();
+    if (amount <= 0) {
+        metrics_op_done(METRIC_OP_WITHDRAW, BANK_ERR_AMOUNT, start);
+        return BANK_ERR_AMOUNT;
+    }
+
+    client_lock(client);
+
+    BankStatus status = BANK_OK;
+    if (account_num < 0 || account_num >= client->account_count) {
+        status = BANK_ERR_NO_ACCOUNT;
+    } else if (client->accounts[account_num].balance - eod_fee_due(client, account_num) < amount) {
+        *balance_out = client->accounts[account_num].balance;
+        status = BANK_ERR_INSUFFICIENT;
+    } else {
+        client_write_begin(client);
+        client->accounts[account_num].balance -= amount;
+        client_write_end(client);
+        *balance_out = client->accounts[account_num].balance;
+
+        WalWithdraw rec = { client->client_no, account_num, amount };
+        client->last_lsn = wal_append(WAL_WITHDRAW, &rec, sizeof(rec));
+    }
+
+    pthread_mutex_unlock(&client->lock);
+    metrics_op_done(METRIC_OP_WITHDRAW, status, start);
+    return status;
+}
+
+// 묶음 이체 (항목 전부 반영 또는 전부 거절)
+// 관련 고객을 client_no 순서로 한꺼번에 잠그고, 항목을 차례로 반영하다 하나라도 실패하면
+// 반영한 것을 되돌린다. 성공하면 WAL 레코드 하나로 남기므로 커밋도 한 번이다.
+// 출금 항목(음수)은 requester 본인 통장만 가능하고, 항목 합은 0이어야 한다.
+// 실패하면 failed_leg에 문제가 된 항목 번호(0부터, 항목과 무관하면 -1)를 넣는다.
+BankStatus bank_transfer(ClientInfo* requester, const TransferLeg* legs, int count, int* failed_leg) {
+    uint64_t start = now_ns();
+    int64_t sum = 0;
+
+    *failed_leg = -1;
+    if (count < 1 || count > TRANSFER_MAX_LEGS) {
+        metrics_op_done(METRIC_OP_TRANSFER, BANK_ERR_BAD_REQUEST, start);
+        return BANK_ERR_BAD_REQUEST;
+    }
+    for (int i = 0; i < count; i++) {
+        if (legs[i].amount == 0 || legs[i].amount == INT_MIN) {
+            *failed_leg = i;
+            metrics_op_done(METRIC_OP_TRANSFER, BANK_ERR_AMOUNT, start);
+            return BANK_ERR_AMOUNT;
+        }
+        if (legs[i].amount < 0 && legs[i].client != requester) {
+            *failed_leg = i;
+            metrics_op_done(METRIC_OP_TRANSFER, BANK_ERR_BAD_REQUEST, start);
+            return BANK_ERR_BAD_REQUEST;
+        }
+        sum += legs[i].amount;
+    }
+    if (sum != 0) {
+        metrics_op_done(METRIC_OP_TRANSFER, BANK_ERR_UNBALANCED, start);
+        return BANK_ERR_UNBALANCED;
+    }
+
+    // 다른 지점 고객이 끼어 있으면 2단계 커밋으로 (출금 항목은 본인 것이므로 항상 이 지점)
+    if (transfer_crosses_shards(legs, count)) {
+        int balance;
+        char bank_name[50];
+        BankStatus status = shard_commit(legs, count, failed_leg, &balance, bank_name);
+        metrics_op_done(METRIC_OP_TRANSFER, status, start);
+        return status;
+    }
+
+    size_t record_len = sizeof(WalTransfer) + sizeof(WalTransferLeg) * count;
+    ClientInfo** locked = malloc(sizeof(ClientInfo*) * count);
+    WalTransfer* rec = malloc(record_len);
+    if (locked == NULL || rec == NULL) {
+        free(locked);
+        free(rec);
+        metrics_op_done(METRIC_OP_TRANSFER, BANK_ERR_BAD_REQUEST, start);
+        return BANK_ERR_BAD_REQUEST;
+    }
+    for (int i = 0; i < count; i++) locked[i] = legs[i].client;
+    lock_clients(locked, count);
+    clients_write_begin(locked, count);
+
+    BankStatus status = transfer_apply_legs(legs, count, failed_leg);
+    if (status == BANK_OK) {
+        rec->leg_count = count;
+        for (int i = 0; i < count; i++) {
+            rec->legs[i].client_no = legs[i].client->client_no;
+            rec->legs[i].account_num = legs[i].account_num;
+            rec->legs[i].amount = legs[i].amount;
+        }
+        uint64_t lsn = wal_append(WAL_TRANSFER, rec, record_len);
+        for (int i = 0; i < count; i++) locked[i]->last_lsn = lsn;
+    }
+
+    clients_write_end(locked, count);
+    unlock_clients(locked, count);
+    free(locked);
+    free(rec);
+
+    metrics_op_done(METRIC_OP_TRANSFER, status, start);
+    return status;
+}
+
+// 다른 지점 고객 항목이 있는지 (있으면 지점 간 거래다)
+bool transfer_crosses_shards(const TransferLeg* legs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (legs[i].client == NULL) return true;
+    }
+    return false;
+}
+
+// 이 지점 고객의 항목을 차례로 반영 (고객 lock을 쥔 채 부른다, 다른 지점 항목은 건너뛴다)
+// 하나라도 실패하면 반영한 것을 되돌리고 failed_leg에 그 항목 번호를 넣는다.
+BankStatus transfer_apply_legs(const TransferLeg* legs, int count, int* failed_leg) {
+    BankStatus status = BANK_OK;
+    int applied = 0;
+    for (; applied < count; applied++) {
+        const TransferLeg* leg = &legs[applied];
+        ClientInfo* client = leg->client;
+        if (client == NULL) continue;
+        if (leg->account_num < 0 || leg->account_num >= client->account_count) {
+            status = BANK_ERR_NO_ACCOUNT;
+            break;
+        }
+        int* balance = &client->accounts[leg->account_num].balance;
+        if (leg->amount < 0 && *balance - eod_fee_due(client, leg->account_num) < -leg->amount) {
+            status = BANK_ERR_INSUFFICIENT;
+            break;
+        }
+        if (leg->amount > 0 && !hot_reserve_credit(client, leg->account_num, leg->amount)) {
+            status = BANK_ERR_AMOUNT;
+            break;
+        }
+        *balance += leg->amount;
+        if (leg->amount > 0) hot_release_credit(client, leg->account_num, leg->amount);
+    }
+
+    if (status != BANK_OK) {
+        *failed_leg = applied;
+        transfer_undo_legs(legs, applied);
+    }
+    return status;
+}
+
+// transfer_apply_legs()로 반영한 항목 되돌리기
+void transfer_undo_legs(const TransferLeg* legs, int count) {
+    while (count-- > 0) {
+        if (legs[count].client == NULL) continue;
+        legs[count].client->accounts[legs[count].account_num].balance -= legs[count].amount;
+    }
+}
+
+// 확인만 하고 결정을 기다리는 동안 들어갈 항목의 한도를 잡아 둔다 (지점 간 거래 준비, 고객 lock을 쥔 채)
+// 하나라도 모자라면 잡은 것을 풀고 failed_leg에 그 항목 번호를 넣는다.
+BankStatus transfer_reserve_legs(const TransferLeg* legs, int count, int* failed_leg) {
+    for (int i = 0; i < count; i++) {
+        const TransferLeg* leg = &legs[i];
+        if (leg->client == NULL || leg->amount <= 0) continue;
+        if (!hot_reserve_credit(leg->client, leg->account_num, leg->amount)) {
+            transfer_release_legs(legs, i);
+            *failed_leg = i;
+            return BANK_ERR_AMOUNT;
+        }
+    }
+    return BANK_OK;
+}
+
+// transfer_reserve_legs()로 잡은 앞 count개 항목의 한도 풀기
+void transfer_release_legs(const TransferLeg* legs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (legs[i].client == NULL || legs[i].amount <= 0) continue;
+        hot_release_credit(legs[i].client, legs[i].account_num, legs[i].amount);
+    }
+}
+
+// 확인하고 한도를 잡아 둔 항목 반영 (다시 확인하지 않는다)
+void transfer_commit_legs(const TransferLeg* legs, int count) {
+    for (int i = 0; i < count; i++) {
+        if (legs[i].client == NULL) continue;
+        legs[i].client->accounts[legs[i].account_num].balance += legs[i].amount;
+    }
+    transfer_release_legs(legs, count);
+}
+
+// 이체 항목의 대상 정하기 (이 지점 고객이면 client, 다른 지점 고객이면 지점 번호와 ID)
+// 어느 지점에도 있을 수 없는 ID면 false (다른 지점 고객이 실제로 있는지는 준비 단계에서 확인한다)
+bool transfer_leg_target(TransferLeg* leg, const char* client_id) {
+    snprintf(leg->client_id, sizeof(leg->client_id), "%s", client_id);
+    leg->client = find_client_by_id(client_id);
+    leg->shard = shard.index;
+    if (leg->client != NULL) return true;
+    if (shard.count == 0 || client_id[0] == 0 || shard_owns(client_id)) return false;
+    leg->shard = shard_of(client_id);
+    return true;
+}
+
+// ========== WAL (선행 기록 로그) ==========
+
+// CRC32 (IEEE) 테이블 초기화
+void crc32_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc32_table[i] = c;
+    }
+}
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len) {
+    const unsigned char* p = data;
+    crc = ~crc;
+    while (len--) {
+        crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// 레코드 CRC (len 필드부터 본문 끝까지)
+uint32_t wal_record_crc(const WalHeader* h, const void* body) {
+    uint32_t crc = crc32_update(0, (const char*)h + 4, sizeof(WalHeader) - 4);
+    return crc32_update(crc, body, h->len);
+}
+
+// 로그 레코드 하나를 메모리 상태에 반영 (기동 시 복구용, 잠금 없음)
+// 스냅샷에 이미 들어 있는 레코드(고객의 last_lsn 이하)는 건너뛴다.
+void wal_apply(const WalHeader* h, const void* body) {
+    switch (h->type) {
+        case WAL_OPEN: {
+            const WalOpen* r = body;
+            ClientInfo* client = client_at(r->client_no);
+            if (h->len != sizeof(WalOpen) || client == NULL ||
+                r->account_num >= (uint32_t)max_accounts) break;
+            if (h->lsn <= client->last_lsn) break;
+            Account* account = &client->accounts[r->account_num];
+            memcpy(account->bank_name, r->bank_name, sizeof(r->bank_name));
+            account->bank_name[49] = 0;
+            account->balance = 0;
+            account->is_active = true;
+            if (client->account_count < (int)r->account_num + 1) {
+                client->account_count = r->account_num + 1;
+            }
+            client->last_lsn = h->lsn;
+            break;
+        }
+        case WAL_DEPOSIT: {
+            const WalDeposit* r = body;
+            ClientInfo* client = client_at(r->client_no);
+            if (h->len != sizeof(WalDeposit) || client == NULL ||
+                r->account_num >= (uint32_t)max_accounts) break;
+            if (h->lsn <= client->last_lsn) break;
+            client->accounts[r->account_num].balance += r->amount;
+            client->last_lsn = h->lsn;
+            break;
+        }
+        case WAL_WITHDRAW: {
+            const WalWithdraw* r = body;
+            ClientInfo* client = client_at(r->client_no);
+            if (h->len != sizeof(WalWithdraw) || client == NULL ||
+                r->account_num >= (uint32_t)max_accounts) break;
+            if (h->lsn <= client->last_lsn) break;
+            client->accounts[r->account_num].balance -= r->amount;
+            client->last_lsn = h->lsn;
+            break;
+        }
+        case WAL_TRANSFER: {
+            const WalTransfer* r = body;
+            if (h->len < sizeof(WalTransfer) ||
+                h->len != sizeof(WalTransfer) + sizeof(WalTransferLeg) * r->leg_count) break;
+            wal_apply_legs(h->lsn, r->legs, r->leg_count);
+            break;
+        }
+        case WAL_XCOMMIT:
+        case WAL_XAPPLY: {
+            // 지점 간 거래는 이 지점 고객의 항목만 담고 있다 (PREPARE/XABORT/XEND는 잔고와 무관)
+            const WalShardTx* r = body;
+            if (h->len < sizeof(WalShardTx) ||
+                h->len != sizeof(WalShardTx) + sizeof(WalTransferLeg) * r->leg_count) break;
+            wal_apply_legs(h->lsn, r->legs, r->leg_count);
+            break;
+        }
+        case WAL_REGISTER: {
+            const WalRegister* r = body;
+            if (h->len != sizeof(WalRegister)) break;
+            // 스냅샷에 이미 들어 있는 고객이면 번호와 ID가 같아야 한다
+            ClientInfo* client = client_at(r->client_no);
+            if (client == NULL && (int)r->client_no == client_count()) {
+                client = directory_add(r->client_id, r->ip);
+                if (client != NULL) client->last_lsn = h->lsn;
+            }
+            if (client == NULL || strncmp(client->client_id, r->client_id, CLIENT_ID_SIZE) != 0) {
+                fprintf(stderr, "❌ WAL의 고객 등록(%.*s, 번호 %u)을 복구할 수 없습니다 "
+                        "(--clients 값이 바뀌었나요?)\n",
+                        CLIENT_ID_SIZE, r->client_id, r->client_no);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case WAL_EPOCH_DATA:
+        case WAL_EPOCH:
+            eod_replay(h, body);
+            break;
+    }
+}
+
+// 이체 항목들 반영 (wal_apply)
+// 스냅샷에 이미 들어간 고객은 건너뛴다. 한 고객이 여러 항목에 나올 수 있으므로
+// last_lsn은 모든 항목을 반영한 다음에 올린다.
+void wal_apply_legs(uint64_t lsn, const WalTransferLeg* legs, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const WalTransferLeg* leg = &legs[i];
+        ClientInfo* client = client_at(leg->client_no);
+        if (client == NULL || leg->account_num >= (uint32_t)max_accounts) continue;
+        if (lsn <= client->last_lsn) continue;
+        client->accounts[leg->account_num].balance += leg->amount;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ClientInfo* client = client_at(legs[i].client_no);
+        if (client != NULL && client->last_lsn < lsn) client->last_lsn = lsn;
+    }
+}
+
+// 세그먼트 파일 경로 (파일 이름 = 첫 레코드의 LSN)
+void wal_segment_path(char* path, size_t size, uint64_t base_lsn) {
+    snprintf(path, size, "%s/wal-%020llu.log", data_dir, (unsigned long long)base_lsn);
+}
+
+int wal_segment_compare(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// 데이터 디렉터리의 세그먼트 목록 (첫 LSN 오름차순, 호출자가 free)
+int wal_list_segments(uint64_t** bases_out) {
+    DIR* dir = opendir(data_dir);
+    uint64_t* bases = NULL;
+    int count = 0, cap = 0;
+    struct dirent* ent;
+
+    if (dir == NULL) {
+        perror("opendir failed");
+        exit(EXIT_FAILURE);
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        unsigned long long base;
+        char tail;
+        if (sscanf(ent->d_name, "wal-%llu.lo%c", &base, &tail) != 2 || tail != 'g') continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            bases = realloc(bases, cap * sizeof(uint64_t));
+        }
+        bases[count++] = base;
+    }
+    closedir(dir);
+
+    qsort(bases, count, sizeof(uint64_t), wal_segment_compare);
+    *bases_out = bases;
+    return count;
+}
+
+// 새 세그먼트 열기 (기록 스레드 또는 기동 시에만 호출)
+void wal_open_segment(uint64_t base_lsn) {
+    char path[PATH_MAX];
+
+    wal_segment_path(path, sizeof(path), base_lsn);
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("WAL segment open failed");
+        exit(EXIT_FAILURE);
+    }
+    if (wal.fd >= 0) close(wal.fd);
+    wal.fd = fd;
+    wal.segment_base = base_lsn;
+    wal.segment_size = lseek(fd, 0, SEEK_END);
+
+    // 새 파일의 디렉터리 항목도 내려보내야 재시작 후 세그먼트가 보인다
+    int dir_fd = open(data_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+// 기존 로그를 읽어 DB를 복구한다 (스냅샷을 먼저 불러 두었다면 그 이후만)
+// 마지막 세그먼트 끝부분의 잘린 레코드(기록 도중 중단)는 버리고 파일을 그 앞까지 자른다.
+void wal_replay(uint64_t start_lsn) {
+    uint64_t* bases;
+    int count = wal_list_segments(&bases);
+    uint64_t expected = start_lsn + 1;
+    uint64_t last_end = expected;   // 마지막 세그먼트 다음 LSN
+    char* body = NULL;
+    size_t body_cap = 0;
+    long applied = 0;
+
+    if (count > 0 && bases[0] > start_lsn + 1) {
+        fprintf(stderr, "❌ WAL 구간 누락: 스냅샷은 LSN %llu까지인데 로그는 %llu부터 있습니다\n",
+            (unsigned long long)start_lsn, (unsigned long long)bases[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < count; i++) {
+        // 다음 세그먼트가 스냅샷 안쪽에서 시작하면 이 세그먼트는 전부 스냅샷에 들어 있다
+        // 지점을 나눴으면 남은 세그먼트를 모두 읽는다 (스냅샷 전에 준비한 지점 간 거래를 찾는다)
+        if (shard.count == 0 && i + 1 < count && bases[i + 1] <= start_lsn + 1) continue;
+
+        char path[PATH_MAX];
+        wal_segment_path(path, sizeof(path), bases[i]);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            perror("WAL segment open failed");
+            exit(EXIT_FAILURE);
+        }
+
+        uint64_t lsn = bases[i];
+        if (lsn > expected) {
+            fprintf(stderr, "❌ WAL 구간 누락: LSN %llu 다음이 %llu입니다\n",
+                (unsigned long long)(expected - 1), (unsigned long long)lsn);
+            exit(EXIT_FAILURE);
+        }
+
+        WalHeader h;
+        off_t good_end = 0;
+        while (1) {
+            if (read(fd, &h, sizeof(h)) != (ssize_t)sizeof(h)) break;
+            if (h.len > WAL_MAX_RECORD) break;
+            if (h.len > body_cap) {
+                body_cap = h.len;
+                body = realloc(body, body_cap);
+            }
+            if (h.len > 0 && read(fd, body, h.len) != (ssize_t)h.len) break;
+            if (wal_record_crc(&h, body) != h.crc || h.lsn != lsn) break;
+
+            if (h.lsn > start_lsn) {
+                wal_apply(&h, body);
+                ledger_record(&h, body);
+                applied++;
+            }
+            if (shard.count > 0) {
+                shard_track(&h, body);
+            }
+            lsn++;
+            good_end += sizeof(h) + h.len;
+        }
+
+        off_t file_end = lseek(fd, 0, SEEK_END);
+        if (file_end != good_end) {
+            if (i + 1 < count) {
+                fprintf(stderr, "❌ WAL 세그먼트 손상: %s (오프셋 %ld)\n", path, (long)good_end);
+                exit(EXIT_FAILURE);
+            }
+            LOG_WARN("⚠️  WAL 끝부분 손상 %ld바이트 제거\n", (long)(file_end - good_end));
+            if (ftruncate(fd, good_end) < 0) {
+                perror("ftruncate failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        close(fd);
+        if (lsn > expected) expected = lsn;
+        last_end = lsn;
+    }
+    free(body);
+
+    // 마지막 세그먼트에 이어 쓴다 (없으면 새로 만든다)
+    // 스냅샷이 마지막 세그먼트보다 앞서 있으면 (대기 서버가 스냅샷을 받다 멈춘 경우) 새 세그먼트에서 시작한다
+    wal.next_lsn = expected;
+    wal_open_segment(count > 0 && last_end == expected ? bases[count - 1] : expected);
+    free(bases);
+
+    wal.written_lsn = wal.durable_lsn = wal.next_lsn - 1;
+    startup_stats.wal_records = applied;
+    LOG_INFO("📜 WAL 복구: %ld건 적용 (LSN %llu까지)\n",
+        applied, (unsigned long long)(wal.next_lsn - 1));
+}
+
+// 로그 열기 및 복구, 기록 스레드 시작
+void wal_open() {
+    struct timespec t0, t1, t2;
+
+    if (mkdir(data_dir, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir data dir failed");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&wal.mutex, NULL);
+    pthread_cond_init(&wal.work, NULL);
+    pthread_cond_init(&wal.flushed, NULL);
+    wal.buf_cap = wal.flush_cap = 64 * 1024;
+    wal.buf = malloc(wal.buf_cap);
+    wal.flush_buf = malloc(wal.flush_cap);
+    if (wal.buf == NULL || wal.flush_buf == NULL) {
+        perror("WAL buffer malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t ledger_end;
+    uint64_t start_lsn = snapshot_load(&ledger_end);
+    ledger_open(ledger_end);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wal_replay(start_lsn);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    startup_stats.snapshot_ms = elapsed_ms(&t0, &t1);
+    startup_stats.replay_ms = elapsed_ms(&t1, &t2);
+
+    // uring 모드는 기록 스레드도 io_uring으로 쓴다 (링을 못 만들면 write/fdatasync)
+    if (server_mode == MODE_URING) {
+        wal.ring = malloc(sizeof(Uring));
+        if (wal.ring != NULL && uring_init(wal.ring, 4, 0) < 0) {
+            LOG_WARN("⚠️  WAL io_uring 생성 실패 (%s), write/fdatasync로 기록합니다.\n", strerror(errno));
+            free(wal.ring);
+            wal.ring = NULL;
+        }
+    }
+
+    wal.enabled = true;
+    pthread_create(&wal.thread, NULL, wal_writer_func, NULL);
+
+    const char* policy = (wal.policy == WAL_SYNC_FSYNC) ? "fsync" :
+                         (wal.policy == WAL_SYNC_INTERVAL) ? "interval" : "none";
+    LOG_INFO("💾 WAL: %s (동기화 정책: %s%s)\n", data_dir, policy, wal.ring ? ", io_uring" : "");
+
+    if (snapshot_interval > 0) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, snapshot_thread_func, NULL);
+        pthread_detach(thread);
+    }
+}
+
+// 레코드 추가 (메모리 버퍼에만 넣고 LSN을 돌려준다)
+// 잔고를 바꾼 고객 lock을 쥔 채로 호출해야 같은 통장의 로그 순서가 변경 순서와 같아진다.
+uint64_t wal_append(uint32_t type, const void* body, uint32_t len) {
+    return wal_append_at(type, body, len, (uint32_t)time(NULL));
+}
+
+// 기록 시각을 정해 레코드 추가 (대기 서버는 주 서버가 붙인 시각을 그대로 쓴다)
+// 잔고를 바꾸는 레코드는 관련 통장의 원장에도 같은 LSN과 시각으로 적는다.
+uint64_t wal_append_at(uint32_t type, const void* body, uint32_t len, uint32_t stamp) {
+    WalHeader h;
+    h.len = len;
+    h.lsn = 0;
+    h.type = type;
+    h.time = stamp;
+    wal_append_record(&h, body);
+    ledger_record(&h, body);
+    return h.lsn;
+}
+
+// 헤더를 채워 레코드를 버퍼에 추가 (h->lsn에 LSN, WAL이 꺼져 있으면 0). 원장은 부른 쪽이 적는다.
+// wal.mutex는 LSN과 자리를 잡는 동안만 쥔다. CRC와 복사는 자리를 잡은 스레드가 lock 밖에서 한다.
+void wal_append_record(WalHeader* h, const void* body) {
+    uint32_t len = h->len;
+    h->lsn = 0;
+    if (!wal.enabled) {
+        return;
+    }
+
+    pthread_mutex_lock(&wal.mutex);
+
+    size_t need = wal.buf_len + sizeof(WalHeader) + len;
+    if (need > wal.buf_cap) {
+        // 옮기기 전에 이 버퍼를 채우는 중인 레코드가 끝나야 한다
+        wal_wait_filled(wal.buf_gen);
+        size_t cap = wal.buf_cap;
+        while (cap < need) cap *= 2;
+        char* buf = realloc(wal.buf, cap);
+        if (buf == NULL) {
+            perror("WAL buffer realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        wal.buf = buf;
+        wal.buf_cap = cap;
+    }
+
+    h->lsn = wal.next_lsn++;
+    char* dst = wal.buf + wal.buf_len;
+    wal.buf_len += sizeof(*h) + len;
+    int gen = wal.buf_gen;
+    atomic_fetch_add_explicit(&wal.filling[gen], 1, memory_order_relaxed);
+    pthread_mutex_unlock(&wal.mutex);
+
+    h->crc = wal_record_crc(h, body);
+    memcpy(dst, h, sizeof(*h));
+    memcpy(dst + sizeof(*h), body, len);
+    atomic_fetch_sub_explicit(&wal.filling[gen], 1, memory_order_release);
+
+    // buf_len은 mutex 안에서 늘렸으므로 기록 스레드가 이미 깨어 있거나 이 신호를 받는다
+    pthread_cond_signal(&wal.work);
+    wal_last_lsn = h->lsn;
+}
+
+// gen 버퍼에 자리를 잡은 레코드가 모두 채워질 때까지 대기 (채우는 쪽은 lock을 잡지 않으므로 곧 끝난다)
+void wal_wait_filled(int gen) {
+    while (atomic_load_explicit(&wal.filling[gen], memory_order_acquire) > 0) {
+        sched_yield();
+    }
+}
+
+// lsn까지 응답해도 되는지 (fsync 정책이 아니면 기록 즉시 응답한다)
+bool wal_is_durable(uint64_t lsn) {
+    if (!wal.enabled || wal.policy != WAL_SYNC_FSYNC || lsn == 0) return true;
+    return atomic_load(&wal.durable_lsn) >= lsn;
+}
+
+// lsn이 디스크에 내려갈 때까지 대기 (스레드 모드)
+void wal_wait_durable(uint64_t lsn) {
+    if (wal_is_durable(lsn)) return;
+
+    pthread_mutex_lock(&wal.mutex);
+    while (atomic_load(&wal.durable_lsn) < lsn) {
+        pthread_cond_wait(&wal.flushed, &wal.mutex);
+    }
+    pthread_mutex_unlock(&wal.mutex);
+}
+
+// 동기화 정책과 상관없이 lsn까지 fdatasync 시키고 기다린다 (스냅샷 전)
+void wal_sync(uint64_t lsn) {
+    pthread_mutex_lock(&wal.mutex);
+    while (atomic_load(&wal.durable_lsn) < lsn) {
+        wal.sync_requested = true;
+        pthread_cond_signal(&wal.work);
+        pthread_cond_wait(&wal.flushed, &wal.mutex);
+    }
+    pthread_mutex_unlock(&wal.mutex);
+}
+
+// 복제해도 되는 마지막 LSN (wal.mutex를 쥔 채 부른다)
+// fsync 정책이면 디스크에 내려간 것까지, 아니면 응답한 것(write까지 끝난 것)까지.
+uint64_t wal_committed_lsn() {
+    return wal.policy == WAL_SYNC_FSYNC ? atomic_load(&wal.durable_lsn) : wal.written_lsn;
+}
+
+// 기록 완료를 알릴 eventfd 등록 (epoll 리액터)
+void wal_add_notify_fd(int fd) {
+    pthread_mutex_lock(&wal.mutex);
+    if (wal.notify_count < (int)(sizeof(wal.notify_fds) / sizeof(wal.notify_fds[0]))) {
+        wal.notify_fds[wal.notify_count++] = fd;
+    }
+    pthread_mutex_unlock(&wal.mutex);
+}
+
+// 기록 스레드
+// 쌓인 레코드를 한 번에 write + fdatasync 한다. fsync 중에 들어온 레코드는
+// 다음 묶음으로 모이므로, 동시에 커밋하는 워커가 많을수록 fsync 한 번이 더 많은 거래를 덮는다.
+void* wal_writer_func(void* arg) {
+    (void)arg;
+    struct timespec last_sync;
+    clock_gettime(CLOCK_MONOTONIC, &last_sync);
+
+    while (1) {
+        pthread_mutex_lock(&wal.mutex);
+        while (wal.buf_len == 0 && !wal.sync_requested) {
+            if (wal.policy == WAL_SYNC_INTERVAL && wal.written_lsn > wal.durable_lsn) {
+                // 기록만 되고 아직 동기화 안 된 레코드가 있으면 주기에 맞춰 깨어난다
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_nsec += (long)wal_interval_ms * 1000000L;
+                deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+                deadline.tv_nsec %= 1000000000L;
+                if (pthread_cond_timedwait(&wal.work, &wal.mutex, &deadline) == ETIMEDOUT) break;
+            } else {
+                pthread_cond_wait(&wal.work, &wal.mutex);
+            }
+        }
+
+        // 버퍼 교체: 기록하는 동안에도 워커는 계속 추가할 수 있다
+        char* tmp = wal.flush_buf;
+        size_t tmp_cap = wal.flush_cap;
+        wal.flush_buf = wal.buf;
+        wal.flush_cap = wal.buf_cap;
+        size_t len = wal.buf_len;
+        wal.buf = tmp;
+        wal.buf_cap = tmp_cap;
+        wal.buf_len = 0;
+        int gen = wal.buf_gen;
+        wal.buf_gen ^= 1;
+        uint64_t upto = wal.next_lsn - 1;
+        bool force_sync = wal.sync_requested;
+        bool rotate = wal.rotate_requested;
+        wal.sync_requested = false;
+        wal.rotate_requested = false;
+        pthread_mutex_unlock(&wal.mutex);
+
+        // 자리만 잡고 아직 채우지 않은 레코드가 있으면 끝날 때까지 기다린다
+        wal_wait_filled(gen);
+
+        bool synced = force_sync;
+        if (wal.policy == WAL_SYNC_FSYNC) {
+            synced = true;
+        } else if (wal.policy == WAL_SYNC_INTERVAL) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            synced = synced || elapsed_ms(&last_sync, &now) >= wal_interval_ms;
+        }
+
+        // uring 모드는 write와 fdatasync를 이어 붙여 한 번에 제출한다 (일부만 써지면 나머지는 아래에서)
+        bool need_sync = synced;
+        size_t off = 0;
+        if (wal.ring != NULL && len > 0) {
+            bool done_sync = false;
+            off = wal_write_uring(len, synced, &done_sync);
+            need_sync = synced && !done_sync;
+        }
+        while (off < len) {
+            ssize_t n = write(wal.fd, wal.flush_buf + off, len - off);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("WAL write failed");
+                exit(EXIT_FAILURE);
+            }
+            off += n;
+        }
+        wal.segment_size += len;
+
+        if (synced) {
+            if (need_sync && fdatasync(wal.fd) < 0) {
+                perror("WAL fdatasync failed");
+                exit(EXIT_FAILURE);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &last_sync);
+        }
+
+        // 세그먼트가 가득 차면 새 파일로 넘어간다 (지난 세그먼트는 스냅샷 후 삭제된다)
+        if (synced && (rotate || wal.segment_size >= WAL_SEGMENT_SIZE)) {
+            wal_open_segment(upto + 1);
+        }
+
+        pthread_mutex_lock(&wal.mutex);
+        wal.written_lsn = upto;
+        if (synced) {
+            atomic_store(&wal.durable_lsn, upto);
+        }
+        wal.groups++;
+        pthread_cond_broadcast(&wal.flushed);
+        int notify_count = wal.notify_count;
+        pthread_mutex_unlock(&wal.mutex);
+
+        // 응답을 보류 중인 리액터 깨우기
+        if (synced) {
+            uint64_t one = 1;
+            for (int i = 0; i < notify_count; i++) {
+                if (write(wal.notify_fds[i], &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                    perror("eventfd write failed");
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// 묶음 하나를 io_uring으로 기록 (sync면 fdatasync를 이어 붙여 같은 io_uring_enter로 제출)
+// 쓴 바이트 수를 돌려주고, fdatasync까지 끝났으면 synced를 true로 한다.
+size_t wal_write_uring(size_t len, bool sync, bool* synced) {
+    Uring* ring = wal.ring;
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = wal.fd;
+    sqe->addr = (uint64_t)(uintptr_t)wal.flush_buf;
+    sqe->len = len;
+    sqe->off = (uint64_t)-1;     // 현재 위치 (O_APPEND)
+    sqe->user_data = IORING_OP_WRITE;
+    if (sync) {
+        sqe->flags = IOSQE_IO_LINK;  // 일부만 써지면 fdatasync는 취소된다
+        sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = wal.fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->user_data = IORING_OP_FSYNC;
+    }
+
+    unsigned want = sync ? 2 : 1;
+    unsigned got = 0;
+    size_t written = 0;
+    *synced = false;
+    while (got < want) {
+        if (uring_enter(ring, want - got, -1) < 0) {
+            perror("WAL io_uring_enter failed");
+            exit(EXIT_FAILURE);
+        }
+        unsigned head = *ring->cq_head;
+        unsigned tail = atomic_load_explicit((_Atomic unsigned*)ring->cq_tail, memory_order_acquire);
+        for (; head != tail; head++, got++) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            if (cqe->user_data == IORING_OP_WRITE) {
+                if (cqe->res < 0 && cqe->res != -EINTR && cqe->res != -EAGAIN) {
+                    errno = -cqe->res;
+                    perror("WAL write failed");
+                    exit(EXIT_FAILURE);
+                }
+                written = cqe->res > 0 ? (size_t)cqe->res : 0;
+            } else if (cqe->res == 0) {
+                *synced = true;
+            } else if (cqe->res != -ECANCELED) {
+                errno = -cqe->res;
+                perror("WAL fdatasync failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        atomic_store_explicit((_Atomic unsigned*)ring->cq_head, head, memory_order_release);
+    }
+    return written;
+}
+
+// 경과 시간 (ms)
+double elapsed_ms(const struct timespec* from, const struct timespec* to) {
+    return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+// ========== 스냅샷 (체크포인트) ==========
+
+// 스냅샷 불러오기 (mmap으로 읽어 고객 디렉터리에 복사)
+// 기본 고객은 이미 만들어져 있으므로 번호와 ID가 맞는지만 보고, 그 뒤는 등록된 고객으로 추가한다.
+// 스냅샷이 담고 있는 마지막 LSN을 돌려주고 ledger_end에 함께 확정된 원장 길이를 넣는다. 파일이 없으면 0.
+uint64_t snapshot_load(uint64_t* ledger_end) {
+    char path[PATH_MAX];
+    struct stat st;
+
+    *ledger_end = 0;
+    snprintf(path, sizeof(path), "%s/bank.snap", data_dir);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return 0;
+        perror("snapshot open failed");
+        exit(EXIT_FAILURE);
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SnapshotFile)) {
+        fprintf(stderr, "❌ 스냅샷 크기가 맞지 않습니다: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t file_size = st.st_size;
+    const SnapshotFile* snap = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snap == MAP_FAILED) {
+        perror("snapshot mmap failed");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t record_size = sizeof(SnapshotClient) + snap->max_accounts * sizeof(SnapshotAccount);
+    size_t data_size = file_size - sizeof(SnapshotFile);
+    if (memcmp(snap->magic, SNAPSHOT_MAGIC, sizeof(snap->magic)) != 0 ||
+        snap->version != SNAPSHOT_VERSION ||
+        data_size != (size_t)snap->client_count * record_size ||
+        crc32_update(0, snap->clients, data_size) != snap->crc) {
+        fprintf(stderr, "❌ 스냅샷이 손상되었거나 형식이 다릅니다: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < snap->client_count; i++) {
+        const SnapshotClient* sc = (const SnapshotClient*)(snap->clients + i * record_size);
+        char client_id[CLIENT_ID_SIZE];
+        memcpy(client_id, sc->client_id, CLIENT_ID_SIZE);
+        client_id[CLIENT_ID_SIZE - 1] = 0;
+
+        ClientInfo* client = client_at(i);
+        if (client == NULL) {
+            client = directory_add(client_id, sc->ip);
+        }
+        if (client == NULL || strcmp(client->client_id, client_id) != 0 ||
+            sc->account_count > (uint32_t)max_accounts) {
+            fprintf(stderr, "❌ 스냅샷의 고객 %s(번호 %u)을 불러올 수 없습니다 "
+                    "(--clients 또는 --max-accounts 값이 바뀌었나요?)\n", client_id, i);
+            exit(EXIT_FAILURE);
+        }
+
+        client->account_count = sc->account_count;
+        client->last_lsn = sc->last_lsn;
+        client->epoch = sc->epoch;
+        if (sc->epoch > atomic_load(&eod.epoch)) atomic_store(&eod.epoch, sc->epoch);
+        for (uint32_t j = 0; j < sc->account_count; j++) {
+            memcpy(client->accounts[j].bank_name, sc->accounts[j].bank_name, 50);
+            client->accounts[j].bank_name[49] = 0;
+            client->accounts[j].balance = sc->accounts[j].balance;
+            client->accounts[j].is_active = sc->accounts[j].is_active;
+        }
+    }
+
+    uint64_t start_lsn = snap->start_lsn;
+    uint32_t loaded = snap->client_count;
+    *ledger_end = snap->ledger_end;
+    munmap((void*)snap, file_size);
+
+    LOG_INFO("📸 스냅샷 불러오기: LSN %llu 시점 (고객 %u명)\n", (unsigned long long)start_lsn, loaded);
+    return start_lsn;
+}
+
+// 스냅샷 찍기
+// 고객을 한 명씩 잠가 복사하므로 워커가 멈추는 구간은 고객 한 명분이다 (전체 잠금 없음).
+// 복사하는 동안 들어온 거래는 고객별 last_lsn으로 구분되어, 복구 시 스냅샷에 없는 것만 재실행된다.
+// 고객 레코드는 버퍼로 흘려 쓰고, 헤더(CRC 포함)는 마지막에 채운다.
+void snapshot_write() {
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+    SnapshotFile header;
+    size_t record_size = sizeof(SnapshotClient) + max_accounts * sizeof(SnapshotAccount);
+    SnapshotClient* sc = calloc(1, record_size);
+    uint64_t max_lsn;
+
+    if (sc == NULL) {
+        perror("snapshot calloc failed");
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/bank.snap", data_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/bank.snap.tmp", data_dir);
+    FILE* fp = fopen(tmp_path, "we");
+    if (fp == NULL) {
+        perror("snapshot open failed");
+        free(sc);
+        return;
+    }
+
+    // 이 LSN 이하의 거래는 모두 메모리에 반영되어 있다 (고객 lock을 쥔 채 기록되므로)
+    // 고객 수는 그 뒤에 읽는다. 사이에 등록된 고객은 복구 때 WAL_REGISTER를 건너뛴다.
+    memset(&header, 0, sizeof(header));
+    pthread_mutex_lock(&wal.mutex);
+    header.start_lsn = wal.next_lsn - 1;
+    pthread_mutex_unlock(&wal.mutex);
+    max_lsn = header.start_lsn;
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.client_count = client_count();
+    header.max_accounts = max_accounts;
+
+    bool failed = fwrite(&header, sizeof(header), 1, fp) != 1;
+    for (uint32_t i = 0; i < header.client_count && !failed; i++) {
+        ClientInfo* client = client_at(i);
+
+        memset(sc, 0, record_size);
+        client_lock(client);
+        memcpy(sc->client_id, client->client_id, CLIENT_ID_SIZE);
+        sc->ip = client->ip;
+        sc->account_count = client->account_count;
+        sc->last_lsn = client->last_lsn;
+        sc->epoch = client->epoch;
+        for (int j = 0; j < client->account_count; j++) {
+            memcpy(sc->accounts[j].bank_name, client->accounts[j].bank_name, 50);
+            sc->accounts[j].balance = client->accounts[j].balance;
+            sc->accounts[j].is_active = client->accounts[j].is_active;
+        }
+        ledger_save_client(client);
+        pthread_mutex_unlock(&client->lock);
+
+        if (sc->last_lsn > max_lsn) max_lsn = sc->last_lsn;
+        header.crc = crc32_update(header.crc, sc, record_size);
+        failed = fwrite(sc, record_size, 1, fp) != 1;
+    }
+    free(sc);
+
+    // 원장은 지금까지 적은 데까지를 이 스냅샷과 함께 확정한다. 그 안의 항목은 모두 길이를 읽기 전에
+    // 로그에 추가된 레코드에서 나왔으므로, 그 뒤의 마지막 LSN까지 내려보내면 원장이 로그를 앞서지 않는다.
+    header.ledger_end = atomic_load(&ledger_file.end);
+    pthread_mutex_lock(&wal.mutex);
+    if (wal.next_lsn - 1 > max_lsn) max_lsn = wal.next_lsn - 1;
+    pthread_mutex_unlock(&wal.mutex);
+
+    // 스냅샷에 담긴 거래는 로그에도 먼저 내려가 있어야 LSN이 끊기지 않는다
+    wal_sync(max_lsn);
+
+    if (!failed) {
+        failed = fflush(fp) != 0 ||
+                 pwrite(fileno(fp), &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+                 (ledger_file.fd >= 0 && fdatasync(ledger_file.fd) < 0);
+    }
+    if (failed) {
+        perror("snapshot write failed");
+        fclose(fp);
+        unlink(tmp_path);
+        return;
+    }
+
+    // 임시 파일을 내려보낸 뒤 이름을 바꿔 교체한다 (중간에 죽어도 이전 스냅샷이 남는다)
+    if (fsync(fileno(fp)) < 0 || rename(tmp_path, path) < 0) {
+        perror("snapshot commit failed");
+        fclose(fp);
+        unlink(tmp_path);
+        return;
+    }
+    fclose(fp);
+
+    int dir_fd = open(data_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    LOG_INFO("📸 스냅샷 저장: LSN %llu 시점 (고객 %u명)\n",
+        (unsigned long long)header.start_lsn, header.client_count);
+    snapshot_prune_segments(shard.count > 0 ? shard_prune_floor(header.start_lsn) : header.start_lsn);
+}
+
+// 스냅샷에 모두 들어간 세그먼트 삭제 (마지막 세그먼트는 기록 중이므로 남긴다)
+void snapshot_prune_segments(uint64_t start_lsn) {
+    uint64_t* bases;
+    int count = wal_list_segments(&bases);
+
+    for (int i = 0; i + 1 < count; i++) {
+        if (bases[i + 1] > start_lsn + 1) break;
+
+        char path[PATH_MAX];
+        wal_segment_path(path, sizeof(path), bases[i]);
+        if (unlink(path) < 0) {
+            perror("WAL segment unlink failed");
+        }
+    }
+    free(bases);
+}
+
+// 스냅샷 스레드 (snapshot_interval초마다, 그 사이 거래가 있었을 때만)
+void* snapshot_thread_func(void* arg) {
+    (void)arg;
+    uint64_t last_lsn = wal.next_lsn - 1;
+
+    while (1) {
+        sleep(snapshot_interval);
+
+        pthread_mutex_lock(&wal.mutex);
+        uint64_t lsn = wal.next_lsn - 1;
+        pthread_mutex_unlock(&wal.mutex);
+
+        if (lsn != last_lsn) {
+            pthread_mutex_lock(&snapshot_mutex);
+            snapshot_write();
+            pthread_mutex_unlock(&snapshot_mutex);
+            last_lsn = lsn;
+        }
+    }
+
+    return NULL;
+}
+
+// 워커 스레드 함수
+void* worker_thread_func(void* arg) {
+    WorkerThread* worker = (WorkerThread*)arg;
+    atomic_uint_fast64_t* my_word = &idle_workers[(worker->worker_id - 1) / 64];
+    uint_fast64_t my_bit = (uint_fast64_t)1 << ((worker->worker_id - 1) % 64);
+    struct timespec idle_timeout = { worker_idle_sec, 0 };
+    
+    while (1) {
+        // 업무 대기
+        Connection conn;
+        if (!dequeue(&conn)) {
+            // 쉬는 창구로 등록한 뒤 큐를 한 번 더 확인한다.
+            // 생산자는 "큐에 넣고 비트맵 확인", 워커는 "비트맵에 등록하고 큐 확인" 순서라
+            // 어느 쪽이든 상대를 반드시 보게 되어 깨우기가 누락되지 않는다.
+            atomic_store(&worker->wake, 0);
+            atomic_fetch_or(my_word, my_bit);
+            if (!dequeue(&conn)) {
+                bool timed_out = false;
+                while (atomic_load(&worker->wake) == 0 && !timed_out) {
+                    timed_out = futex_wait(&worker->wake, 0, &idle_timeout) == ETIMEDOUT;
+                }
+                if (timed_out && worker_try_retire(worker)) {
+                    return NULL;
+                }
+                continue;
+            }
+            // 직접 가져갔으면 등록을 거둔다 (이미 생산자가 지웠다면 남은 wake 신호는 무해)
+            atomic_fetch_and(my_word, ~my_bit);
+        }
+
+        int client_fd = conn.client_fd;
+        worker->client_fd = client_fd;
+        LOG_DEBUG("🪟 창구 %d번에 배정되었습니다.\n", worker->worker_id);
+
+        uint64_t assigned_ns = now_ns();
+        hist_record(&metrics.queue_wait[conn.qclass], assigned_ns - conn.enqueued_ns);
+        hist_record(&metrics.accept_to_assign, assigned_ns - conn.accepted_ns);
+
+        struct timespec busy_start, busy_end;
+        clock_gettime(CLOCK_MONOTONIC, &busy_start);
+
+        // 고객은 수락할 때 IP로 이미 확인해 두었다
+        atomic_fetch_add(&conn.client->windows, 1);
+        handle_client(worker->worker_id, conn, conn.client);
+        atomic_fetch_sub(&conn.client->windows, 1);
+
+        // 업무 종료 (다음 루프에서 대기 고객을 바로 확인한다)
+        close(client_fd);
+        worker->client_fd = -1;
+        clock_gettime(CLOCK_MONOTONIC, &busy_end);
+        atomic_fetch_add(&worker->busy_ns, (uint64_t)(elapsed_ms(&busy_start, &busy_end) * 1e6));
+        atomic_fetch_add(&worker->sessions, 1);
+        LOG_DEBUG("🪟 창구 %d번 업무 종료. 대기 상태로 전환. (가동률 %.0f%%)\n",
+            worker->worker_id, worker_utilization(worker));
+    }
+    
+    return NULL;
+}
+
+// 클라이언트 처리 (스레드 모드: 블로킹 read로 세션 상태 머신을 구동)
+void handle_client(int worker_id, Connection conn, ClientInfo* client) {
+    char buffer[BUFFER_SIZE];
+    Session session;
+    int client_fd = conn.client_fd;
+
+    session_init(&session, conn, worker_id, client);
+    session_start(&session);
+
+    while (session.state != STATE_CLOSED) {
+        // 응답에 담긴 거래가 디스크에 내려간 뒤에 보낸다
+        wal_wait_durable(session.commit_lsn);
+        if (session_flush(&session) < 0) {
+            break;
+        }
+
+        // 기한까지 입력을 기다린다 (기한이 없으면 무한정)
+        bool idle;
+        uint64_t deadline = session_deadline(&session, &idle);
+        if (deadline != 0) {
+            uint64_t now = now_ns();
+            struct pollfd pfd = { .fd = client_fd, .events = POLLIN };
+            int ready = (deadline > now) ? poll(&pfd, 1, (deadline - now + 999999) / 1000000) : 0;
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready == 0) {
+                if (now_ns() < deadline) continue;
+                session_expire(&session, idle);
+                break;
+            }
+        }
+
+        // 클라이언트 입력 받기
+        int bytes_read = read(client_fd, buffer, BUFFER_SIZE);
+        atomic_fetch_add_explicit(&metrics.read_calls, 1, memory_order_relaxed);
+        if (bytes_read <= 0) {
+            LOG_WARN("⚠️  [창구 %d] %s 연결 종료\n", worker_id, client->client_id);
+            break;
+        }
+
+        session_on_bytes(&session, buffer, bytes_read);
+    }
+
+    wal_wait_durable(session.commit_lsn);
+    session_flush(&session);
+    session_destroy(&session);
+}
+
+// 세션 초기화
+void session_init(Session* s, Connection conn, int window_id, ClientInfo* client) {
+    memset(s, 0, sizeof(Session));
+    s->client_fd = conn.client_fd;
+    s->proto = conn.proto;
+    s->window_id = window_id;
+    s->client = client;
+    s->state = STATE_MENU;
+    s->account_num = -1;
+    s->opened_ns = s->active_ns = now_ns();
+}
+
+// 세션의 가까운 기한 (ns, 기한이 없으면 0), idle은 유휴 기한이면 true
+uint64_t session_deadline(Session* s, bool* idle) {
+    uint64_t deadline = 0;
+
+    *idle = false;
+    if (idle_timeout > 0) {
+        deadline = s->active_ns + (uint64_t)idle_timeout * 1000000000ull;
+        *idle = true;
+    }
+    if (session_timeout > 0) {
+        uint64_t end = s->opened_ns + (uint64_t)session_timeout * 1000000000ull;
+        if (deadline == 0 || end < deadline) {
+            deadline = end;
+            *idle = false;
+        }
+    }
+    return deadline;
+}
+
+// 기한이 지난 세션을 안내와 함께 닫는다 (바이너리 세션과 응답을 보내는 중인 uring 세션은 안내 없이)
+void session_expire(Session* s, bool idle) {
+    if (s->proto == PROTO_TEXT && !s->out_busy) {
+        if (idle) {
+            session_printf(s,
+                "\n\n⏰ %d초 동안 입력이 없어 상담을 종료합니다. 다시 접속해주세요.\n", idle_timeout);
+        } else {
+            session_printf(s,
+                "\n\n⏰ 상담 시간(%d초)이 지나 종료합니다. 다시 접속해주세요.\n", session_timeout);
+        }
+    }
+    atomic_fetch_add_explicit(idle ? &metrics.timeouts_idle : &metrics.timeouts_session, 1,
+        memory_order_relaxed);
+    LOG_WARN("⏰ [창구 %d] %s %s 기한 초과로 세션 종료\n", s->window_id, s->client->client_id,
+        idle ? "유휴" : "상담 시간");
+    s->state = STATE_CLOSED;
+}
+
+// 세션 자원 해제
+void session_destroy(Session* s) {
+    // 다음 접속의 대기 등급을 정할 때 쓴다 (업무 하나로 끝나는 고객은 빠른 창구)
+    if (s->proto == PROTO_TEXT && s->client != NULL) {
+        atomic_store_explicit(&s->client->last_tasks, s->tasks + 1, memory_order_relaxed);
+    }
+    free(s->out);
+    free(s->frags);
+    free(s->in);
+    free(s->legs);
+    free(s->rbuf);
+    free(s->send_iov);
+    s->rbuf = NULL;
+    s->send_iov = NULL;
+    s->legs = NULL;
+    s->leg_count = s->leg_cap = 0;
+    s->out = s->in = NULL;
+    s->frags = NULL;
+    s->out_len = s->out_cap = 0;
+    s->frag_count = s->frag_cap = s->frag_head = 0;
+    s->frag_done = 0;
+    s->in_len = s->in_cap = 0;
+}
+
+// 출력 조각 추가 (out 버퍼 안에서 바로 이어지는 조각은 앞 조각에 합친다)
+bool session_add_frag(Session* s, const char* data, size_t offset, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+    if (data == NULL && s->frag_count > s->frag_head) {
+        OutFrag* last = &s->frags[s->frag_count - 1];
+        if (last->data == NULL && last->offset + last->len == offset) {
+            last->len += len;
+            return true;
+        }
+    }
+    if (s->frag_count == s->frag_cap) {
+        int cap = s->frag_cap ? s->frag_cap * 2 : 16;
+        OutFrag* frags = realloc(s->frags, cap * sizeof(OutFrag));
+        if (frags == NULL) return false;
+        s->frags = frags;
+        s->frag_cap = cap;
+    }
+    s->frags[s->frag_count++] = (OutFrag){ data, offset, len };
+    return true;
+}
+
+// out 버퍼에 len바이트 여유 확보
+bool session_out_reserve(Session* s, size_t len) {
+    if (s->out_len + len > s->out_cap) {
+        size_t cap = s->out_cap ? s->out_cap : BUFFER_SIZE;
+        while (cap < s->out_len + len) cap *= 2;
+        char* out = realloc(s->out, cap);
+        if (out == NULL) return false;
+        s->out = out;
+        s->out_cap = cap;
+    }
+    return true;
+}
+
+// 응답 추가 (복사해 둔다)
+void session_send(Session* s, const char* data, size_t len) {
+    if (!session_out_reserve(s, len)) return;
+    memcpy(s->out + s->out_len, data, len);
+    if (session_add_frag(s, NULL, s->out_len, len)) {
+        s->out_len += len;
+    }
+}
+
+// 고정 안내문 추가 (문자열 리터럴처럼 전송이 끝날 때까지 살아 있는 데이터만, 복사하지 않는다)
+void session_send_static(Session* s, const char* text) {
+    session_add_frag(s, text, 0, strlen(text));
+}
+
+// 형식 응답을 out 버퍼에 바로 만든다 (길이 제한 없음, 모자라면 늘려서 다시 쓴다)
+void session_printf(Session* s, const char* fmt, ...) {
+    va_list ap;
+
+    if (!session_out_reserve(s, BUFFER_SIZE)) return;
+    va_start(ap, fmt);
+    int n = vsnprintf(s->out + s->out_len, s->out_cap - s->out_len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+
+    if ((size_t)n >= s->out_cap - s->out_len) {
+        if (!session_out_reserve(s, n + 1)) return;
+        va_start(ap, fmt);
+        vsnprintf(s->out + s->out_len, s->out_cap - s->out_len, fmt, ap);
+        va_end(ap);
+    }
+    if (session_add_frag(s, NULL, s->out_len, n)) {
+        s->out_len += n;
+    }
+}
+
+// 보낼 조각을 iov에 채운다 (최대 MAX_OUT_IOV개, 일부만 나간 조각은 남은 부분부터)
+int session_out_iov(Session* s, struct iovec* iov) {
+    int count = 0;
+    for (int i = s->frag_head; i < s->frag_count && count < MAX_OUT_IOV; i++, count++) {
+        OutFrag* f = &s->frags[i];
+        size_t skip = (i == s->frag_head) ? s->frag_done : 0;
+        iov[count].iov_base = (char*)(f->data ? f->data : s->out + f->offset) + skip;
+        iov[count].iov_len = f->len - skip;
+    }
+    return count;
+}
+
+// n바이트가 나갔다: 다 나간 조각은 건너뛰고 일부만 나간 조각은 위치를 기억한다
+void session_out_advance(Session* s, size_t n) {
+    while (n > 0 && s->frag_head < s->frag_count) {
+        size_t left = s->frags[s->frag_head].len - s->frag_done;
+        if (n < left) {
+            s->frag_done += n;
+            break;
+        }
+        n -= left;
+        s->frag_head++;
+        s->frag_done = 0;
+    }
+    if (s->frag_head == s->frag_count) {
+        s->out_len = 0;
+        s->frag_count = s->frag_head = 0;
+        s->frag_done = 0;
+    }
+}
+
+// 쌓인 조각을 sendmsg 한 번(조각이 MAX_OUT_IOV개를 넘거나 일부만 나가면 더)으로 전송
+// 반환값: 0 = 모두 전송, 1 = 남은 데이터 있음(EAGAIN), -1 = 오류
+int session_flush(Session* s) {
+    struct iovec iov[MAX_OUT_IOV];
+
+    while (s->frag_head < s->frag_count) {
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = session_out_iov(s, iov) };
+        ssize_t n = sendmsg(s->client_fd, &msg, MSG_NOSIGNAL);
+        atomic_fetch_add_explicit(&metrics.write_calls, 1, memory_order_relaxed);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return -1;
+        }
+        session_out_advance(s, n);
+    }
+    return 0;
+}
+
+// 세션 시작: 환영 메시지와 첫 업무 선택 요청 (바이너리 세션은 인사 없이 요청을 기다린다)
+void session_start(Session* s) {
+    if (s->proto == PROTO_BINARY) {
+        return;
+    }
+    
+    // 환영 메시지
+    session_printf(s, 
+        "\n🏦 ========== 은행 업무 시작 ==========\n"
+        "👤 고객님: %s\n"
+        "🪟 담당 창구: %d번\n"
+        "=====================================\n",
+        s->client->client_id, s->window_id);
+    
+    session_prompt_menu(s);
+}
+
+// 업무 선택 요청
+void session_prompt_menu(Session* s) {
+    char* prompt = "💬 어떤 업무를 도와드릴까요?\n"
+                  "   (통장 개설 / 입금 / 출금 / 잔액 조회 / 이체 / 거래 내역 중 원하시는 업무를 말씀해주세요)\n\n"
+                  "입력: ";
+    session_send_static(s, prompt);
+    s->state = STATE_MENU;
+}
+
+// 업무 하나가 끝나면 추가 업무 여부 확인
+void session_end_task(Session* s) {
+    s->tasks++;
+    char* ask_more = "\n💡 추가로 처리하실 업무가 있으신가요? (예/아니오): ";
+    session_send_static(s, ask_more);
+    LOG_DEBUG("📤 [창구 %d] 추가 업무 질문 전송\n", s->window_id);
+    s->state = STATE_ASK_MORE;
+}
+
+// 소켓에서 읽은 바이트 처리 (완성된 입력이 여러 건이면 모두 처리한다)
+void session_on_bytes(Session* s, char* data, size_t len) {
+    s->active_ns = now_ns();
+    wal_last_lsn = 0;
+    if (s->proto == PROTO_BINARY) {
+        bin_on_bytes(s, data, len);
+    } else {
+        text_on_bytes(s, data, len);
+    }
+
+    // 이번 입력으로 기록된 마지막 WAL 레코드 (응답 전에 커밋되어야 한다)
+    if (wal_last_lsn > s->commit_lsn) {
+        s->commit_lsn = wal_last_lsn;
+    }
+}
+
+// 입력 버퍼 뒤에 읽은 바이트를 붙인다 (NUL 한 바이트 여유를 남긴다)
+// 메모리가 부족하면 세션을 닫고 false를 돌려준다.
+bool session_in_append(Session* s, const char* data, size_t len) {
+    if (s->in_len + len + 1 > s->in_cap) {
+        size_t cap = s->in_cap ? s->in_cap : BUFFER_SIZE;
+        while (cap < s->in_len + len + 1) cap *= 2;
+        char* in = realloc(s->in, cap);
+        if (in == NULL) {
+            s->state = STATE_CLOSED;
+            return false;
+        }
+        s->in = in;
+        s->in_cap = cap;
+    }
+    memcpy(s->in + s->in_len, data, len);
+    s->in_len += len;
+    return true;
+}
+
+// 처리한 앞부분(pos바이트)은 버리고 남은 조각을 앞으로 당긴다
+void session_in_consume(Session* s, size_t pos) {
+    if (pos > 0) {
+        memmove(s->in, s->in + pos, s->in_len - pos);
+        s->in_len -= pos;
+    }
+}
+
+// 대화형 입력: 줄바꿈까지를 한 건으로 잘라 순서대로 처리한다
+// 줄 끝의 \r\n은 떼고 넘기며, 마지막 줄바꿈 뒤 조각은 다음 read를 기다린다.
+void text_on_bytes(Session* s, const char* data, size_t len) {
+    if (!session_in_append(s, data, len)) {
+        return;
+    }
+
+    // 지점 간 호출의 답을 기다리는 동안은 쌓기만 한다
+    size_t pos = 0;
+    while (s->state != STATE_CLOSED && s->shard_call == NULL) {
+        char* line = s->in + pos;
+        char* newline = memchr(line, '\n', s->in_len - pos);
+        if (newline == NULL) {
+            break;
+        }
+        *newline = '\0';
+        if (newline > line && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        pos = newline + 1 - s->in;
+        session_on_input(s, line);
+    }
+
+    if (s->state == STATE_CLOSED) {
+        s->in_len = 0;      // 종료 뒤에 온 입력은 버린다
+        return;
+    }
+    if (s->shard_call == NULL && s->in_len - pos > TEXT_MAX_LINE) {
+        char* too_long = "\n❌ 입력이 너무 깁니다. 연결을 종료합니다.\n";
+        session_send_static(s, too_long);
+        LOG_WARN("⚠️  [창구 %d] %s 줄바꿈 없는 입력이 %d바이트를 넘어 연결 종료\n",
+            s->window_id, s->client->client_id, TEXT_MAX_LINE);
+        s->state = STATE_CLOSED;
+        s->in_len = 0;
+        return;
+    }
+    session_in_consume(s, pos);
+}
+
+// 입력 한 건을 현재 상태에 맞게 처리
+void session_on_input(Session* s, char* input) {
+    switch (s->state) {
+        case STATE_MENU: {
+            LOG_DEBUG("💬 [창구 %d] %s: %s\n", s->window_id, s->client->client_id, input);
+
+            // 키워드로 업무 분류 (입력을 한 번만 훑는다)
+            switch (classify_input(input, INTENT_STATEMENT, INTENT_BALANCE)) {
+                case INTENT_STATEMENT:
+                    process_statement(s);
+                    break;
+                case INTENT_OPEN:
+                    process_account_open(s);
+                    break;
+                case INTENT_DEPOSIT:
+                    process_deposit(s);
+                    break;
+                case INTENT_WITHDRAW:
+                    process_withdraw(s);
+                    break;
+                case INTENT_BALANCE:
+                    process_balance(s);
+                    break;
+                case INTENT_TRANSFER:
+                    process_transfer(s);
+                    break;
+                default:
+                    session_send_static(s,
+                        "❌ 요청하신 업무를 찾을 수 없습니다.\n"
+                        "   '통장 개설', '입금', '출금', '잔액 조회', '이체', '거래 내역' 중 하나를 말씀해주세요.\n\n");
+                    session_prompt_menu(s); // 다시 업무 선택으로
+                    break;
+            }
+            break;
+        }
+        case STATE_OPEN_NAME:
+            process_account_open_name(s, input);
+            break;
+        case STATE_DEPOSIT_TARGET:
+            process_deposit_target(s, input);
+            break;
+        case STATE_DEPOSIT_ACCOUNT:
+            process_deposit_account(s, input);
+            break;
+        case STATE_DEPOSIT_AMOUNT:
+            process_deposit_amount(s, input);
+            break;
+        case STATE_WITHDRAW_ACCOUNT:
+            process_withdraw_account(s, input);
+            break;
+        case STATE_WITHDRAW_PASSWORD:
+            process_withdraw_password(s, input);
+            break;
+        case STATE_WITHDRAW_AMOUNT:
+            process_withdraw_amount(s, input);
+            break;
+        case STATE_TRANSFER_ACCOUNT:
+            process_transfer_account(s, input);
+            break;
+        case STATE_TRANSFER_PASSWORD:
+            process_transfer_password(s, input);
+            break;
+        case STATE_TRANSFER_LEGS:
+            process_transfer_leg(s, input);
+            break;
+        case STATE_STATEMENT_ACCOUNT:
+            process_statement_account(s, input);
+            break;
+        case STATE_STATEMENT_MORE:
+            process_statement_more(s, input);
+            break;
+        case STATE_ASK_MORE:
+            process_ask_more(s, input);
+            break;
+        case STATE_CLOSED:
+            break;
+    }
+}
+
+// 추가 업무 응답 처리
+void process_ask_more(Session* s, char* input) {
+    LOG_DEBUG("📥 [창구 %d] 추가 업무 응답: %s\n", s->window_id, input);
+        
+    // "아니오", "아니요", "없어", "없습니다", "종료", "끝", "no" 등으로 종료
+    if (classify_input(input, INTENT_NO, INTENT_NO) == INTENT_NO) {
+        // 종료 메시지
+        char* goodbye = "\n✅ 업무가 완료되었습니다. 감사합니다!\n";
+        session_send_static(s, goodbye);
+        s->state = STATE_CLOSED;
+        LOG_INFO("✅ [창구 %d] %s 고객 업무 완료\n", s->window_id, s->client->client_id);
+        return;
+    }
+    
+    // "예", "네", "있어요", "yes" 등으로 계속
+    LOG_DEBUG("🔄 [창구 %d] %s 추가 업무 진행\n", s->window_id, s->client->client_id);
+    session_prompt_menu(s);
+}
+
+// 통장 개설 처리
+void process_account_open(Session* s) {
+    ClientInfo* client = s->client;
+    
+    client_lock(client);
+    int account_count = client->account_count;
+    pthread_mutex_unlock(&client->lock);
+    
+    // 이미 최대 개수만큼 통장이 있는지 확인
+    if (account_count >= max_accounts) {
+        session_printf(s, 
+            "❌ 더 이상 통장을 개설할 수 없습니다.\n"
+            "   (최대 %d개까지만 가능합니다)\n", max_accounts);
+        session_end_task(s);
+        return;
+    }
+    
+    // 은행명 입력 요청
+    char* prompt = "\n💳 개설할 통장의 은행명을 입력하세요: ";
+    session_send_static(s, prompt);
+    s->state = STATE_OPEN_NAME;
+}
+
+// 통장 개설: 은행명 입력 처리
+void process_account_open_name(Session* s, char* input) {
+    ClientInfo* client = s->client;
+    
+    // 개행 문자 제거
+    input[strcspn(input, "\n")] = 0;
+    
+    // DB에 통장 추가 (은행명을 기다리는 동안 다른 세션이 통장을 채웠을 수 있어 다시 확인한다)
+    int idx;
+    if (bank_open_account(client, input, &idx) != BANK_OK) {
+        session_printf(s,
+            "❌ 더 이상 통장을 개설할 수 없습니다.\n"
+            "   (최대 %d개까지만 가능합니다)\n", max_accounts);
+        session_end_task(s);
+        return;
+    }
+    
+    session_printf(s, 
+        "\n✅ 통장 개설이 완료되었습니다!\n"
+        "   📌 은행명: %s\n"
+        "   💰 초기 잔고: 0원\n"
+        "   📊 현재 통장 개수: %d/%d\n",
+        client->accounts[idx].bank_name, 
+        idx + 1, 
+        max_accounts);
+    
+    LOG_INFO("💳 [통장 개설] %s - %s 통장 개설 완료\n", 
+        client->client_id, client->accounts[idx].bank_name);
+
+    session_end_task(s);
+}
+
+// 통장 목록 보여주기
+// 고객 lock을 잡지 않고 seqlock으로 읽으므로 입출금을 막지 않는다.
+void show_accounts(Session* s, ClientInfo* client) {
+    Account accounts[MAX_ACCOUNTS_LIMIT];
+    uint64_t start = now_ns();
+    
+    int count = client_read_accounts(client, accounts);
+    metrics_op_done(METRIC_OP_BALANCE, BANK_OK, start);
+    
+    session_send_static(s, "\n📋 보유 통장 목록:\n");
+    session_send_static(s, "=====================================\n");
+    
+    if (count == 0) {
+        session_send_static(s, "   (보유한 통장이 없습니다)\n");
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (accounts[i].is_active) {
+                session_printf(s, 
+                    "   %d. %s - 잔고: %d원\n", 
+                    i + 1, 
+                    accounts[i].bank_name, 
+                    accounts[i].balance);
+            }
+        }
+    }
+    session_send_static(s, "=====================================\n");
+}
+
+// 잔액 조회
+void process_balance(Session* s) {
+    show_accounts(s, s->client);
+    session_end_task(s);
+}
+
+// 입금 처리
+void process_deposit(Session* s) {
+    // 입금 대상 ID 입력 요청
+    char* prompt = "\n💵 입금할 대상의 ID를 입력하세요 (예: pi200): ";
+    session_send_static(s, prompt);
+    s->state = STATE_DEPOSIT_TARGET;
+}
+
+// 입금: 대상 ID 입력 처리
+void process_deposit_target(Session* s, char* input) {
+    input[strcspn(input, "\n")] = 0;
+    
+    // 대상 클라이언트 찾기
+    ClientInfo* target = find_client_by_id(input);
+    
+    // 다른 지점 고객이면 그 지점에 통장 목록을 물어 본다 (답은 process_deposit_target_remote)
+    if (target == NULL && shard.count > 0 && input[0] != 0 && strlen(input) < CLIENT_ID_SIZE &&
+        !shard_owns(input)) {
+        ShardCall* call = shard_call_new(s, SHARD_CALL_ACCOUNTS, NULL, 0);
+        if (call == NULL) {
+            session_printf(s, "❌ %s님이 계신 지점에 연결할 수 없습니다. 잠시 후 다시 시도하세요.\n", input);
+            session_end_task(s);
+            return;
+        }
+        call->shard_index = shard_of(input);
+        snprintf(call->target_id, sizeof(call->target_id), "%s", input);
+        session_shard_call(s, call);
+        return;
+    }
+
+    if (target == NULL) {
+        session_send_static(s, "❌ 존재하지 않는 ID입니다.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    // 대상의 통장 목록 보여주기 (lock 없이 읽는다)
+    Account accounts[MAX_ACCOUNTS_LIMIT];
+    int count = client_read_accounts(target, accounts);
+    
+    if (count == 0) {
+        session_printf(s, 
+            "❌ %s님은 개설된 통장이 없습니다.\n", target->client_id);
+        session_end_task(s);
+        return;
+    }
+    
+    session_printf(s, "\n📋 %s님의 통장 목록:\n", target->client_id);
+    for (int i = 0; i < count; i++) {
+        if (accounts[i].is_active) {
+            session_printf(s, "   %d. %s\n", 
+                i + 1, accounts[i].bank_name);
+        }
+    }
+    session_send_static(s, "\n입금할 통장 번호를 선택하세요: ");
+    
+    s->target = target;
+    s->state = STATE_DEPOSIT_ACCOUNT;
+}
+
+// 입금: 다른 지점 고객의 통장 목록을 받았다
+void process_deposit_target_remote(Session* s, const ShardCall* call) {
+    if (call->status == BANK_ERR_NO_CLIENT) {
+        session_send_static(s, "❌ 존재하지 않는 ID입니다.\n");
+        session_end_task(s);
+        return;
+    }
+    if (call->status != BANK_OK) {
+        session_printf(s, "❌ %s님이 계신 지점에 연결할 수 없습니다. 잠시 후 다시 시도하세요.\n", call->target_id);
+        session_end_task(s);
+        return;
+    }
+    if (call->count == 0) {
+        session_printf(s, "❌ %s님은 개설된 통장이 없습니다.\n", call->target_id);
+        session_end_task(s);
+        return;
+    }
+
+    session_printf(s, "\n📋 %s님의 통장 목록:\n", call->target_id);
+    for (int i = 0; i < call->count; i++) {
+        session_printf(s, "   %d. %s\n", i + 1, call->names[i]);
+    }
+    session_send_static(s, "\n입금할 통장 번호를 선택하세요: ");
+
+    s->target = NULL;
+    s->target_shard = call->shard_index;
+    memcpy(s->target_id, call->target_id, CLIENT_ID_SIZE);
+    s->target_accounts = call->count;
+    s->state = STATE_DEPOSIT_ACCOUNT;
+}
+
+// 입금: 통장 번호 입력 처리
+void process_deposit_account(Session* s, char* input) {
+    ClientInfo* target = s->target;
+
+    // 통장 수는 늘어나기만 하므로 여기서는 잠그지 않고 확인한다 (실제 검증은 bank_deposit)
+    int account_num = atoi(input) - 1;
+    int account_count = target != NULL ? target->account_count : s->target_accounts;
+    if (account_num < 0 || account_num >= account_count) {
+        session_send_static(s, "❌ 잘못된 통장 번호입니다.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    // 입금액 입력
+    char* prompt = "\n입금액을 입력하세요: ";
+    session_send_static(s, prompt);
+    
+    s->account_num = account_num;
+    s->state = STATE_DEPOSIT_AMOUNT;
+}
+
+// 입금: 금액 입력 처리
+void process_deposit_amount(Session* s, char* input) {
+    ClientInfo* client = s->client;
+    ClientInfo* target = s->target;
+    int account_num = s->account_num;
+
+    // 입금 처리
+    int balance;
+    int amount = atoi(input);
+    if (target == NULL) {
+        // 다른 지점 고객 (답은 process_deposit_amount_remote)
+        ShardCall* call = shard_call_new(s, SHARD_CALL_DEPOSIT, NULL, 0);
+        if (call == NULL) {
+            session_send_static(s, "❌ 다른 지점과 처리하지 못했습니다. 입금하지 않았습니다. 잠시 후 다시 시도하세요.\n");
+            session_end_task(s);
+            return;
+        }
+        call->shard_index = s->target_shard;
+        memcpy(call->target_id, s->target_id, CLIENT_ID_SIZE);
+        call->account_num = account_num;
+        call->amount = amount;
+        session_shard_call(s, call);
+        return;
+    }
+    if (bank_deposit(client, target, account_num, amount, &balance) != BANK_OK) {
+        session_send_static(s, "❌ 올바른 금액을 입력하세요.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    session_printf(s, 
+        "\n✅ 입금이 완료되었습니다!\n"
+        "   📌 입금 대상: %s\n"
+        "   🏦 은행: %s\n"
+        "   💰 입금액: %d원\n"
+        "   📊 입금 후 잔고: %d원\n",
+        target->client_id,
+        target->accounts[account_num].bank_name,
+        amount,
+        balance);
+    
+    LOG_INFO("💵 [입금] %s → %s (%s 통장) %d원\n", 
+        client->client_id, target->client_id, 
+        target->accounts[account_num].bank_name, amount);
+
+    session_end_task(s);
+}
+
+// 입금: 다른 지점 고객에게 입금한 결과
+void process_deposit_amount_remote(Session* s, const ShardCall* call) {
+    if (call->status == BANK_ERR_AMOUNT) {
+        session_send_static(s, "❌ 올바른 금액을 입력하세요.\n");
+    } else if (call->status == BANK_ERR_BUSY || call->status == BANK_ERR_UNAVAILABLE) {
+        session_send_static(s, "❌ 다른 지점과 처리하지 못했습니다. 입금하지 않았습니다. 잠시 후 다시 시도하세요.\n");
+    } else if (call->status != BANK_OK) {
+        session_send_static(s, "❌ 입금할 수 없습니다. 입금하지 않았습니다.\n");
+    } else {
+        session_printf(s,
+            "\n✅ 입금이 완료되었습니다!\n"
+            "   📌 입금 대상: %s (%d번 지점)\n"
+            "   🏦 은행: %s\n"
+            "   💰 입금액: %d원\n"
+            "   📊 입금 후 잔고: %d원\n",
+            call->target_id, call->shard_index, call->bank_name, call->amount, call->balance);
+        LOG_INFO("💵 [입금] %s → %s (%d번 지점, %d번 통장) %d원\n",
+            s->client->client_id, call->target_id, call->shard_index, call->account_num + 1, call->amount);
+    }
+    session_end_task(s);
+}
+
+// 출금 처리
+void process_withdraw(Session* s) {
+    ClientInfo* client = s->client;
+    
+    // 본인 통장 확인
+    client_lock(client);
+    int account_count = client->account_count;
+    pthread_mutex_unlock(&client->lock);
+    
+    if (account_count == 0) {
+        session_send_static(s, 
+            "❌ 개설된 통장이 없습니다.\n"
+            "   먼저 통장을 개설해주세요.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    // 통장 목록 보여주기
+    show_accounts(s, client);
+    
+    // 통장 선택
+    char* prompt = "\n출금할 통장 번호를 선택하세요: ";
+    session_send_static(s, prompt);
+    s->state = STATE_WITHDRAW_ACCOUNT;
+}
+
+// 출금: 통장 번호 입력 처리
+void process_withdraw_account(Session* s, char* input) {
+    ClientInfo* client = s->client;
+    
+    int account_num = atoi(input) - 1;
+    if (account_num < 0 || account_num >= client->account_count) {
+        session_send_static(s, "❌ 잘못된 통장 번호입니다.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    // 비밀번호 확인 (IP 마지막 3자리)
+    char* prompt = "\n비밀번호를 입력하세요 (ID 뒷 3자리): ";
+    session_send_static(s, prompt);
+    
+    s->account_num = account_num;
+    s->state = STATE_WITHDRAW_PASSWORD;
+}
+
+// 출금: 비밀번호 입력 처리
+void process_withdraw_password(Session* s, char* input) {
+    ClientInfo* client = s->client;
+
+    int password = atoi(input);
+    if (password != client->ip_last_digit) {
+        session_send_static(s, "❌ 비밀번호가 일치하지 않습니다.\n");
+        LOG_WARN("⚠️  [출금 실패] %s - 비밀번호 불일치\n", client->client_id);
+        session_end_task(s);
+        return;
+    }
+    
+    // 출금액 입력
+    char* prompt = "\n출금액을 입력하세요: ";
+    session_send_static(s, prompt);
+    s->state = STATE_WITHDRAW_AMOUNT;
+}
+
+// 출금: 금액 입력 처리
+void process_withdraw_amount(Session* s, char* input) {
+    ClientInfo* client = s->client;
+    int account_num = s->account_num;
     
-    // 잔고 확인 및 출금 처리
-    pthread_mutex_lock(&db_mutex);
-    
-    if (client->accounts[account_num].balance < amount) {
-        snprintf(response, BUFFER_SIZE, 
+    // 잔고 확인 및 출금 처리
+    int balance;
+    int amount = atoi(input);
+    BankStatus status = bank_withdraw(client, account_num, amount, &balance);
+    
+    if (status == BANK_ERR_INSUFFICIENT) {
+        session_printf(s, 
             "❌ 잔고가 부족합니다.\n"
             "   현재 잔고: %d원\n"
             "   출금 요청액: %d원\n",
-            client->accounts[account_num].balance, amount);
-        send(client_fd, response, strlen(response), 0);
-        pthread_mutex_unlock(&db_mutex);
+            balance, amount);
+        session_end_task(s);
+        return;
+    }
+    if (status != BANK_OK) {
+        session_send_static(s, "❌ 올바른 금액을 입력하세요.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    session_printf(s, 
+        "\n✅ 출금이 완료되었습니다!\n"
+        "   🏦 은행: %s\n"
+        "   💰 출금액: %d원\n"
+        "   📊 출금 후 잔고: %d원\n",
+        client->accounts[account_num].bank_name,
+        amount,
+        balance);
+    
+    LOG_INFO("💸 [출금] %s - %s 통장에서 %d원 출금\n", 
+        client->client_id, client->accounts[account_num].bank_name, amount);
+
+    session_end_task(s);
+}
+
+// 이체 처리 (본인 통장 하나에서 여러 사람에게 한 번에 보낸다)
+void process_transfer(Session* s) {
+    ClientInfo* client = s->client;
+    
+    if (client->account_count == 0) {
+        session_send_static(s, 
+            "❌ 개설된 통장이 없습니다.\n"
+            "   먼저 통장을 개설해주세요.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    show_accounts(s, client);
+    
+    char* prompt = "\n이체할(돈을 보낼) 통장 번호를 선택하세요: ";
+    session_send_static(s, prompt);
+    s->state = STATE_TRANSFER_ACCOUNT;
+}
+
+// 이체: 보낼 통장 번호 입력 처리
+void process_transfer_account(Session* s, char* input) {
+    int account_num = atoi(input) - 1;
+    if (account_num < 0 || account_num >= s->client->account_count) {
+        session_send_static(s, "❌ 잘못된 통장 번호입니다.\n");
+        session_end_task(s);
+        return;
+    }
+    
+    char* prompt = "\n비밀번호를 입력하세요 (ID 뒷 3자리): ";
+    session_send_static(s, prompt);
+    
+    s->account_num = account_num;
+    s->state = STATE_TRANSFER_PASSWORD;
+}
+
+// 이체: 비밀번호 입력 처리
+void process_transfer_password(Session* s, char* input) {
+    ClientInfo* client = s->client;
+
+    if (atoi(input) != client->ip_last_digit) {
+        session_send_static(s, "❌ 비밀번호가 일치하지 않습니다.\n");
+        LOG_WARN("⚠️  [이체 실패] %s - 비밀번호 불일치\n", client->client_id);
+        session_end_task(s);
+        return;
+    }
+
+    // 0번 항목은 본인 통장 출금 (금액은 받는 사람을 다 입력한 뒤 채운다)
+    TransferLeg leg = { .client = client, .account_num = s->account_num, .shard = shard.index };
+    memcpy(leg.client_id, client->client_id, CLIENT_ID_SIZE);
+    s->leg_count = 0;
+    session_add_leg(s, &leg);
+
+    char* prompt =
+        "\n받는 분을 한 줄에 한 명씩 'ID 통장번호 금액'으로 입력하세요 (예: pi201 1 5000).\n"
+        "다 입력했으면 '끝'을 입력하세요.\n"
+        "받는 분을 입력하세요: ";
+    session_send_static(s, prompt);
+    s->state = STATE_TRANSFER_LEGS;
+}
+
+// 이체: 받는 사람 한 줄 또는 "끝" 처리
+void process_transfer_leg(Session* s, char* input) {
+    char target_id[CLIENT_ID_SIZE];
+    int account_no, amount;
+    input[strcspn(input, "\n")] = 0;
+
+    if (strcmp(input, "끝") == 0) {
+        // 보낼 총액을 0번 항목(출금)에 채우고 한 번에 반영
+        int64_t total = 0;
+        for (int i = 1; i < s->leg_count; i++) total += s->legs[i].amount;
+        if (s->leg_count < 2 || total > INT_MAX) {
+            session_send_static(s, "❌ 받는 분이 없거나 총액이 너무 큽니다.\n");
+            session_end_task(s);
+            return;
+        }
+        s->legs[0].amount = -(int)total;
+
+        // 다른 지점 고객이 끼어 있으면 지점 간 호출로 (답은 process_transfer_result)
+        if (transfer_crosses_shards(s->legs, s->leg_count)) {
+            ShardCall* call = shard_call_new(s, SHARD_CALL_TRANSFER, s->legs, s->leg_count);
+            if (call == NULL) {
+                process_transfer_result(s, BANK_ERR_UNAVAILABLE, -1);
+                return;
+            }
+            session_shard_call(s, call);
+            return;
+        }
+        int failed_leg;
+        BankStatus status = bank_transfer(s->client, s->legs, s->leg_count, &failed_leg);
+        process_transfer_result(s, status, failed_leg);
+        return;
+    }
+
+    if (sscanf(input, "%15s %d %d", target_id, &account_no, &amount) != 3 || amount <= 0) {
+        session_send_static(s, "❌ 'ID 통장번호 금액' 형식으로 입력하세요. 이체를 취소합니다.\n");
+        s->leg_count = 0;
+        session_end_task(s);
+        return;
+    }
+    // 다른 지점 고객은 실제로 있는지 이체할 때 그 지점이 확인한다
+    TransferLeg leg = { .account_num = account_no - 1, .amount = amount };
+    if (!transfer_leg_target(&leg, target_id)) {
+        session_printf(s, "❌ 존재하지 않는 ID입니다: %s. 이체를 취소합니다.\n", target_id);
+        s->leg_count = 0;
+        session_end_task(s);
+        return;
+    }
+    if (!session_add_leg(s, &leg)) {
+        session_printf(s, "❌ 한 번에 %d명까지만 보낼 수 있습니다. 이체를 취소합니다.\n",
+            TRANSFER_MAX_LEGS - 1);
+        s->leg_count = 0;
+        session_end_task(s);
+        return;
+    }
+
+    char* prompt = "다음 받는 분을 입력하세요 ('끝'으로 마침): ";
+    session_send_static(s, prompt);
+}
+
+// 이체: 결과 안내 (legs[0]에 보낼 총액을 채운 뒤)
+void process_transfer_result(Session* s, BankStatus status, int failed_leg) {
+    long long total = -(long long)s->legs[0].amount;
+
+    if (status == BANK_ERR_INSUFFICIENT) {
+        session_printf(s,
+            "❌ 잔고가 부족합니다.\n"
+            "   이체 총액: %lld원\n", total);
+    } else if (status == BANK_ERR_NO_ACCOUNT) {
+        session_printf(s,
+            "❌ %d번째 받는 분(%s)의 통장 번호가 잘못되었습니다. 이체하지 않았습니다.\n",
+            failed_leg, s->legs[failed_leg].client_id);
+    } else if (status == BANK_ERR_NO_CLIENT && failed_leg > 0) {
+        session_printf(s,
+            "❌ %d번째 받는 분(%s)은 존재하지 않는 ID입니다. 이체하지 않았습니다.\n",
+            failed_leg, s->legs[failed_leg].client_id);
+    } else if (status == BANK_ERR_BUSY || status == BANK_ERR_UNAVAILABLE) {
+        session_send_static(s, "❌ 다른 지점과 처리하지 못했습니다. 이체하지 않았습니다. 잠시 후 다시 시도하세요.\n");
+    } else if (status != BANK_OK) {
+        session_send_static(s, "❌ 이체할 수 없습니다. 이체하지 않았습니다.\n");
+    } else {
+        session_printf(s,
+            "\n✅ 이체가 완료되었습니다!\n"
+            "   👥 받는 분: %d명\n"
+            "   💰 이체 총액: %lld원\n",
+            s->leg_count - 1, total);
+        LOG_INFO("🔁 [이체] %s → %d명 %lld원\n",
+            s->client->client_id, s->leg_count - 1, total);
+    }
+    s->leg_count = 0;
+    session_end_task(s);
+}
+
+// 세션의 이체 항목 추가
+bool session_add_leg(Session* s, const TransferLeg* leg) {
+    if (s->leg_count >= TRANSFER_MAX_LEGS) return false;
+    if (s->leg_count == s->leg_cap) {
+        int cap = s->leg_cap ? s->leg_cap * 2 : 16;
+        TransferLeg* legs = realloc(s->legs, sizeof(TransferLeg) * cap);
+        if (legs == NULL) return false;
+        s->legs = legs;
+        s->leg_cap = cap;
+    }
+    s->legs[s->leg_count++] = *leg;
+    return true;
+}
+
+// 거래 내역
+void process_statement(Session* s) {
+    ClientInfo* client = s->client;
+
+    client_lock(client);
+    int account_count = client->account_count;
+    pthread_mutex_unlock(&client->lock);
+
+    if (account_count == 0) {
+        session_send_static(s,
+            "❌ 개설된 통장이 없습니다.\n"
+            "   먼저 통장을 개설해주세요.\n");
+        session_end_task(s);
+        return;
+    }
+
+    show_accounts(s, client);
+
+    char* prompt = "\n거래 내역을 볼 통장 번호를 선택하세요: ";
+    session_send_static(s, prompt);
+    s->state = STATE_STATEMENT_ACCOUNT;
+}
+
+// 거래 내역: 통장 번호 입력 처리 (최근 한 쪽부터 보여준다)
+void process_statement_account(Session* s, char* input) {
+    int account_num = atoi(input) - 1;
+    if (account_num < 0 || account_num >= s->client->account_count) {
+        session_send_static(s, "❌ 잘못된 통장 번호입니다.\n");
+        session_end_task(s);
+        return;
+    }
+
+    s->account_num = account_num;
+    s->statement_next = UINT64_MAX;
+    statement_show_page(s);
+}
+
+// 거래 내역: 이전 쪽을 더 볼지 입력 처리
+void process_statement_more(Session* s, char* input) {
+    if (classify_input(input, INTENT_NO, INTENT_NO) == INTENT_NO) {
+        session_end_task(s);
+        return;
+    }
+    statement_show_page(s);
+}
+
+// 원장 항목의 거래 종류 (거래 내역 표시용)
+const char* ledger_type_name(const LedgerEntry* entry) {
+    switch (entry->type) {
+        case WAL_DEPOSIT:
+            return "입금";
+        case WAL_WITHDRAW:
+            return "출금";
+        case WAL_TRANSFER:
+            return entry->amount < 0 ? "이체 출금" : "이체 입금";
+        case WAL_EPOCH:
+            return entry->amount < 0 ? "결산 수수료" : "결산 이자";
+        default:
+            return entry->amount < 0 ? "지점 간 출금" : "지점 간 입금";
+    }
+}
+
+// 거래 내역 한 쪽 보여주기 (statement_next 앞의 LEDGER_PAGE건을 최근 것부터)
+// statement_next가 UINT64_MAX면 마지막 쪽이다. 앞에 남은 항목이 있으면 더 볼지 묻는다.
+void statement_show_page(Session* s) {
+    LedgerEntry entries[LEDGER_PAGE];
+    LedgerPage page;
+    BankStatus status;
+    bool latest = s->statement_next == UINT64_MAX;
+
+    if (latest) {
+        status = bank_statement(s->client, s->account_num, LEDGER_LAST, 0, 0,
+                                LEDGER_PAGE, entries, &page);
+    } else {
+        uint64_t end = s->statement_next;
+        status = bank_statement(s->client, s->account_num, LEDGER_BY_SEQ,
+                                end > LEDGER_PAGE ? end - LEDGER_PAGE : 0, end,
+                                LEDGER_PAGE, entries, &page);
+    }
+    if (status != BANK_OK) {
+        session_send_static(s, status == BANK_ERR_NO_ACCOUNT ?
+            "❌ 잘못된 통장 번호입니다.\n" :
+            "❌ 거래 내역을 읽지 못했습니다. 잠시 후 다시 시도해주세요.\n");
+        session_end_task(s);
+        return;
+    }
+    if (page.total == 0) {
+        session_send_static(s, "\n📜 아직 거래 내역이 없습니다.\n");
+        session_end_task(s);
+        return;
+    }
+
+    if (latest) {
+        session_printf(s, "\n📜 %d번 통장 거래 내역 (전체 %llu건, 최근 거래부터)\n",
+            s->account_num + 1, (unsigned long long)page.total);
+    }
+    session_send_static(s, "=====================================\n");
+    for (int i = page.count - 1; i >= 0; i--) {
+        const LedgerEntry* e = &entries[i];
+        char when[32];
+        struct tm tm;
+        time_t t = e->time;
+        localtime_r(&t, &tm);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+        session_printf(s, "   %llu. %s  %s %+d원  잔고 %d원%s%.*s%s\n",
+            (unsigned long long)(page.first + i + 1), when, ledger_type_name(e),
+            e->amount, e->balance,
+            e->counterparty[0] ? "  (" : "", CLIENT_ID_SIZE, e->counterparty,
+            e->counterparty[0] ? ")" : "");
+    }
+    session_send_static(s, "=====================================\n");
+    LOG_DEBUG("📜 [창구 %d] %s %d번 통장 거래 내역 %d건\n",
+        s->window_id, s->client->client_id, s->account_num + 1, page.count);
+
+    if (page.first > 0) {
+        s->statement_next = page.first;
+        session_printf(s, "\n이전 거래 %llu건이 더 있습니다. 더 보시려면 '다음', 그만 보시려면 '끝'을 입력하세요: ",
+            (unsigned long long)page.first);
+        s->state = STATE_STATEMENT_MORE;
+        return;
+    }
+    session_send_static(s, "   (첫 거래까지 모두 보여드렸습니다)\n");
+    session_end_task(s);
+}
+
+// ========== 바이너리 프로토콜 처리 ==========
+
+// 빅엔디안 정수 읽기/쓰기
+uint32_t bin_get_u32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+void bin_put_u32(unsigned char* p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+uint64_t bin_get_u64(const unsigned char* p) {
+    return (uint64_t)bin_get_u32(p) << 32 | bin_get_u32(p + 4);
+}
+
+void bin_put_u64(unsigned char* p, uint64_t v) {
+    bin_put_u32(p, (uint32_t)(v >> 32));
+    bin_put_u32(p + 4, (uint32_t)v);
+}
+
+// 읽은 바이트를 입력 버퍼에 모으고, 완성된 프레임을 도착 순서대로 처리
+void bin_on_bytes(Session* s, const char* data, size_t len) {
+    if (!session_in_append(s, data, len)) {
+        return;
+    }
+
+    size_t pos = 0;
+    while (s->in_len - pos >= 4 && s->shard_call == NULL) {
+        const unsigned char* p = (const unsigned char*)s->in + pos;
+        uint32_t frame_len = bin_get_u32(p);
+        if (frame_len < BIN_HEADER_SIZE - 4 || frame_len > BIN_MAX_FRAME) {
+            // 프레임 경계를 잃었으므로 더 읽을 수 없다
+            LOG_WARN("⚠️  [창구 %d] %s 잘못된 바이너리 프레임 (길이 %u), 연결 종료\n",
+                s->window_id, s->client->client_id, frame_len);
+            s->state = STATE_CLOSED;
+            break;
+        }
+        if (s->in_len - pos < 4 + (size_t)frame_len) {
+            break; // 나머지는 다음 read에서
+        }
+        bin_handle_frame(s, p + 4, frame_len);
+        pos += 4 + frame_len;
+    }
+
+    session_in_consume(s, pos);
+}
+
+// 응답 프레임 작성
+void bin_reply(Session* s, uint8_t op, uint8_t status, uint32_t request_id,
+               const void* body, uint32_t body_len) {
+    unsigned char header[BIN_HEADER_SIZE];
+    bin_put_u32(header, BIN_HEADER_SIZE - 4 + body_len);
+    header[4] = op;
+    header[5] = status;
+    header[6] = header[7] = 0;
+    bin_put_u32(header + 8, request_id);
+    session_send(s, (const char*)header, BIN_HEADER_SIZE);
+    if (body_len > 0) {
+        session_send(s, body, body_len);
+    }
+}
+
+// 프레임 하나 처리 (frame은 length 필드 다음부터)
+void bin_handle_frame(Session* s, const unsigned char* frame, uint32_t len) {
+    ClientInfo* client = s->client;
+    uint8_t op = frame[0];
+    uint32_t request_id = bin_get_u32(frame + 4);
+    const unsigned char* body = frame + (BIN_HEADER_SIZE - 4);
+    uint32_t body_len = len - (BIN_HEADER_SIZE - 4);
+    unsigned char out[4 + MAX_ACCOUNTS_LIMIT * (BIN_NAME_SIZE + 6)];
+    BankStatus status;
+    int balance;
+
+    switch (op) {
+        case BIN_OP_OPEN: {
+            if (body_len != BIN_NAME_SIZE) break;
+            char bank_name[BIN_NAME_SIZE];
+            memcpy(bank_name, body, BIN_NAME_SIZE);
+            bank_name[BIN_NAME_SIZE - 1] = 0;
+
+            int idx;
+            status = bank_open_account(client, bank_name, &idx);
+            if (status != BANK_OK) {
+                bin_reply(s, op, status, request_id, NULL, 0);
+                return;
+            }
+            bin_put_u32(out, idx + 1);
+            bin_reply(s, op, BANK_OK, request_id, out, 4);
+            LOG_INFO("💳 [통장 개설] %s - %s 통장 개설 완료\n", client->client_id, bank_name);
+            return;
+        }
+        case BIN_OP_DEPOSIT: {
+            if (body_len != BIN_ID_SIZE + 8) break;
+            char target_id[BIN_ID_SIZE];
+            memcpy(target_id, body, BIN_ID_SIZE);
+            target_id[BIN_ID_SIZE - 1] = 0;
+            int account_num = (int)bin_get_u32(body + BIN_ID_SIZE) - 1;
+            int amount = (int32_t)bin_get_u32(body + BIN_ID_SIZE + 4);
+
+            ClientInfo* target = find_client_by_id(target_id);
+            if (target == NULL && shard.count > 0 && target_id[0] != 0 && !shard_owns(target_id)) {
+                // 다른 지점 고객 (그 지점과 2단계 커밋, 답은 bin_deposit_remote_result)
+                ShardCall* call = shard_call_new(s, SHARD_CALL_DEPOSIT, NULL, 0);
+                if (call == NULL) {
+                    bin_reply(s, op, BANK_ERR_UNAVAILABLE, request_id, NULL, 0);
+                    return;
+                }
+                call->binary = true;
+                call->op = op;
+                call->request_id = request_id;
+                call->shard_index = shard_of(target_id);
+                snprintf(call->target_id, sizeof(call->target_id), "%s", target_id);
+                call->account_num = account_num;
+                call->amount = amount;
+                session_shard_call(s, call);
+                return;
+            }
+            if (target == NULL) {
+                bin_reply(s, op, BANK_ERR_NO_CLIENT, request_id, NULL, 0);
+                return;
+            }
+            status = bank_deposit(client, target, account_num, amount, &balance);
+            if (status != BANK_OK) {
+                bin_reply(s, op, status, request_id, NULL, 0);
+                return;
+            }
+            bin_put_u32(out, (uint32_t)balance);
+            bin_reply(s, op, BANK_OK, request_id, out, 4);
+            LOG_INFO("💵 [입금] %s → %s (%d번 통장) %d원\n",
+                client->client_id, target->client_id, account_num + 1, amount);
+            return;
+        }
+        case BIN_OP_WITHDRAW: {
+            if (body_len != 12) break;
+            int account_num = (int)bin_get_u32(body) - 1;
+            int password = (int)bin_get_u32(body + 4);
+            int amount = (int32_t)bin_get_u32(body + 8);
+
+            if (password != client->ip_last_digit) {
+                bin_reply(s, op, BANK_ERR_PASSWORD, request_id, NULL, 0);
+                LOG_WARN("⚠️  [출금 실패] %s - 비밀번호 불일치\n", client->client_id);
+                return;
+            }
+            status = bank_withdraw(client, account_num, amount, &balance);
+            if (status != BANK_OK) {
+                bin_reply(s, op, status, request_id, NULL, 0);
+                return;
+            }
+            bin_put_u32(out, (uint32_t)balance);
+            bin_reply(s, op, BANK_OK, request_id, out, 4);
+            LOG_INFO("💸 [출금] %s - %d번 통장에서 %d원 출금\n",
+                client->client_id, account_num + 1, amount);
+            return;
+        }
+        case BIN_OP_BALANCE: {
+            if (body_len != 0) break;
+            size_t off = 4;
+            uint64_t start = now_ns();
+
+            Account accounts[MAX_ACCOUNTS_LIMIT];
+            int count = client_read_accounts(client, accounts);
+            metrics_op_done(METRIC_OP_BALANCE, BANK_OK, start);
+            for (int i = 0; i < count; i++) {
+                memcpy(out + off, accounts[i].bank_name, BIN_NAME_SIZE);
+                out[off + BIN_NAME_SIZE] = out[off + BIN_NAME_SIZE + 1] = 0;
+                bin_put_u32(out + off + BIN_NAME_SIZE + 2, (uint32_t)accounts[i].balance);
+                off += BIN_NAME_SIZE + 6;
+            }
+
+            bin_put_u32(out, count);
+            bin_reply(s, op, BANK_OK, request_id, out, off);
+            return;
+        }
+        case BIN_OP_STATEMENT: {
+            if (body_len != 28) break;
+            const uint32_t entry_size = 16 + BIN_ID_SIZE;
+            int account_num = (int)bin_get_u32(body) - 1;
+            uint32_t mode = bin_get_u32(body + 4);
+            uint32_t limit = bin_get_u32(body + 24);
+            LedgerEntry entries[LEDGER_MAX_PAGE];
+            unsigned char page_out[28 + LEDGER_MAX_PAGE * (16 + BIN_ID_SIZE)];
+            LedgerPage page;
+
+            status = bank_statement(client, account_num, (LedgerRange)mode, bin_get_u64(body + 8),
+                                    bin_get_u64(body + 16), limit > LEDGER_MAX_PAGE ? -1 : (int)limit,
+                                    entries, &page);
+            if (status != BANK_OK) {
+                bin_reply(s, op, status, request_id, NULL, 0);
+                return;
+            }
+            bin_put_u64(page_out, page.total);
+            bin_put_u64(page_out + 8, page.first);
+            bin_put_u64(page_out + 16, page.end);
+            bin_put_u32(page_out + 24, page.count);
+            for (int i = 0; i < page.count; i++) {
+                unsigned char* p = page_out + 28 + i * entry_size;
+                bin_put_u32(p, entries[i].time);
+                bin_put_u32(p + 4, entries[i].type);
+                bin_put_u32(p + 8, (uint32_t)entries[i].amount);
+                bin_put_u32(p + 12, (uint32_t)entries[i].balance);
+                memcpy(p + 16, entries[i].counterparty, BIN_ID_SIZE);
+            }
+            bin_reply(s, op, BANK_OK, request_id, page_out, 28 + page.count * entry_size);
+            return;
+        }
+    }
+
+    if (op == BIN_OP_TRANSFER && body_len >= 8) {
+        int password = (int)bin_get_u32(body);
+        uint32_t count = bin_get_u32(body + 4);
+        const uint32_t leg_size = BIN_ID_SIZE + 8;
+        if (count >= 1 && count <= TRANSFER_MAX_LEGS && body_len == 8 + count * leg_size) {
+            int failed_leg = -1;
+            TransferLeg* legs = malloc(sizeof(TransferLeg) * count);
+            if (legs == NULL) {
+                status = BANK_ERR_BAD_REQUEST;
+            } else if (password != client->ip_last_digit) {
+                status = BANK_ERR_PASSWORD;
+            } else {
+                status = BANK_OK;
+                for (uint32_t i = 0; i < count && status == BANK_OK; i++) {
+                    const unsigned char* p = body + 8 + i * leg_size;
+                    char target_id[BIN_ID_SIZE];
+                    memcpy(target_id, p, BIN_ID_SIZE);
+                    target_id[BIN_ID_SIZE - 1] = 0;
+                    legs[i].account_num = (int)bin_get_u32(p + BIN_ID_SIZE) - 1;
+                    legs[i].amount = (int32_t)bin_get_u32(p + BIN_ID_SIZE + 4);
+                    if (!transfer_leg_target(&legs[i], target_id)) {
+                        status = BANK_ERR_NO_CLIENT;
+                        failed_leg = i;
+                    }
+                }
+                if (status == BANK_OK && transfer_crosses_shards(legs, count)) {
+                    // 다른 지점 고객이 끼어 있으면 지점 간 호출로 (답은 bin_transfer_result)
+                    ShardCall* call = shard_call_new(s, SHARD_CALL_TRANSFER, legs, count);
+                    if (call != NULL) {
+                        call->binary = true;
+                        call->op = op;
+                        call->request_id = request_id;
+                        free(legs);
+                        session_shard_call(s, call);
+                        return;
+                    }
+                    status = BANK_ERR_UNAVAILABLE;
+                } else if (status == BANK_OK) {
+                    status = bank_transfer(client, legs, count, &failed_leg);
+                }
+            }
+            free(legs);
+
+            bin_transfer_result(s, op, request_id, status, count, failed_leg);
+            return;
+        }
+    }
+
+    // 알 수 없는 op 또는 본문 길이 불일치
+    bin_reply(s, op, BANK_ERR_BAD_REQUEST, request_id, NULL, 0);
+}
+
+// 다른 지점 고객에게 입금한 결과 응답
+void bin_deposit_remote_result(Session* s, const ShardCall* call) {
+    unsigned char out[4];
+
+    if (call->status != BANK_OK) {
+        bin_reply(s, call->op, call->status, call->request_id, NULL, 0);
+        return;
+    }
+    bin_put_u32(out, (uint32_t)call->balance);
+    bin_reply(s, call->op, BANK_OK, call->request_id, out, 4);
+    LOG_INFO("💵 [입금] %s → %s (%d번 지점, %d번 통장) %d원\n",
+        s->client->client_id, call->target_id, call->shard_index, call->account_num + 1, call->amount);
+}
+
+// 묶음 이체 결과 응답 (성공하면 항목 수, 실패하면 문제가 된 항목 번호(1부터, 0이면 항목과 무관))
+void bin_transfer_result(Session* s, uint8_t op, uint32_t request_id, BankStatus status,
+                         uint32_t count, int failed_leg) {
+    unsigned char out[4];
+
+    bin_put_u32(out, status == BANK_OK ? count : (uint32_t)(failed_leg + 1));
+    bin_reply(s, op, status, request_id, out, 4);
+    if (status == BANK_OK) {
+        LOG_INFO("🔁 [이체] %s - %u건 묶음 이체\n", s->client->client_id, count);
+    }
+}
+
+// ========== 입력 분류 (키워드) ==========
+// 메뉴 선택과 추가 업무 응답은 키워드를 포함하는지로 판단한다. 키워드마다 strstr로
+// 입력을 다시 훑는 대신, 기동 시 모든 키워드로 Aho-Corasick 자동자를 만들고 실패 전이까지
+// 256바이트 전이표에 펼쳐 두어 입력을 한 번만 훑으며 나온 (의도, 조건) 비트를 모은다.
+// 영문 대문자는 소문자와 같은 상태로 가게 전이표를 채워 대소문자를 무시한다.
+
+// 상태 하나 추가 (전이 없음, 출력 없음)
+int classifier_new_state() {
+    if (classifier.state_count == classifier.state_cap) {
+        int cap = classifier.state_cap ? classifier.state_cap * 2 : 64;
+        if (cap > CLASSIFIER_MAX_STATES) cap = CLASSIFIER_MAX_STATES;
+        if (classifier.state_count == cap) {
+            fprintf(stderr, "❌ 분류 키워드가 너무 많습니다 (상태 %d개 초과)\n", CLASSIFIER_MAX_STATES);
+            exit(EXIT_FAILURE);
+        }
+        classifier.next = realloc(classifier.next, cap * sizeof(*classifier.next));
+        classifier.out = realloc(classifier.out, cap * sizeof(uint64_t));
+        if (classifier.next == NULL || classifier.out == NULL) {
+            perror("classifier realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        classifier.state_cap = cap;
+    }
+
+    int state = classifier.state_count++;
+    memset(classifier.next[state], 0, sizeof(classifier.next[state]));
+    classifier.out[state] = 0;
+    return state;
+}
+
+// 키워드 하나를 트라이에 넣는다 (classifier_build 전에만)
+void classifier_add(const char* keyword, Intent intent, int group) {
+    if (classifier.built) {
+        fprintf(stderr, "❌ 분류기를 만든 뒤에는 키워드를 더할 수 없습니다: %s\n", keyword);
+        exit(EXIT_FAILURE);
+    }
+    if (classifier.state_count == 0) {
+        classifier_new_state();     // 시작 상태
+    }
+
+    int state = 0;
+    for (const unsigned char* p = (const unsigned char*)keyword; *p; p++) {
+        unsigned char c = (*p >= 'A' && *p <= 'Z') ? *p + ('a' - 'A') : *p;
+        if (classifier.next[state][c] == 0) {
+            int child = classifier_new_state();
+            classifier.next[state][c] = child;
+        }
+        state = classifier.next[state][c];
+    }
+
+    classifier.out[state] |= 1ull << (intent * INTENT_MAX_GROUPS + group);
+    if (classifier.groups[intent] < group + 1) {
+        classifier.groups[intent] = group + 1;
+    }
+}
+
+// 실패 전이를 구해 빈 전이를 채우고 출력을 실패 상태에서 물려받는다 (너비 우선)
+void classifier_build() {
+    int count = classifier.state_count;
+    uint16_t* fail = calloc(count, sizeof(uint16_t));
+    uint16_t* queue = malloc(count * sizeof(uint16_t));
+    int head = 0, tail = 0;
+
+    if (fail == NULL || queue == NULL) {
+        perror("classifier calloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    queue[tail++] = 0;
+    while (head < tail) {
+        int state = queue[head++];
+        uint16_t* row = classifier.next[state];
+
+        for (int c = 0; c < 256; c++) {
+            if (c >= 'A' && c <= 'Z') continue;
+            int child = row[c];
+            if (child == 0) {
+                // 트라이에 없는 전이는 실패 상태의 전이를 따른다 (얕은 상태라 이미 채워짐)
+                row[c] = (state == 0) ? 0 : classifier.next[fail[state]][c];
+                continue;
+            }
+            fail[child] = (state == 0) ? 0 : classifier.next[fail[state]][c];
+            classifier.out[child] |= classifier.out[fail[child]];
+            queue[tail++] = child;
+        }
+        for (int c = 'A'; c <= 'Z'; c++) {
+            row[c] = row[c + ('a' - 'A')];
+        }
+    }
+
+    free(fail);
+    free(queue);
+    classifier.built = true;
+}
+
+// 추가 키워드 파일 읽기: 한 줄에 "<의도>[.<조건>] <키워드>", #으로 시작하면 주석
+// 예) "deposit deposit", "open.0 account", "open.1 open"
+void classifier_load(const char* path) {
+    char line[256];
+    int line_no = 0, added = 0;
+    FILE* f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror("keywords fopen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char name[32], keyword[128];
+        int intent = INTENT_NONE, group = 0;
+
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || sscanf(line, "%31s %127s", name, keyword) != 2) {
+            continue;
+        }
+
+        char* dot = strchr(name, '.');
+        if (dot != NULL) {
+            *dot = '\0';
+            group = atoi(dot + 1);
+        }
+        for (int i = INTENT_NONE + 1; i < INTENT_COUNT; i++) {
+            if (strcmp(name, intent_names[i]) == 0) {
+                intent = i;
+                break;
+            }
+        }
+        if (intent == INTENT_NONE || group < 0 || group >= INTENT_MAX_GROUPS) {
+            fprintf(stderr, "❌ %s:%d: 알 수 없는 의도 또는 조건 번호: %s\n", path, line_no, line);
+            exit(EXIT_FAILURE);
+        }
+
+        classifier_add(keyword, intent, group);
+        added++;
+    }
+    fclose(f);
+    LOG_INFO("🔤 추가 키워드 %d개 읽음 (%s)\n", added, path);
+}
+
+// 기본 키워드와 --keywords 파일로 분류기 준비
+void classifier_init() {
+    for (IntentKeyword* k = default_keywords; k->keyword != NULL; k++) {
+        classifier_add(k->keyword, k->intent, k->group);
+    }
+    if (keywords_path != NULL) {
+        classifier_load(keywords_path);
+    }
+    classifier_build();
+}
+
+// 입력을 한 번 훑어 나온 (의도, 조건) 비트를 모은다
+uint64_t classifier_scan(const char* text) {
+    uint16_t (*next)[256] = classifier.next;
+    const uint64_t* out = classifier.out;
+    uint64_t seen = 0;
+    int state = 0;
+
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        state = next[state][*p];
+        seen |= out[state];
+    }
+    return seen;
+}
+
+// 모은 비트로 first ~ last 의도 중 조건을 모두 채운 첫 번째를 고른다 (없으면 INTENT_NONE)
+Intent classifier_resolve(uint64_t seen, Intent first, Intent last) {
+    for (int i = first; i <= (int)last; i++) {
+        uint64_t need = ((1ull << classifier.groups[i]) - 1) << (i * INTENT_MAX_GROUPS);
+        if (need != 0 && (seen & need) == need) {
+            return i;
+        }
+    }
+    return INTENT_NONE;
+}
+
+// 입력 분류 (한 번 훑고 문맥에 맞는 의도 범위에서 고른다)
+Intent classify_input(const char* text, Intent first, Intent last) {
+    return classifier_resolve(classifier_scan(text), first, last);
+}
+
+// ========== 로그 ==========
+// 요청 경로에서는 printf 대신 LOG_*()로 스레드 전용 링에 레코드만 넣는다.
+// 레코드는 형식 문자열 포인터 + 인자 원본(정수/실수 8바이트, 문자열은 길이 + 바이트)이고,
+// 문자열로 만드는 일과 stdout 쓰기는 로그 스레드가 한다.
+
+// 형식 지정자 하나 읽기 (fmt는 '%' 다음을 가리킨다)
+// 변환 문자를 돌려주고 *len_mod에 길이 수식자(0, 'l', 'L'=ll, 'z')를 채운다. *end는 지정자 끝.
+char log_parse_spec(const char* fmt, char* len_mod, const char** end) {
+    const char* p = fmt;
+    while (*p && strchr("-+ #0123456789.", *p)) p++;
+    *len_mod = 0;
+    if (*p == 'l' && p[1] == 'l') { *len_mod = 'L'; p += 2; }
+    else if (*p == 'l' || *p == 'z') { *len_mod = *p; p++; }
+    *end = *p ? p + 1 : p;
+    return *p;
+}
+
+// 이 스레드의 링 (처음 로그를 남길 때 만든다)
+LogRing* log_thread_ring() {
+    LogRing* ring = log_ring;
+    if (ring != NULL) return ring;
+
+    ring = calloc(1, sizeof(LogRing));
+    if (ring == NULL) return NULL;
+    ring->data = malloc(LOG_RING_SIZE);
+    if (ring->data == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&logger.registry_mutex);
+    ring->next = logger.rings;
+    logger.rings = ring;
+    pthread_mutex_unlock(&logger.registry_mutex);
+
+    // 스레드가 끝나면 남은 레코드를 다 쓴 뒤 로그 스레드가 링을 치운다
+    pthread_setspecific(logger.ring_key, ring);
+    log_ring = ring;
+    return ring;
+}
+
+void log_ring_release(void* arg) {
+    LogRing* ring = arg;
+    atomic_store_explicit(&ring->abandoned, true, memory_order_release);
+}
+
+// 레코드 하나 기록 (잠금 없음, 링이 가득 차면 버리고 센다)
+void log_write(int level, const char* fmt, ...) {
+    unsigned char rec[LOG_MAX_RECORD];
+    LogRecordHeader* h = (LogRecordHeader*)rec;
+    size_t off = sizeof(LogRecordHeader);
+    va_list ap;
+
+    LogRing* ring = log_thread_ring();
+    if (ring == NULL) return;
+
+    va_start(ap, fmt);
+    for (const char* p = fmt; *p; ) {
+        if (*p++ != '%') continue;
+        if (*p == '%') { p++; continue; }
+
+        char len_mod;
+        char conv = log_parse_spec(p, &len_mod, &p);
+        if (off + 8 > LOG_MAX_RECORD) break;
+
+        if (conv == 's') {
+            // 문자열은 복사해 둔다 (호출이 끝나면 버퍼가 바뀔 수 있다)
+            const char* str = va_arg(ap, const char*);
+            size_t n = str ? strnlen(str, LOG_MAX_STRING) : 0;
+            if (off + 2 + n > LOG_MAX_RECORD) n = LOG_MAX_RECORD - off - 2;
+            uint16_t n16 = n;
+            memcpy(rec + off, &n16, 2);
+            if (n > 0) memcpy(rec + off + 2, str, n);
+            off += 2 + n;
+            continue;
+        }
+
+        int64_t v;
+        if (conv == 'f' || conv == 'g' || conv == 'e') {
+            double d = va_arg(ap, double);
+            memcpy(&v, &d, 8);
+        } else if (conv == 'p') {
+            v = (int64_t)(intptr_t)va_arg(ap, void*);
+        } else if (len_mod == 'L') {
+            v = va_arg(ap, long long);
+        } else if (len_mod == 'l') {
+            v = va_arg(ap, long);
+        } else if (len_mod == 'z') {
+            v = (int64_t)va_arg(ap, size_t);
+        } else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o') {
+            v = va_arg(ap, unsigned int);
+        } else {
+            v = va_arg(ap, int);
+        }
+        memcpy(rec + off, &v, 8);
+        off += 8;
+    }
+    va_end(ap);
+
+    size_t size = (off + 7) & ~(size_t)7;
+    h->size = size;
+    h->level = level;
+    h->ts_ns = now_ns();
+    h->fmt = fmt;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t pos = head & (LOG_RING_SIZE - 1);
+    size_t contiguous = LOG_RING_SIZE - pos;
+    size_t need = (size > contiguous) ? contiguous + size : size;
+
+    if (LOG_RING_SIZE - (head - tail) < need) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    if (size > contiguous) {
+        // 끝에 안 들어가면 남은 칸은 건너뛰기 레코드로 채우고 처음부터 쓴다
+        // (헤더도 안 들어가는 자투리는 로그 스레드가 알아서 건너뛴다)
+        if (contiguous >= sizeof(LogRecordHeader)) {
+            LogRecordHeader pad = { .size = contiguous, .fmt = NULL };
+            memcpy(ring->data + pos, &pad, sizeof(pad));
+        }
+        head += contiguous;
+        pos = 0;
+    }
+    memcpy(ring->data + pos, rec, size);
+    atomic_store_explicit(&ring->head, head + size, memory_order_release);
+}
+
+// 레코드 하나를 문자열로 풀어 out에 쓴다
+void log_format(FILE* out, const LogRecordHeader* h) {
+    const unsigned char* arg = (const unsigned char*)h + sizeof(LogRecordHeader);
+    const unsigned char* arg_end = (const unsigned char*)h + h->size;
+    const char* p = h->fmt;
+
+    while (*p) {
+        const char* pct = strchr(p, '%');
+        if (pct == NULL) {
+            fputs(p, out);
+            break;
+        }
+        fwrite(p, 1, pct - p, out);
+        if (pct[1] == '%') {
+            fputc('%', out);
+            p = pct + 2;
+            continue;
+        }
+
+        char len_mod, spec[32];
+        const char* end;
+        char conv = log_parse_spec(pct + 1, &len_mod, &end);
+        size_t spec_len = end - pct;
+        if (spec_len >= sizeof(spec) || conv == 0) break;
+        memcpy(spec, pct, spec_len);
+        spec[spec_len] = 0;
+        p = end;
+
+        if (conv == 's') {
+            uint16_t n = 0;
+            if (arg + 2 <= arg_end) memcpy(&n, arg, 2);
+            char str[LOG_MAX_STRING + 1];
+            if (arg + 2 + n > arg_end) n = 0;
+            memcpy(str, arg + 2, n);
+            str[n] = 0;
+            arg += 2 + n;
+            fprintf(out, spec, str);
+            continue;
+        }
+
+        int64_t v = 0;
+        if (arg + 8 <= arg_end) memcpy(&v, arg, 8);
+        arg += 8;
+        if (conv == 'f' || conv == 'g' || conv == 'e') {
+            double d;
+            memcpy(&d, &v, 8);
+            fprintf(out, spec, d);
+        } else if (conv == 'p') {
+            fprintf(out, spec, (void*)(intptr_t)v);
+        } else if (len_mod == 'L') {
+            fprintf(out, spec, (long long)v);
+        } else if (len_mod == 'l') {
+            fprintf(out, spec, (long)v);
+        } else if (len_mod == 'z') {
+            fprintf(out, spec, (size_t)v);
+        } else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o') {
+            fprintf(out, spec, (unsigned int)v);
+        } else {
+            fprintf(out, spec, (int)v);
+        }
+    }
+}
+
+// 링의 다음 레코드 (건너뛰기 레코드는 넘긴다, 없으면 NULL)
+LogRecordHeader* log_ring_peek(LogRing* ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail != head) {
+        size_t pos = tail & (LOG_RING_SIZE - 1);
+        LogRecordHeader* h = (LogRecordHeader*)(ring->data + pos);
+        if (LOG_RING_SIZE - pos >= sizeof(LogRecordHeader) && h->fmt != NULL) return h;
+        tail += (LOG_RING_SIZE - pos < sizeof(LogRecordHeader)) ? LOG_RING_SIZE - pos : h->size;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+// 모든 링 비우기 (스레드 사이 순서는 기록 시각 순으로 맞춘다)
+// 반환값: 쓴 레코드 수
+int log_drain() {
+    int written = 0;
+
+    pthread_mutex_lock(&logger.drain_mutex);
+    pthread_mutex_lock(&logger.registry_mutex);
+    LogRing* rings = logger.rings;
+    pthread_mutex_unlock(&logger.registry_mutex);
+
+    while (1) {
+        LogRing* best = NULL;
+        LogRecordHeader* best_h = NULL;
+        for (LogRing* r = rings; r != NULL; r = r->next) {
+            LogRecordHeader* h = log_ring_peek(r);
+            if (h != NULL && (best_h == NULL || h->ts_ns < best_h->ts_ns)) {
+                best = r;
+                best_h = h;
+            }
+        }
+        if (best == NULL) break;
+
+        log_format(stdout, best_h);
+        size_t tail = atomic_load_explicit(&best->tail, memory_order_relaxed);
+        atomic_store_explicit(&best->tail, tail + best_h->size, memory_order_release);
+        written++;
+    }
+    if (written > 0) fflush(stdout);
+
+    // 끝난 스레드의 빈 링 정리 (목록 맨 앞은 새 링이 붙을 수 있으므로 건드리지 않는다)
+    pthread_mutex_lock(&logger.registry_mutex);
+    for (LogRing** pp = &logger.rings; *pp != NULL; ) {
+        LogRing* r = *pp;
+        if (r != logger.rings && atomic_load_explicit(&r->abandoned, memory_order_acquire) &&
+            log_ring_peek(r) == NULL) {
+            atomic_fetch_add(&logger.dropped_retired, atomic_load(&r->dropped));
+            *pp = r->next;
+            free(r->data);
+            free(r);
+            continue;
+        }
+        pp = &r->next;
+    }
+    pthread_mutex_unlock(&logger.registry_mutex);
+    pthread_mutex_unlock(&logger.drain_mutex);
+
+    return written;
+}
+
+// 버린 레코드 수 (링이 가득 찼을 때)
+unsigned long log_dropped() {
+    unsigned long dropped = atomic_load(&logger.dropped_retired);
+    pthread_mutex_lock(&logger.registry_mutex);
+    for (LogRing* r = logger.rings; r != NULL; r = r->next) {
+        dropped += atomic_load(&r->dropped);
+    }
+    pthread_mutex_unlock(&logger.registry_mutex);
+    return dropped;
+}
+
+// 로그 스레드: 쌓인 레코드를 주기적으로 내보낸다
+void* log_thread_func(void* arg) {
+    (void)arg;
+    while (1) {
+        if (log_drain() == 0) {
+            usleep(LOG_FLUSH_INTERVAL_US);
+        }
+    }
+    return NULL;
+}
+
+// 종료 직전 남은 로그 내보내기
+void log_flush_at_exit() {
+    log_drain();
+}
+
+// 로거 시작 (다른 스레드를 만들기 전에 부른다)
+void log_init() {
+    pthread_t thread;
+
+    pthread_mutex_init(&logger.registry_mutex, NULL);
+    pthread_mutex_init(&logger.drain_mutex, NULL);
+    pthread_key_create(&logger.ring_key, log_ring_release);
+    pthread_create(&thread, NULL, log_thread_func, NULL);
+    pthread_detach(thread);
+    atexit(log_flush_at_exit);
+}
+
+// ========== 거래 원장 ==========
+// 통장마다 거래 한 건당 항목 하나(시각, 상대, 금액, 거래 후 잔고)를 순번대로 덧붙인다.
+// 메모리에는 덜 찬 마지막 묶음과 지난 묶음의 파일 위치만 두고, 다 찬 묶음은 ledger.dat에
+// 이어 쓴다. 순번 s는 묶음 s / LEDGER_CHUNK_ENTRIES에 있으므로 어느 구간이든 그 묶음만 읽는다.
+// 항목은 잔고를 바꾼 WAL 레코드에서 만든다 (영업 중에는 wal_append(), 복구 때는 wal_replay()).
+// 파일은 스냅샷과 함께 확정한다. 기동할 때 확정된 길이 뒤는 버리고, 고객의 스냅샷 시점보다
+// 뒤의 항목도 버린 다음 WAL 재실행으로 다시 적으므로 원장과 잔고가 어긋나지 않는다.
+
+// 통장의 원장 (처음 쓸 때 만든다)
+Ledger* ledger_of(Account* account) {
+    if (account->ledger == NULL) {
+        account->ledger = calloc(1, sizeof(Ledger));
+        if (account->ledger == NULL) {
+            perror("ledger calloc failed");
+            exit(EXIT_FAILURE);
+        }
+        atomic_fetch_add(&ledger_file.memory, sizeof(Ledger));
+    }
+    return account->ledger;
+}
+
+// 묶음 위치 표를 need칸 이상으로 (새 칸은 0)
+void ledger_reserve_chunks(Ledger* ledger, uint64_t need) {
+    if (need <= ledger->chunk_cap) return;
+    uint32_t cap = ledger->chunk_cap ? ledger->chunk_cap : 4;
+    while (cap < need) cap *= 2;
+    uint64_t* offsets = realloc(ledger->chunk_offsets, cap * sizeof(uint64_t));
+    if (offsets == NULL) {
+        perror("ledger realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(offsets + ledger->chunk_cap, 0, (cap - ledger->chunk_cap) * sizeof(uint64_t));
+    atomic_fetch_add(&ledger_file.memory, (long)(cap - ledger->chunk_cap) * sizeof(uint64_t));
+    ledger->chunk_offsets = offsets;
+    ledger->chunk_cap = cap;
+}
+
+// 마지막 묶음의 앞 count건을 파일 끝에 묶음 하나로 적고 그 위치를 돌려준다
+// 자리는 fetch_add로 잡으므로 여러 창구가 lock 없이 동시에 쓸 수 있다.
+uint64_t ledger_write_chunk(uint32_t client_no, uint32_t account_num, const Ledger* ledger, uint32_t count) {
+    LedgerChunk chunk;
+
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.client_no = client_no;
+    chunk.account_num = account_num;
+    chunk.count = count;
+    chunk.first_seq = ledger->count - count;
+    memcpy(chunk.entries, ledger->tail, count * sizeof(LedgerEntry));
+    chunk.crc = crc32_update(0, (const char*)&chunk + 4, sizeof(chunk) - 4);
+
+    uint64_t offset = atomic_fetch_add(&ledger_file.end, sizeof(chunk));
+    if (pwrite(ledger_file.fd, &chunk, sizeof(chunk), offset) != (ssize_t)sizeof(chunk)) {
+        perror("ledger write failed");
+        exit(EXIT_FAILURE);
+    }
+    atomic_fetch_add(&ledger_file.chunks[count < LEDGER_CHUNK_ENTRIES], 1);
+    return offset;
+}
+
+// 항목 하나 덧붙이기 (고객 lock을 쥔 채로)
+// 마지막 묶음이 차면 파일로 내리고 비운다. 묶음 버퍼는 4건부터 두 배씩 늘려 거래가 드문 통장은 작게 둔다.
+void ledger_add(ClientInfo* client, int account_num, Ledger* ledger, const LedgerEntry* entry) {
+    uint32_t n = ledger->count % LEDGER_CHUNK_ENTRIES;
+
+    if (n == ledger->tail_cap) {
+        uint32_t cap = ledger->tail_cap ? ledger->tail_cap * 2 : 4;
+        LedgerEntry* tail = realloc(ledger->tail, cap * sizeof(LedgerEntry));
+        if (tail == NULL) {
+            perror("ledger realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        atomic_fetch_add(&ledger_file.memory, (long)(cap - ledger->tail_cap) * sizeof(LedgerEntry));
+        ledger->tail = tail;
+        ledger->tail_cap = cap;
+    }
+    ledger->tail[n] = *entry;
+    ledger->count++;
+    atomic_fetch_add(&ledger_file.entries, 1);
+
+    if (n + 1 == LEDGER_CHUNK_ENTRIES) {
+        uint64_t k = ledger->count / LEDGER_CHUNK_ENTRIES - 1;
+        ledger_reserve_chunks(ledger, k + 1);
+        ledger->chunk_offsets[k] = ledger_write_chunk(client->client_no, account_num,
+                                                      ledger, LEDGER_CHUNK_ENTRIES);
+        ledger->tail_saved = 0;
+    }
+}
+
+// WAL 레코드 하나를 관련 통장의 원장에 적는다 (잔고를 바꾼 뒤, 그 고객들의 lock을 쥔 채로)
+// 잔고와 무관한 레코드(개설, 등록, 지점 간 준비/철회/끝)는 건너뛴다.
+void ledger_record(const WalHeader* h, const void* body) {
+    if (ledger_file.fd < 0) return;
+
+    switch (h->type) {
+        case WAL_DEPOSIT: {
+            const WalDeposit* r = body;
+            if (h->len != sizeof(WalDeposit)) break;
+            ClientInfo* from = client_at(r->from_no);
+            WalTransferLeg leg = { r->client_no, r->account_num, r->amount };
+            ledger_record_legs(h, &leg, 1, from != NULL ? from->client_id : "");
+            break;
+        }
+        case WAL_WITHDRAW: {
+            const WalWithdraw* r = body;
+            if (h->len != sizeof(WalWithdraw)) break;
+            WalTransferLeg leg = { r->client_no, r->account_num, -r->amount };
+            ledger_record_legs(h, &leg, 1, "");
+            break;
+        }
+        case WAL_TRANSFER: {
+            const WalTransfer* r = body;
+            if (h->len < sizeof(WalTransfer) ||
+                h->len != sizeof(WalTransfer) + sizeof(WalTransferLeg) * r->leg_count) break;
+            ledger_record_legs(h, r->legs, r->leg_count, NULL);
+            break;
+        }
+        case WAL_XCOMMIT:
+        case WAL_XAPPLY: {
+            const WalShardTx* r = body;
+            if (h->len < sizeof(WalShardTx) ||
+                h->len != sizeof(WalShardTx) + sizeof(WalTransferLeg) * r->leg_count) break;
+            ledger_record_legs(h, r->legs, r->leg_count, NULL);
+            break;
+        }
+    }
+}
+
+// 항목들을 원장에 적기 (counterparty가 NULL이면 이체: 받는 쪽의 상대는 보낸 고객,
+// 보낸 쪽의 상대는 받는 고객이 한 명일 때만 그 고객). 다른 지점 고객은 레코드에 없으므로 빈 문자열이다.
+// 한 통장이 여러 항목에 나올 수 있어 last_lsn은 wal_apply_legs()처럼 모두 적은 다음에 올린다.
+void ledger_record_legs(const WalHeader* h, const WalTransferLeg* legs, uint32_t count,
+                        const char* counterparty) {
+    const char* payer = "";
+    const char* payee = NULL;
+
+    if (counterparty == NULL) {
+        for (uint32_t i = 0; i < count; i++) {
+            ClientInfo* client = client_at(legs[i].client_no);
+            if (client == NULL) continue;
+            if (legs[i].amount < 0) {
+                payer = client->client_id;
+            } else if (payee == NULL) {
+                payee = client->client_id;
+            } else if (strcmp(payee, client->client_id) != 0) {
+                payee = "";
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const WalTransferLeg* leg = &legs[i];
+        ClientInfo* client = client_at(leg->client_no);
+        if (client == NULL || leg->account_num >= (uint32_t)client->account_count) continue;
+        Account* account = &client->accounts[leg->account_num];
+        Ledger* ledger = ledger_of(account);
+        if (h->lsn != 0 && h->lsn <= ledger->last_lsn) continue;
+
+        // 같은 통장이 뒤 항목에 또 나오면 그만큼 빼야 이 항목 직후의 잔고다
+        int64_t balance = account->balance;
+        for (uint32_t j = i + 1; j < count; j++) {
+            if (legs[j].client_no == leg->client_no && legs[j].account_num == leg->account_num) {
+                balance -= legs[j].amount;
+            }
+        }
+
+        LedgerEntry entry = {
+            .lsn = h->lsn, .time = h->time, .type = h->type,
+            .amount = leg->amount, .balance = (int32_t)balance
+        };
+        const char* other = counterparty;
+        if (other == NULL) {
+            other = leg->amount < 0 ? (payee != NULL ? payee : "") : payer;
+        }
+        snprintf(entry.counterparty, sizeof(entry.counterparty), "%s", other);
+        ledger_add(client, leg->account_num, ledger, &entry);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        ClientInfo* client = client_at(legs[i].client_no);
+        if (client == NULL || legs[i].account_num >= (uint32_t)client->account_count) continue;
+        Ledger* ledger = client->accounts[legs[i].account_num].ledger;
+        if (ledger != NULL && ledger->last_lsn < h->lsn) ledger->last_lsn = h->lsn;
+    }
+}
+
+// 스냅샷: 고객의 덜 찬 마지막 묶음을 파일에 적는다 (snapshot_write()가 고객 lock을 쥔 채로)
+// 지난번에 적은 뒤로 늘어난 통장만 새 묶음으로 덧붙인다. 덮어쓰지 않으므로 중간에 죽어도 앞의 것이 남는다.
+void ledger_save_client(ClientInfo* client) {
+    if (ledger_file.fd < 0) return;
+
+    for (int j = 0; j < client->account_count; j++) {
+        Ledger* ledger = client->accounts[j].ledger;
+        if (ledger == NULL) continue;
+        uint32_t n = ledger->count % LEDGER_CHUNK_ENTRIES;
+        if (n > ledger->tail_saved) {
+            ledger_write_chunk(client->client_no, j, ledger, n);
+            ledger->tail_saved = n;
+        }
+    }
+}
+
+// 원장 파일 열기 및 불러오기 (스냅샷을 불러온 뒤, WAL 재실행 전에)
+// 스냅샷과 함께 확정된 길이 뒤는 잘라 낸다. 묶음을 차례로 읽어 통장마다 순번 자리별로
+// 가장 긴 묶음을 고르는데, 고객의 스냅샷 시점(last_lsn)보다 뒤의 항목은 세지 않는다.
+// 고르는 동안 chunk_offsets[k]에는 (위치 << 6 | 쓸 수 있는 항목 수)를 둔다.
+void ledger_open(uint64_t committed_end) {
+    char path[PATH_MAX];
+    const size_t batch = 256;
+    long chunks = 0;
+
+    if (mkdir(data_dir, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir data dir failed");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(path, sizeof(path), "%s/ledger.dat", data_dir);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("ledger open failed");
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(fd, committed_end) < 0) {
+        perror("ledger truncate failed");
+        exit(EXIT_FAILURE);
+    }
+    ledger_file.fd = fd;
+    atomic_store(&ledger_file.end, committed_end);
+
+    LedgerChunk* buf = malloc(batch * sizeof(LedgerChunk));
+    if (buf == NULL) {
+        perror("ledger malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t offset = 0;
+    while (offset < committed_end) {
+        ssize_t n = pread(fd, buf, batch * sizeof(LedgerChunk), offset);
+        int got = n > 0 ? (int)(n / sizeof(LedgerChunk)) : 0;
+        if (got == 0) break;
+
+        for (int i = 0; i < got; i++, offset += sizeof(LedgerChunk)) {
+            const LedgerChunk* c = &buf[i];
+            if (crc32_update(0, (const char*)c + 4, sizeof(*c) - 4) != c->crc) continue;
+            ClientInfo* client = client_at(c->client_no);
+            if (client == NULL || c->account_num >= (uint32_t)client->account_count ||
+                c->count == 0 || c->count > LEDGER_CHUNK_ENTRIES ||
+                c->first_seq % LEDGER_CHUNK_ENTRIES != 0) continue;
+
+            uint32_t valid = 0;
+            while (valid < c->count && c->entries[valid].lsn <= client->last_lsn) valid++;
+            if (valid == 0) continue;
+
+            Ledger* ledger = ledger_of(&client->accounts[c->account_num]);
+            uint64_t k = c->first_seq / LEDGER_CHUNK_ENTRIES;
+            ledger_reserve_chunks(ledger, k + 1);
+            if (valid >= (ledger->chunk_offsets[k] & 63)) {
+                ledger->chunk_offsets[k] = offset << 6 | valid;
+            }
+            chunks++;
+        }
+    }
+    free(buf);
+
+    int count = client_count();
+    for (int i = 0; i < count; i++) {
+        ClientInfo* client = client_at(i);
+        for (int j = 0; j < client->account_count; j++) {
+            if (client->accounts[j].ledger != NULL) {
+                ledger_finish_load(client->accounts[j].ledger, client->last_lsn);
+            }
+        }
+    }
+
+    LOG_INFO("📒 거래 원장: 묶음 %ld개 (%.1fMB)\n", chunks, committed_end / (1024.0 * 1024.0));
+}
+
+// 불러온 묶음 정리: 0번부터 다 찬 묶음이 이어지는 데까지가 지난 묶음이고,
+// 그 다음 덜 찬 묶음은 마지막 묶음으로 메모리에 올린다. 순번이 끊긴 뒤의 묶음은 버린다.
+// client_lsn은 고객의 스냅샷 시점 (그때까지의 항목은 모두 파일에 있고, 그 뒤의 것은 골라낼 때 뺐다).
+void ledger_finish_load(Ledger* ledger, uint64_t client_lsn) {
+    uint64_t k = 0;
+
+    for (; k < ledger->chunk_cap; k++) {
+        uint32_t valid = ledger->chunk_offsets[k] & 63;
+        uint64_t offset = ledger->chunk_offsets[k] >> 6;
+        if (valid == LEDGER_CHUNK_ENTRIES) {
+            ledger->chunk_offsets[k] = offset;
+            ledger->count += LEDGER_CHUNK_ENTRIES;
+            continue;
+        }
+        if (valid > 0) {
+            LedgerEntry* tail = malloc(LEDGER_CHUNK_ENTRIES * sizeof(LedgerEntry));
+            if (tail == NULL || pread(ledger_file.fd, tail, valid * sizeof(LedgerEntry),
+                                      offset + offsetof(LedgerChunk, entries)) !=
+                                (ssize_t)(valid * sizeof(LedgerEntry))) {
+                perror("ledger read failed");
+                exit(EXIT_FAILURE);
+            }
+            free(ledger->tail);
+            ledger->tail = tail;
+            ledger->tail_cap = LEDGER_CHUNK_ENTRIES;
+            ledger->tail_saved = valid;
+            ledger->count += valid;
+            atomic_fetch_add(&ledger_file.memory, LEDGER_CHUNK_ENTRIES * sizeof(LedgerEntry));
+        }
+        break;
+    }
+    // 고르다 남은 칸은 비운다 (다음 묶음을 내릴 때 채운다)
+    uint64_t full = ledger->count / LEDGER_CHUNK_ENTRIES;
+    if (full < ledger->chunk_cap) {
+        memset(ledger->chunk_offsets + full, 0, (ledger->chunk_cap - full) * sizeof(uint64_t));
+    }
+
+    // 재실행 때 이미 적힌 레코드를 건너뛰는 기준. 마지막 항목의 LSN으로는 안 된다:
+    // 인기 통장 입금은 반영할 때 적으므로 더 큰 LSN의 출금 뒤에 작은 LSN으로 올 수 있다.
+    ledger->last_lsn = client_lsn;
+    atomic_fetch_add(&ledger_file.entries, ledger->count);
+}
+
+// 원장 비우기 (대기 서버가 주 서버의 스냅샷을 받았을 때: 그 전 내역은 이 서버에 없다)
+void ledger_reset() {
+    if (ledger_file.fd < 0) return;
+
+    int count = client_count();
+    for (int i = 0; i < count; i++) {
+        ClientInfo* client = client_at(i);
+        client_lock(client);
+        for (int j = 0; j < max_accounts; j++) {
+            Ledger* ledger = client->accounts[j].ledger;
+            if (ledger == NULL) continue;
+            free(ledger->tail);
+            free(ledger->chunk_offsets);
+            free(ledger);
+            client->accounts[j].ledger = NULL;
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+    if (ftruncate(ledger_file.fd, 0) < 0) {
+        perror("ledger truncate failed");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&ledger_file.end, 0);
+    atomic_store(&ledger_file.memory, 0);
+}
+
+// 원장 항목 읽기 (순번 from부터 최대 max건, max는 LEDGER_MAX_PAGE 이하)
+// 고객 lock은 마지막 묶음을 복사하고 지난 묶음의 위치를 읽는 동안만 쥐고, 파일은 lock 밖에서 읽는다
+// (파일에 적은 묶음은 바뀌지 않는다). max가 0이면 전체 항목 수만 본다.
+BankStatus ledger_read(ClientInfo* client, int account_num, uint64_t from, int max,
+                       LedgerEntry* out, int* count_out, uint64_t* total_out) {
+    uint64_t offsets[LEDGER_MAX_PAGE / LEDGER_CHUNK_ENTRIES + 2];
+    int chunk_count = 0;
+
+    *count_out = 0;
+    client_lock(client);
+    if (account_num < 0 || account_num >= client->account_count) {
+        pthread_mutex_unlock(&client->lock);
+        return BANK_ERR_NO_ACCOUNT;
+    }
+    Ledger* ledger = client->accounts[account_num].ledger;
+    uint64_t total = ledger != NULL ? ledger->count : 0;
+    *total_out = total;
+    if (from >= total || max <= 0) {
+        pthread_mutex_unlock(&client->lock);
+        return BANK_OK;
+    }
+
+    uint64_t end = total - from > (uint64_t)max ? from + max : total;
+    uint64_t tail_start = total - total % LEDGER_CHUNK_ENTRIES;
+    for (uint64_t seq = from > tail_start ? from : tail_start; seq < end; seq++) {
+        out[seq - from] = ledger->tail[seq - tail_start];
+    }
+    for (uint64_t k = from / LEDGER_CHUNK_ENTRIES; k * LEDGER_CHUNK_ENTRIES < end &&
+         k * LEDGER_CHUNK_ENTRIES < tail_start; k++) {
+        offsets[chunk_count++] = ledger->chunk_offsets[k];
+    }
+    pthread_mutex_unlock(&client->lock);
+
+    for (int c = 0; c < chunk_count; c++) {
+        uint64_t base = (from / LEDGER_CHUNK_ENTRIES + c) * LEDGER_CHUNK_ENTRIES;
+        uint64_t lo = from > base ? from : base;
+        uint64_t hi = base + LEDGER_CHUNK_ENTRIES;
+        if (hi > end) hi = end;
+        if (hi > tail_start) hi = tail_start;
+        size_t len = (hi - lo) * sizeof(LedgerEntry);
+        off_t pos = offsets[c] + offsetof(LedgerChunk, entries) + (lo - base) * sizeof(LedgerEntry);
+        if (pread(ledger_file.fd, out + (lo - from), len, pos) != (ssize_t)len) {
+            LOG_ERROR("❌ 원장 읽기 실패 (%s %d번 통장): %s\n", client->client_id, account_num + 1,
+                strerror(errno));
+            return BANK_ERR_UNAVAILABLE;
+        }
+    }
+    *count_out = (int)(end - from);
+    return BANK_OK;
+}
+
+// 거래 시각이 time 이상인 첫 항목의 순번 (항목은 시각 순서로 쌓인다, 없으면 total)
+// 순번 구간을 반씩 줄여 가며 항목 하나씩만 읽는다.
+uint64_t ledger_find_time(ClientInfo* client, int account_num, uint64_t time, uint64_t total) {
+    uint64_t lo = 0, hi = total;
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        LedgerEntry entry;
+        int count;
+        uint64_t now_total;
+        if (ledger_read(client, account_num, mid, 1, &entry, &count, &now_total) != BANK_OK ||
+            count == 0) {
+            break;
+        }
+        if (entry.time < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// 거래 내역 (통장 원장의 한 쪽, 순번 오름차순)
+// 요청 구간을 순번 [first, end)로 바꾸고 앞에서부터 최대 limit건을 돌려준다.
+// 필요한 묶음만 읽으므로 거래가 많은 통장이라도 최근 내역을 보는 비용은 같다.
+BankStatus bank_statement(ClientInfo* client, int account_num, LedgerRange range,
+                          uint64_t from, uint64_t to, int limit, LedgerEntry* out, LedgerPage* page) {
+    uint64_t start = now_ns();
+    int count;
+
+    memset(page, 0, sizeof(*page));
+    if (limit < 1 || limit > LEDGER_MAX_PAGE || range > LEDGER_LAST) {
+        metrics_op_done(METRIC_OP_STATEMENT, BANK_ERR_BAD_REQUEST, start);
+        return BANK_ERR_BAD_REQUEST;
+    }
+
+    BankStatus status = ledger_read(client, account_num, 0, 0, NULL, &count, &page->total);
+    if (status != BANK_OK) {
+        metrics_op_done(METRIC_OP_STATEMENT, status, start);
+        return status;
+    }
+
+    uint64_t first = from, end = to;
+    if (range == LEDGER_LAST) {
+        end = page->total;
+        first = end > (uint64_t)limit ? end - limit : 0;
+    } else if (range == LEDGER_BY_TIME) {
+        first = ledger_find_time(client, account_num, from, page->total);
+        end = ledger_find_time(client, account_num, to, page->total);
+    }
+    if (end > page->total) end = page->total;
+    if (first > end) first = end;
+    page->first = first;
+    page->end = end;
+
+    int want = end - first < (uint64_t)limit ? (int)(end - first) : limit;
+    status = ledger_read(client, account_num, first, want, out, &page->count, &page->total);
+    metrics_op_done(METRIC_OP_STATEMENT, status, start);
+    return status;
+}
+
+// ========== 인기 통장 (입금 누적기) ==========
+// 가맹점처럼 입금이 몰리는 통장은 입금마다 고객 lock을 잡지 않고 스레드별 누적기 조각에 적어 둔다.
+// 입금은 더하기뿐이라 순서를 바꿔도 결과가 같으므로, 고객 lock을 잡는 쪽(출금, 이체, 조회 lock,
+// 스냅샷 등)이 client_lock()에서 쌓인 입금을 LSN 순서로 잔고와 원장에 반영한다 (hot_fold()).
+// WAL 레코드는 보통 입금과 같은 WAL_DEPOSIT이라 복구와 복제는 달라지는 것이 없다.
+// 반영할 때 고객 lock과 모든 조각 lock을 함께 쥐므로, 그때까지 LSN을 받은 입금은 빠짐없이 들어가고
+// 그 뒤의 입금은 더 큰 LSN을 받는다. 그래서 고객의 last_lsn을 반영한 입금의 마지막 LSN까지 올려도 된다.
+
+// 통장의 입금 누적기 (일반 통장이면 NULL)
+HotAccount* hot_account_of(ClientInfo* client, int account_num) {
+    if (account_num < 0 || account_num >= max_accounts) return NULL;
+    return atomic_load_explicit(&client->accounts[account_num].hot, memory_order_acquire);
+}
+
+// 통장을 인기 통장으로 바꾸기 (되돌리지 않는다, 재시작하면 --hot-accounts로 다시 지정)
+BankStatus hot_enable(ClientInfo* client, int account_num) {
+    client_lock(client);
+    if (account_num < 0 || account_num >= client->account_count) {
+        pthread_mutex_unlock(&client->lock);
+        return BANK_ERR_NO_ACCOUNT;
+    }
+    if (client->accounts[account_num].hot != NULL) {
+        pthread_mutex_unlock(&client->lock);
+        return BANK_OK;
+    }
+
+    HotAccount* hot = calloc(1, sizeof(HotAccount));
+    if (hot == NULL) {
+        perror("hot account calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < HOT_STRIPES; i++) {
+        pthread_mutex_init(&hot->stripes[i].lock, NULL);
+    }
+    atomic_init(&hot->pending, 0);
+    atomic_store_explicit(&client->accounts[account_num].hot, hot, memory_order_release);
+    atomic_fetch_add(&client->hot_accounts, 1);
+    atomic_fetch_add(&hot_account_count, 1);
+    pthread_mutex_unlock(&client->lock);
+
+    LOG_INFO("🔥 [인기 통장] %s %d번 통장: 입금을 누적기(%d조각)에 모아 반영합니다\n",
+        client->client_id, account_num + 1, HOT_STRIPES);
+    return BANK_OK;
+}
+
+// --hot-accounts ID:통장번호,... 적용 (WAL 복구 뒤, 영업 시작 전)
+void hot_enable_list(const char* list) {
+    char* copy = strdup(list);
+    char* save = NULL;
+
+    for (char* item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        char* colon = strchr(item, ':');
+        ClientInfo* client = NULL;
+        if (colon != NULL) {
+            *colon = 0;
+            client = find_client_by_id(item);
+        }
+        if (client == NULL || hot_enable(client, atoi(colon + 1) - 1) != BANK_OK) {
+            LOG_WARN("⚠️  인기 통장으로 지정할 수 없습니다: %s%s%s (ID:통장번호, 개설된 통장만)\n",
+                item, colon != NULL ? ":" : "", colon != NULL ? colon + 1 : "");
+        }
+    }
+    free(copy);
+}
+
+// 이 스레드가 쓸 누적기 조각 (창구/리액터마다 처음 입금할 때 돌아가며 하나씩 받는다)
+// 스레드가 HOT_STRIPES개 이하면 입금끼리 조각 lock을 다투지 않는다.
+int hot_stripe_index() {
+    if (hot_stripe < 0) {
+        hot_stripe = atomic_fetch_add(&hot_stripe_next, 1) % HOT_STRIPES;
+    }
+    return hot_stripe;
+}
+
+// 인기 통장 입금 (고객 lock 없이 조각 lock만 잡는다)
+// 잔고 한도는 반영된 잔고 + 쌓인 입금 합으로 확인하고, 합은 CAS로 예약해 동시에 넘치지 않게 한다.
+// 합에는 이체/지점 간 거래가 잡아 둔 금액(hot_reserve_credit())도 들어 있다.
+// balance_out에는 아직 반영하지 않은 입금까지 더한 잔고를 돌려준다.
+// 일 마감이 잔고 복사를 시작해 공개하기 전이면 받지 않고 false (고객 lock 경로가 이자를 넣어 확인한다).
+// 조각 lock 안에서 보므로, 이 입금은 마감이 이 통장을 반영(복사)하기 전에 끝나거나 마감을 본다.
+// 그때와 조각이 가득 찼을 때는 고객 lock을 기다리므로 bank_hot_fallbacks_total에 따로 센다.
+bool bank_deposit_hot(ClientInfo* from, ClientInfo* target, int account_num, HotAccount* hot,
+                      int amount, int* balance_out, BankStatus* status_out) {
+    HotStripe* stripe = &hot->stripes[hot_stripe_index()];
+
+    pthread_mutex_lock(&stripe->lock);
+    if (stripe->count == HOT_PENDING) {
+        atomic_fetch_add_explicit(&metrics.hot_full_waits, 1, memory_order_relaxed);
+    }
+    while (stripe->count == HOT_PENDING) {
+        // 조각이 가득 찼으면 고객 lock을 잡아 반영하고 다시 본다 (잠금 순서: 고객 -> 조각)
+        pthread_mutex_unlock(&stripe->lock);
+        client_lock(target);
+        pthread_mutex_unlock(&target->lock);
+        pthread_mutex_lock(&stripe->lock);
+    }
+    if (atomic_load(&eod.closing) > atomic_load(&eod.epoch)) {
+        pthread_mutex_unlock(&stripe->lock);
+        atomic_fetch_add_explicit(&metrics.hot_eod_fallbacks, 1, memory_order_relaxed);
+        return false;
+    }
+
+    // 반영하면 잔고가 먼저 오르고 합이 나중에 줄어든다. 합을 먼저 읽으면 겹쳐도 많게만 본다.
+    long long pending = atomic_load(&hot->pending);
+    while (1) {
+        long long total = (long long)account_balance_read(target, account_num) + pending + amount;
+        if (total > INT_MAX) {
+            pthread_mutex_unlock(&stripe->lock);
+            *status_out = BANK_ERR_AMOUNT;
+            return true;
+        }
+        if (atomic_compare_exchange_weak(&hot->pending, &pending, pending + amount)) {
+            *balance_out = (int)(total - atomic_load(&hot->reserved));
+            break;
+        }
+    }
+
+    WalDeposit rec = { from->client_no, target->client_no, account_num, amount };
+    WalHeader h = { .len = sizeof(rec), .type = WAL_DEPOSIT, .time = (uint32_t)time(NULL) };
+    wal_append_record(&h, &rec);
+    stripe->pending[stripe->count++] = (HotDeposit){
+        .lsn = h.lsn, .time = h.time, .from_no = from->client_no, .amount = amount
+    };
+    pthread_mutex_unlock(&stripe->lock);
+
+    atomic_fetch_add_explicit(&metrics.hot_deposits, 1, memory_order_relaxed);
+    *status_out = BANK_OK;
+    return true;
+}
+
+int hot_deposit_compare(const void* a, const void* b) {
+    uint64_t x = ((const HotDeposit*)a)->lsn, y = ((const HotDeposit*)b)->lsn;
+    return (x > y) - (x < y);
+}
+
+// 쌓인 입금을 잔고와 원장에 반영 (고객 lock을 쥔 채, client_lock()이 부른다)
+void hot_fold(ClientInfo* client) {
+    if (atomic_load_explicit(&client->hot_accounts, memory_order_relaxed) == 0) return;
+
+    for (int j = 0; j < client->account_count; j++) {
+        HotAccount* hot = client->accounts[j].hot;
+        if (hot == NULL || atomic_load_explicit(&hot->pending, memory_order_relaxed) == 0) continue;
+        hot_fold_account(client, j, hot);
+    }
+}
+
+void hot_fold_account(ClientInfo* client, int account_num, HotAccount* hot) {
+    HotDeposit deposits[HOT_STRIPES * HOT_PENDING];
+    int count = 0;
+    long long sum = 0;
+
+    for (int i = 0; i < HOT_STRIPES; i++) {
+        HotStripe* stripe = &hot->stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+        memcpy(deposits + count, stripe->pending, stripe->count * sizeof(HotDeposit));
+        count += stripe->count;
+        stripe->count = 0;
+    }
+    qsort(deposits, count, sizeof(HotDeposit), hot_deposit_compare);
+
+    Account* account = &client->accounts[account_num];
+    Ledger* ledger = ledger_file.fd >= 0 ? ledger_of(account) : NULL;
+    client_write_begin(client);
+    for (int k = 0; k < count; k++) {
+        const HotDeposit* d = &deposits[k];
+        account->balance += d->amount;
+        sum += d->amount;
+        if (ledger != NULL) {
+            ClientInfo* from = client_at(d->from_no);
+            LedgerEntry entry = {
+                .lsn = d->lsn, .time = d->time, .type = WAL_DEPOSIT,
+                .amount = d->amount, .balance = account->balance
+            };
+            snprintf(entry.counterparty, sizeof(entry.counterparty), "%s",
+                from != NULL ? from->client_id : "");
+            ledger_add(client, account_num, ledger, &entry);
+        }
+    }
+    atomic_fetch_sub(&hot->pending, sum);
+    client_write_end(client);
+
+    if (count > 0) {
+        uint64_t last = deposits[count - 1].lsn;
+        if (client->last_lsn < last) client->last_lsn = last;
+        if (ledger != NULL && ledger->last_lsn < last) ledger->last_lsn = last;
+    }
+    for (int i = HOT_STRIPES - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&hot->stripes[i].lock);
+    }
+    atomic_fetch_add_explicit(&metrics.hot_folds, 1, memory_order_relaxed);
+}
+
+// 고객 lock 쪽에서 통장에 더할 금액의 한도 확인 (고객 lock을 쥔 채)
+// 인기 통장이면 누적기 입금과 같은 합(pending)에 CAS로 잡아 둔다. 누적기 입금은 고객 lock 없이
+// 이 합으로 한도를 보므로, 잔고에 더할 때까지 잡아 두지 않으면 둘이 함께 한도를 넘길 수 있다.
+// 일 마감을 복사했지만 공개 전이면 그 이자도 더해 본다 (공개하면 잔고에 더해지므로).
+bool hot_reserve_credit(ClientInfo* client, int account_num, int amount) {
+    int delta = eod_inflight(client, account_num);
+    long long balance = (long long)client->accounts[account_num].balance + (delta > 0 ? delta : 0);
+    HotAccount* hot = hot_account_of(client, account_num);
+    if (hot == NULL) return balance + amount <= INT_MAX;
+
+    long long pending = atomic_load(&hot->pending);
+    do {
+        if (balance + pending + amount > INT_MAX) return false;
+    } while (!atomic_compare_exchange_weak(&hot->pending, &pending, pending + amount));
+    atomic_fetch_add(&hot->reserved, amount);
+    return true;
+}
+
+// hot_reserve_credit()으로 잡은 금액 풀기 (잔고에 더한 뒤, 또는 철회할 때)
+// 잔고가 먼저 오르고 합이 나중에 줄어 누적기 입금은 겹쳐도 많게만 본다.
+void hot_release_credit(ClientInfo* client, int account_num, int amount) {
+    HotAccount* hot = hot_account_of(client, account_num);
+    if (hot == NULL) return;
+    atomic_fetch_sub(&hot->reserved, amount);
+    atomic_fetch_sub(&hot->pending, amount);
+}
+
+// 통장 하나의 반영된 잔고를 lock 없이 읽기 (쌓인 입금은 빼고, 공개된 일 마감 증감은 더해)
+int account_balance_read(ClientInfo* client, int account_num) {
+    while (1) {
+        unsigned int seq = atomic_load_explicit(&client->seq, memory_order_acquire);
+        if ((seq & 1) == 0) {
+            int balance = client->accounts[account_num].balance + eod_pending(client, account_num);
+
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&client->seq, memory_order_relaxed) == seq) {
+                return balance;
+            }
+        }
+        atomic_fetch_add_explicit(&metrics.read_retries, 1, memory_order_relaxed);
+        sched_yield();
+    }
+}
+
+// ========== 일 마감 (이자, 수수료) ==========
+// 영업을 멈추지 않고 모든 통장에 이자와 계좌 유지 수수료를 붙인다.
+//   1. 잔고 복사: 모든 고객을 client_no 순서로 잠가 잔고를 복사한 뒤 푼다 (한 시점의 잔고).
+//   2. 계산: 스레드들이 EOD_CHUNK명씩 가져가 복사본에 규칙을 적용한다 (고객 lock 없음).
+//   3. 확정: 증감을 WAL_EPOCH_DATA 묶음으로 적고 WAL_EPOCH를 내려보낸 뒤 회차 번호를 올린다.
+//      회차가 오르는 순간 모든 조회가 증감을 더해 보므로, 결과는 한 번에 공개된다.
+//   4. 반영: 고객 lock을 잡는 쪽이 먼저 반영하고(eod_fold), 반영 스레드들이 남은 고객을 마저 반영한다.
+// 확정은 스냅샷과 겹치지 않게 snapshot_mutex 안에서 한다. 그래서 스냅샷은 증감 레코드 전체의
+// 앞이거나(복구 때 재실행), 회차를 공개한 뒤라 복사하며 모든 고객을 반영한 것이다.
+// 증감은 더하기라 그 사이 거래와 순서가 바뀌어도 최종 잔고가 같다. 대신 복사한 뒤 공개하기 전의
+// 거래는 그 증감을 더한 잔고로 한도를 확인한다 (eod_inflight). 수수료만큼은 출금할 수 없고,
+// 이자를 더하면 INT_MAX를 넘을 입금은 거절한다. 인기 통장 입금도 그동안은 고객 lock으로 받는다.
+
+// 공개됐지만 아직 반영하지 않은 증감 (조회용, seq로 확인하는 구간 안에서 부른다)
+int eod_pending(const ClientInfo* client, int account_num) {
+    if (client->epoch >= atomic_load_explicit(&eod.epoch, memory_order_acquire) ||
+        (uint32_t)client->client_no >= eod.cut_clients) return 0;
+    return eod.deltas[(size_t)client->client_no * max_accounts + account_num];
+}
+
+// 잔고를 복사했지만 아직 공개하지 않은 회차의 증감 (고객 lock을 쥔 채, 한도 확인용)
+// 공개하면 client_lock()이 이 증감을 잔고에 더하므로, 그 사이 입출금과 이체는 더한 뒤의 잔고로
+// 확인해야 수수료로 0 아래가 되거나 이자로 INT_MAX를 넘지 않는다. 계산 단계가 아직 이 고객에
+// 오지 않았을 수 있어 복사본에서 같은 규칙으로 바로 구한다.
+int eod_inflight(const ClientInfo* client, int account_num) {
+    if (client->epoch >= eod.cut_epoch || (uint32_t)client->client_no >= eod.cut_clients) return 0;
+    int64_t gain, fee;
+    eod_rule(eod.balances[(size_t)client->client_no * max_accounts + account_num], &gain, &fee);
+    return (int)(gain - fee);
+}
+
+// 공개 전 회차가 떼 갈 수수료 (출금 한도에서 뺀다, 이자는 공개 전에 찾을 수 없다)
+int eod_fee_due(const ClientInfo* client, int account_num) {
+    int delta = eod_inflight(client, account_num);
+    return delta < 0 ? -delta : 0;
+}
+
+// 마감 시점 잔고 하나의 이자와 수수료
+// 이자는 양수 잔고에 붙이고 (INT_MAX를 넘지 않게), 수수료는 면제 기준 미만 통장에서 그 잔고를 넘지 않게 뗀다.
+void eod_rule(int64_t balance, int64_t* gain, int64_t* fee) {
+    *gain = 0;
+    *fee = 0;
+    if (balance > 0) {
+        *gain = balance * eod.interest_ppm / 1000000;
+        if (balance + *gain > INT_MAX) *gain = INT_MAX - balance;
+        if (balance < eod.fee_waive) *fee = eod.fee < balance ? eod.fee : balance;
+    }
+}
+
+// 공개된 회차를 고객에게 반영 (고객 lock을 쥔 채, client_lock()이 부른다)
+void eod_fold(ClientInfo* client) {
+    uint32_t epoch = atomic_load_explicit(&eod.epoch, memory_order_acquire);
+    if (client->epoch >= epoch) return;
+
+    const int32_t* deltas = NULL;
+    if ((uint32_t)client->client_no < eod.cut_clients) {
+        deltas = eod.deltas + (size_t)client->client_no * max_accounts;
+    }
+    eod_apply_client(client, deltas, epoch, eod.epoch_lsn, eod.epoch_time);
+}
+
+// 고객 한 명에게 회차의 증감 반영 (deltas는 max_accounts칸, NULL이면 증감 없이 회차만 올린다)
+// 원장 항목은 WAL_EPOCH의 LSN으로 적는다. 그 사이 거래보다 LSN이 작을 수 있지만 적는 순서가
+// 잔고가 바뀐 순서이므로 거래 후 잔고는 이어진다.
+void eod_apply_client(ClientInfo* client, const int32_t* deltas, uint32_t epoch, uint64_t lsn, uint32_t stamp) {
+    client_write_begin(client);
+    for (int j = 0; deltas != NULL && j < client->account_count; j++) {
+        if (deltas[j] == 0) continue;
+        Account* account = &client->accounts[j];
+        account->balance += deltas[j];
+        if (ledger_file.fd >= 0) {
+            Ledger* ledger = ledger_of(account);
+            LedgerEntry entry = {
+                .lsn = lsn, .time = stamp, .type = WAL_EPOCH,
+                .amount = deltas[j], .balance = account->balance
+            };
+            ledger_add(client, j, ledger, &entry);
+            if (ledger->last_lsn < lsn) ledger->last_lsn = lsn;
+        }
+    }
+    if (client->last_lsn < lsn) client->last_lsn = lsn;
+    client->epoch = epoch;
+    client_write_end(client);
+}
+
+// 일 마감 레코드 재실행 (wal_apply: 기동 복구, 대기 서버)
+// 증감 묶음은 모아 두기만 하고, 확정 레코드에서 모든 고객을 한 번에 반영한다.
+// 확정 레코드가 없으면 (적는 도중 죽었으면) 그 회차는 없던 일이 된다.
+void eod_replay(const WalHeader* h, const void* body) {
+    if (h->type == WAL_EPOCH_DATA) {
+        const WalEpochData* r = body;
+        if (h->len < sizeof(WalEpochData) ||
+            h->len != sizeof(WalEpochData) + sizeof(WalTransferLeg) * r->leg_count) return;
+        if (r->epoch != eod.replay_epoch) {
+            eod.replay_epoch = r->epoch;
+            eod.replay_records = 0;
+            eod.replay_count = 0;
+        }
+        if (eod.replay_count + r->leg_count > eod.replay_cap) {
+            size_t cap = eod.replay_cap ? eod.replay_cap : 4096;
+            while (cap < eod.replay_count + r->leg_count) cap *= 2;
+            WalTransferLeg* legs = realloc(eod.replay_legs, cap * sizeof(WalTransferLeg));
+            if (legs == NULL) {
+                perror("eod replay realloc failed");
+                exit(EXIT_FAILURE);
+            }
+            eod.replay_legs = legs;
+            eod.replay_cap = cap;
+        }
+        memcpy(eod.replay_legs + eod.replay_count, r->legs, sizeof(WalTransferLeg) * r->leg_count);
+        eod.replay_count += r->leg_count;
+        eod.replay_records++;
+        return;
+    }
+
+    const WalEpoch* r = body;
+    if (h->len != sizeof(WalEpoch)) return;
+    if (r->epoch != eod.replay_epoch || r->records != eod.replay_records || r->legs != eod.replay_count) {
+        fprintf(stderr, "❌ 일 마감 %u회차의 증감 레코드가 맞지 않습니다 (묶음 %u/%u, 항목 %zu/%llu)\n",
+                r->epoch, eod.replay_records, r->records, eod.replay_count, (unsigned long long)r->legs);
+        exit(EXIT_FAILURE);
+    }
+
+    // 증감은 고객 번호 순서로 적혀 있다. 증감이 없는 고객도 회차를 올린다.
+    int32_t* row = malloc(max_accounts * sizeof(int32_t));
+    if (row == NULL) {
+        perror("eod replay malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    size_t k = 0;
+    int count = client_count();
+    for (int i = 0; i < count; i++) {
+        ClientInfo* client = client_at(i);
+        bool any = false;
+        memset(row, 0, max_accounts * sizeof(int32_t));
+        while (k < eod.replay_count && eod.replay_legs[k].client_no <= (uint32_t)i) {
+            const WalTransferLeg* leg = &eod.replay_legs[k++];
+            if (leg->client_no == (uint32_t)i && leg->account_num < (uint32_t)max_accounts) {
+                row[leg->account_num] += leg->amount;
+                any = true;
+            }
+        }
+
+        pthread_mutex_lock(&client->lock);
+        if (client->epoch < r->epoch) {
+            eod_apply_client(client, any ? row : NULL, r->epoch, h->lsn, h->time);
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+    free(row);
+
+    eod.epoch_lsn = h->lsn;
+    eod.epoch_time = h->time;
+    eod.cut_clients = 0;
+    if (r->epoch > atomic_load(&eod.epoch)) atomic_store(&eod.epoch, r->epoch);
+    eod.replay_count = 0;
+    eod.replay_records = 0;
+}
+
+// 일 마감 시작 (이미 도는 중이면 false)
+bool eod_start() {
+    bool expected = false;
+    if (!atomic_compare_exchange_strong(&eod.running, &expected, true)) return false;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, eod_thread_func, NULL) != 0) {
+        perror("eod thread create failed");
+        atomic_store(&eod.running, false);
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+void* eod_thread_func(void* arg) {
+    (void)arg;
+    eod_run();
+    atomic_store(&eod.running, false);
+    return NULL;
+}
+
+// 일 마감 한 회차 (잔고 복사 → 계산 → 확정 → 반영)
+void eod_run() {
+    uint32_t epoch = atomic_load(&eod.epoch) + 1;
+    uint64_t start = now_ns(), t;
+
+    LOG_INFO("🌙 [일 마감] %u회차 시작 (이자 %d ppm, 수수료 %d원: 잔고 %d원 미만, 스레드 %d개)\n",
+        epoch, eod.interest_ppm, eod.fee, eod.fee_waive, eod.threads > 0 ? eod.threads : cpu_count);
+    atomic_store(&eod.interest, 0);
+    atomic_store(&eod.fees, 0);
+    atomic_store(&eod.accounts, 0);
+
+    t = now_ns();
+    atomic_store(&eod.phase, EOD_CUT);
+    eod_cut(epoch);
+    eod.phase_ms[EOD_CUT] = (now_ns() - t) / 1e6;
+
+    eod_parallel(EOD_COMPUTE, eod_compute_func, eod.cut_clients);
+
+    t = now_ns();
+    atomic_store(&eod.phase, EOD_COMMIT);
+    eod_commit(epoch);
+    eod.phase_ms[EOD_COMMIT] = (now_ns() - t) / 1e6;
+
+    eod_parallel(EOD_APPLY, eod_apply_func, eod.cut_clients);
+    atomic_store(&eod.phase, EOD_IDLE);
+    atomic_fetch_add(&eod.runs, 1);
+
+    LOG_INFO("🌙 [일 마감] %u회차 완료: 고객 %u명, 통장 %lu개 변동, 이자 %lld원, 수수료 %lld원 "
+        "(%.1fms: 복사 %.1f, 계산 %.1f, 확정 %.1f, 반영 %.1f)\n",
+        epoch, eod.cut_clients, atomic_load(&eod.accounts), atomic_load(&eod.interest),
+        atomic_load(&eod.fees), (now_ns() - start) / 1e6, eod.phase_ms[EOD_CUT],
+        eod.phase_ms[EOD_COMPUTE], eod.phase_ms[EOD_COMMIT], eod.phase_ms[EOD_APPLY]);
+}
+
+// 마감 시점 잔고 복사
+// 모든 고객을 잠근 상태가 되어야 한 시점이므로 한 스레드가 잠금 순서대로 잡는다 (나눠 잡으면
+// 여러 고객을 함께 잠그는 이체와 교착할 수 있다). 잠그는 동안 지난 회차도 모두 반영된다.
+// 인기 통장 입금은 고객 lock 없이 들어오므로 잠그기 전에 closing을 올려 고객 lock 경로로 돌린다.
+void eod_cut(uint32_t epoch) {
+    int count = client_count();
+    size_t cells = (size_t)count * max_accounts;
+
+    if (cells > eod.cap) {
+        int32_t* balances = realloc(eod.balances, cells * sizeof(int32_t));
+        if (balances != NULL) eod.balances = balances;
+        int32_t* deltas = balances != NULL ? realloc(eod.deltas, cells * sizeof(int32_t)) : NULL;
+        if (deltas == NULL) {
+            perror("eod realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        eod.deltas = deltas;
+        eod.cap = cells;
+    }
+
+    atomic_store(&eod.done, 0);
+    atomic_store(&eod.closing, epoch);
+    for (int i = 0; i < count; i++) {
+        ClientInfo* client = client_at(i);
+        int32_t* row = eod.balances + (size_t)i * max_accounts;
+
+        client_lock(client);
+        // client_lock()은 합이 0이면 조각을 건너뛴다. 조각 lock을 모두 거쳐야 closing을 못 본 채
+        // 들어오던 입금까지 이 복사에 들어간다.
+        for (int j = 0; atomic_load(&client->hot_accounts) > 0 && j < client->account_count; j++) {
+            if (client->accounts[j].hot != NULL) hot_fold_account(client, j, client->accounts[j].hot);
+        }
+        for (int j = 0; j < max_accounts; j++) {
+            const Account* account = &client->accounts[j];
+            row[j] = (j < client->account_count && account->is_active) ? account->balance : 0;
+        }
+        if ((i + 1) % EOD_CHUNK == 0) atomic_store_explicit(&eod.done, i + 1, memory_order_relaxed);
+    }
+    eod.cut_clients = count;
+    eod.cut_epoch = epoch;
+    for (int i = count - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&client_at(i)->lock);
+    }
+    atomic_store(&eod.done, count);
+}
+
+// 계산 스레드: 복사본의 통장마다 eod_rule()을 적용한다.
+void* eod_compute_func(void* arg) {
+    (void)arg;
+    long long interest = 0, fees = 0;
+    unsigned long accounts = 0;
+
+    while (1) {
+        uint32_t first = atomic_fetch_add(&eod.next, EOD_CHUNK);
+        if (first >= eod.cut_clients) break;
+        uint32_t end = first + EOD_CHUNK < eod.cut_clients ? first + EOD_CHUNK : eod.cut_clients;
+
+        for (size_t k = (size_t)first * max_accounts; k < (size_t)end * max_accounts; k++) {
+            int64_t gain, fee;
+            eod_rule(eod.balances[k], &gain, &fee);
+            eod.deltas[k] = (int32_t)(gain - fee);
+            interest += gain;
+            fees += fee;
+            if (gain != fee) accounts++;
+        }
+        atomic_fetch_add(&eod.done, end - first);
+    }
+
+    atomic_fetch_add(&eod.interest, interest);
+    atomic_fetch_add(&eod.fees, fees);
+    atomic_fetch_add(&eod.accounts, accounts);
+    return NULL;
+}
+
+// 확정: 증감을 WAL에 적어 내려보낸 뒤 회차 공개 (WAL이 없으면 공개만)
+void eod_commit(uint32_t epoch) {
+    uint64_t lsn = 0;
+    uint32_t stamp = (uint32_t)time(NULL);
+
+    pthread_mutex_lock(&snapshot_mutex);
+    if (wal.enabled) {
+        uint32_t cap = (WAL_MAX_RECORD - sizeof(WalEpochData)) / sizeof(WalTransferLeg);
+        WalEpochData* rec = malloc(WAL_MAX_RECORD);
+        WalEpoch commit = {
+            .epoch = epoch, .interest = atomic_load(&eod.interest), .fees = atomic_load(&eod.fees)
+        };
+        if (rec == NULL) {
+            perror("eod record malloc failed");
+            exit(EXIT_FAILURE);
+        }
+
+        rec->epoch = epoch;
+        rec->leg_count = 0;
+        for (uint32_t i = 0; i < eod.cut_clients; i++) {
+            const int32_t* row = eod.deltas + (size_t)i * max_accounts;
+            for (int j = 0; j < max_accounts; j++) {
+                if (row[j] == 0) continue;
+                rec->legs[rec->leg_count++] = (WalTransferLeg){ i, j, row[j] };
+                commit.legs++;
+                if (rec->leg_count == cap) {
+                    wal_append_at(WAL_EPOCH_DATA, rec,
+                        sizeof(WalEpochData) + rec->leg_count * sizeof(WalTransferLeg), stamp);
+                    commit.records++;
+                    rec->leg_count = 0;
+                }
+            }
+        }
+        if (rec->leg_count > 0) {
+            wal_append_at(WAL_EPOCH_DATA, rec,
+                sizeof(WalEpochData) + rec->leg_count * sizeof(WalTransferLeg), stamp);
+            commit.records++;
+        }
+        free(rec);
+
+        lsn = wal_append_at(WAL_EPOCH, &commit, sizeof(commit), stamp);
+        wal_sync(lsn);
+    }
+
+    eod.epoch_lsn = lsn;
+    eod.epoch_time = stamp;
+    atomic_store_explicit(&eod.epoch, epoch, memory_order_release);
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    LOG_INFO("🌙 [일 마감] %u회차 공개 (LSN %llu)\n", epoch, (unsigned long long)lsn);
+}
+
+// 반영 스레드: 아직 반영하지 않은 고객의 lock을 잡았다 놓는다 (client_lock()이 반영한다)
+void* eod_apply_func(void* arg) {
+    (void)arg;
+    uint32_t epoch = atomic_load(&eod.epoch);
+
+    while (1) {
+        uint32_t first = atomic_fetch_add(&eod.next, EOD_CHUNK);
+        if (first >= eod.cut_clients) break;
+        uint32_t end = first + EOD_CHUNK < eod.cut_clients ? first + EOD_CHUNK : eod.cut_clients;
+
+        for (uint32_t i = first; i < end; i++) {
+            ClientInfo* client = client_at(i);
+            if (client->epoch >= epoch) continue;   // 거래하며 이미 반영했다
+            client_lock(client);
+            pthread_mutex_unlock(&client->lock);
+        }
+        atomic_fetch_add(&eod.done, end - first);
+    }
+    return NULL;
+}
+
+// 병렬 단계: 스레드들이 고객을 EOD_CHUNK명씩 나눠 가져가고, 부른 스레드는 1초마다 진행을 알린다
+void eod_parallel(EodPhase phase, void* (*func)(void*), uint32_t total) {
+    int threads = eod.threads > 0 ? eod.threads : cpu_count;
+    pthread_t* ids = calloc(threads, sizeof(pthread_t));
+    uint64_t start = now_ns();
+
+    if (ids == NULL) {
+        perror("eod calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&eod.next, 0);
+    atomic_store(&eod.done, 0);
+    atomic_store(&eod.phase, phase);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&ids[i], NULL, func, NULL) != 0) {
+            perror("eod thread create failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec++;
+        while (pthread_timedjoin_np(ids[i], NULL, &deadline) == ETIMEDOUT) {
+            uint32_t done = atomic_load(&eod.done);
+            LOG_INFO("📊 [일 마감] %s %u/%u명 (%.0f%%)\n",
+                eod_phase_names[phase], done, total, total > 0 ? done * 100.0 / total : 100.0);
+            deadline.tv_sec++;
+        }
+    }
+    free(ids);
+    eod.phase_ms[phase] = (now_ns() - start) / 1e6;
+}
+
+// --eod-at: 매일 정한 시각에 일 마감
+void eod_schedule_start() {
+    pthread_t thread;
+    pthread_create(&thread, NULL, eod_schedule_func, NULL);
+    pthread_detach(thread);
+    LOG_INFO("🌙 일 마감: 매일 %02d:%02d (이자 %d ppm, 수수료 %d원)\n",
+        eod.at_minute / 60, eod.at_minute % 60, eod.interest_ppm, eod.fee);
+}
+
+void* eod_schedule_func(void* arg) {
+    (void)arg;
+
+    while (1) {
+        time_t now = time(NULL);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        int wait = (eod.at_minute - tm.tm_hour * 60 - tm.tm_min) * 60 - tm.tm_sec;
+        if (wait <= 0) wait += 24 * 60 * 60;
+        sleep(wait);
+
+        // 대기 서버는 주 서버의 마감을 복제로 받는다
+        if (repl_is_standby()) continue;
+        if (!eod_start()) {
+            LOG_WARN("⚠️  [일 마감] 이전 회차가 아직 도는 중이라 건너뜁니다\n");
+        }
+    }
+    return NULL;
+}
+
+// ========== 복제 (핫 스탠바이) ==========
+// 주 서버는 커밋된 WAL 레코드를 세그먼트 파일에서 읽어 그대로 흘려보낸다 (기록 경로에는 손대지 않는다).
+// 대기 서버는 레코드를 순서대로 반영하고 자기 WAL에도 같은 LSN으로 남기므로,
+// promote 하면 재구축 없이 그 자리에서 영업을 시작하고, 재시작해도 받은 데까지 이어 받는다.
+
+bool repl_send_all(int fd, const void* data, size_t len, int flags) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, flags | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool repl_recv_all(int fd, void* data, size_t len) {
+    char* p = data;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool repl_send_msg(int fd, uint32_t type, uint64_t lsn, const void* body, size_t len) {
+    ReplMsgHeader m = { .type = type, .lsn = lsn, .len = len };
+    return repl_send_all(fd, &m, sizeof(m), len > 0 ? MSG_MORE : 0) &&
+           (len == 0 || repl_send_all(fd, body, len, 0));
+}
+
+// lsn이 들어 있는 세그먼트 열기 (첫 LSN이 lsn 이하인 마지막 세그먼트)
+// 이미 스냅샷 뒤에 지워졌으면 -1
+int repl_segment_open(uint64_t lsn, uint64_t* base_out) {
+    uint64_t* bases;
+    int count = wal_list_segments(&bases);
+    int found = -1;
+
+    for (int i = 0; i < count && bases[i] <= lsn; i++) {
+        found = i;
+    }
+    int fd = -1;
+    if (found >= 0) {
+        char path[PATH_MAX];
+        wal_segment_path(path, sizeof(path), bases[found]);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        *base_out = bases[found];
+    }
+    free(bases);
+    return fd;
+}
+
+// 스냅샷 파일 보내기 (대기 서버가 원하는 LSN의 로그가 이미 지워졌을 때)
+// 스냅샷 스레드가 도중에 새 파일로 바꿔도 연 파일은 그대로 남는다.
+bool repl_send_snapshot(int fd, uint64_t next_lsn, uint64_t* start_out) {
+    char path[PATH_MAX];
+    SnapshotFile header;
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s/bank.snap", data_dir);
+    int snap_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (snap_fd < 0 || fstat(snap_fd, &st) < 0 ||
+        pread(snap_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header.start_lsn + 1 < next_lsn) {
+        if (snap_fd >= 0) close(snap_fd);
+        const char* reason = "필요한 WAL 구간이 주 서버에 없습니다";
+        repl_send_msg(fd, REPL_MSG_ERROR, 0, reason, strlen(reason));
+        return false;
+    }
+
+    // 본문은 sendfile로 (사용자 공간으로 복사하지 않는다)
+    ReplMsgHeader m = { .type = REPL_MSG_SNAPSHOT, .lsn = header.start_lsn, .len = st.st_size };
+    bool ok = repl_send_all(fd, &m, sizeof(m), MSG_MORE);
+    off_t off = 0;
+    while (ok && off < st.st_size) {
+        ssize_t n = sendfile(fd, snap_fd, &off, st.st_size - off);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+    }
+    close(snap_fd);
+
+    *start_out = header.start_lsn;
+    return ok;
+}
+
+// 대기 서버 하나에 next부터 흘려보내기 (연결이 끊기거나 보낼 수 없으면 돌아온다)
+// 세그먼트를 버퍼로 읽어 커밋된 LSN까지의 온전한 레코드만 보낸다. 그 뒤 바이트(기록 중인 묶음)는
+// 버퍼에 남겨 두었다가 다음에 이어 읽는다.
+void repl_sender_stream(ReplFollower* f, uint64_t next) {
+    char* buf = malloc(REPL_BUF_SIZE);
+    size_t have = 0;
+    int seg_fd = -1;
+    uint64_t seg_base = 0;
+    const char* error = NULL;
+    bool connected = true;
+
+    if (buf == NULL) {
+        perror("repl buffer malloc failed");
+        return;
+    }
+
+    while (connected && error == NULL) {
+        if (seg_fd < 0) {
+            seg_fd = repl_segment_open(next, &seg_base);
+            have = 0;
+            if (seg_fd < 0) {
+                // 로그가 스냅샷 뒤에 지워졌다: 스냅샷부터 보내고 그 다음 LSN부터 잇는다
+                uint64_t start;
+                if (!repl_send_snapshot(f->fd, next, &start)) break;
+                LOG_INFO("🔁 [복제] %s에 스냅샷 전송 (LSN %llu 시점)\n", f->addr, (unsigned long long)start);
+                next = start + 1;
+                atomic_store(&f->sent_lsn, start);
+                continue;
+            }
+        }
+
+        // 커밋된 LSN이 next에 닿을 때까지 (없으면 하트비트 주기마다 깨어난다)
+        pthread_mutex_lock(&wal.mutex);
+        uint64_t limit = wal_committed_lsn();
+        if (limit < next) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += REPL_HEARTBEAT_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&wal.flushed, &wal.mutex, &deadline);
+            limit = wal_committed_lsn();
+        }
+        pthread_mutex_unlock(&wal.mutex);
+        if (limit < next) {
+            connected = repl_send_msg(f->fd, REPL_MSG_HEARTBEAT, limit, NULL, 0);
+            continue;
+        }
+
+        // limit까지 읽고 보낸다
+        while (connected && error == NULL && next <= limit) {
+            size_t off = 0, from = 0;
+            while (have - off >= sizeof(WalHeader)) {
+                WalHeader h;
+                memcpy(&h, buf + off, sizeof(h));
+                if (h.len > WAL_MAX_RECORD) {
+                    error = "WAL 세그먼트 손상";
+                    break;
+                }
+                if (have - off < sizeof(h) + h.len || h.lsn > limit) break;
+                off += sizeof(h) + h.len;
+                if (h.lsn < next) {
+                    from = off;         // 세그먼트 앞부분 (이미 받은 레코드)
+                } else if (h.lsn != next++) {
+                    error = "WAL LSN이 이어지지 않습니다";
+                    break;
+                }
+            }
+            if (error != NULL) break;
+            if (off > from) {
+                connected = repl_send_msg(f->fd, REPL_MSG_RECORDS, limit, buf + from, off - from);
+            }
+            atomic_store(&f->sent_lsn, next - 1);
+            memmove(buf, buf + off, have - off);
+            have -= off;
+            if (next > limit) break;
+
+            ssize_t n = read(seg_fd, buf + have, REPL_BUF_SIZE - have);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                error = "WAL 세그먼트 읽기 실패";
+            } else if (n > 0) {
+                have += n;
+            } else if (have > 0) {
+                error = "WAL 세그먼트 끝에 잘린 레코드";
+            } else {
+                // 이 세그먼트는 끝났다: 커밋된 레코드가 더 있으면 다음 세그먼트에 있다
+                uint64_t base;
+                int fd = repl_segment_open(next, &base);
+                if (fd >= 0 && base == seg_base) {
+                    close(fd);
+                    error = "다음 WAL 세그먼트가 없습니다";
+                } else {
+                    close(seg_fd);
+                    seg_fd = fd;
+                    seg_base = base;
+                    if (seg_fd < 0) break;  // 지워졌으면 위에서 스냅샷부터
+                }
+            }
+        }
+    }
+
+    if (error != NULL) {
+        LOG_ERROR("❌ [복제] %s: %s (LSN %llu)\n", f->addr, error, (unsigned long long)next);
+        repl_send_msg(f->fd, REPL_MSG_ERROR, 0, error, strlen(error));
+    }
+    if (seg_fd >= 0) close(seg_fd);
+    free(buf);
+}
+
+// 대기 서버 연결 하나 (인사를 확인하고 받을 LSN부터 흘려보낸다)
+void* repl_sender_func(void* arg) {
+    ReplFollower* f = arg;
+    ReplMsgHeader m;
+    ReplHello hello;
+    const char* reason = NULL;
+
+    if (!repl_recv_all(f->fd, &m, sizeof(m)) || m.type != REPL_MSG_HELLO || m.len != sizeof(hello) ||
+        !repl_recv_all(f->fd, &hello, sizeof(hello)) ||
+        memcmp(hello.magic, REPL_MAGIC, sizeof(hello.magic)) != 0 || hello.version != REPL_VERSION) {
+        reason = "복제 인사 형식이 다릅니다";
+    } else if (hello.initial_clients != (uint32_t)initial_clients ||
+               hello.max_accounts != (uint32_t)max_accounts) {
+        reason = "--clients 또는 --max-accounts 값이 주 서버와 다릅니다";
+    } else {
+        pthread_mutex_lock(&wal.mutex);
+        uint64_t next_lsn = wal.next_lsn;
+        pthread_mutex_unlock(&wal.mutex);
+        if (m.lsn > next_lsn || m.lsn == 0) {
+            reason = "대기 서버가 주 서버보다 앞서 있습니다 (다른 주 서버의 데이터인가요?)";
+        }
+    }
+
+    if (reason != NULL) {
+        LOG_WARN("⚠️  [복제] %s 거절: %s\n", f->addr, reason);
+        repl_send_msg(f->fd, REPL_MSG_ERROR, 0, reason, strlen(reason));
+    } else {
+        LOG_INFO("🔁 [복제] 대기 서버 %s 연결 (LSN %llu부터)\n", f->addr, (unsigned long long)m.lsn);
+        atomic_store(&f->sent_lsn, m.lsn - 1);
+        repl_sender_stream(f, m.lsn);
+        LOG_INFO("🔁 [복제] 대기 서버 %s 끊김 (LSN %llu까지 보냄)\n",
+            f->addr, (unsigned long long)atomic_load(&f->sent_lsn));
+    }
+
+    close(f->fd);
+    pthread_mutex_lock(&repl.mutex);
+    f->used = false;
+    pthread_mutex_unlock(&repl.mutex);
+    return NULL;
+}
+
+// 복제 수신 스레드 (대기 서버마다 보내는 스레드를 하나씩 띄운다)
+void* repl_listen_func(void* arg) {
+    int listen_fd = *(int*)arg;
+
+    while (1) {
+        struct sockaddr_in addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept4(listen_fd, (struct sockaddr*)&addr, &addr_len, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR) perror("repl accept failed");
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ReplFollower* f = NULL;
+        pthread_mutex_lock(&repl.mutex);
+        for (int i = 0; i < REPL_MAX_FOLLOWERS && f == NULL; i++) {
+            if (!repl.followers[i].used) f = &repl.followers[i];
+        }
+        if (f != NULL) {
+            f->used = true;
+            f->fd = fd;
+            snprintf(f->addr, sizeof(f->addr), "%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+            atomic_store(&f->sent_lsn, 0);
+        }
+        pthread_mutex_unlock(&repl.mutex);
+
+        pthread_t thread;
+        if (f == NULL) {
+            const char* reason = "대기 서버가 너무 많습니다";
+            repl_send_msg(fd, REPL_MSG_ERROR, 0, reason, strlen(reason));
+            close(fd);
+        } else if (pthread_create(&thread, NULL, repl_sender_func, f) != 0) {
+            close(fd);
+            pthread_mutex_lock(&repl.mutex);
+            f->used = false;
+            pthread_mutex_unlock(&repl.mutex);
+        } else {
+            pthread_detach(thread);
+        }
+    }
+
+    return NULL;
+}
+
+// 복제 포트 열기 (주 서버)
+void repl_start() {
+    static int listen_fd;
+    struct sockaddr_in address;
+    pthread_t thread;
+    int opt = 1;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(repl.port);
+    if (inet_pton(AF_INET, repl.bind_addr, &address.sin_addr) != 1) {
+        fprintf(stderr, "❌ 복제 주소가 잘못되었습니다: %s\n", repl.bind_addr);
+        exit(EXIT_FAILURE);
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("repl socket failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd, 16) < 0) {
+        perror("repl bind failed");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_create(&thread, NULL, repl_listen_func, &listen_fd);
+    pthread_detach(thread);
+    LOG_INFO("🔁 복제 포트: %s:%d\n", repl.bind_addr, repl.port);
+}
+
+// 대기 서버인지 (promote 전까지는 고객을 받지 않고 관리 명령으로도 바꾸지 않는다)
+bool repl_is_standby() {
+    if (repl.primary == NULL) return false;
+    pthread_mutex_lock(&repl.mutex);
+    bool standby = !repl.promoted;
+    pthread_mutex_unlock(&repl.mutex);
+    return standby;
+}
+
+// 받은 레코드 하나 반영 (대기 서버)
+// 영업 중 거래처럼 관련 고객 lock 안에서 메모리를 바꾸고 자기 WAL에 추가한다.
+// 대기 서버에서 WAL에 추가하는 것은 이 스레드뿐이므로 LSN이 주 서버와 같게 붙는다.
+void repl_apply(const WalHeader* h, const void* body) {
+    static ClientInfo* clients[TRANSFER_MAX_LEGS];
+    int count = 0;
+
+    switch (h->type) {
+        case WAL_OPEN:
+            if (h->len == sizeof(WalOpen)) clients[count++] = client_at(((const WalOpen*)body)->client_no);
+            break;
+        case WAL_DEPOSIT:
+            if (h->len == sizeof(WalDeposit)) clients[count++] = client_at(((const WalDeposit*)body)->client_no);
+            break;
+        case WAL_WITHDRAW:
+            if (h->len == sizeof(WalWithdraw)) clients[count++] = client_at(((const WalWithdraw*)body)->client_no);
+            break;
+        case WAL_TRANSFER: {
+            const WalTransfer* r = body;
+            if (h->len < sizeof(WalTransfer) || r->leg_count > TRANSFER_MAX_LEGS ||
+                h->len != sizeof(WalTransfer) + sizeof(WalTransferLeg) * r->leg_count) break;
+            for (uint32_t i = 0; i < r->leg_count; i++) {
+                clients[count++] = client_at(r->legs[i].client_no);
+            }
+            break;
+        }
+        case WAL_XCOMMIT:
+        case WAL_XAPPLY: {
+            const WalShardTx* r = body;
+            if (h->len < sizeof(WalShardTx) || r->leg_count > TRANSFER_MAX_LEGS ||
+                h->len != sizeof(WalShardTx) + sizeof(WalTransferLeg) * r->leg_count) break;
+            for (uint32_t i = 0; i < r->leg_count; i++) {
+                clients[count++] = client_at(r->legs[i].client_no);
+            }
+            break;
+        }
+    }
+    // 없는 고객 번호는 wal_apply가 건너뛴다 (잠글 것만 남긴다)
+    int live = 0;
+    for (int i = 0; i < count; i++) {
+        if (clients[i] != NULL) clients[live++] = clients[i];
+    }
+
+    uint64_t lsn;
+    if (h->type == WAL_REGISTER) {
+        pthread_rwlock_wrlock(&directory.lock);
+        wal_apply(h, body);
+        lsn = wal_append_at(h->type, body, h->len, h->time);
+        pthread_rwlock_unlock(&directory.lock);
+    } else {
+        lock_clients(clients, live);
+        for (int i = 0; i < live; i++) {
+            if (i == 0 || clients[i] != clients[i - 1]) client_write_begin(clients[i]);
+        }
+        wal_apply(h, body);
+        lsn = wal_append_at(h->type, body, h->len, h->time);
+        for (int i = 0; i < live; i++) {
+            if (i == 0 || clients[i] != clients[i - 1]) client_write_end(clients[i]);
+        }
+        unlock_clients(clients, live);
+    }
+
+    // 준비 중인 지점 간 거래와 결정도 따라 적어 둔다 (promote 후 마저 끝낸다)
+    if (shard.count > 0) {
+        shard_track(h, body);
+    }
+
+    if (lsn != h->lsn) {
+        fprintf(stderr, "❌ 복제 LSN이 어긋났습니다 (받은 %llu, 기록 %llu)\n",
+            (unsigned long long)h->lsn, (unsigned long long)lsn);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// 주 서버가 보낸 스냅샷으로 바꾼다 (대기 서버가 원하는 구간의 로그가 주 서버에서 지워졌을 때)
+// 파일을 먼저 내려보내고 메모리에 불러온 뒤 WAL을 스냅샷 다음 LSN의 새 세그먼트로 넘기고 지난 세그먼트를 지운다.
+// 어느 단계에서 멈춰도 재시작하면 스냅샷 + 남은 로그로 복구된다.
+bool repl_install_snapshot(int fd, uint64_t start_lsn, uint64_t len, char* buf) {
+    char path[PATH_MAX], tmp_path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/bank.snap", data_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/bank.snap.repl", data_dir);
+    int out = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        perror("snapshot open failed");
+        return false;
+    }
+
+    bool ok = true, first = true;
+    while (ok && len > 0) {
+        size_t n = len < REPL_BUF_SIZE ? len : REPL_BUF_SIZE;
+        ok = repl_recv_all(fd, buf, n);
+        // 원장 길이는 주 서버의 원장 파일 것이므로 지운다 (이 서버의 원장은 받은 뒤부터 새로 쌓는다)
+        if (ok && first && n >= sizeof(SnapshotFile)) {
+            ((SnapshotFile*)buf)->ledger_end = 0;
+        }
+        first = false;
+        ok = ok && write(out, buf, n) == (ssize_t)n;
+        len -= n;
+    }
+    ok = ok && fsync(out) == 0;
+    close(out);
+    if (!ok) {
+        unlink(tmp_path);
+        return false;
+    }
+
+    pthread_mutex_lock(&snapshot_mutex);
+
+    // 쌓인 레코드를 먼저 내려보낸다 (스냅샷과 새 세그먼트보다 앞서야 한다)
+    pthread_mutex_lock(&wal.mutex);
+    uint64_t last = wal.next_lsn - 1;
+    pthread_mutex_unlock(&wal.mutex);
+    wal_sync(last);
+
+    if (rename(tmp_path, path) < 0) {
+        perror("snapshot commit failed");
+        exit(EXIT_FAILURE);
+    }
+    int dir_fd = open(data_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    uint64_t ledger_end;
+    pthread_rwlock_wrlock(&directory.lock);
+    uint64_t loaded = snapshot_load(&ledger_end);
+    pthread_rwlock_unlock(&directory.lock);
+    ledger_reset();
+    if (loaded != start_lsn) {
+        fprintf(stderr, "❌ 받은 스냅샷의 LSN이 다릅니다 (%llu, %llu)\n",
+            (unsigned long long)loaded, (unsigned long long)start_lsn);
+        exit(EXIT_FAILURE);
+    }
+
+    // 다음 레코드부터 새 세그먼트에 쓴다
+    pthread_mutex_lock(&wal.mutex);
+    wal.next_lsn = start_lsn + 1;
+    wal.rotate_requested = true;
+    wal.sync_requested = true;
+    pthread_cond_signal(&wal.work);
+    while (wal.segment_base != start_lsn + 1) {
+        pthread_cond_wait(&wal.flushed, &wal.mutex);
+    }
+    pthread_mutex_unlock(&wal.mutex);
+    snapshot_prune_segments(start_lsn);
+
+    pthread_mutex_unlock(&snapshot_mutex);
+    atomic_fetch_add(&repl.snapshots, 1);
+    return true;
+}
+
+// 주 서버 연결 하나에서 메시지를 받아 반영 (끊기거나 promote 요청이 오면 돌아온다)
+void repl_receive(int fd, char* buf) {
+    pthread_mutex_lock(&wal.mutex);
+    uint64_t next = wal.next_lsn;
+    pthread_mutex_unlock(&wal.mutex);
+
+    ReplHello hello = { .version = REPL_VERSION, .initial_clients = initial_clients,
+                        .max_accounts = max_accounts };
+    memcpy(hello.magic, REPL_MAGIC, sizeof(hello.magic));
+    if (!repl_send_msg(fd, REPL_MSG_HELLO, next, &hello, sizeof(hello))) return;
+    atomic_store(&repl.connected, true);
+    LOG_INFO("🔁 [복제] 주 서버 %s 연결 (LSN %llu부터)\n", repl.primary, (unsigned long long)next);
+
+    ReplMsgHeader m;
+    while (repl_recv_all(fd, &m, sizeof(m))) {
+        if (m.type == REPL_MSG_SNAPSHOT) {
+            if (!repl_install_snapshot(fd, m.lsn, m.len, buf)) break;
+            LOG_INFO("📸 [복제] 스냅샷 받음 (LSN %llu 시점)\n", (unsigned long long)m.lsn);
+            next = m.lsn + 1;
+            atomic_store(&repl.applied_lsn, m.lsn);
+            continue;
+        }
+        if (m.len > REPL_BUF_SIZE || !repl_recv_all(fd, buf, m.len)) break;
+
+        if (m.type == REPL_MSG_ERROR) {
+            fprintf(stderr, "❌ 주 서버가 복제를 거절했습니다: %.*s\n", (int)m.len, buf);
+            exit(EXIT_FAILURE);
+        }
+        if (m.type == REPL_MSG_RECORDS) {
+            size_t off = 0;
+            while (off + sizeof(WalHeader) <= m.len) {
+                WalHeader h;
+                memcpy(&h, buf + off, sizeof(h));
+                if (h.len > m.len - off - sizeof(h) || h.lsn != next ||
+                    wal_record_crc(&h, buf + off + sizeof(h)) != h.crc) {
+                    break;
+                }
+                repl_apply(&h, buf + off + sizeof(h));
+                next++;
+                off += sizeof(h) + h.len;
+            }
+            if (off != m.len) {
+                LOG_ERROR("❌ [복제] 받은 레코드가 손상되었습니다 (LSN %llu), 다시 연결합니다\n",
+                    (unsigned long long)next);
+                break;
+            }
+            atomic_store(&repl.applied_lsn, next - 1);
+        }
+        atomic_store(&repl.primary_lsn, m.lsn);
+        if (next - 1 >= m.lsn) {
+            atomic_store(&repl.caught_up_ns, now_ns());
+        }
+    }
+
+    atomic_store(&repl.connected, false);
+}
+
+// 주 서버에 연결 (--follow HOST:PORT)
+int repl_connect() {
+    char host[256];
+    const char* colon = strrchr(repl.primary, ':');
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *res;
+
+    if (colon == NULL || colon == repl.primary || (size_t)(colon - repl.primary) >= sizeof(host)) {
+        fprintf(stderr, "❌ 주 서버 주소는 HOST:PORT 형식이어야 합니다: %s\n", repl.primary);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(host, repl.primary, colon - repl.primary);
+    host[colon - repl.primary] = 0;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) return -1;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct timeval timeout = { 2, 0 };
+    int one = 1;
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// 복제 스레드 (대기 서버): 끊기면 1초 뒤 다시 연결해 받은 다음 LSN부터 잇는다
+void* repl_follower_func(void* arg) {
+    (void)arg;
+    char* buf = malloc(REPL_BUF_SIZE);
+    bool warned = false;
+
+    if (buf == NULL) {
+        perror("repl buffer malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1) {
+        int fd = repl_connect();
+
+        pthread_mutex_lock(&repl.mutex);
+        if (repl.promoting) {
+            pthread_mutex_unlock(&repl.mutex);
+            if (fd >= 0) close(fd);
+            break;
+        }
+        repl.fd = fd;
+        pthread_mutex_unlock(&repl.mutex);
+
+        if (fd >= 0) {
+            repl_receive(fd, buf);
+            pthread_mutex_lock(&repl.mutex);
+            repl.fd = -1;
+            pthread_mutex_unlock(&repl.mutex);
+            close(fd);
+            LOG_WARN("⚠️  [복제] 주 서버 %s와 연결이 끊겼습니다 (LSN %llu까지 반영)\n",
+                repl.primary, (unsigned long long)atomic_load(&repl.applied_lsn));
+            warned = false;
+        } else if (!warned) {
+            LOG_WARN("⚠️  [복제] 주 서버 %s에 연결할 수 없습니다. 1초마다 다시 시도합니다.\n", repl.primary);
+            warned = true;
+        }
+
+        // 1초 쉬되 promote 요청이 오면 바로 멈춘다
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        pthread_mutex_lock(&repl.mutex);
+        while (!repl.promoting) {
+            if (pthread_cond_timedwait(&repl.changed, &repl.mutex, &deadline) == ETIMEDOUT) break;
+        }
+        bool stop = repl.promoting;
+        pthread_mutex_unlock(&repl.mutex);
+        if (stop) break;
+        atomic_fetch_add(&repl.reconnects, 1);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// 대기 서버로 시작: 복제 스레드를 띄우고 promote 될 때까지 기다린다 (그 뒤 main이 영업을 시작한다)
+void repl_follow() {
+    atomic_store(&repl.caught_up_ns, now_ns());
+    pthread_mutex_lock(&wal.mutex);
+    atomic_store(&repl.applied_lsn, wal.next_lsn - 1);
+    pthread_mutex_unlock(&wal.mutex);
+
+    pthread_create(&repl.thread, NULL, repl_follower_func, NULL);
+    LOG_INFO("🔁 대기 서버로 시작: 주 서버 %s (영업은 promote 후)\n", repl.primary);
+
+    pthread_mutex_lock(&repl.mutex);
+    while (!repl.promoted) {
+        pthread_cond_wait(&repl.changed, &repl.mutex);
+    }
+    pthread_mutex_unlock(&repl.mutex);
+}
+
+// ========== 지점 나누기 (샤딩) ==========
+// 고객을 ID의 CRC32로 여러 서버(지점)에 나눠 둔다. 지점마다 자기 고객의 디렉터리와 WAL만
+// 가지므로 같은 지점 고객끼리의 업무는 지금까지와 똑같이 처리된다. 다른 지점 고객에게 가는
+// 입금/이체는 요청을 받은 지점(조정 지점)이 2단계 커밋으로 처리한다.
+//   1. 조정 지점: 이 지점 항목의 고객을 잠그고 반영할 수 있는지 확인한 뒤 참여 지점마다 PREPARE
+//   2. 참여 지점: 항목 고객을 잠그고 확인한 뒤 WAL_PREPARE를 디스크에 내리고 OK (lock은 쥔 채 기다린다)
+//   3. 조정 지점: 모두 OK면 이 지점 항목을 반영하며 WAL_XCOMMIT(결정)을 디스크에 내리고 COMMIT
+//   4. 참여 지점: 항목을 반영하고 WAL_XAPPLY를 내린 뒤 OK. 모두 OK면 조정 지점이 WAL_XEND
+// 조정 지점이 결정 전에 죽으면 결정 기록이 없으므로 철회다 (참여 지점이 STATUS로 물어 확인한다).
+// 결정 후에 죽으면 재시작할 때 WAL에서 결정을 찾아 끝나지 않은 참여 지점에 COMMIT을 다시 보낸다.
+
+// --shards HOST:PORT,HOST:PORT,... 해석
+void shard_parse_list(const char* list) {
+    char* copy = strdup(list);
+    char* save = NULL;
+
+    for (char* item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        char* colon = strrchr(item, ':');
+        if (shard.count >= MAX_SHARDS || colon == NULL || colon == item ||
+            (size_t)(colon - item) >= sizeof(shard.addrs[0].host) || atoi(colon + 1) <= 0) {
+            fprintf(stderr, "❌ --shards는 HOST:PORT를 쉼표로 이은 목록이어야 합니다 (최대 %d개): %s\n",
+                MAX_SHARDS, list);
+            exit(EXIT_FAILURE);
+        }
+
+        ShardAddr* a = &shard.addrs[shard.count++];
+        memcpy(a->host, item, colon - item);
+        a->host[colon - item] = 0;
+        a->port = atoi(colon + 1);
+
+        struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *res;
+        if (getaddrinfo(a->host, NULL, &hints, &res) != 0) {
+            fprintf(stderr, "❌ 지점 주소를 찾을 수 없습니다: %s\n", a->host);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(&a->addr, res->ai_addr, sizeof(a->addr));
+        a->addr.sin_port = htons(a->port);
+        freeaddrinfo(res);
+    }
+    free(copy);
+}
+
+// 고객이 속한 지점 (디렉터리 해시와 겹치지 않게 CRC32를 쓴다)
+int shard_of(const char* client_id) {
+    return crc32_update(0, client_id, strlen(client_id)) % shard.count;
+}
+
+// 이 서버에 둘 고객인지 (지점을 나누지 않았으면 모두)
+bool shard_owns(const char* client_id) {
+    return shard.count == 0 || shard_of(client_id) == shard.index;
+}
+
+// 지점 간 메시지 보내기 (바이너리 프로토콜 프레임, request_id는 쓰지 않는다)
+bool shard_peer_send(int fd, uint8_t op, uint8_t status, const void* body, uint32_t len) {
+    unsigned char header[BIN_HEADER_SIZE];
+    bin_put_u32(header, BIN_HEADER_SIZE - 4 + len);
+    header[4] = op;
+    header[5] = status;
+    header[6] = header[7] = 0;
+    bin_put_u32(header + 8, 0);
+
+    struct iovec iov[2] = { { header, BIN_HEADER_SIZE }, { (void*)body, len } };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = len > 0 ? 2 : 1 };
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (n < 0) return false;
+    // 짧게 보내졌으면 나머지를 마저 보낸다
+    if ((size_t)n < BIN_HEADER_SIZE) {
+        return repl_send_all(fd, header + n, BIN_HEADER_SIZE - n, 0) && repl_send_all(fd, body, len, 0);
+    }
+    n -= BIN_HEADER_SIZE;
+    return repl_send_all(fd, (const char*)body + n, len - n, 0);
+}
+
+// 지점 간 메시지 받기 (frame: op부터, 길이는 len_out)
+int shard_peer_recv(int fd, unsigned char* frame, uint32_t cap, uint32_t* len_out) {
+    unsigned char len_buf[4];
+    if (!repl_recv_all(fd, len_buf, 4)) return -1;
+    uint32_t len = bin_get_u32(len_buf);
+    if (len < BIN_HEADER_SIZE - 4 || len > cap) return -1;
+    if (!repl_recv_all(fd, frame, len)) return -1;
+    *len_out = len;
+    return 0;
+}
+
+// 이 스레드의 지점 연결 (없거나 끊겼으면 새로 연결)
+int shard_peer_connect(int index) {
+    if (peer_fds[index] > 0) {
+        // 상대가 재시작했으면 읽을 것(EOF)이 있다. 보내기 전에 걸러 낸다.
+        struct pollfd pfd = { peer_fds[index] - 1, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) == 0) return peer_fds[index] - 1;
+        shard_peer_drop(index);
+    }
+
+    struct sockaddr_in addr = shard.addrs[index].addr;
+    addr.sin_port = htons(shard.addrs[index].port + 2);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    // 준비 단계의 답은 상대가 lock을 기다리는 시간(SHARD_LOCK_TIMEOUT_MS)과 fsync 뒤에 온다
+    struct timeval timeout = { 5, 0 };
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    peer_fds[index] = fd + 1;
+    return fd;
+}
+
+void shard_peer_drop(int index) {
+    if (peer_fds[index] > 0) {
+        close(peer_fds[index] - 1);
+        peer_fds[index] = 0;
+    }
+}
+
+// 요청 하나 보내고 답 받기 (reply: 답 본문, 연결할 수 없으면 BANK_ERR_UNAVAILABLE)
+BankStatus shard_call(int index, uint8_t op, const void* body, uint32_t len,
+                      unsigned char* reply, uint32_t reply_cap, uint32_t* reply_len) {
+    unsigned char frame[BIN_HEADER_SIZE - 4 + 4 + MAX_ACCOUNTS_LIMIT * BIN_NAME_SIZE];
+    uint32_t frame_len;
+
+    int fd = shard_peer_connect(index);
+    if (fd < 0) return BANK_ERR_UNAVAILABLE;
+    if (!shard_peer_send(fd, op, 0, body, len) ||
+        shard_peer_recv(fd, frame, sizeof(frame), &frame_len) < 0) {
+        shard_peer_drop(index);
+        return BANK_ERR_UNAVAILABLE;
+    }
+
+    uint32_t n = frame_len - (BIN_HEADER_SIZE - 4);
+    if (n > reply_cap) n = reply_cap;
+    if (reply != NULL) memcpy(reply, frame + (BIN_HEADER_SIZE - 4), n);
+    if (reply_len != NULL) *reply_len = n;
+    return frame[1] < BANK_STATUS_COUNT ? (BankStatus)frame[1] : BANK_ERR_BAD_REQUEST;
+}
+
+uint64_t shard_txid_get(const unsigned char* p) {
+    return ((uint64_t)bin_get_u32(p) << 32) | bin_get_u32(p + 4);
+}
+
+void shard_txid_put(unsigned char* p, uint64_t txid) {
+    bin_put_u32(p, (uint32_t)(txid >> 32));
+    bin_put_u32(p + 4, (uint32_t)txid);
+}
+
+// 결정 표와 준비 표 (shard.mutex를 쥔 채 부른다, 동시에 진행 중인 지점 간 거래만 들어 있다)
+ShardDecision* shard_decision_add(uint64_t txid) {
+    if (shard.decision_count == shard.decision_cap) {
+        int cap = shard.decision_cap ? shard.decision_cap * 2 : 64;
+        ShardDecision* decisions = realloc(shard.decisions, sizeof(ShardDecision) * cap);
+        if (decisions == NULL) {
+            perror("shard decision realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        shard.decisions = decisions;
+        shard.decision_cap = cap;
+    }
+    ShardDecision* d = &shard.decisions[shard.decision_count++];
+    memset(d, 0, sizeof(*d));
+    d->txid = txid;
+    return d;
+}
+
+ShardDecision* shard_decision_find(uint64_t txid) {
+    for (int i = 0; i < shard.decision_count; i++) {
+        if (shard.decisions[i].txid == txid) return &shard.decisions[i];
+    }
+    return NULL;
+}
+
+void shard_decision_remove(uint64_t txid) {
+    ShardDecision* d = shard_decision_find(txid);
+    if (d != NULL) {
+        *d = shard.decisions[--shard.decision_count];
+    }
+}
+
+ShardPrepared* shard_prepared_find(uint64_t txid) {
+    for (int i = 0; i < shard.prepared_count; i++) {
+        if (shard.prepared[i]->txid == txid) return shard.prepared[i];
+    }
+    return NULL;
+}
+
+void shard_prepared_add(ShardPrepared* p) {
+    if (shard.prepared_count == shard.prepared_cap) {
+        int cap = shard.prepared_cap ? shard.prepared_cap * 2 : 64;
+        ShardPrepared** prepared = realloc(shard.prepared, sizeof(ShardPrepared*) * cap);
+        if (prepared == NULL) {
+            perror("shard prepared realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        shard.prepared = prepared;
+        shard.prepared_cap = cap;
+    }
+    shard.prepared[shard.prepared_count++] = p;
+}
+
+void shard_prepared_remove(ShardPrepared* p) {
+    for (int i = 0; i < shard.prepared_count; i++) {
+        if (shard.prepared[i] == p) {
+            shard.prepared[i] = shard.prepared[--shard.prepared_count];
+            return;
+        }
+    }
+}
+
+// 복구/복제 중 만난 레코드로 준비 표와 결정 표를 맞춘다
+// 스냅샷보다 앞선 레코드도 보므로 스냅샷 전에 준비하고 아직 끝나지 않은 거래도 찾는다.
+void shard_track(const WalHeader* h, const void* body) {
+    const WalShardTx* tx = body;
+    const WalShardEnd* end = body;
+    bool is_tx = h->len >= sizeof(WalShardTx) &&
+                 h->len == sizeof(WalShardTx) + sizeof(WalTransferLeg) * tx->leg_count;
+    bool is_end = h->len == sizeof(WalShardEnd);
+
+    pthread_mutex_lock(&shard.mutex);
+    if (h->type == WAL_PREPARE && is_tx && shard_prepared_find(tx->txid) == NULL) {
+        ShardPrepared* p = calloc(1, sizeof(ShardPrepared));
+        size_t legs_len = sizeof(WalTransferLeg) * tx->leg_count;
+        if (p == NULL || (p->legs = malloc(legs_len)) == NULL) {
+            perror("shard prepared malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        p->txid = tx->txid;
+        p->lsn = h->lsn;
+        p->coordinator = tx->peer;
+        p->leg_count = tx->leg_count;
+        memcpy(p->legs, tx->legs, legs_len);
+        shard_prepared_add(p);
+    } else if ((h->type == WAL_XAPPLY && is_tx) || (h->type == WAL_XABORT && is_end)) {
+        ShardPrepared* p = shard_prepared_find(h->type == WAL_XAPPLY ? tx->txid : end->txid);
+        if (p != NULL) {
+            shard_prepared_remove(p);
+            free(p->legs);
+            free(p);
+        }
+    } else if (h->type == WAL_XCOMMIT && is_tx && tx->peer != 0) {
+        ShardDecision* d = shard_decision_add(tx->txid);
+        d->lsn = h->lsn;
+        d->committed = true;
+        d->pending = tx->peer;
+    } else if (h->type == WAL_XEND && is_end) {
+        shard_decision_remove(end->txid);
+    }
+    pthread_mutex_unlock(&shard.mutex);
+}
+
+// 스냅샷 뒤에 지워도 되는 세그먼트 한계 (끝나지 않은 지점 간 거래의 레코드가 든 세그먼트는 남긴다)
+uint64_t shard_prune_floor(uint64_t start_lsn) {
+    uint64_t floor = start_lsn;
+    pthread_mutex_lock(&shard.mutex);
+    for (int i = 0; i < shard.decision_count; i++) {
+        if (shard.decisions[i].committed && shard.decisions[i].lsn - 1 < floor) {
+            floor = shard.decisions[i].lsn - 1;
+        }
+    }
+    for (int i = 0; i < shard.prepared_count; i++) {
+        if (shard.prepared[i]->lsn > 0 && shard.prepared[i]->lsn - 1 < floor) {
+            floor = shard.prepared[i]->lsn - 1;
+        }
+    }
+    pthread_mutex_unlock(&shard.mutex);
+    return floor;
+}
+
+// 다른 지점 고객의 통장 이름 목록 (입금 대화에서 통장을 고르게 보여 준다)
+BankStatus shard_lookup_accounts(int index, const char* client_id, char names[][50], int* count_out) {
+    unsigned char id[BIN_ID_SIZE] = { 0 };
+    unsigned char reply[4 + MAX_ACCOUNTS_LIMIT * BIN_NAME_SIZE];
+    uint32_t reply_len;
+
+    snprintf((char*)id, sizeof(id), "%s", client_id);
+    BankStatus status = shard_call(index, PEER_OP_ACCOUNTS, id, sizeof(id), reply, sizeof(reply), &reply_len);
+    if (status != BANK_OK) return status;
+    if (reply_len < 4) return BANK_ERR_UNAVAILABLE;
+
+    int count = bin_get_u32(reply);
+    if (count > max_accounts || reply_len != 4 + (uint32_t)count * BIN_NAME_SIZE) return BANK_ERR_UNAVAILABLE;
+    for (int i = 0; i < count; i++) {
+        memcpy(names[i], reply + 4 + i * BIN_NAME_SIZE, BIN_NAME_SIZE);
+        names[i][49] = 0;
+    }
+    *count_out = count;
+    return BANK_OK;
+}
+
+// 지점 간 거래 조정 (이 지점이 받은 입금/이체에 다른 지점 고객 항목이 있을 때)
+// legs에서 client가 NULL인 항목은 leg->shard 지점에 준비시키고, 나머지는 이 지점에서 반영한다.
+// 모든 지점이 준비되면 결정을 디스크에 내린 뒤 커밋한다 (하나라도 실패하면 모두 철회).
+// 결정이 디스크에 내려간 다음에 돌아오므로 응답해도 된다. balance_out/bank_out에는
+// 첫 번째 다른 지점 항목의 반영 후 잔고와 은행 이름을 넣는다 (입금 응답용).
+BankStatus shard_commit(const TransferLeg* legs, int count, int* failed_leg,
+                        int* balance_out, char* bank_out) {
+    unsigned char reply[64];
+    uint32_t participants = 0, prepared = 0;
+    int local = 0, first_remote = -1;
+
+    *failed_leg = -1;
+    *balance_out = 0;
+    bank_out[0] = 0;
+
+    size_t prepare_cap = 16 + (size_t)count * (BIN_ID_SIZE + 8);
+    size_t record_len = sizeof(WalShardTx) + sizeof(WalTransferLeg) * count;
+    ClientInfo** locked = malloc(sizeof(ClientInfo*) * count);
+    int* leg_map = malloc(sizeof(int) * count);
+    unsigned char* prepare = malloc(prepare_cap);
+    WalShardTx* rec = malloc(record_len);
+    if (locked == NULL || leg_map == NULL || prepare == NULL || rec == NULL) {
+        free(locked);
+        free(leg_map);
+        free(prepare);
+        free(rec);
+        return BANK_ERR_BAD_REQUEST;
+    }
+    for (int i = 0; i < count; i++) {
+        if (legs[i].client != NULL) {
+            locked[local++] = legs[i].client;
+        } else {
+            participants |= 1u << legs[i].shard;
+            if (first_remote < 0) first_remote = i;
+        }
+    }
+
+    uint64_t txid = shard.txid_base + atomic_fetch_add(&shard.txid_seq, 1);
+    pthread_mutex_lock(&shard.mutex);
+    shard_decision_add(txid);
+    pthread_mutex_unlock(&shard.mutex);
+
+    // 1. 이 지점 항목 확인 (반영했다가 되돌린다, lock은 결정할 때까지 쥔다)
+    //    들어갈 금액은 결정까지 한도를 잡아 둔다 (그 사이 인기 통장 누적기 입금이 채우지 못하게)
+    //    고객 lock은 참여 지점처럼 제한 시간까지만 기다린다 (다른 지점 거래가 쥐고 있으면 거절)
+    BankStatus status = BANK_ERR_BUSY;
+    bool held = lock_clients_timed(locked, local, SHARD_LOCK_TIMEOUT_MS);
+    if (held) {
+        clients_write_begin(locked, local);
+        status = transfer_apply_legs(legs, count, failed_leg);
+        if (status == BANK_OK) transfer_undo_legs(legs, count);
+        clients_write_end(locked, local);
+        if (status == BANK_OK) status = transfer_reserve_legs(legs, count, failed_leg);
+    }
+    bool reserved = status == BANK_OK;
+
+    // 2. 참여 지점 준비 (지점마다 그 지점 고객 항목만 보낸다)
+    for (int p = 0; p < shard.count && status == BANK_OK; p++) {
+        if ((participants & (1u << p)) == 0) continue;
+
+        uint32_t n = 0;
+        size_t off = 16;
+        shard_txid_put(prepare, txid);
+        bin_put_u32(prepare + 8, shard.index);
+        for (int i = 0; i < count; i++) {
+            if (legs[i].client != NULL || legs[i].shard != p) continue;
+            memset(prepare + off, 0, BIN_ID_SIZE);
+            memcpy(prepare + off, legs[i].client_id, strnlen(legs[i].client_id, BIN_ID_SIZE - 1));
+            bin_put_u32(prepare + off + BIN_ID_SIZE, legs[i].account_num);
+            bin_put_u32(prepare + off + BIN_ID_SIZE + 4, (uint32_t)legs[i].amount);
+            leg_map[n++] = i;
+            off += BIN_ID_SIZE + 8;
+        }
+        bin_put_u32(prepare + 12, n);
+
+        unsigned char frame[BIN_HEADER_SIZE - 4 + 8];
+        uint32_t frame_len;
+        int fd = shard_peer_connect(p);
+        if (fd < 0 || !shard_peer_send(fd, PEER_OP_PREPARE, 0, prepare, off) ||
+            shard_peer_recv(fd, frame, sizeof(frame), &frame_len) < 0) {
+            shard_peer_drop(p);
+            status = BANK_ERR_UNAVAILABLE;
+            *failed_leg = leg_map[0];
+            break;
+        }
+        if (frame[1] != BANK_OK) {
+            status = frame[1] < BANK_STATUS_COUNT ? (BankStatus)frame[1] : BANK_ERR_BAD_REQUEST;
+            if (frame_len >= BIN_HEADER_SIZE) {
+                uint32_t k = bin_get_u32(frame + BIN_HEADER_SIZE - 4);
+                if (k < n) *failed_leg = leg_map[k];
+            }
+            break;
+        }
+        prepared |= 1u << p;
+    }
+
+    // 3. 결정 (참여 지점이 먼저 결과를 물었으면 이미 철회로 답했으므로 철회)
+    uint64_t lsn = 0;
+    pthread_mutex_lock(&shard.mutex);
+    ShardDecision* d = shard_decision_find(txid);
+    if (status == BANK_OK && d->doomed) {
+        status = BANK_ERR_BUSY;
+    }
+    if (status == BANK_OK) {
+        uint32_t n = 0;
+        clients_write_begin(locked, local);
+        transfer_commit_legs(legs, count);   // lock을 쥔 채 확인하고 한도를 잡아 두었다
+        clients_write_end(locked, local);
+        for (int i = 0; i < count; i++) {
+            if (legs[i].client == NULL) continue;
+            rec->legs[n].client_no = legs[i].client->client_no;
+            rec->legs[n].account_num = legs[i].account_num;
+            rec->legs[n].amount = legs[i].amount;
+            n++;
+        }
+        rec->txid = txid;
+        rec->peer = prepared;
+        rec->leg_count = n;
+        lsn = wal_append(WAL_XCOMMIT, rec, sizeof(WalShardTx) + sizeof(WalTransferLeg) * n);
+        for (int i = 0; i < local; i++) locked[i]->last_lsn = lsn;
+        d->lsn = lsn;
+        d->committed = true;
+        d->pending = prepared;
+        d->decided_ns = now_ns();
+    } else {
+        shard_decision_remove(txid);
+        if (reserved) transfer_release_legs(legs, count);
+    }
+    pthread_mutex_unlock(&shard.mutex);
+    if (held) unlock_clients(locked, local);
+
+    // 4. 결과 알리기 (커밋은 결정이 디스크에 내려간 뒤에)
+    if (status == BANK_OK) wal_wait_durable(lsn);
+    for (int p = 0; p < shard.count; p++) {
+        if ((prepared & (1u << p)) == 0) continue;
+
+        unsigned char frame[BIN_HEADER_SIZE - 4 + 4 + BIN_NAME_SIZE];
+        uint32_t frame_len;
+        int fd = peer_fds[p] - 1;
+        shard_txid_put(reply, txid);
+        if (!shard_peer_send(fd, status == BANK_OK ? PEER_OP_COMMIT : PEER_OP_ABORT, 0, reply, 8) ||
+            shard_peer_recv(fd, frame, sizeof(frame), &frame_len) < 0) {
+            // 참여 지점이 직접 결과를 묻는다. 커밋이면 정리 스레드가 COMMIT을 다시 보낸다.
+            shard_peer_drop(p);
+            continue;
+        }
+        if (status != BANK_OK || frame[1] != BANK_OK) continue;
+        if (p == legs[first_remote].shard && frame_len == sizeof(frame)) {
+            *balance_out = (int32_t)bin_get_u32(frame + BIN_HEADER_SIZE - 4);
+            memcpy(bank_out, frame + BIN_HEADER_SIZE, BIN_NAME_SIZE);
+            bank_out[49] = 0;
+        }
+        shard_decision_ack(txid, p);
+    }
+
+    if (status == BANK_OK) {
+        atomic_fetch_add(&shard.committed, 1);
+    } else {
+        atomic_fetch_add(&shard.aborted, 1);
+        LOG_DEBUG("🔗 [지점] 거래 %016llx 철회 (%s)\n", (unsigned long long)txid, bank_status_names[status]);
+    }
+    free(locked);
+    free(leg_map);
+    free(prepare);
+    free(rec);
+    return status;
+}
+
+// 참여 지점 하나가 커밋을 마쳤다 (모두 마쳤으면 결정을 잊는다)
+bool shard_decision_ack(uint64_t txid, int index) {
+    bool done = false;
+    pthread_mutex_lock(&shard.mutex);
+    ShardDecision* d = shard_decision_find(txid);
+    if (d != NULL) {
+        d->pending &= ~(1u << index);
+        if (d->pending == 0) {
+            shard_decision_remove(txid);
+            done = true;
+        }
+    }
+    pthread_mutex_unlock(&shard.mutex);
+
+    if (done) {
+        WalShardEnd rec = { txid };
+        wal_append(WAL_XEND, &rec, sizeof(rec));
+    }
+    return done;
+}
+
+// 다른 지점 고객에게 입금 (항목 하나짜리 지점 간 거래)
+BankStatus bank_deposit_remote(int shard_index, const char* target_id, int account_num,
+                               int amount, int* balance_out, char* bank_out) {
+    uint64_t start = now_ns();
+    if (amount <= 0) {
+        metrics_op_done(METRIC_OP_DEPOSIT, BANK_ERR_AMOUNT, start);
+        return BANK_ERR_AMOUNT;
+    }
+
+    TransferLeg leg = { .client = NULL, .account_num = account_num, .amount = amount, .shard = shard_index };
+    snprintf(leg.client_id, sizeof(leg.client_id), "%s", target_id);
+    int failed_leg;
+    BankStatus status = shard_commit(&leg, 1, &failed_leg, balance_out, bank_out);
+    metrics_op_done(METRIC_OP_DEPOSIT, status, start);
+    return status;
+}
+
+// 지점 간 호출 만들기 (legs가 있으면 복사해 둔다, 메모리가 모자라면 NULL)
+ShardCall* shard_call_new(Session* s, ShardCallKind kind, const TransferLeg* legs, int leg_count) {
+    ShardCall* call = calloc(1, sizeof(ShardCall));
+    if (call == NULL) return NULL;
+    call->kind = kind;
+    call->requester = s->client;
+    call->failed_leg = -1;
+    if (legs != NULL) {
+        call->legs = malloc(sizeof(TransferLeg) * leg_count);
+        if (call->legs == NULL) {
+            free(call);
+            return NULL;
+        }
+        memcpy(call->legs, legs, sizeof(TransferLeg) * leg_count);
+        call->leg_count = leg_count;
+    }
+    return call;
+}
+
+// 지점 간 호출 해제
+void shard_call_free(ShardCall* call) {
+    free(call->legs);
+    free(call);
+}
+
+// 세션의 지점 간 호출
+// 스레드 모드는 창구 스레드가 그 자리에서 부르고 답한다. 리액터 세션은 호출 스레드에 넘기고
+// 답이 올 때까지 입력 처리를 멈춘다. 리액터는 그동안 다른 세션을 처리한다 (reactor_shard_done).
+void session_shard_call(Session* s, ShardCall* call) {
+    if (s->reactor == NULL) {
+        shard_call_run(call);
+        shard_call_reply(s, call);
+        shard_call_free(call);
+        return;
+    }
+
+    call->session = s;
+    call->reactor = s->reactor;
+    s->shard_call = call;
+    pthread_mutex_lock(&shard_calls.mutex);
+    if (shard_calls.tail != NULL) shard_calls.tail->next = call;
+    else shard_calls.head = call;
+    shard_calls.tail = call;
+    pthread_cond_signal(&shard_calls.cond);
+    pthread_mutex_unlock(&shard_calls.mutex);
+}
+
+// 지점 간 호출 실행 (다른 지점의 답과 고객 lock을 기다린다)
+void shard_call_run(ShardCall* call) {
+    switch (call->kind) {
+        case SHARD_CALL_ACCOUNTS:
+            call->status = shard_lookup_accounts(call->shard_index, call->target_id, call->names, &call->count);
+            break;
+        case SHARD_CALL_DEPOSIT:
+            call->status = bank_deposit_remote(call->shard_index, call->target_id, call->account_num,
+                                               call->amount, &call->balance, call->bank_name);
+            break;
+        case SHARD_CALL_TRANSFER:
+            call->status = bank_transfer(call->requester, call->legs, call->leg_count, &call->failed_leg);
+            break;
+    }
+    call->lsn = wal_last_lsn;
+}
+
+// 지점 간 호출 결과를 세션에 답한다 (대화형은 다음 단계로 넘어간다)
+void shard_call_reply(Session* s, const ShardCall* call) {
+    switch (call->kind) {
+        case SHARD_CALL_ACCOUNTS:
+            process_deposit_target_remote(s, call);
+            break;
+        case SHARD_CALL_DEPOSIT:
+            if (call->binary) bin_deposit_remote_result(s, call);
+            else process_deposit_amount_remote(s, call);
+            break;
+        case SHARD_CALL_TRANSFER:
+            if (call->binary) {
+                bin_transfer_result(s, call->op, call->request_id, call->status,
+                                    call->leg_count, call->failed_leg);
+            } else {
+                process_transfer_result(s, call->status, call->failed_leg);
+            }
+            break;
+    }
+}
+
+// 호출 스레드 (리액터 세션이 맡긴 지점 간 호출을 부르고, 결과를 그 리액터에 돌려준다)
+void* shard_call_func(void* arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&shard_calls.mutex);
+        while (shard_calls.head == NULL) {
+            pthread_cond_wait(&shard_calls.cond, &shard_calls.mutex);
+        }
+        ShardCall* call = shard_calls.head;
+        shard_calls.head = call->next;
+        if (shard_calls.head == NULL) shard_calls.tail = NULL;
+        pthread_mutex_unlock(&shard_calls.mutex);
+
+        shard_call_run(call);
+
+        Reactor* reactor = call->reactor;
+        pthread_mutex_lock(&reactor->shard_mutex);
+        call->next = reactor->shard_done;
+        reactor->shard_done = call;
+        pthread_mutex_unlock(&reactor->shard_mutex);
+        uint64_t one = 1;
+        if (write(reactor->event_fd, &one, sizeof(one)) < 0) {
+            perror("eventfd write failed");
+        }
+    }
+    return NULL;
+}
+
+// 준비한 거래의 고객 목록 (lock_clients용, 반환값: 항목 수)
+int shard_prepared_clients(const ShardPrepared* p, ClientInfo** clients) {
+    int count = 0;
+    for (uint32_t i = 0; i < p->leg_count; i++) {
+        ClientInfo* client = client_at(p->legs[i].client_no);
+        if (client != NULL) clients[count++] = client;
+    }
+    return count;
+}
+
+// 준비한 거래의 입금 한도 잡기 (재시작 뒤 복구 스레드가 고객 lock을 잡은 다음에)
+// 준비할 때 확인했고 영업 전이라 누적기도 비어 있으므로 보통은 남는다.
+bool shard_prepared_reserve(ShardPrepared* p) {
+    for (uint32_t i = 0; i < p->leg_count; i++) {
+        ClientInfo* client = client_at(p->legs[i].client_no);
+        if (p->legs[i].amount <= 0) continue;
+        if (!hot_reserve_credit(client, p->legs[i].account_num, p->legs[i].amount)) {
+            while (i-- > 0) {
+                if (p->legs[i].amount <= 0) continue;
+                hot_release_credit(client_at(p->legs[i].client_no), p->legs[i].account_num, p->legs[i].amount);
+            }
+            return false;
+        }
+    }
+    p->reserved = true;
+    return true;
+}
+
+// 준비한 거래가 잡아 둔 입금 한도 풀기 (반영한 뒤, 또는 철회할 때)
+void shard_prepared_release(ShardPrepared* p) {
+    if (!p->reserved) return;
+    for (uint32_t i = 0; i < p->leg_count; i++) {
+        if (p->legs[i].amount <= 0) continue;
+        hot_release_credit(client_at(p->legs[i].client_no), p->legs[i].account_num, p->legs[i].amount);
+    }
+    p->reserved = false;
+}
+
+// 준비한 거래 끝내기 (clients: 준비할 때 잠근 고객, 여기서 푼다)
+// 커밋이면 항목을 반영하고 XAPPLY가 디스크에 내려갈 때까지 기다린다
+// (조정 지점은 이 답을 받고 결정을 잊으므로, 그 전에 반영 기록이 남아 있어야 한다).
+void shard_prepared_finish(ShardPrepared* p, ClientInfo** clients, int count, bool commit,
+                           int* balance_out, char* bank_out) {
+    uint64_t lsn;
+    if (commit) {
+        size_t record_len = sizeof(WalShardTx) + sizeof(WalTransferLeg) * p->leg_count;
+        WalShardTx* rec = malloc(record_len);
+        if (rec == NULL) {
+            perror("shard record malloc failed");
+            exit(EXIT_FAILURE);
+        }
+        clients_write_begin(clients, count);
+        for (uint32_t i = 0; i < p->leg_count; i++) {
+            ClientInfo* client = client_at(p->legs[i].client_no);
+            client->accounts[p->legs[i].account_num].balance += p->legs[i].amount;
+        }
+        clients_write_end(clients, count);
+        shard_prepared_release(p);
+
+        rec->txid = p->txid;
+        rec->peer = p->coordinator;
+        rec->leg_count = p->leg_count;
+        memcpy(rec->legs, p->legs, sizeof(WalTransferLeg) * p->leg_count);
+        lsn = wal_append(WAL_XAPPLY, rec, record_len);
+        for (int i = 0; i < count; i++) clients[i]->last_lsn = lsn;
+        free(rec);
+
+        if (balance_out != NULL) {
+            ClientInfo* client = client_at(p->legs[0].client_no);
+            *balance_out = client->accounts[p->legs[0].account_num].balance;
+            memcpy(bank_out, client->accounts[p->legs[0].account_num].bank_name, 50);
+        }
+    } else {
+        shard_prepared_release(p);
+        WalShardEnd rec = { p->txid };
+        lsn = wal_append(WAL_XABORT, &rec, sizeof(rec));
+    }
+
+    pthread_mutex_lock(&shard.mutex);
+    shard_prepared_remove(p);
+    pthread_mutex_unlock(&shard.mutex);
+    unlock_clients(clients, count);
+    wal_wait_durable(lsn);
+
+    free(p->legs);
+    free(p);
+}
+
+// 준비한 뒤 결정 기다리기 (true = 커밋)
+// 조정 지점은 같은 연결로 COMMIT/ABORT를 보낸다. 소식 없이 SHARD_STATUS_SEC초가 지나거나 연결이
+// 끊기면 조정 지점에 결과를 묻는다 (결정 전이면 조정 지점이 철회로 정하고 답한다).
+// reply_op: 연결로 받은 op (답을 보내야 한다), 물어서 정했으면 0, 연결이 끊겼으면 -1.
+bool shard_wait_decision(int fd, const ShardPrepared* p, int* reply_op) {
+    unsigned char frame[BIN_HEADER_SIZE - 4 + 8];
+    unsigned char txid[8];
+    unsigned char reply[4];
+    uint32_t len;
+
+    shard_txid_put(txid, p->txid);
+    *reply_op = 0;
+    while (1) {
+        if (*reply_op == 0) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int n = poll(&pfd, 1, SHARD_STATUS_SEC * 1000);
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0) {
+                if (shard_peer_recv(fd, frame, sizeof(frame), &len) < 0) {
+                    *reply_op = -1;
+                } else if ((frame[0] == PEER_OP_COMMIT || frame[0] == PEER_OP_ABORT) &&
+                           len == sizeof(frame) && shard_txid_get(frame + BIN_HEADER_SIZE - 4) == p->txid) {
+                    *reply_op = frame[0];
+                    return frame[0] == PEER_OP_COMMIT;
+                } else {
+                    shard_peer_send(fd, frame[0], BANK_ERR_BUSY, NULL, 0);
+                    continue;
+                }
+            }
+        }
+
+        if (shard_call(p->coordinator, PEER_OP_STATUS, txid, 8, reply, sizeof(reply), &len) == BANK_OK &&
+            len == 4) {
+            return bin_get_u32(reply) == 1;
+        }
+        if (*reply_op != 0) sleep(SHARD_STATUS_SEC);
+    }
+}
+
+// PREPARE 처리 (답을 보낸 뒤 결정이 올 때까지 이 연결 스레드가 고객 lock을 쥐고 기다린다)
+// 반환값: 연결을 계속 쓸 수 있는지
+bool shard_peer_prepare(int fd, const unsigned char* body, uint32_t body_len) {
+    const uint32_t leg_size = BIN_ID_SIZE + 8;
+    unsigned char out[4 + BIN_NAME_SIZE];
+
+    if (body_len < 16) {
+        return shard_peer_send(fd, PEER_OP_PREPARE, BANK_ERR_BAD_REQUEST, NULL, 0);
+    }
+    uint64_t txid = shard_txid_get(body);
+    uint32_t coordinator = bin_get_u32(body + 8);
+    uint32_t count = bin_get_u32(body + 12);
+    if (count < 1 || count > TRANSFER_MAX_LEGS || body_len != 16 + count * leg_size ||
+        coordinator >= (uint32_t)shard.count) {
+        return shard_peer_send(fd, PEER_OP_PREPARE, BANK_ERR_BAD_REQUEST, NULL, 0);
+    }
+
+    TransferLeg* legs = malloc(sizeof(TransferLeg) * count);
+    ClientInfo** locked = malloc(sizeof(ClientInfo*) * count);
+    ShardPrepared* p = calloc(1, sizeof(ShardPrepared));
+    size_t record_len = sizeof(WalShardTx) + sizeof(WalTransferLeg) * count;
+    WalShardTx* rec = malloc(record_len);
+    if (legs == NULL || locked == NULL || p == NULL || rec == NULL ||
+        (p->legs = malloc(sizeof(WalTransferLeg) * count)) == NULL) {
+        perror("shard prepare malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    BankStatus status = BANK_OK;
+    int failed_leg = -1;
+    for (uint32_t i = 0; i < count && status == BANK_OK; i++) {
+        const unsigned char* q = body + 16 + i * leg_size;
+        char client_id[BIN_ID_SIZE];
+        memcpy(client_id, q, BIN_ID_SIZE);
+        client_id[BIN_ID_SIZE - 1] = 0;
+        legs[i].client = find_client_by_id(client_id);
+        legs[i].account_num = (int)bin_get_u32(q + BIN_ID_SIZE);
+        legs[i].amount = (int32_t)bin_get_u32(q + BIN_ID_SIZE + 4);
+        if (legs[i].client == NULL) {
+            status = BANK_ERR_NO_CLIENT;
+        } else if (legs[i].amount <= 0) {
+            status = BANK_ERR_AMOUNT;   // 다른 지점 고객 통장에서는 출금할 수 없다
+        }
+        if (status != BANK_OK) failed_leg = i;
+        locked[i] = legs[i].client;
+    }
+
+    // 다른 지점이 정한 순서로 오므로 오래 기다리지 않는다 (교착이면 조정 지점이 철회한다)
+    if (status == BANK_OK && !lock_clients_timed(locked, count, SHARD_LOCK_TIMEOUT_MS)) {
+        status = BANK_ERR_BUSY;
+    } else if (status == BANK_OK) {
+        clients_write_begin(locked, count);
+        status = transfer_apply_legs(legs, count, &failed_leg);
+        if (status == BANK_OK) transfer_undo_legs(legs, count);
+        clients_write_end(locked, count);
+        if (status == BANK_OK) status = transfer_reserve_legs(legs, count, &failed_leg);
+        if (status != BANK_OK) unlock_clients(locked, count);
+    }
+
+    if (status != BANK_OK) {
+        bin_put_u32(out, failed_leg < 0 ? UINT32_MAX : (uint32_t)failed_leg);
+        free(legs);
+        free(locked);
+        free(p->legs);
+        free(p);
+        free(rec);
+        return shard_peer_send(fd, PEER_OP_PREPARE, status, out, 4);
+    }
+
+    // 준비 기록 (디스크에 내려간 뒤에 OK)
+    p->txid = rec->txid = txid;
+    p->coordinator = rec->peer = coordinator;
+    p->leg_count = rec->leg_count = count;
+    p->held = true;
+    p->reserved = true;
+    for (uint32_t i = 0; i < count; i++) {
+        p->legs[i].client_no = legs[i].client->client_no;
+        p->legs[i].account_num = legs[i].account_num;
+        p->legs[i].amount = legs[i].amount;
+    }
+    memcpy(rec->legs, p->legs, sizeof(WalTransferLeg) * count);
+    pthread_mutex_lock(&shard.mutex);
+    p->lsn = wal_append(WAL_PREPARE, rec, record_len);
+    shard_prepared_add(p);
+    pthread_mutex_unlock(&shard.mutex);
+    free(rec);
+    free(legs);
+    wal_wait_durable(p->lsn);
+
+    bool alive = shard_peer_send(fd, PEER_OP_PREPARE, BANK_OK, NULL, 0);
+    int reply_op;
+    bool commit = shard_wait_decision(fd, p, &reply_op);
+
+    int balance;
+    char bank_name[50];
+    shard_prepared_finish(p, locked, count, commit, &balance, bank_name);
+    free(locked);
+
+    if (reply_op < 0) return false;
+    if (reply_op == PEER_OP_COMMIT) {
+        bin_put_u32(out, (uint32_t)balance);
+        memcpy(out + 4, bank_name, BIN_NAME_SIZE);
+        alive = shard_peer_send(fd, PEER_OP_COMMIT, BANK_OK, out, sizeof(out));
+    } else if (reply_op == PEER_OP_ABORT) {
+        alive = shard_peer_send(fd, PEER_OP_ABORT, BANK_OK, NULL, 0);
+    }
+    return alive;
+}
+
+// 지점 간 요청 하나 처리 (반환값: 연결을 계속 쓸 수 있는지)
+bool shard_peer_handle(int fd, const unsigned char* frame, uint32_t len) {
+    uint8_t op = frame[0];
+    const unsigned char* body = frame + (BIN_HEADER_SIZE - 4);
+    uint32_t body_len = len - (BIN_HEADER_SIZE - 4);
+    unsigned char out[4 + MAX_ACCOUNTS_LIMIT * BIN_NAME_SIZE];
+
+    // 대기 서버는 promote 뒤에 지점 간 포트를 연다 (여기 오는 일은 없다)
+    if (repl_is_standby()) {
+        return shard_peer_send(fd, op, BANK_ERR_UNAVAILABLE, NULL, 0);
+    }
+
+    switch (op) {
+        case PEER_OP_OWNER: {
+            if (body_len != 4) break;
+            ClientInfo* client = find_client_by_addr(bin_get_u32(body));
+            if (client == NULL) {
+                return shard_peer_send(fd, op, BANK_ERR_NO_CLIENT, NULL, 0);
+            }
+            memset(out, 0, BIN_ID_SIZE);
+            memcpy(out, client->client_id, strnlen(client->client_id, BIN_ID_SIZE - 1));
+            return shard_peer_send(fd, op, BANK_OK, out, BIN_ID_SIZE);
+        }
+        case PEER_OP_ACCOUNTS: {
+            if (body_len != BIN_ID_SIZE) break;
+            char client_id[BIN_ID_SIZE];
+            memcpy(client_id, body, BIN_ID_SIZE);
+            client_id[BIN_ID_SIZE - 1] = 0;
+            ClientInfo* client = find_client_by_id(client_id);
+            if (client == NULL) {
+                return shard_peer_send(fd, op, BANK_ERR_NO_CLIENT, NULL, 0);
+            }
+            Account accounts[MAX_ACCOUNTS_LIMIT];
+            int count = client_read_accounts(client, accounts);
+            bin_put_u32(out, count);
+            for (int i = 0; i < count; i++) {
+                memcpy(out + 4 + i * BIN_NAME_SIZE, accounts[i].bank_name, BIN_NAME_SIZE);
+            }
+            return shard_peer_send(fd, op, BANK_OK, out, 4 + count * BIN_NAME_SIZE);
+        }
+        case PEER_OP_PREPARE:
+            return shard_peer_prepare(fd, body, body_len);
+        case PEER_OP_COMMIT:
+        case PEER_OP_ABORT: {
+            // 준비한 연결이 끊긴 뒤 조정 지점이 다시 보낸 것. 준비한 스레드가 아직 결과를
+            // 묻는 중이면 나중에 다시 보내게 하고, 이미 끝났으면 OK.
+            if (body_len != 8) break;
+            pthread_mutex_lock(&shard.mutex);
+            bool pending = shard_prepared_find(shard_txid_get(body)) != NULL;
+            pthread_mutex_unlock(&shard.mutex);
+            return shard_peer_send(fd, op, pending ? BANK_ERR_BUSY : BANK_OK, NULL, 0);
+        }
+        case PEER_OP_STATUS: {
+            // 조정 지점으로서 결과 답하기 (결정 전이면 철회로 정한다, 모르는 거래도 철회)
+            if (body_len != 8) break;
+            uint64_t lsn = 0;
+            bool committed = false;
+            pthread_mutex_lock(&shard.mutex);
+            ShardDecision* d = shard_decision_find(shard_txid_get(body));
+            if (d != NULL && d->committed) {
+                committed = true;
+                lsn = d->lsn;
+            } else if (d != NULL) {
+                d->doomed = true;
+            }
+            pthread_mutex_unlock(&shard.mutex);
+            if (committed) wal_wait_durable(lsn);
+            bin_put_u32(out, committed ? 1 : 0);
+            return shard_peer_send(fd, op, BANK_OK, out, 4);
+        }
+    }
+    return shard_peer_send(fd, op, BANK_ERR_BAD_REQUEST, NULL, 0);
+}
+
+// 지점 간 연결 하나 (연결마다 스레드, 준비한 거래가 있으면 결정이 올 때까지 이 스레드가 기다린다)
+void* shard_peer_conn_func(void* arg) {
+    int fd = (int)(intptr_t)arg;
+    unsigned char* frame = malloc(BIN_MAX_FRAME);
+    uint32_t len;
+    int one = 1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    while (frame != NULL && shard_peer_recv(fd, frame, BIN_MAX_FRAME, &len) == 0) {
+        if (!shard_peer_handle(fd, frame, len)) break;
+    }
+    free(frame);
+    close(fd);
+    return NULL;
+}
+
+// 지점 간 포트 수락 스레드
+void* shard_peer_listen_func(void* arg) {
+    int listen_fd = (int)(intptr_t)arg;
+    while (1) {
+        struct pollfd pfd = { listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, -1) <= 0) continue;
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, shard_peer_conn_func, (void*)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+// 재시작 전에 준비하고 결정을 못 받은 거래 마저 끝내기 (거래마다 스레드)
+// 고객 lock을 잡은 뒤 조정 지점에 결과를 물어, 답이 올 때까지 SHARD_STATUS_SEC초마다 다시 묻는다.
+void* shard_resolver_func(void* arg) {
+    ShardPrepared* p = arg;
+    ClientInfo** clients = malloc(sizeof(ClientInfo*) * p->leg_count);
+    unsigned char txid[8], reply[4];
+    uint32_t len;
+
+    if (clients == NULL) {
+        perror("shard resolver malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    int count = shard_prepared_clients(p, clients);
+    lock_clients(clients, count);
+    if (!shard_prepared_reserve(p)) {
+        LOG_WARN("⚠️  [지점] 준비한 거래 %016llx: 인기 통장 입금 한도를 잡지 못했습니다\n",
+            (unsigned long long)p->txid);
+    }
+    if (atomic_fetch_sub(&shard.resolving, 1) == 1) {
+        futex_wake(&shard.resolving);
+    }
+
+    shard_txid_put(txid, p->txid);
+    while (shard_call(p->coordinator, PEER_OP_STATUS, txid, 8, reply, sizeof(reply), &len) != BANK_OK ||
+           len != 4) {
+        sleep(SHARD_STATUS_SEC);
+    }
+    bool commit = bin_get_u32(reply) == 1;
+    LOG_INFO("🔗 [지점] 재시작 전에 준비한 거래 %016llx: %d번 지점 결정에 따라 %s\n",
+        (unsigned long long)p->txid, p->coordinator, commit ? "커밋" : "철회");
+    shard_prepared_finish(p, clients, count, commit, NULL, NULL);
+    free(clients);
+    return NULL;
+}
+
+// 준비해 둔 거래마다 복구 스레드를 띄우고, 모두 고객 lock을 잡을 때까지 기다린다
+// (영업을 시작한 뒤에 다른 업무가 준비한 통장을 먼저 바꾸면 안 된다)
+void shard_resolve_prepared() {
+    pthread_mutex_lock(&shard.mutex);
+    int count = 0;
+    for (int i = 0; i < shard.prepared_count; i++) {
+        if (!shard.prepared[i]->held) count++;
+    }
+    atomic_store(&shard.resolving, count);
+    for (int i = 0; i < shard.prepared_count; i++) {
+        ShardPrepared* p = shard.prepared[i];
+        if (p->held) continue;
+        p->held = true;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, shard_resolver_func, p) != 0) {
+            perror("pthread_create failed");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+    pthread_mutex_unlock(&shard.mutex);
+
+    int left;
+    while ((left = atomic_load(&shard.resolving)) > 0) {
+        futex_wait(&shard.resolving, left, NULL);
+    }
+    if (count > 0) {
+        LOG_INFO("🔗 [지점] 결정을 기다리는 준비된 거래 %d건을 이어서 처리합니다\n", count);
+    }
+}
+
+// 정리 스레드: 커밋하기로 정했지만 확인받지 못한 참여 지점에 COMMIT을 다시 보낸다
+// (조정하던 연결이 끊겼거나, 결정을 남기고 재시작한 경우)
+void* shard_janitor_func(void* arg) {
+    (void)arg;
+    while (1) {
+        sleep(1);
+
+        uint64_t now = now_ns();
+        int count = 0;
+        pthread_mutex_lock(&shard.mutex);
+        ShardDecision* due = malloc(sizeof(ShardDecision) * (shard.decision_count + 1));
+        for (int i = 0; due != NULL && i < shard.decision_count; i++) {
+            ShardDecision* d = &shard.decisions[i];
+            if (d->committed && d->pending != 0 && now - d->decided_ns > 1000000000ull) {
+                due[count++] = *d;
+            }
+        }
+        pthread_mutex_unlock(&shard.mutex);
+
+        for (int i = 0; i < count; i++) {
+            unsigned char txid[8];
+            shard_txid_put(txid, due[i].txid);
+            for (int p = 0; p < shard.count; p++) {
+                if ((due[i].pending & (1u << p)) == 0) continue;
+                if (shard_call(p, PEER_OP_COMMIT, txid, 8, NULL, 0, NULL) == BANK_OK &&
+                    shard_decision_ack(due[i].txid, p)) {
+                    LOG_INFO("🔗 [지점] 거래 %016llx 커밋을 모든 지점이 마쳤습니다 (다시 보냄)\n",
+                        (unsigned long long)due[i].txid);
+                }
+            }
+        }
+        free(due);
+    }
+    return NULL;
+}
+
+// 지점으로 영업 시작 (WAL 복구 뒤, 고객 포트를 열기 전)
+void shard_start() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    // 재시작해도 거래 번호가 겹치지 않게 기동 시각(us)에서 시작한다
+    shard.txid_base = ((uint64_t)shard.index << 56) |
+        (((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000) & ((1ull << 56) - 1));
+
+    int port = shard.addrs[shard.index].port + 2;
+    listener_probe(port);
+    int listen_fd = create_listener(port);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, shard_peer_listen_func, (void*)(intptr_t)listen_fd);
+    pthread_detach(thread);
+    pthread_create(&thread, NULL, shard_janitor_func, NULL);
+    pthread_detach(thread);
+    // 리액터는 다른 지점을 기다리지 않고 지점 간 호출을 이 스레드들에 맡긴다
+    if (server_mode != MODE_THREAD) {
+        for (int i = 0; i < SHARD_CALL_THREADS; i++) {
+            pthread_create(&thread, NULL, shard_call_func, NULL);
+            pthread_detach(thread);
+        }
+    }
+
+    shard_resolve_prepared();
+    LOG_INFO("🔗 [지점] %d개 지점 중 %d번 (지점 간 포트 %d, 결정 대기 %d건)\n",
+        shard.count, shard.index, port, shard.decision_count);
+}
+
+// ========== 라우터 (--router) ==========
+// 고객 연결을 그 고객이 있는 지점으로 넘겨 주는 프록시. 접속한 주소로 지점을 찾고(처음 보는 주소는
+// 조회 스레드가 지점마다 OWNER로 물어 캐시한다. 그동안 연결은 읽지 않고 세워 둔다),
+// 지점에 새로 연결해 바이트를 그대로 양쪽으로 옮긴다.
+// 지점은 접속 주소로 고객을 알아보므로 지점 쪽 연결의 출발 주소를 고객 주소로 맞춘다.
+// 루프백(127.x.x.x)에서는 그대로 되고, 다른 호스트라면 IP_TRANSPARENT(CAP_NET_ADMIN)와 라우팅 설정이 필요하다.
+
+// 캐시에 있는 고객 주소의 지점 (없으면 -1, 지점에 묻지 않는다)
+int router_owner_cached(uint32_t ip) {
+    int owner = -1;
+    pthread_mutex_lock(&shard.mutex);
+    for (uint32_t i = client_ip_hash(ip) & shard.route_mask; shard.route_ips != NULL; i = (i + 1) & shard.route_mask) {
+        if (shard.route_ips[i] == 0) break;
+        if (shard.route_ips[i] == ip) {
+            owner = shard.route_shards[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shard.mutex);
+    return owner;
+}
+
+// 고객 주소(호스트 바이트 순서)가 속한 지점 (어느 지점도 모르는 주소는 0번 지점이 거절하게 한다)
+// 캐시에 없으면 지점마다 차례로 물으므로 오래 걸릴 수 있다. 조회 스레드에서만 부른다.
+int router_owner(uint32_t ip) {
+    int cached = router_owner_cached(ip);
+    if (cached >= 0) return cached;
+
+    unsigned char body[4];
+    bin_put_u32(body, ip);
+    int owner = -1;
+    for (int i = 0; i < shard.count && owner < 0; i++) {
+        if (shard_call(i, PEER_OP_OWNER, body, 4, NULL, 0, NULL) == BANK_OK) owner = i;
+    }
+    if (owner < 0) return 0;
+
+    // 고객은 지점을 옮기지 않으므로 찾은 것만 캐시한다 (새로 등록한 고객은 다음에 다시 묻는다)
+    pthread_mutex_lock(&shard.mutex);
+    if ((uint32_t)(shard.route_count + 1) * 2 > shard.route_mask + 1 || shard.route_ips == NULL) {
+        uint32_t old_mask = shard.route_mask;
+        uint32_t* old_ips = shard.route_ips;
+        uint8_t* old_shards = shard.route_shards;
+        shard.route_mask = old_ips == NULL ? 1023 : old_mask * 2 + 1;
+        shard.route_ips = calloc(shard.route_mask + 1, sizeof(uint32_t));
+        shard.route_shards = calloc(shard.route_mask + 1, sizeof(uint8_t));
+        if (shard.route_ips == NULL || shard.route_shards == NULL) {
+            perror("router cache calloc failed");
+            exit(EXIT_FAILURE);
+        }
+        shard.route_count = 0;
+        for (uint32_t j = 0; old_ips != NULL && j <= old_mask; j++) {
+            if (old_ips[j] == 0) continue;
+            uint32_t k = client_ip_hash(old_ips[j]) & shard.route_mask;
+            while (shard.route_ips[k] != 0) k = (k + 1) & shard.route_mask;
+            shard.route_ips[k] = old_ips[j];
+            shard.route_shards[k] = old_shards[j];
+            shard.route_count++;
+        }
+        free(old_ips);
+        free(old_shards);
+    }
+    uint32_t k = client_ip_hash(ip) & shard.route_mask;
+    while (shard.route_ips[k] != 0 && shard.route_ips[k] != ip) k = (k + 1) & shard.route_mask;
+    if (shard.route_ips[k] == 0) shard.route_count++;
+    shard.route_ips[k] = ip;
+    shard.route_shards[k] = owner;
+    pthread_mutex_unlock(&shard.mutex);
+    return owner;
+}
+
+// 조회 스레드 (라우터 스레드가 넘긴 연결의 지점을 묻고, 답을 그 라우터 스레드에 돌려준다)
+void* router_lookup_func(void* arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&router_lookups.mutex);
+        while (router_lookups.head == NULL) {
+            pthread_cond_wait(&router_lookups.cond, &router_lookups.mutex);
+        }
+        RouterPending* p = router_lookups.head;
+        router_lookups.head = p->next;
+        if (router_lookups.head == NULL) router_lookups.tail = NULL;
+        pthread_mutex_unlock(&router_lookups.mutex);
+
+        p->owner = router_owner(ntohl(p->addr.sin_addr.s_addr));
+
+        RouterThread* t = p->thread;
+        pthread_mutex_lock(&t->mutex);
+        p->next = t->done;
+        t->done = p;
+        pthread_mutex_unlock(&t->mutex);
+        uint64_t one = 1;
+        if (write(t->event_fd, &one, sizeof(one)) < 0) {
+            perror("eventfd write failed");
+        }
+    }
+    return NULL;
+}
+
+// 지점이 정해진 고객 연결을 지점에 이어 epoll에 건다 (실패하면 고객 연결을 닫는다)
+void router_attach(int epoll_fd, int client_fd, int idx, const struct sockaddr_in* addr, int owner) {
+    int shard_fd = router_connect(owner, idx, addr);
+    RouterPipe* pipe = calloc(1, sizeof(RouterPipe));
+    if (shard_fd < 0 || pipe == NULL ||
+        (pipe->bufs[0] = malloc(ROUTER_BUF_SIZE)) == NULL ||
+        (pipe->bufs[1] = malloc(ROUTER_BUF_SIZE)) == NULL) {
+        LOG_WARN("⚠️  [라우터] %s를 %d번 지점에 연결하지 못했습니다\n",
+            inet_ntoa(addr->sin_addr), owner);
+        if (pipe != NULL) {
+            free(pipe->bufs[0]);
+            free(pipe);
+        }
+        if (shard_fd >= 0) close(shard_fd);
+        close(client_fd);
+        return;
+    }
+    atomic_fetch_add(&shard.routed[owner], 1);
+
+    pipe->fds[0] = client_fd;
+    pipe->fds[1] = shard_fd;
+    for (int i = 0; i < 2; i++) {
+        pipe->sides[i].pipe = pipe;
+        pipe->sides[i].side = i;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &pipe->sides[i] };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pipe->fds[i], &ev);
+    }
+}
+
+// 지점의 대화형(idx 0) 또는 바이너리(idx 1) 포트에 고객 주소로 연결 (논블로킹, 연결 중일 수 있다)
+int router_connect(int index, int idx, const struct sockaddr_in* client_addr) {
+    struct sockaddr_in addr = shard.addrs[index].addr;
+    struct sockaddr_in source = *client_addr;
+    int one = 1;
+
+    addr.sin_port = htons(shard.addrs[index].port + idx);
+    source.sin_port = 0;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if ((ntohl(source.sin_addr.s_addr) >> 24) != 127) {
+        setsockopt(fd, SOL_IP, IP_TRANSPARENT, &one, sizeof(one));
+    }
+    if (bind(fd, (struct sockaddr*)&source, sizeof(source)) < 0 ||
+        (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 연결 쌍 닫기 (같은 epoll_wait 묶음에 반대쪽 이벤트가 남아 있을 수 있으므로 해제는 묶음이 끝난 뒤에)
+void router_pipe_close(int epoll_fd, RouterPipe* pipe) {
+    for (int i = 0; i < 2; i++) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pipe->fds[i], NULL);
+        close(pipe->fds[i]);
+        pipe->fds[i] = -1;
+    }
+    pipe->next_closed = router_closed;
+    router_closed = pipe;
+}
+
+// 관심 이벤트 다시 정하기 (버퍼가 차면 그쪽 읽기를 멈추고, 보낼 것이 남으면 쓰기를 기다린다)
+void router_pipe_update(int epoll_fd, RouterPipe* pipe) {
+    for (int i = 0; i < 2; i++) {
+        struct epoll_event ev = { .data.ptr = &pipe->sides[i] };
+        if (!pipe->eof[i] && pipe->lens[i] < ROUTER_BUF_SIZE) ev.events |= EPOLLIN;
+        if (pipe->lens[1 - i] > pipe->offs[1 - i]) ev.events |= EPOLLOUT;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, pipe->fds[i], &ev);
+    }
+}
+
+// 한쪽 소켓의 이벤트 (읽은 것은 바로 반대쪽으로 보내 본다)
+void router_pipe_event(int epoll_fd, RouterPipe* pipe, int side, uint32_t events) {
+    if ((events & EPOLLIN) && !pipe->eof[side] && pipe->lens[side] < ROUTER_BUF_SIZE) {
+        ssize_t n = read(pipe->fds[side], pipe->bufs[side] + pipe->lens[side], ROUTER_BUF_SIZE - pipe->lens[side]);
+        if (n > 0) {
+            pipe->lens[side] += n;
+        } else if (n == 0) {
+            pipe->eof[side] = true;
+        } else if (errno != EAGAIN && errno != EINTR) {
+            router_pipe_close(epoll_fd, pipe);
+            return;
+        }
+    } else if (events & (EPOLLERR | EPOLLHUP)) {
+        if (!(events & EPOLLOUT) || (events & EPOLLERR)) {
+            router_pipe_close(epoll_fd, pipe);
+            return;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (pipe->lens[i] > pipe->offs[i]) {
+            ssize_t n = send(pipe->fds[1 - i], pipe->bufs[i] + pipe->offs[i],
+                             pipe->lens[i] - pipe->offs[i], MSG_NOSIGNAL);
+            if (n > 0) {
+                pipe->offs[i] += n;
+            } else if (n < 0 && errno != EAGAIN && errno != EINTR && errno != ENOTCONN) {
+                router_pipe_close(epoll_fd, pipe);
+                return;
+            }
+        }
+        if (pipe->offs[i] == pipe->lens[i]) {
+            pipe->offs[i] = pipe->lens[i] = 0;
+            if (pipe->eof[i]) shutdown(pipe->fds[1 - i], SHUT_WR);
+        }
+    }
+
+    // 양쪽이 모두 닫고 보낼 것도 없으면 끝
+    if (pipe->eof[0] && pipe->eof[1] && pipe->lens[0] == 0 && pipe->lens[1] == 0) {
+        router_pipe_close(epoll_fd, pipe);
+        return;
+    }
+    router_pipe_update(epoll_fd, pipe);
+}
+
+// 라우터 스레드 (스레드마다 SO_REUSEPORT 수신 소켓 한 벌과 epoll)
+// 캐시에 없는 고객은 조회 스레드에 넘기고 다음 이벤트로 넘어간다. 답은 eventfd(data 2)로 온다.
+void* router_thread_func(void* arg) {
+    (void)arg;
+    int listen_fds[2] = { create_listener(text_port), binary_port > 0 ? create_listener(binary_port) : -1 };
+    RouterThread self = {
+        .epoll_fd = epoll_create1(EPOLL_CLOEXEC),
+        .event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC),
+        .mutex = PTHREAD_MUTEX_INITIALIZER
+    };
+    int epoll_fd = self.epoll_fd;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (epoll_fd < 0 || self.event_fd < 0) {
+        perror("router epoll/eventfd failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int idx = 0; idx < 2; idx++) {
+        if (listen_fds[idx] < 0) continue;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = idx };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fds[idx], &ev);
+    }
+    struct epoll_event wake_ev = { .events = EPOLLIN, .data.u64 = 2 };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, self.event_fd, &wake_ev);
+
+    while (1) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        for (int e = 0; e < n; e++) {
+            if (events[e].data.u64 < 2) {
+                int idx = (int)events[e].data.u64;
+                struct sockaddr_in addr;
+                socklen_t addr_len = sizeof(addr);
+                int client_fd = accept4(listen_fds[idx], (struct sockaddr*)&addr, &addr_len,
+                                        SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (client_fd < 0) continue;
+
+                int owner = router_owner_cached(ntohl(addr.sin_addr.s_addr));
+                if (owner >= 0) {
+                    router_attach(epoll_fd, client_fd, idx, &addr, owner);
+                    continue;
+                }
+
+                RouterPending* p = calloc(1, sizeof(RouterPending));
+                if (p == NULL) {
+                    close(client_fd);
+                    continue;
+                }
+                p->client_fd = client_fd;
+                p->idx = idx;
+                p->addr = addr;
+                p->thread = &self;
+                pthread_mutex_lock(&router_lookups.mutex);
+                if (router_lookups.tail) router_lookups.tail->next = p;
+                else router_lookups.head = p;
+                router_lookups.tail = p;
+                pthread_cond_signal(&router_lookups.cond);
+                pthread_mutex_unlock(&router_lookups.mutex);
+                continue;
+            }
+
+            if (events[e].data.u64 == 2) {
+                // 조회 스레드가 답한 연결들을 지점에 잇는다
+                uint64_t count;
+                if (read(self.event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    perror("eventfd read failed");
+                }
+                pthread_mutex_lock(&self.mutex);
+                RouterPending* done = self.done;
+                self.done = NULL;
+                pthread_mutex_unlock(&self.mutex);
+                while (done != NULL) {
+                    RouterPending* p = done;
+                    done = p->next;
+                    router_attach(epoll_fd, p->client_fd, p->idx, &p->addr, p->owner);
+                    free(p);
+                }
+                continue;
+            }
+
+            struct RouterSide* side = events[e].data.ptr;
+            if (side->pipe->fds[0] < 0) continue;
+            router_pipe_event(epoll_fd, side->pipe, side->side, events[e].events);
+        }
+
+        while (router_closed != NULL) {
+            RouterPipe* pipe = router_closed;
+            router_closed = pipe->next_closed;
+            free(pipe->bufs[0]);
+            free(pipe->bufs[1]);
+            free(pipe);
+        }
+    }
+    return NULL;
+}
+
+// 라우터로 실행 (지점에 고객을 넘겨 주기만 하고 업무는 처리하지 않는다)
+void run_router() {
+    listener_probe(text_port);
+    if (binary_port > 0) {
+        listener_probe(binary_port);
+    }
+
+    LOG_INFO("🧭 라우터 시작: 대화형 %d, 바이너리 %d → 지점 %d개\n", text_port, binary_port, shard.count);
+    for (int i = 0; i < shard.count; i++) {
+        LOG_INFO("   %d번 지점: %s:%d\n", i, shard.addrs[i].host, shard.addrs[i].port);
+    }
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * reactor_count);
+    for (int i = 0; i < reactor_count; i++) {
+        pthread_create(&threads[i], NULL, router_thread_func, NULL);
+    }
+    // 처음 보는 고객의 지점 조회 (지점 하나가 느려도 라우터 스레드는 계속 바이트를 옮긴다)
+    for (int i = 0; i < reactor_count; i++) {
+        pthread_t lookup;
+        pthread_create(&lookup, NULL, router_lookup_func, NULL);
+        pthread_detach(lookup);
+    }
+    for (int i = 0; i < reactor_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+// ========== 지표 (메트릭) ==========
+
+// 단조 시계 (ns)
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 히스토그램에 표본 하나 기록 (잠금 없이 칸 하나만 올린다)
+// i번 칸은 1us * 2^i 이하, 마지막 칸은 상한 초과.
+void hist_record(Histogram* h, uint64_t ns) {
+    int idx = 0;
+    if (ns > 1000) {
+        idx = 64 - __builtin_clzll((ns - 1) / 1000);
+        if (idx > HIST_BUCKETS) idx = HIST_BUCKETS;
+    }
+    atomic_fetch_add_explicit(&h->buckets[idx], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+}
+
+// 은행 업무 하나 완료 (start_ns부터 잰 처리 시간과 결과)
+void metrics_op_done(MetricOp op, BankStatus status, uint64_t start_ns) {
+    hist_record(&metrics.op_latency[op], now_ns() - start_ns);
+    atomic_fetch_add_explicit(&metrics.op_status[op][status], 1, memory_order_relaxed);
+}
+
+// 고객 lock 잡기 (경합이 있었을 때만 대기 시간을 잰다)
+// 인기 통장에 쌓인 입금과 공개된 일 마감 증감을 먼저 반영하므로, lock을 쥔 쪽은 항상 반영된 잔고를 본다.
+void client_lock(ClientInfo* client) {
+    atomic_fetch_add_explicit(&metrics.lock_acquired, 1, memory_order_relaxed);
+    if (pthread_mutex_trylock(&client->lock) != 0) {
+        uint64_t start = now_ns();
+        pthread_mutex_lock(&client->lock);
+        hist_record(&metrics.lock_wait, now_ns() - start);
+        atomic_fetch_add_explicit(&metrics.lock_contended, 1, memory_order_relaxed);
+    }
+    hot_fold(client);
+    eod_fold(client);
+}
+
+// 연 뒤로 일한 시간 비율 (%)
+double busy_percent(const struct timespec* opened, uint64_t busy_ns) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double open_ms = elapsed_ms(opened, &now);
+    if (open_ms <= 0) return 0;
+    return busy_ns / 1e6 / open_ms * 100.0;
+}
+
+// 히스토그램 출력 (Prometheus 텍스트 형식, 누적 칸)
+void metrics_write_hist(FILE* out, const char* name, const char* labels, Histogram* h) {
+    unsigned long cumulative = 0;
+    const char* sep = labels[0] ? "," : "";
+
+    for (int i = 0; i <= HIST_BUCKETS; i++) {
+        cumulative += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if (i < HIST_BUCKETS) {
+            fprintf(out, "%s_bucket{%s%sle=\"%g\"} %lu\n",
+                name, labels, sep, (1000.0 * (1ull << i)) / 1e9, cumulative);
+        } else {
+            fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, cumulative);
+        }
+    }
+    fprintf(out, "%s_sum%s%s%s %.9f\n", name, sep[0] ? "{" : "", labels, sep[0] ? "}" : "",
+        atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / 1e9);
+    fprintf(out, "%s_count%s%s%s %lu\n", name, sep[0] ? "{" : "", labels, sep[0] ? "}" : "",
+        atomic_load_explicit(&h->count, memory_order_relaxed));
+}
+
+// 전체 지표 출력
+void metrics_write(FILE* out) {
+    char labels[64];
+
+    fprintf(out, "# HELP bank_op_duration_seconds 은행 업무 처리 시간 (잠금 대기와 WAL 추가 포함)\n");
+    fprintf(out, "# TYPE bank_op_duration_seconds histogram\n");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        snprintf(labels, sizeof(labels), "op=\"%s\"", metric_op_names[op]);
+        metrics_write_hist(out, "bank_op_duration_seconds", labels, &metrics.op_latency[op]);
+    }
+
+    fprintf(out, "# HELP bank_ops_total 결과별 은행 업무 수\n");
+    fprintf(out, "# TYPE bank_ops_total counter\n");
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        for (int st = 0; st < BANK_STATUS_COUNT; st++) {
+            unsigned long n = atomic_load_explicit(&metrics.op_status[op][st], memory_order_relaxed);
+            if (n == 0) continue;
+            fprintf(out, "bank_ops_total{op=\"%s\",status=\"%s\"} %lu\n",
+                metric_op_names[op], bank_status_names[st], n);
+        }
+    }
+
+    fprintf(out, "# HELP bank_accept_to_assign_seconds 접속 수락부터 창구 배정까지\n");
+    fprintf(out, "# TYPE bank_accept_to_assign_seconds histogram\n");
+    metrics_write_hist(out, "bank_accept_to_assign_seconds", "", &metrics.accept_to_assign);
+    fprintf(out, "# HELP bank_queue_wait_seconds 대기 큐에 머문 시간\n");
+    fprintf(out, "# TYPE bank_queue_wait_seconds histogram\n");
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "class=\"%s\"", queue_class_names[c]);
+        metrics_write_hist(out, "bank_queue_wait_seconds", labels, &metrics.queue_wait[c]);
+    }
+    fprintf(out, "# TYPE bank_queue_depth gauge\n");
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        fprintf(out, "bank_queue_depth{class=\"%s\"} %d\n", queue_class_names[c], queue_class_depth(c));
+    }
+    fprintf(out, "# HELP bank_queue_served_total 대기 등급별 창구 배정 수\n");
+    fprintf(out, "# TYPE bank_queue_served_total counter\n");
+    for (int c = 0; c < QUEUE_CLASSES; c++) {
+        fprintf(out, "bank_queue_served_total{class=\"%s\"} %lu\n",
+            queue_class_names[c], atomic_load(&queue_served[c]));
+    }
+    fprintf(out, "# TYPE bank_queue_rejected_total counter\n");
+    fprintf(out, "bank_queue_rejected_total %ld\n", atomic_load(&queue_rejected));
+    fprintf(out, "# TYPE bank_connections_total counter\n");
+    fprintf(out, "bank_connections_total %lu\n", atomic_load(&metrics.connections_accepted));
+    if (listeners != NULL) {
+        fprintf(out, "# HELP bank_acceptor_connections_total 수신 소켓 묶음(수락 스레드 또는 리액터)별 수락한 연결 수\n");
+        fprintf(out, "# TYPE bank_acceptor_connections_total counter\n");
+        for (int i = 0; i < listener_count; i++) {
+            fprintf(out, "bank_acceptor_connections_total{acceptor=\"%d\"} %lu\n",
+                i + 1, atomic_load(&listeners[i].accepted));
+        }
+    }
+    fprintf(out, "# TYPE bank_auth_failed_total counter\n");
+    fprintf(out, "bank_auth_failed_total %lu\n", atomic_load(&metrics.auth_failed));
+    unsigned long reads = atomic_load(&metrics.read_calls);
+    unsigned long writes = atomic_load(&metrics.write_calls);
+    unsigned long enters = atomic_load(&metrics.uring_enters);
+    unsigned long ops = 0;
+    for (int op = 0; op < METRIC_OP_COUNT; op++) {
+        ops += atomic_load(&metrics.op_latency[op].count);
+    }
+    fprintf(out, "# HELP bank_io_syscalls_total 고객 소켓 입출력 시스템 호출 수 (read, sendmsg, uring 모드는 io_uring_enter)\n");
+    fprintf(out, "# TYPE bank_io_syscalls_total counter\n");
+    fprintf(out, "bank_io_syscalls_total{dir=\"read\"} %lu\n", reads);
+    fprintf(out, "bank_io_syscalls_total{dir=\"write\"} %lu\n", writes);
+    fprintf(out, "bank_io_syscalls_total{dir=\"uring\"} %lu\n", enters);
+    fprintf(out, "# HELP bank_io_syscalls_per_op 은행 업무 한 건당 입출력 시스템 호출 수 (기동 후 누적)\n");
+    fprintf(out, "# TYPE bank_io_syscalls_per_op gauge\n");
+    fprintf(out, "bank_io_syscalls_per_op{dir=\"read\"} %.3f\n", ops ? (double)reads / ops : 0.0);
+    fprintf(out, "bank_io_syscalls_per_op{dir=\"write\"} %.3f\n", ops ? (double)writes / ops : 0.0);
+    fprintf(out, "bank_io_syscalls_per_op{dir=\"uring\"} %.3f\n", ops ? (double)enters / ops : 0.0);
+    fprintf(out, "# HELP bank_session_timeouts_total 기한을 넘겨 닫은 세션 수 (idle: 입력 없음, session: 전체 상담 시간)\n");
+    fprintf(out, "# TYPE bank_session_timeouts_total counter\n");
+    fprintf(out, "bank_session_timeouts_total{reason=\"idle\"} %lu\n", atomic_load(&metrics.timeouts_idle));
+    fprintf(out, "bank_session_timeouts_total{reason=\"session\"} %lu\n", atomic_load(&metrics.timeouts_session));
+
+    fprintf(out, "# HELP bank_client_lock_wait_seconds 경합이 난 고객 lock 대기 시간\n");
+    fprintf(out, "# TYPE bank_client_lock_wait_seconds histogram\n");
+    metrics_write_hist(out, "bank_client_lock_wait_seconds", "", &metrics.lock_wait);
+    fprintf(out, "# TYPE bank_client_lock_acquired_total counter\n");
+    fprintf(out, "bank_client_lock_acquired_total %lu\n", atomic_load(&metrics.lock_acquired));
+    fprintf(out, "# TYPE bank_client_lock_contended_total counter\n");
+    fprintf(out, "bank_client_lock_contended_total %lu\n", atomic_load(&metrics.lock_contended));
+    fprintf(out, "# HELP bank_balance_read_retries_total 잔고 조회가 입출금과 겹쳐 다시 읽은 횟수 (lock 없음)\n");
+    fprintf(out, "# TYPE bank_balance_read_retries_total counter\n");
+    fprintf(out, "bank_balance_read_retries_total %lu\n", atomic_load(&metrics.read_retries));
+
+    if (server_mode == MODE_THREAD && workers != NULL) {
+        fprintf(out, "# TYPE bank_workers_live gauge\n");
+        fprintf(out, "bank_workers_live %d\n", atomic_load(&live_workers));
+        fprintf(out, "# HELP bank_worker_busy_ratio 창구를 연 뒤로 상담에 쓴 시간 비율\n");
+        fprintf(out, "# TYPE bank_worker_busy_ratio gauge\n");
+        for (int i = 0; i < max_workers; i++) {
+            if (atomic_load(&workers[i].state) != WORKER_RUNNING) continue;
+            fprintf(out, "bank_worker_busy_ratio{worker=\"%d\"} %.4f\n",
+                i + 1, worker_utilization(&workers[i]) / 100.0);
+        }
+        fprintf(out, "# TYPE bank_worker_sessions_total counter\n");
+        for (int i = 0; i < max_workers; i++) {
+            if (atomic_load(&workers[i].state) != WORKER_RUNNING) continue;
+            fprintf(out, "bank_worker_sessions_total{worker=\"%d\"} %ld\n",
+                i + 1, atomic_load(&workers[i].sessions));
+        }
+    }
+    if (server_mode != MODE_THREAD && reactors != NULL) {
+        fprintf(out, "# HELP bank_reactor_busy_ratio 리액터가 이벤트 처리에 쓴 시간 비율\n");
+        fprintf(out, "# TYPE bank_reactor_busy_ratio gauge\n");
+        for (int i = 0; i < reactor_count; i++) {
+            fprintf(out, "bank_reactor_busy_ratio{reactor=\"%d\"} %.4f\n", i + 1,
+                busy_percent(&reactors[i].opened, atomic_load(&reactors[i].busy_ns)) / 100.0);
+        }
+    }
+
+    if (wal.enabled) {
+        pthread_mutex_lock(&wal.mutex);
+        uint64_t next_lsn = wal.next_lsn;
+        long groups = wal.groups;
+        pthread_mutex_unlock(&wal.mutex);
+        fprintf(out, "# TYPE bank_wal_lsn gauge\n");
+        fprintf(out, "bank_wal_lsn{kind=\"appended\"} %llu\n", (unsigned long long)(next_lsn - 1));
+        fprintf(out, "bank_wal_lsn{kind=\"durable\"} %llu\n",
+            (unsigned long long)atomic_load(&wal.durable_lsn));
+        fprintf(out, "# TYPE bank_wal_groups_total counter\n");
+        fprintf(out, "bank_wal_groups_total %ld\n", groups);
+    }
+
+    if (repl.primary != NULL) {
+        uint64_t applied = atomic_load(&repl.applied_lsn);
+        uint64_t primary = atomic_load(&repl.primary_lsn);
+        bool caught_up = atomic_load(&repl.connected) && applied >= primary;
+        fprintf(out, "# HELP bank_repl_standby 대기 서버로 복제 중이면 1 (promote 후 0)\n");
+        fprintf(out, "# TYPE bank_repl_standby gauge\n");
+        fprintf(out, "bank_repl_standby %d\n", repl_is_standby() ? 1 : 0);
+        fprintf(out, "# TYPE bank_repl_connected gauge\n");
+        fprintf(out, "bank_repl_connected %d\n", atomic_load(&repl.connected) ? 1 : 0);
+        fprintf(out, "# TYPE bank_repl_lsn gauge\n");
+        fprintf(out, "bank_repl_lsn{kind=\"applied\"} %llu\n", (unsigned long long)applied);
+        fprintf(out, "bank_repl_lsn{kind=\"primary\"} %llu\n", (unsigned long long)primary);
+        fprintf(out, "# HELP bank_repl_lag_lsn 주 서버가 커밋했지만 아직 반영하지 못한 레코드 수\n");
+        fprintf(out, "# TYPE bank_repl_lag_lsn gauge\n");
+        fprintf(out, "bank_repl_lag_lsn %llu\n", (unsigned long long)(primary > applied ? primary - applied : 0));
+        fprintf(out, "# HELP bank_repl_lag_seconds 마지막으로 주 서버를 따라잡은 뒤 지난 시간 (따라잡은 상태면 0)\n");
+        fprintf(out, "# TYPE bank_repl_lag_seconds gauge\n");
+        fprintf(out, "bank_repl_lag_seconds %.3f\n",
+            caught_up ? 0.0 : (now_ns() - atomic_load(&repl.caught_up_ns)) / 1e9);
+        fprintf(out, "# TYPE bank_repl_reconnects_total counter\n");
+        fprintf(out, "bank_repl_reconnects_total %lu\n", atomic_load(&repl.reconnects));
+        fprintf(out, "# TYPE bank_repl_snapshots_total counter\n");
+        fprintf(out, "bank_repl_snapshots_total %lu\n", atomic_load(&repl.snapshots));
+    }
+    if (repl.port > 0) {
+        int followers = 0;
+        fprintf(out, "# HELP bank_repl_sent_lsn 대기 서버별로 보낸 마지막 LSN\n");
+        fprintf(out, "# TYPE bank_repl_sent_lsn gauge\n");
+        pthread_mutex_lock(&repl.mutex);
+        for (int i = 0; i < REPL_MAX_FOLLOWERS; i++) {
+            ReplFollower* f = &repl.followers[i];
+            if (!f->used) continue;
+            followers++;
+            fprintf(out, "bank_repl_sent_lsn{follower=\"%s\"} %llu\n",
+                f->addr, (unsigned long long)atomic_load(&f->sent_lsn));
+        }
+        pthread_mutex_unlock(&repl.mutex);
+        fprintf(out, "# TYPE bank_repl_followers gauge\n");
+        fprintf(out, "bank_repl_followers %d\n", followers);
+    }
+
+    if (shard.count > 0 && !shard.router) {
+        pthread_mutex_lock(&shard.mutex);
+        int prepared = shard.prepared_count, pending = 0;
+        for (int i = 0; i < shard.decision_count; i++) {
+            if (shard.decisions[i].committed) pending++;
+        }
+        pthread_mutex_unlock(&shard.mutex);
+        fprintf(out, "# TYPE bank_shard_info gauge\n");
+        fprintf(out, "bank_shard_info{index=\"%d\",count=\"%d\"} 1\n", shard.index, shard.count);
+        fprintf(out, "# HELP bank_shard_tx_total 이 지점이 조정한 지점 간 거래 (2단계 커밋)\n");
+        fprintf(out, "# TYPE bank_shard_tx_total counter\n");
+        fprintf(out, "bank_shard_tx_total{result=\"commit\"} %lu\n", atomic_load(&shard.committed));
+        fprintf(out, "bank_shard_tx_total{result=\"abort\"} %lu\n", atomic_load(&shard.aborted));
+        fprintf(out, "# HELP bank_shard_prepared 준비하고 조정 지점의 결정을 기다리는 거래 수 (고객 lock을 쥐고 있다)\n");
+        fprintf(out, "# TYPE bank_shard_prepared gauge\n");
+        fprintf(out, "bank_shard_prepared %d\n", prepared);
+        fprintf(out, "# HELP bank_shard_commit_pending 커밋하기로 정했지만 아직 모든 참여 지점이 마치지 않은 거래 수\n");
+        fprintf(out, "# TYPE bank_shard_commit_pending gauge\n");
+        fprintf(out, "bank_shard_commit_pending %d\n", pending);
+    }
+    if (shard.router) {
+        fprintf(out, "# HELP bank_router_connections_total 라우터가 지점별로 넘긴 고객 연결 수\n");
+        fprintf(out, "# TYPE bank_router_connections_total counter\n");
+        for (int i = 0; i < shard.count; i++) {
+            fprintf(out, "bank_router_connections_total{shard=\"%d\"} %lu\n", i, atomic_load(&shard.routed[i]));
+        }
+    }
+
+    if (ledger_file.fd >= 0) {
+        fprintf(out, "# HELP bank_ledger_entries_total 거래 원장에 적은 항목 수\n");
+        fprintf(out, "# TYPE bank_ledger_entries_total counter\n");
+        fprintf(out, "bank_ledger_entries_total %lu\n", atomic_load(&ledger_file.entries));
+        fprintf(out, "# HELP bank_ledger_chunks_written_total 원장 파일로 내린 묶음 수\n");
+        fprintf(out, "# TYPE bank_ledger_chunks_written_total counter\n");
+        fprintf(out, "bank_ledger_chunks_written_total{kind=\"full\"} %lu\n", atomic_load(&ledger_file.chunks[0]));
+        fprintf(out, "bank_ledger_chunks_written_total{kind=\"partial\"} %lu\n", atomic_load(&ledger_file.chunks[1]));
+        fprintf(out, "# TYPE bank_ledger_file_bytes gauge\n");
+        fprintf(out, "bank_ledger_file_bytes %llu\n", (unsigned long long)atomic_load(&ledger_file.end));
+        fprintf(out, "# HELP bank_ledger_memory_bytes 원장이 메모리에 쥔 크기 (마지막 묶음 + 묶음 위치 표)\n");
+        fprintf(out, "# TYPE bank_ledger_memory_bytes gauge\n");
+        fprintf(out, "bank_ledger_memory_bytes %ld\n", atomic_load(&ledger_file.memory));
+    }
+
+    if (atomic_load(&hot_account_count) > 0) {
+        fprintf(out, "# TYPE bank_hot_accounts gauge\n");
+        fprintf(out, "bank_hot_accounts %d\n", atomic_load(&hot_account_count));
+        fprintf(out, "# HELP bank_hot_deposits_total 인기 통장 누적기로 받은 입금 수\n");
+        fprintf(out, "# TYPE bank_hot_deposits_total counter\n");
+        fprintf(out, "bank_hot_deposits_total %lu\n", atomic_load(&metrics.hot_deposits));
+        fprintf(out, "# HELP bank_hot_folds_total 누적기에 쌓인 입금을 잔고에 반영한 횟수\n");
+        fprintf(out, "# TYPE bank_hot_folds_total counter\n");
+        fprintf(out, "bank_hot_folds_total %lu\n", atomic_load(&metrics.hot_folds));
+        fprintf(out, "# HELP bank_hot_fallbacks_total 누적기 대신 고객 lock을 기다린 입금 수 (조각 가득 참, 일 마감 중)\n");
+        fprintf(out, "# TYPE bank_hot_fallbacks_total counter\n");
+        fprintf(out, "bank_hot_fallbacks_total{reason=\"stripe_full\"} %lu\n",
+            atomic_load(&metrics.hot_full_waits));
+        fprintf(out, "bank_hot_fallbacks_total{reason=\"eod\"} %lu\n",
+            atomic_load(&metrics.hot_eod_fallbacks));
+    }
+
+    if (atomic_load(&eod.epoch) > 0 || atomic_load(&eod.running)) {
+        int phase = atomic_load(&eod.phase);
+        uint32_t total = phase == EOD_CUT ? (uint32_t)client_count() : eod.cut_clients;
+        fprintf(out, "# HELP bank_eod_epoch 공개한 마지막 일 마감 회차\n");
+        fprintf(out, "# TYPE bank_eod_epoch gauge\n");
+        fprintf(out, "bank_eod_epoch %u\n", atomic_load(&eod.epoch));
+        fprintf(out, "# TYPE bank_eod_runs_total counter\n");
+        fprintf(out, "bank_eod_runs_total %lu\n", atomic_load(&eod.runs));
+        if (atomic_load(&eod.running)) {
+            fprintf(out, "# HELP bank_eod_progress 진행 중인 일 마감 단계에서 끝낸 고객 비율\n");
+            fprintf(out, "# TYPE bank_eod_progress gauge\n");
+            for (int i = EOD_CUT; i < EOD_PHASES; i++) {
+                fprintf(out, "bank_eod_progress{phase=\"%s\"} %.4f\n", eod_phase_names[i],
+                    i == phase && total > 0 ? atomic_load(&eod.done) / (double)total : 0.0);
+            }
+        }
+        if (atomic_load(&eod.runs) > 0) {
+            fprintf(out, "# HELP bank_eod_phase_seconds 마지막 일 마감의 단계별 소요 시간\n");
+            fprintf(out, "# TYPE bank_eod_phase_seconds gauge\n");
+            for (int i = EOD_CUT; i < EOD_PHASES; i++) {
+                fprintf(out, "bank_eod_phase_seconds{phase=\"%s\"} %.6f\n", eod_phase_names[i],
+                    eod.phase_ms[i] / 1000.0);
+            }
+            fprintf(out, "# HELP bank_eod_amount 마지막 일 마감의 이자/수수료 합 (원)\n");
+            fprintf(out, "# TYPE bank_eod_amount gauge\n");
+            fprintf(out, "bank_eod_amount{kind=\"interest\"} %lld\n", atomic_load(&eod.interest));
+            fprintf(out, "bank_eod_amount{kind=\"fee\"} %lld\n", atomic_load(&eod.fees));
+        }
+    }
+
+    fprintf(out, "# HELP bank_log_dropped_total 로그 링이 가득 차 버린 레코드 수\n");
+    fprintf(out, "# TYPE bank_log_dropped_total counter\n");
+    fprintf(out, "bank_log_dropped_total %lu\n", log_dropped());
+
+    fprintf(out, "# HELP bank_clients 고객 디렉터리에 등록된 고객 수\n");
+    fprintf(out, "# TYPE bank_clients gauge\n");
+    fprintf(out, "bank_clients %d\n", client_count());
+
+    fprintf(out, "# HELP bank_startup_seconds 기동 단계별 소요 시간\n");
+    fprintf(out, "# TYPE bank_startup_seconds gauge\n");
+    fprintf(out, "bank_startup_seconds{phase=\"snapshot\"} %.6f\n", startup_stats.snapshot_ms / 1000.0);
+    fprintf(out, "bank_startup_seconds{phase=\"replay\"} %.6f\n", startup_stats.replay_ms / 1000.0);
+    fprintf(out, "bank_startup_seconds{phase=\"total\"} %.6f\n", startup_stats.total_ms / 1000.0);
+    fprintf(out, "# TYPE bank_startup_replayed_records gauge\n");
+    fprintf(out, "bank_startup_replayed_records %ld\n", startup_stats.wal_records);
+}
+
+// ========== 관리 소켓 ==========
+// 127.0.0.1에서만 받는다. 한 줄 명령("metrics")이나 HTTP GET(/metrics)을 받아
+// 응답을 보내고 연결을 닫는다. 명령은 admin_commands 표에 추가한다.
+
+void admin_cmd_metrics(FILE* out, const char* args) {
+    (void)args;
+    metrics_write(out);
+}
+
+void admin_cmd_help(FILE* out, const char* args) {
+    (void)args;
+    for (int i = 0; admin_commands[i].name != NULL; i++) {
+        fprintf(out, "%-10s %s\n", admin_commands[i].name, admin_commands[i].help);
+    }
+}
+
+// 영업 중 고객 등록 (WAL에 기록이 내려간 뒤 응답한다)
+void admin_cmd_register(FILE* out, const char* args) {
+    char client_id[64], ip_text[64];
+    struct in_addr addr;
+
+    if (args == NULL || sscanf(args, "%63s %63s", client_id, ip_text) != 2 ||
+        inet_pton(AF_INET, ip_text, &addr) != 1) {
+        fprintf(out, "error bad_request (register <ID> <IPv4>)\n");
         return;
     }
-    
-    client->accounts[account_num].balance -= amount;
-    
-    snprintf(response, BUFFER_SIZE, 
-        "\n✅ 출금이 완료되었습니다!\n"
-        "   🏦 은행: %s\n"
-        "   💰 출금액: %d원\n"
-        "   📊 출금 후 잔고: %d원\n",
-        client->accounts[account_num].bank_name,
-        amount,
-        client->accounts[account_num].balance);
-    send(client_fd, response, strlen(response), 0);
-    
-    pthread_mutex_unlock(&db_mutex);
-    
-    printf("💸 [출금] %s - %s 통장에서 %d원 출금\n", 
-        client->client_id, client->accounts[account_num].bank_name, amount);
+
+    if (repl_is_standby()) {
+        fprintf(out, "error standby (대기 서버는 promote 후에 등록할 수 있습니다)\n");
+        return;
+    }
+    if (shard.router) {
+        fprintf(out, "error router (고객이 속할 지점의 관리 포트에서 등록하세요)\n");
+        return;
+    }
+    if (strlen(client_id) < CLIENT_ID_SIZE && !shard_owns(client_id)) {
+        fprintf(out, "error other_shard (%s은 %d번 지점 고객입니다)\n", client_id, shard_of(client_id));
+        return;
+    }
+
+    ClientInfo* client;
+    BankStatus status = client_register(client_id, ntohl(addr.s_addr), &client);
+    if (status != BANK_OK) {
+        fprintf(out, "error %s\n", bank_status_names[status]);
+        return;
+    }
+    wal_wait_durable(client->last_lsn);
+
+    fprintf(out, "ok %s %s client_no=%d\n", client->client_id, ip_text, client->client_no);
+    LOG_INFO("🆔 [고객 등록] %s (%s, 번호 %d)\n", client->client_id, ip_text, client->client_no);
+}
+
+// 인기 통장 지정 / 목록
+void admin_cmd_hot(FILE* out, const char* args) {
+    char client_id[64];
+    int account_no;
+
+    if (args == NULL || args[0] == 0) {
+        for (int i = 0; i < client_count(); i++) {
+            ClientInfo* client = client_at(i);
+            if (atomic_load(&client->hot_accounts) == 0) continue;
+            for (int j = 0; j < max_accounts; j++) {
+                HotAccount* hot = hot_account_of(client, j);
+                if (hot == NULL) continue;
+                fprintf(out, "%s %d balance=%d pending=%lld reserved=%lld\n", client->client_id, j + 1,
+                    account_balance_read(client, j), (long long)atomic_load(&hot->pending),
+                    (long long)atomic_load(&hot->reserved));
+            }
+        }
+        fprintf(out, "ok %d\n", atomic_load(&hot_account_count));
+        return;
+    }
+    if (sscanf(args, "%63s %d", client_id, &account_no) != 2) {
+        fprintf(out, "error bad_request (hot <ID> <통장번호>)\n");
+        return;
+    }
+
+    ClientInfo* client = find_client_by_id(client_id);
+    if (client == NULL) {
+        fprintf(out, "error %s\n", bank_status_names[BANK_ERR_NO_CLIENT]);
+        return;
+    }
+    BankStatus status = hot_enable(client, account_no - 1);
+    if (status != BANK_OK) {
+        fprintf(out, "error %s\n", bank_status_names[status]);
+        return;
+    }
+    fprintf(out, "ok %s %d\n", client->client_id, account_no);
+}
+
+// 일 마감 시작 / 진행 상황
+void admin_cmd_eod(FILE* out, const char* args) {
+    uint32_t epoch = atomic_load(&eod.epoch);
+
+    if (args != NULL && strcmp(args, "run") == 0) {
+        if (repl_is_standby()) {
+            fprintf(out, "error standby (대기 서버는 주 서버의 일 마감을 복제로 받습니다)\n");
+            return;
+        }
+        if (shard.router) {
+            fprintf(out, "error router (지점마다 관리 포트에서 돌리세요)\n");
+            return;
+        }
+        if (!eod_start()) {
+            fprintf(out, "error running (%s)\n", eod_phase_names[atomic_load(&eod.phase)]);
+            return;
+        }
+        fprintf(out, "ok started epoch=%u\n", epoch + 1);
+        return;
+    }
+    if (args != NULL && args[0] != 0) {
+        fprintf(out, "error bad_request (eod [run])\n");
+        return;
+    }
+
+    int phase = atomic_load(&eod.phase);
+    fprintf(out, "epoch %u\nphase %s\n", epoch, eod_phase_names[phase]);
+    if (phase != EOD_IDLE) {
+        fprintf(out, "progress %u/%u\n", atomic_load(&eod.done),
+            phase == EOD_CUT ? (uint32_t)client_count() : eod.cut_clients);
+    }
+    if (phase != EOD_IDLE || atomic_load(&eod.runs) > 0) {
+        fprintf(out, "accounts %lu\ninterest %lld\nfees %lld\n", atomic_load(&eod.accounts),
+            atomic_load(&eod.interest), atomic_load(&eod.fees));
+        fprintf(out, "last_ms cut=%.1f compute=%.1f commit=%.1f apply=%.1f\n", eod.phase_ms[EOD_CUT],
+            eod.phase_ms[EOD_COMPUTE], eod.phase_ms[EOD_COMMIT], eod.phase_ms[EOD_APPLY]);
+    }
+}
+
+// 복제 상태
+void admin_cmd_repl(FILE* out, const char* args) {
+    (void)args;
+    if (repl.primary != NULL) {
+        uint64_t applied = atomic_load(&repl.applied_lsn);
+        uint64_t primary = atomic_load(&repl.primary_lsn);
+        fprintf(out, "role %s\nprimary %s\nconnected %s\napplied_lsn %llu\nprimary_lsn %llu\n",
+            repl_is_standby() ? "standby" : "primary (promoted)", repl.primary,
+            atomic_load(&repl.connected) ? "yes" : "no",
+            (unsigned long long)applied, (unsigned long long)primary);
+        fprintf(out, "lag_lsn %llu\n", (unsigned long long)(primary > applied ? primary - applied : 0));
+    } else {
+        fprintf(out, "role primary\n");
+    }
+
+    pthread_mutex_lock(&repl.mutex);
+    for (int i = 0; i < REPL_MAX_FOLLOWERS; i++) {
+        ReplFollower* f = &repl.followers[i];
+        if (f->used) {
+            fprintf(out, "follower %s sent_lsn=%llu\n", f->addr, (unsigned long long)atomic_load(&f->sent_lsn));
+        }
+    }
+    pthread_mutex_unlock(&repl.mutex);
+}
+
+// 대기 서버를 주 서버로 전환
+// 복제 연결을 끊고 복제 스레드가 멈추면 받은 레코드를 모두 디스크에 내려보낸 뒤
+// main이 고객 포트를 열도록 알린다. 메모리 상태는 이미 최신이므로 재구축이 없다.
+void admin_cmd_promote(FILE* out, const char* args) {
+    (void)args;
+    uint64_t start = now_ns();
+
+    pthread_mutex_lock(&repl.mutex);
+    if (repl.primary == NULL || repl.promoting) {
+        pthread_mutex_unlock(&repl.mutex);
+        fprintf(out, "error %s\n", repl.primary == NULL ? "not_standby" : "already_promoted");
+        return;
+    }
+    repl.promoting = true;
+    if (repl.fd >= 0) shutdown(repl.fd, SHUT_RDWR);
+    pthread_cond_broadcast(&repl.changed);
+    pthread_mutex_unlock(&repl.mutex);
+
+    pthread_join(repl.thread, NULL);
+
+    pthread_mutex_lock(&wal.mutex);
+    uint64_t lsn = wal.next_lsn - 1;
+    pthread_mutex_unlock(&wal.mutex);
+    wal_sync(lsn);
+
+    pthread_mutex_lock(&repl.mutex);
+    repl.promoted = true;
+    pthread_cond_broadcast(&repl.changed);
+    pthread_mutex_unlock(&repl.mutex);
+
+    fprintf(out, "ok promoted lsn=%llu (%.1fms)\n", (unsigned long long)lsn, (now_ns() - start) / 1e6);
+    LOG_INFO("🏦 [복제] promote: LSN %llu까지 반영한 상태로 영업을 시작합니다 (%.1fms)\n",
+        (unsigned long long)lsn, (now_ns() - start) / 1e6);
+}
+
+// 관리 소켓 열기 (루프백 전용)
+int admin_create_listener(int port) {
+    struct sockaddr_in address;
+    int opt = 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("admin socket failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        perror("admin bind failed");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// 관리 연결 하나 처리
+void admin_handle(int fd) {
+    char request[512];
+    size_t len = 0;
+    struct timeval timeout = { 1, 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (len < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (n <= 0) break;
+        len += n;
+        if (memchr(request, '\n', len) != NULL) break;
+    }
+    request[len] = 0;
+    request[strcspn(request, "\r\n")] = 0;
+
+    // HTTP 요청이면 경로를 명령으로 쓴다 ("GET /metrics HTTP/1.1" → "metrics")
+    bool http = strncmp(request, "GET /", 5) == 0;
+    char* cmd = http ? request + 5 : request;
+    if (http) cmd[strcspn(cmd, " ?")] = 0;
+    char* args = cmd + strcspn(cmd, " ");
+    if (*args) *args++ = 0;
+
+    char* body = NULL;
+    size_t body_len = 0;
+    FILE* out = open_memstream(&body, &body_len);
+    if (out == NULL) return;
+
+    bool found = false;
+    for (int i = 0; admin_commands[i].name != NULL; i++) {
+        if (strcmp(cmd, admin_commands[i].name) == 0) {
+            admin_commands[i].handler(out, args);
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        fprintf(out, "unknown command: %s (try: help)\n", cmd);
+    }
+    fclose(out);
+
+    if (http) {
+        char header[256];
+        int n = snprintf(header, sizeof(header),
+            "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+            found ? "200 OK" : "404 Not Found", body_len);
+        send(fd, header, n, MSG_NOSIGNAL);
+    }
+    size_t off = 0;
+    while (off < body_len) {
+        ssize_t n = send(fd, body + off, body_len - off, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        off += n;
+    }
+    free(body);
+}
+
+// 관리 스레드 (요청이 드물어 한 번에 한 연결씩 처리한다)
+void* admin_thread_func(void* arg) {
+    int listen_fd = *(int*)arg;
+
+    while (1) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR) perror("admin accept failed");
+            continue;
+        }
+        admin_handle(fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+// 관리 소켓 시작
+void admin_start() {
+    static int listen_fd;
+    pthread_t thread;
+
+    listen_fd = admin_create_listener(admin_port);
+    pthread_create(&thread, NULL, admin_thread_func, &listen_fd);
+    pthread_detach(thread);
+    LOG_INFO("📈 관리 소켓: 127.0.0.1:%d (metrics, help)\n", admin_port);
+}
+
+// ========== 자체 시험 (--self-test) ==========
+
+// 시험용 임시 데이터 디렉터리 지우기 (안에는 파일만 있다)
+void scratch_dir_remove(const char* dir) {
+    char path[PATH_MAX];
+    DIR* d = opendir(dir);
+    if (d == NULL) return;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+void* self_test_snapshot_func(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot_write();
+    pthread_mutex_unlock(&snapshot_mutex);
+    return NULL;
+}
+
+// 원장 재실행 순서: 창구가 고객 lock을 쥐고 출금을 적는 사이 인기 통장 입금이 먼저 LSN을 받으면,
+// 그 입금은 다음 반영 때 더 큰 LSN의 출금 뒤에 원장에 적힌다. 스냅샷이 그 둘보다 앞의 LSN에서
+// 시작했으면 기동할 때 둘 다 다시 재실행되는데, 이미 원장에 있는 출금을 또 적으면 안 된다.
+// 자식 프로세스가 임시 디렉터리에서 이 상태를 만들고 스냅샷 뒤 그대로 끝나면(장애),
+// 이 프로세스가 같은 디렉터리로 기동(스냅샷 + 원장 + WAL 재실행)해 원장을 확인한다.
+void self_test_ledger() {
+    char dir[] = "/tmp/bank_selftest_XXXXXX";
+    const char* saved_dir = data_dir;
+    LedgerFile saved_ledger = ledger_file;
+    ClientInfo* merchant = client_at(0);
+    ClientInfo* payer = client_at(1);
+    int idx = merchant->account_count;      // 자식이 열 통장 (기동 직후라 양쪽이 같다)
+    int balance;
+
+    if (payer == NULL) {
+        fprintf(stderr, "❌ 고객이 두 명 이상 있어야 합니다 (--clients)\n");
+        exit(EXIT_FAILURE);
+    }
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp failed");
+        exit(EXIT_FAILURE);
+    }
+    data_dir = dir;
+    snapshot_interval = 0;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        wal_open();
+        if (bank_open_account(merchant, "HOT", &idx) != BANK_OK || hot_enable(merchant, idx) != BANK_OK ||
+            bank_deposit(payer, merchant, idx, 10, &balance) != BANK_OK) {
+            _exit(EXIT_FAILURE);
+        }
+
+        // 창구가 출금하려고 고객 lock을 잡는다 (쌓인 10원 입금은 여기서 반영된다)
+        client_lock(merchant);
+        unsigned long acquired = atomic_load(&metrics.lock_acquired);
+        pthread_t thread;
+        pthread_create(&thread, NULL, self_test_snapshot_func, NULL);
+        // 스냅샷이 시작 LSN을 읽고 첫 고객(merchant)의 lock을 기다릴 때까지
+        while (atomic_load(&metrics.lock_acquired) == acquired) {
+            sched_yield();
+        }
+
+        // 고객 lock 없이 누적기로 들어가는 입금이 먼저 LSN을 받는다
+        if (bank_deposit(payer, merchant, idx, 1, &balance) != BANK_OK) _exit(EXIT_FAILURE);
+
+        // 출금은 bank_withdraw()가 lock 안에서 하는 그대로 (더 큰 LSN, 원장에 바로 적힌다)
+        client_write_begin(merchant);
+        merchant->accounts[idx].balance -= 5;
+        client_write_end(merchant);
+        WalWithdraw rec = { merchant->client_no, idx, 5 };
+        merchant->last_lsn = wal_append(WAL_WITHDRAW, &rec, sizeof(rec));
+        pthread_mutex_unlock(&merchant->lock);
+
+        // 스냅샷이 1원 입금을 출금 뒤에 반영해 원장에 적고, WAL을 내려보낸 다음 저장한다
+        pthread_join(thread, NULL);
+        _exit(EXIT_SUCCESS);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "❌ 원장 시험 상태를 만들지 못했습니다\n");
+        exit(EXIT_FAILURE);
+    }
+
+    wal_open();
+    LedgerEntry entries[8];
+    int count = 0;
+    uint64_t total = 0;
+    ledger_read(merchant, idx, 0, 8, entries, &count, &total);
+
+    bool distinct = true;
+    printf("\n🧪 자체 시험: 인기 통장 원장 재실행 (스냅샷 뒤 재실행 %ld건)\n", startup_stats.wal_records);
+    for (int i = 0; i < count; i++) {
+        printf("   LSN %llu %+d원 (잔고 %d원)\n", (unsigned long long)entries[i].lsn,
+            entries[i].amount, entries[i].balance);
+        for (int k = 0; k < i; k++) {
+            if (entries[k].lsn == entries[i].lsn) distinct = false;
+        }
+    }
+
+    close(ledger_file.fd);
+    ledger_file = saved_ledger;
+    data_dir = saved_dir;
+    scratch_dir_remove(dir);
+
+    if (startup_stats.wal_records < 2) {
+        fprintf(stderr, "❌ 스냅샷이 두 거래 뒤에서 시작해 재실행할 것이 없습니다\n");
+        exit(EXIT_FAILURE);
+    }
+    if (count != 3 || !distinct) {
+        fprintf(stderr, "❌ 원장 항목 %d건 (3건이어야 한다): 이미 적힌 레코드를 재실행 때 또 적었습니다\n", count);
+        exit(EXIT_FAILURE);
+    }
+    printf("   ✅ 원장 3건, LSN 중복 없음\n");
+}
+
+// 자체 시험 실행
+void run_self_test(const char* name) {
+    if (strcmp(name, "ledger") == 0) {
+        self_test_ledger();
+    } else {
+        fprintf(stderr, "❌ 알 수 없는 자체 시험: %s (ledger)\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// ========== 벤치마크 (--bench) ==========
+
+// 잠금 벤치마크 스레드 인자
+typedef struct {
+    pthread_t thread;
+    unsigned int seed;
+    bool use_global_lock;       // true면 예전 db_mutex처럼 전역 lock을 추가로 잡는다
+    int hot_account;            // 0 이상이면 모든 입금을 pi200의 이 통장으로 (bench_hot)
+    volatile bool* stop;
+    long ops;
+} BenchLockArg;
+
+pthread_mutex_t bench_global_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// 임의의 두 고객 사이에 1원씩 입금을 반복
+void* bench_lock_thread(void* arg) {
+    BenchLockArg* a = (BenchLockArg*)arg;
+    long ops = 0;
+    int balance;
+
+    while (!*a->stop) {
+        ClientInfo* from = client_at(rand_r(&a->seed) % client_count());
+        ClientInfo* target = a->hot_account >= 0 ? client_at(0) : client_at(rand_r(&a->seed) % client_count());
+
+        if (a->use_global_lock) pthread_mutex_lock(&bench_global_mutex);
+        bank_deposit(from, target, a->hot_account >= 0 ? a->hot_account : 0, 1, &balance);
+        if (a->use_global_lock) pthread_mutex_unlock(&bench_global_mutex);
+        ops++;
+    }
+
+    a->ops = ops;
+    return NULL;
+}
+
+// threads개 스레드로 bench_seconds초 동안 입금하고 초당 처리량을 돌려준다
+double bench_lock_run(int threads, bool use_global_lock, int hot_account) {
+    volatile bool stop = false;
+    BenchLockArg* args = calloc(threads, sizeof(BenchLockArg));
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threads; i++) {
+        args[i].seed = 12345u + i * 7919u;
+        args[i].use_global_lock = use_global_lock;
+        args[i].hot_account = hot_account;
+        args[i].stop = &stop;
+        pthread_create(&args[i].thread, NULL, bench_lock_thread, &args[i]);
+    }
+
+    sleep(bench_seconds);
+    stop = true;
+
+    long total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(args[i].thread, NULL);
+        total += args[i].ops;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(args);
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return total / elapsed;
+}
+
+// 전역 lock(이전 방식)과 고객별 lock의 입금 처리량 비교
+void bench_locks() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (cpus > 2) ? (int)cpus * 2 : 4;
+    int idx;
+
+    for (int i = 0; i < client_count(); i++) {
+        bank_open_account(client_at(i), "BENCH", &idx);
+    }
+
+    printf("\n🏁 벤치마크: 전역 lock vs 고객별 lock (고객 %d명 사이 임의 입금, 구간당 %d초)\n",
+        client_count(), bench_seconds);
+    printf("%8s %18s %18s %8s\n", "스레드", "전역 lock(ops/s)", "고객별 lock(ops/s)", "배율");
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double global = bench_lock_run(threads, true, -1);
+        double per_client = bench_lock_run(threads, false, -1);
+        printf("%8d %18.0f %18.0f %7.2fx\n", threads, global, per_client, per_client / global);
+    }
+}
+
+// 한 통장에 몰리는 입금: 고객 lock(일반 통장)과 스레드별 누적기 조각(인기 통장)의 처리량 비교
+// pi200의 1번 통장은 일반, 2번 통장은 인기 통장으로 두고 모든 스레드가 같은 통장에 입금한다.
+// 입금마다 WAL 레코드를 추가하는 비용까지 재도록 임시 디렉터리에 WAL과 원장을 켠다 (--wal-sync 정책).
+void bench_hot() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (cpus > 2) ? (int)cpus * 2 : 4;
+    ClientInfo* merchant = client_at(0);
+    char dir[] = "/tmp/bank_bench_XXXXXX";
+    int idx;
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp failed");
+        exit(EXIT_FAILURE);
+    }
+    data_dir = dir;
+    snapshot_interval = 0;
+    wal_open();
+
+    bank_open_account(merchant, "NORMAL", &idx);
+    bank_open_account(merchant, "HOT", &idx);
+    hot_enable(merchant, idx);
+
+    const char* policy = (wal.policy == WAL_SYNC_FSYNC) ? "fsync" :
+                         (wal.policy == WAL_SYNC_INTERVAL) ? "interval" : "none";
+    printf("\n🏁 벤치마크: 한 통장에 몰린 입금 - 고객 lock vs 입금 누적기 (%s 1원씩, 구간당 %d초, CPU %ld개, WAL %s)\n",
+        merchant->client_id, bench_seconds, cpus, policy);
+    printf("%8s %18s %18s %8s\n", "스레드", "고객 lock(ops/s)", "누적기(ops/s)", "배율");
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double locked = bench_lock_run(threads, false, 0);
+        double hot = bench_lock_run(threads, false, idx);
+        printf("%8d %18.0f %18.0f %7.2fx\n", threads, locked, hot, hot / locked);
+    }
+
+    // 반영한 뒤 두 통장의 합이 입금 건수와 같아야 한다
+    client_lock(merchant);
+    long long sum = merchant->accounts[0].balance + (long long)merchant->accounts[idx].balance;
+    pthread_mutex_unlock(&merchant->lock);
+    unsigned long deposits = atomic_load(&metrics.op_status[METRIC_OP_DEPOSIT][BANK_OK]);
+    printf("   누적기 입금 %lu건, 반영 %lu번, 두 통장 잔고 합 %lld원 (입금 %lu건)\n",
+        atomic_load(&metrics.hot_deposits), atomic_load(&metrics.hot_folds), sum, deposits);
+    if (sum != (long long)deposits) {
+        fprintf(stderr, "❌ 잔고 합이 입금 건수와 다릅니다\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&wal.mutex);
+    uint64_t last = wal.next_lsn - 1;
+    long groups = wal.groups;
+    pthread_mutex_unlock(&wal.mutex);
+    wal_sync(last);
+    printf("   WAL 레코드 %llu건, 기록 묶음 %ld번\n", (unsigned long long)last, groups);
+    scratch_dir_remove(dir);
+}
+
+// 일 마감 벤치마크의 영업 스레드 인자
+typedef struct {
+    pthread_t thread;
+    unsigned int seed;
+    volatile bool* stop;
+    long ops;
+    long long net;              // 성공한 입금 - 출금
+} BenchEodArg;
+
+// 임의 고객의 1번 통장에 입금과 출금을 번갈아 (일 마감과 함께 도는 영업)
+void* bench_eod_live_thread(void* arg) {
+    BenchEodArg* a = (BenchEodArg*)arg;
+    int balance;
+
+    while (!*a->stop) {
+        ClientInfo* client = client_at(rand_r(&a->seed) % client_count());
+        int amount = 1 + rand_r(&a->seed) % 1000;
+        if (a->ops % 2 == 0) {
+            if (bank_deposit(client, client, 0, amount, &balance) == BANK_OK) a->net += amount;
+        } else {
+            if (bank_withdraw(client, 0, amount, &balance) == BANK_OK) a->net -= amount;
+        }
+        a->ops++;
+    }
+    return NULL;
+}
+
+// 모든 통장의 잔고 합 (고객 lock으로 반영된 값)
+long long bench_eod_total() {
+    long long total = 0;
+    for (int i = 0; i < client_count(); i++) {
+        ClientInfo* client = client_at(i);
+        client_lock(client);
+        for (int j = 0; j < client->account_count; j++) {
+            total += client->accounts[j].balance;
+        }
+        pthread_mutex_unlock(&client->lock);
+    }
+    return total;
+}
+
+// 일 마감 처리량: 고객마다 통장을 max_accounts개 채워 두고, 영업 스레드 2개가 입출금하는 동안
+// 배치 스레드 수를 바꿔 가며 한 회차씩 돌린다. 회차마다 잔고 합 = 이전 합 + 영업 증감 + 이자 - 수수료.
+void bench_eod() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (cpus > 2) ? (int)cpus * 2 : 4;
+    int idx;
+
+    for (int i = 0; i < client_count(); i++) {
+        ClientInfo* client = client_at(i);
+        for (int j = 0; j < max_accounts; j++) {
+            bank_open_account(client, "BENCH", &idx);
+            client->accounts[idx].balance = (int)(((unsigned)i * 7919u + (unsigned)j * 104729u) % 300000u);
+        }
+    }
+    if (eod.fee == 0) eod.fee = 500;    // 수수료 규칙도 함께 잰다
+    long long before = bench_eod_total();
+    long accounts = (long)client_count() * max_accounts;
+
+    printf("\n🏁 벤치마크: 일 마감 (고객 %d명, 통장 %ld개, 이자 %d ppm, 수수료 %d원: 잔고 %d원 미만, 영업 스레드 2개)\n",
+        client_count(), accounts, eod.interest_ppm, eod.fee, eod.fee_waive);
+    printf("%8s %10s %10s %10s %10s %10s %14s %12s\n", "스레드", "복사(ms)", "계산(ms)", "확정(ms)",
+        "반영(ms)", "전체(ms)", "통장/s", "영업(ops/s)");
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        volatile bool stop = false;
+        BenchEodArg live[2];
+        memset(live, 0, sizeof(live));
+        for (int i = 0; i < 2; i++) {
+            live[i].seed = 4242u + i * 7919u + threads;
+            live[i].stop = &stop;
+            pthread_create(&live[i].thread, NULL, bench_eod_live_thread, &live[i]);
+        }
+
+        eod.threads = threads;
+        uint64_t start = now_ns();
+        eod_run();
+        double ms = (now_ns() - start) / 1e6;
+
+        stop = true;
+        long ops = 0;
+        long long net = 0;
+        for (int i = 0; i < 2; i++) {
+            pthread_join(live[i].thread, NULL);
+            ops += live[i].ops;
+            net += live[i].net;
+        }
+
+        printf("%8d %10.1f %10.1f %10.1f %10.1f %10.1f %14.0f %12.0f\n", threads,
+            eod.phase_ms[EOD_CUT], eod.phase_ms[EOD_COMPUTE], eod.phase_ms[EOD_COMMIT],
+            eod.phase_ms[EOD_APPLY], ms, accounts / (ms / 1000.0), ops / (ms / 1000.0));
+
+        long long after = bench_eod_total();
+        long long expected = before + net + atomic_load(&eod.interest) - atomic_load(&eod.fees);
+        if (after != expected) {
+            fprintf(stderr, "❌ 잔고 합이 맞지 않습니다: %lld (예상 %lld)\n", after, expected);
+            exit(EXIT_FAILURE);
+        }
+        before = after;
+    }
+    printf("   %u회차, 마지막 회차 이자 %lld원, 수수료 %lld원, 잔고가 바뀐 통장 %lu개\n",
+        atomic_load(&eod.epoch), atomic_load(&eod.interest), atomic_load(&eod.fees),
+        atomic_load(&eod.accounts));
+}
+
+// 이전 방식: 의도마다 strstr로 입력을 다시 훑는다 (비교용)
+int bench_menu_choice_strstr(const char* message) {
+    if (strstr(message, "내역") != NULL || strstr(message, "명세") != NULL) return 6;
+    if (strstr(message, "통장") != NULL && strstr(message, "개설") != NULL) return 1;
+    if (strstr(message, "입금") != NULL) return 2;
+    if (strstr(message, "출금") != NULL) return 3;
+    if (strstr(message, "이체") != NULL || strstr(message, "송금") != NULL) return 5;
+    if (strstr(message, "조회") != NULL || strstr(message, "잔액") != NULL) return 4;
+    return 0;
+}
+
+bool bench_ask_more_strstr(const char* input) {
+    return strstr(input, "아니") != NULL || strstr(input, "없") != NULL ||
+           strstr(input, "종료") != NULL || strstr(input, "끝") != NULL ||
+           strstr(input, "no") != NULL || strstr(input, "No") != NULL ||
+           strstr(input, "NO") != NULL;
+}
+
+// 대화에서 나올 법한 입력 한 벌을 strstr 방식과 분류기로 각각 bench_seconds초 동안 분류
+void bench_classify() {
+    const char* inputs[] = {
+        "통장 개설", "입금", "출금하고 싶어요", "잔액 조회 부탁드립니다", "이체",
+        "친구에게 송금하려고 하는데요", "예", "네 있어요", "아니요", "없습니다",
+        "음... 지난달에 만든 통장으로 월급이 들어왔는지 확인하고 싶은데 어떻게 하면 되나요",
+        "yes", "No thanks", "입금 내역 보여주세요",
+    };
+    int count = sizeof(inputs) / sizeof(inputs[0]);
+    volatile long sink = 0;
+    double ns[2];
+
+    // 두 방식의 결과가 같아야 비교가 의미 있다
+    int menu_of[INTENT_COUNT] = { 0, 6, 1, 2, 3, 5, 4, 0 };
+    for (int i = 0; i < count; i++) {
+        if (bench_menu_choice_strstr(inputs[i]) !=
+                menu_of[classify_input(inputs[i], INTENT_STATEMENT, INTENT_BALANCE)] ||
+            bench_ask_more_strstr(inputs[i]) !=
+                (classify_input(inputs[i], INTENT_NO, INTENT_NO) == INTENT_NO)) {
+            fprintf(stderr, "❌ 분류 결과가 다릅니다: %s\n", inputs[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("\n🏁 벤치마크: strstr 반복 vs 키워드 분류기 (입력 %d종, 메뉴 + 추가 업무 판단, 구간당 %d초)\n",
+        count, bench_seconds);
+    for (int method = 0; method < 2; method++) {
+        uint64_t start = now_ns(), deadline = start + (uint64_t)bench_seconds * 1000000000ull;
+        uint64_t end;
+        long ops = 0;
+        do {
+            for (int r = 0; r < 1000; r++) {
+                const char* input = inputs[ops++ % count];
+                if (method == 0) {
+                    sink += bench_menu_choice_strstr(input) + bench_ask_more_strstr(input);
+                } else {
+                    uint64_t seen = classifier_scan(input);     // 두 문맥을 한 번 훑은 결과로 판단
+                    sink += classifier_resolve(seen, INTENT_STATEMENT, INTENT_BALANCE) +
+                            classifier_resolve(seen, INTENT_NO, INTENT_NO);
+                }
+            }
+            end = now_ns();
+        } while (end < deadline);
+        ns[method] = (double)(end - start) / ops;
+    }
+    printf("%-14s %10.1f ns/입력\n", "strstr 반복", ns[0]);
+    printf("%-14s %10.1f ns/입력 (%.2fx, 상태 %d개)\n", "키워드 분류기", ns[1],
+        ns[0] / ns[1], classifier.state_count);
+}
+
+// 벤치마크 실행
+void run_benchmark(const char* name) {
+    if (strcmp(name, "locks") == 0) {
+        bench_locks();
+    } else if (strcmp(name, "classify") == 0) {
+        bench_classify();
+    } else if (strcmp(name, "hot") == 0) {
+        bench_hot();
+    } else if (strcmp(name, "eod") == 0) {
+        bench_eod();
+    } else {
+        fprintf(stderr, "❌ 알 수 없는 벤치마크: %s (locks, classify, hot, eod)\n", name);
+        exit(EXIT_FAILURE);
+    }
 }